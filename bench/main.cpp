@@ -0,0 +1,522 @@
+#include "vulkan/VkRenderer.h"
+#include "scene/Scene.h"
+#include "io/Json.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+// Renders a fixed set of scenes headlessly and reports their performance as JSON.
+// With --baseline, the report is compared against a previous one and the process fails
+// when a scene got slower than the threshold allows.
+
+namespace {
+
+    struct BenchSettings {
+        uint32_t m_width = 1280;
+        uint32_t m_height = 720;
+        // Of one trace pass, as in RenderConfig. Reports are only comparable for the same values.
+        int m_passSamples = 10;
+        int m_bounces = 8;
+        // BVH refits and texture decoding threads, all the cores when 0
+        unsigned int m_threads = 0;
+        int m_warmupFrames = 5;
+        int m_frames = 60;
+        bool m_denoise = false;
+        std::string m_output = "bench_results.json";
+        std::string m_baseline;
+        // When set, every measured frame is captured there, to measure what the captures cost the render loop
+        std::string m_captureDirectory;
+        // Independent frames read back to estimate the noise of the trace pass, none when 0
+        int m_noiseFrames = 0;
+        // Pixels the noise is measured over as x, y, width, height, the whole image when the width is 0
+        std::array<uint32_t, 4> m_noiseRegion = { 0, 0, 0, 0 };
+        // Relative slowdown tolerated before a scene counts as a regression
+        double m_threshold = 0.05;
+        std::vector<std::string> m_scenes;
+    };
+
+    struct BenchScene {
+        std::string m_name;
+        std::function<Scene()> m_build;
+        // The textures are streamed within this many bytes when not 0
+        VkDeviceSize m_textureBudget = 0;
+        // Called before each frame, warmup included, to move the scene through the renderer
+        std::function<void(VkRenderer&, int)> m_animate;
+        // Loaded with loadScene after an empty initialization, the frames until it is resident are measured apart
+        bool m_streamed = false;
+    };
+
+    constexpr unsigned int g_movingSphereCount = 1000;
+
+    // Moves every sphere of movingSpheres, at a fixed step so the refits do not depend on the frame rate
+    void animateMovingSpheres(VkRenderer& renderer, int frame) {
+        float time = static_cast<float>(frame) / 30.0f;
+        size_t first = renderer.getSpheres().size() - g_movingSphereCount;
+        for (unsigned int i = 0; i < g_movingSphereCount; ++i) {
+            Sphere sphere = renderer.getSpheres()[first + i];
+            sphere.m_center = Scene::getMovingSpherePosition(g_movingSphereCount, i, time);
+            renderer.updateSphere(static_cast<uint32_t>(first + i), sphere);
+        }
+    }
+
+    // The canonical scenes, their size is fixed so reports stay comparable
+    const std::vector<BenchScene> g_benchScenes = {
+        { "cornell_box", [] { return Scene::cornellBox(); } },
+        { "high_triangle_mesh", [] { return Scene::highTriangleMesh(48, 64); } },
+        { "many_lights", [] { return Scene::manyLights(64); } },
+        { "instanced", [] { return Scene::instanced(5, 12, 16); } },
+        { "dielectrics", [] { return Scene::dielectrics(); } },
+        { "textured", [] { return Scene::textured(); } },
+        { "texture_streaming", [] { return Scene::textureStreaming(4, 1024); }, 4 * 1024 * 1024 },
+        { "moving_spheres", [] { return Scene::movingSpheres(g_movingSphereCount); }, 0, animateMovingSpheres },
+        { "instanced_streamed", [] { return Scene::instanced(5, 12, 16); }, 0, nullptr, true }
+    };
+
+    // Metrics compared against the baseline, and whether a higher value is better
+    const std::vector<std::pair<std::string, bool>> g_comparedMetrics = {
+        { "ms_per_frame", false },
+        { "gpu_ms_per_frame", false },
+        { "mrays_per_s", true },
+        { "spp_for_1pct_noise", false }
+    };
+
+    // Relative noise the sample counts are estimated for
+    constexpr double g_targetNoise = 0.01;
+
+    // Peak resident memory of the whole process so far, in MB
+    double peakHostMemory() {
+#if defined(__linux__)
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return static_cast<double>(usage.ru_maxrss) / 1024.0;
+#elif defined(__APPLE__)
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return static_cast<double>(usage.ru_maxrss) / (1024.0 * 1024.0);
+#else
+        return 0.0;
+#endif
+    }
+
+    void printUsage() {
+        std::cout << "Usage: raytracer_bench [options]\n"
+                  << "  --width <pixels>        render width (default 1280)\n"
+                  << "  --height <pixels>       render height (default 720)\n"
+                  << "  --pass-samples <count>  samples per pixel traced by one frame (default 10)\n"
+                  << "  --bounces <count>       bounces per path (default 8)\n"
+                  << "  --threads <count>       threads of the BVH refits and texture decoding (default all cores)\n"
+                  << "  --frames <count>        measured frames per scene (default 60)\n"
+                  << "  --warmup <count>        frames rendered before measuring (default 5)\n"
+                  << "  --scene <name>          only run this scene, can be repeated\n"
+                  << "  --denoise               include the denoiser in the measured frames\n"
+                  << "  --output <file>         JSON report (default bench_results.json)\n"
+                  << "  --baseline <file>       previous report to compare against\n"
+                  << "  --threshold <fraction>  tolerated slowdown, 0.05 is 5% (default 0.05)\n"
+                  << "  --capture <directory>   capture every measured frame as PNG, dropped when the slots are busy\n"
+                  << "  --noise <frames>        read back that many frames without the denoiser to estimate the samples\n"
+                  << "                          per pixel needed for 1% noise\n"
+                  << "  --noise-region <x,y,w,h>  pixels the noise is measured over (default the whole image)\n";
+    }
+
+    BenchSettings parseArguments(int argc, char** argv) {
+        BenchSettings settings;
+
+        auto nextValue = [&](int& i) -> std::string {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(std::string("Missing value for ") + argv[i]);
+            }
+            return argv[++i];
+        };
+
+        for (int i = 1; i < argc; ++i) {
+            std::string argument = argv[i];
+            if (argument == "--width") {
+                settings.m_width = static_cast<uint32_t>(std::stoul(nextValue(i)));
+            }
+            else if (argument == "--height") {
+                settings.m_height = static_cast<uint32_t>(std::stoul(nextValue(i)));
+            }
+            else if (argument == "--pass-samples") {
+                settings.m_passSamples = std::stoi(nextValue(i));
+            }
+            else if (argument == "--bounces") {
+                settings.m_bounces = std::stoi(nextValue(i));
+            }
+            else if (argument == "--threads") {
+                settings.m_threads = static_cast<unsigned int>(std::stoul(nextValue(i)));
+            }
+            else if (argument == "--frames") {
+                settings.m_frames = std::stoi(nextValue(i));
+            }
+            else if (argument == "--warmup") {
+                settings.m_warmupFrames = std::stoi(nextValue(i));
+            }
+            else if (argument == "--scene") {
+                settings.m_scenes.push_back(nextValue(i));
+            }
+            else if (argument == "--denoise") {
+                settings.m_denoise = true;
+            }
+            else if (argument == "--output") {
+                settings.m_output = nextValue(i);
+            }
+            else if (argument == "--baseline") {
+                settings.m_baseline = nextValue(i);
+            }
+            else if (argument == "--threshold") {
+                settings.m_threshold = std::stod(nextValue(i));
+            }
+            else if (argument == "--capture") {
+                settings.m_captureDirectory = nextValue(i);
+            }
+            else if (argument == "--noise") {
+                settings.m_noiseFrames = std::stoi(nextValue(i));
+            }
+            else if (argument == "--noise-region") {
+                std::string value = nextValue(i);
+                if (std::sscanf(value.c_str(), "%u,%u,%u,%u", &settings.m_noiseRegion[0], &settings.m_noiseRegion[1],
+                    &settings.m_noiseRegion[2], &settings.m_noiseRegion[3]) != 4) {
+                    throw std::runtime_error("--noise-region expects x,y,width,height");
+                }
+            }
+            else if (argument == "--help" || argument == "-h") {
+                printUsage();
+                std::exit(EXIT_SUCCESS);
+            }
+            else {
+                throw std::runtime_error("Unknown argument " + argument);
+            }
+        }
+
+        if (settings.m_width == 0 || settings.m_height == 0 || settings.m_frames <= 0 || settings.m_warmupFrames < 0) {
+            throw std::runtime_error("The resolution and the frame count must be positive");
+        }
+        if (settings.m_passSamples <= 0 || settings.m_passSamples > VkRenderer::m_MAX_TRACE_SAMPLES ||
+            settings.m_bounces <= 0 || settings.m_bounces > VkRenderer::m_MAX_TRACE_BOUNCES) {
+            throw std::runtime_error("The samples must be between 1 and " + std::to_string(VkRenderer::m_MAX_TRACE_SAMPLES) +
+                ", the bounces between 1 and " + std::to_string(VkRenderer::m_MAX_TRACE_BOUNCES));
+        }
+        if (settings.m_noiseFrames == 1 || settings.m_noiseFrames < 0) {
+            throw std::runtime_error("The noise needs at least 2 frames");
+        }
+        const std::array<uint32_t, 4>& region = settings.m_noiseRegion;
+        if (region[2] > 0 && (region[3] == 0 || region[0] + region[2] > settings.m_width || region[1] + region[3] > settings.m_height)) {
+            throw std::runtime_error("The noise region must be inside the image");
+        }
+
+        for (const std::string& name : settings.m_scenes) {
+            bool known = std::any_of(g_benchScenes.begin(), g_benchScenes.end(), [&](const BenchScene& scene) { return scene.m_name == name; });
+            if (!known) {
+                throw std::runtime_error("Unknown scene " + name);
+            }
+        }
+
+        return settings;
+    }
+
+    // Each frame of the trace pass is an independent estimate of the image with its own random sequences. The
+    // variance of the luminance of each pixel across frames gives the samples per pixel needed to bring its
+    // standard deviation down to the target fraction of its mean. Returns the median over the lit pixels.
+    double measureNoise(VkRenderer& renderer, const BenchSettings& settings) {
+        VkRect2D area{ { 0, 0 }, { settings.m_width, settings.m_height } };
+        if (settings.m_noiseRegion[2] > 0) {
+            area = { { static_cast<int32_t>(settings.m_noiseRegion[0]), static_cast<int32_t>(settings.m_noiseRegion[1]) },
+                     { settings.m_noiseRegion[2], settings.m_noiseRegion[3] } };
+        }
+
+        size_t pixelCount = static_cast<size_t>(area.extent.width) * area.extent.height;
+        std::vector<double> mean(pixelCount, 0.0);
+        std::vector<double> squaredDeviation(pixelCount, 0.0);
+        int frames = 0;
+
+        // The denoiser would blend the frames together
+        renderer.setDenoiseEnabled(false);
+        for (int i = 0; i < settings.m_noiseFrames; ++i) {
+            renderer.requestCapture(area, [&](const float* pixels, uint32_t, uint32_t) {
+                ++frames;
+                for (size_t p = 0; p < pixelCount; ++p) {
+                    const float* pixel = pixels + p * 4;
+                    double luminance = 0.2126 * pixel[0] + 0.7152 * pixel[1] + 0.0722 * pixel[2];
+                    double delta = luminance - mean[p];
+                    mean[p] += delta / frames;
+                    squaredDeviation[p] += delta * (luminance - mean[p]);
+                }
+            }, true);
+            renderer.renderHeadlessFrame();
+        }
+        renderer.finishCaptures();
+        renderer.setDenoiseEnabled(settings.m_denoise);
+
+        std::vector<double> samplesNeeded;
+        for (size_t p = 0; p < pixelCount; ++p) {
+            if (mean[p] > 1e-3 && frames > 1) {
+                double relativeVariance = squaredDeviation[p] / (frames - 1) / (mean[p] * mean[p]);
+                samplesNeeded.push_back(renderer.getSamplesPerFrame() * relativeVariance / (g_targetNoise * g_targetNoise));
+            }
+        }
+        if (samplesNeeded.empty()) {
+            return 0.0;
+        }
+        std::nth_element(samplesNeeded.begin(), samplesNeeded.begin() + samplesNeeded.size() / 2, samplesNeeded.end());
+        return samplesNeeded[samplesNeeded.size() / 2];
+    }
+
+    JsonValue runScene(const BenchScene& benchScene, const BenchSettings& settings, std::string& deviceName) {
+        auto buildStart = std::chrono::high_resolution_clock::now();
+        Scene scene = benchScene.m_build();
+        auto buildEnd = std::chrono::high_resolution_clock::now();
+        float buildTime = std::chrono::duration<float, std::milli>(buildEnd - buildStart).count();
+
+        VkRenderer renderer;
+        renderer.setTextureStreaming(benchScene.m_textureBudget > 0, benchScene.m_textureBudget);
+        renderer.setWorkerCount(settings.m_threads);
+        renderer.setTraceSettings(settings.m_passSamples, settings.m_bounces);
+        renderer.initHeadless(settings.m_width, settings.m_height, benchScene.m_streamed ? Scene{} : scene);
+        renderer.setDenoiseEnabled(settings.m_denoise);
+        deviceName = renderer.getDeviceName();
+
+        int frame = 0;
+        auto renderFrame = [&]() {
+            if (benchScene.m_animate) {
+                benchScene.m_animate(renderer, frame);
+            }
+            ++frame;
+            return renderer.renderHeadlessFrame();
+        };
+
+        // Until the last triangle is resident, before the warmup
+        if (benchScene.m_streamed) {
+            renderer.loadScene([&scene] { return scene; });
+            while (renderer.isSceneLoading()) {
+                renderFrame();
+            }
+        }
+
+        for (int i = 0; i < settings.m_warmupFrames; ++i) {
+            renderFrame();
+        }
+
+        std::vector<float> frameTimes;
+        std::vector<float> traceTimes;
+        std::vector<float> gpuTimes;
+        bool capture = !settings.m_captureDirectory.empty();
+        if (capture) {
+            std::filesystem::create_directories(settings.m_captureDirectory);
+        }
+
+        for (int i = 0; i < settings.m_frames; ++i) {
+            if (capture) {
+                char fileName[128];
+                std::snprintf(fileName, sizeof(fileName), "%s_%05d.png", benchScene.m_name.c_str(), i);
+                renderer.requestCapture((std::filesystem::path(settings.m_captureDirectory) / fileName).string(), ImageWriter::Format::Png, false);
+            }
+            frameTimes.push_back(renderFrame());
+            traceTimes.push_back(renderer.getTraceGpuTime());
+            gpuTimes.push_back(renderer.getTraceGpuTime() + (settings.m_denoise ? renderer.getDenoiseGpuTime() : 0.0f));
+        }
+
+        bool gpuTimings = renderer.isProfilerAvailable();
+        double frameTime = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0) / frameTimes.size();
+        double gpuTime = std::accumulate(gpuTimes.begin(), gpuTimes.end(), 0.0) / gpuTimes.size();
+        // Without timestamps the throughput falls back to the wall clock time of the frames
+        double traceTime = gpuTimings ? std::accumulate(traceTimes.begin(), traceTimes.end(), 0.0) / traceTimes.size() : frameTime;
+        std::sort(frameTimes.begin(), frameTimes.end());
+
+        // Camera rays only, the secondary rays of each bounce are not counted
+        double raysPerFrame = static_cast<double>(settings.m_width) * settings.m_height * renderer.getSamplesPerFrame();
+        double mraysPerSecond = traceTime > 0.0 ? raysPerFrame / (traceTime * 1000.0) : 0.0;
+
+        const VkRenderer::InitTimings& timings = renderer.getInitTimings();
+
+        JsonValue result = JsonValue::object();
+        result.set("name", benchScene.m_name);
+        result.set("triangles", static_cast<uint64_t>(scene.m_triangles.size()));
+        result.set("spheres", static_cast<uint64_t>(scene.m_spheres.size()));
+        result.set("lights", static_cast<uint64_t>(scene.m_lights.size()));
+        result.set("textures", static_cast<uint64_t>(renderer.getTextureCount()));
+        result.set("scene_build_ms", static_cast<double>(buildTime));
+        result.set("device_init_ms", static_cast<double>(timings.m_deviceTime));
+        result.set("pipeline_build_ms", static_cast<double>(timings.m_pipelineTime));
+        result.set("scene_upload_ms", static_cast<double>(timings.m_sceneUploadTime));
+        result.set("ms_per_frame", frameTime);
+        result.set("ms_per_frame_median", static_cast<double>(frameTimes[frameTimes.size() / 2]));
+        result.set("ms_per_frame_max", static_cast<double>(frameTimes.back()));
+        result.set("gpu_ms_per_frame", gpuTimings ? JsonValue(gpuTime) : JsonValue());
+        result.set("mrays_per_s", mraysPerSecond);
+        result.set("peak_device_memory_mb", static_cast<double>(renderer.getPeakDeviceMemory()) / (1024.0 * 1024.0));
+        result.set("peak_host_memory_mb", peakHostMemory());
+        if (renderer.getTextureCount() > 0) {
+            const TextureManager::Statistics& textureStatistics = renderer.getTextureStatistics();
+            result.set("texture_memory_mb", static_cast<double>(renderer.getTextureMemory()) / (1024.0 * 1024.0));
+            if (renderer.isTextureStreaming()) {
+                // Resident once the frames settled, against the whole mip chains
+                const TextureManager::StreamingStatistics& streamingStatistics = renderer.getTextureStreamingStatistics();
+                result.set("texture_budget_mb", static_cast<double>(benchScene.m_textureBudget) / (1024.0 * 1024.0));
+                result.set("texture_full_mb", static_cast<double>(streamingStatistics.m_fullMemory) / (1024.0 * 1024.0));
+                result.set("texture_cache_build_ms", streamingStatistics.m_cacheBuildTime);
+                result.set("texture_streamed_mb", static_cast<double>(streamingStatistics.m_uploadedBytes) / (1024.0 * 1024.0));
+                result.set("texture_loads", streamingStatistics.m_loads);
+                result.set("texture_evictions", streamingStatistics.m_evictions);
+            }
+            else {
+                result.set("texture_decode_ms", textureStatistics.m_decodeTime);
+                result.set("texture_upload_ms", textureStatistics.m_uploadTime);
+            }
+        }
+        const VkRenderer::SceneUpdateStatistics& updateStatistics = renderer.getSceneUpdateStatistics();
+        if (updateStatistics.m_updates > 0) {
+            // Averaged over the updates, the frames of the warmup included
+            double updates = static_cast<double>(updateStatistics.m_updates);
+            result.set("scene_update_ms", updateStatistics.m_totalTime / updates);
+            result.set("scene_update_kb", static_cast<double>(updateStatistics.m_uploadedBytes) / 1024.0 / updates);
+            result.set("bvh_refit_nodes", static_cast<double>(updateStatistics.m_refittedNodes) / updates);
+            result.set("bvh_rebuilds", updateStatistics.m_rebuilds);
+            result.set("bvh_sah_cost_ratio", static_cast<double>(updateStatistics.m_costRatio));
+        }
+        if (benchScene.m_streamed) {
+            // The frames while streaming against the measured ones show the hitch of the uploads
+            const VkRenderer::SceneLoadStatistics& loadStatistics = renderer.getSceneLoadStatistics();
+            const VkRenderer::FrameTimeStatistics& streamingFrames = loadStatistics.m_streamingFrames;
+            result.set("stream_first_frame_ms", loadStatistics.m_firstFrameTime);
+            result.set("stream_resident_ms", loadStatistics.m_residentTime);
+            result.set("stream_upload_mb", static_cast<double>(loadStatistics.m_uploadedBytes) / (1024.0 * 1024.0));
+            result.set("stream_upload_gb_per_s", loadStatistics.m_uploadTime > 0.0 ? loadStatistics.m_uploadedBytes / (loadStatistics.m_uploadTime * 1e6) : 0.0);
+            result.set("stream_frames", streamingFrames.m_frames);
+            result.set("stream_ms_per_frame", streamingFrames.m_frames > 0 ? streamingFrames.m_totalTime / streamingFrames.m_frames : 0.0);
+            result.set("stream_ms_per_frame_max", streamingFrames.m_maxTime);
+        }
+        if (capture) {
+            renderer.finishCaptures();
+            VkRenderer::CaptureStatistics captureStatistics = renderer.getCaptureStatistics();
+            result.set("captures_written", captureStatistics.m_encoder.m_frames);
+            result.set("captures_dropped", captureStatistics.m_dropped);
+            result.set("capture_encode_ms", captureStatistics.m_encoder.m_frames > 0 ? captureStatistics.m_encoder.m_encodeTime / captureStatistics.m_encoder.m_frames : 0.0);
+        }
+#ifdef RAYTRACER_RAY_STATS
+        // Counted by the instrumented trace pass over the last measured frame
+        const VkRenderer::RayStatistics& rayStats = renderer.getRayStatistics();
+        result.set("primary_rays_per_frame", rayStats.m_primaryRays);
+        result.set("bounce_rays_per_frame", rayStats.m_bounceRays);
+        result.set("shadow_rays_per_frame", rayStats.m_shadowRays);
+        result.set("triangle_tests_per_frame", rayStats.m_triangleTests);
+        result.set("sphere_tests_per_frame", rayStats.m_sphereTests);
+        result.set("node_visits_per_frame", rayStats.m_nodeVisits);
+#endif
+        if (settings.m_noiseFrames > 0) {
+            result.set("spp_for_1pct_noise", measureNoise(renderer, settings));
+        }
+
+        renderer.cleanupVulkan();
+
+        std::cout << benchScene.m_name << ": " << frameTime << " ms/frame, " << mraysPerSecond << " Mrays/s" << std::endl;
+
+        return result;
+    }
+
+    // Returns false if a scene regressed by more than the threshold
+    bool compareWithBaseline(const JsonValue& report, const JsonValue& baseline, double threshold) {
+        if (report["width"].asNumber() != baseline.getNumber("width", 0.0) ||
+            report["height"].asNumber() != baseline.getNumber("height", 0.0) ||
+            report["samples_per_pixel"].asNumber() != baseline.getNumber("samples_per_pixel", 0.0) ||
+            report["bounces"].asNumber() != baseline.getNumber("bounces", 8.0)) {
+            std::cerr << "Warning: the baseline was recorded with another resolution, sample count or bounce count" << std::endl;
+        }
+        if (report["spectral"].asBool() != baseline.getBool("spectral", false)) {
+            std::cerr << "Warning: the baseline was recorded with the other of the RGB and spectral modes" << std::endl;
+        }
+
+        bool passed = true;
+        const JsonValue& scenes = report["scenes"];
+        const JsonValue& baselineScenes = baseline["scenes"];
+
+        for (size_t i = 0; i < scenes.size(); ++i) {
+            const JsonValue& scene = scenes[i];
+            const std::string& name = scene["name"].asString();
+
+            const JsonValue* baselineScene = nullptr;
+            for (size_t j = 0; j < baselineScenes.size(); ++j) {
+                if (baselineScenes[j].getString("name", "") == name) {
+                    baselineScene = &baselineScenes[j];
+                }
+            }
+            if (baselineScene == nullptr) {
+                std::cout << name << ": not in the baseline" << std::endl;
+                continue;
+            }
+
+            for (const auto& [metric, higherIsBetter] : g_comparedMetrics) {
+                const JsonValue* current = scene.find(metric);
+                const JsonValue* previous = baselineScene->find(metric);
+                if (current == nullptr || previous == nullptr || !current->isNumber() || !previous->isNumber() || previous->asNumber() <= 0.0) {
+                    continue;
+                }
+
+                double change = current->asNumber() / previous->asNumber() - 1.0;
+                double slowdown = higherIsBetter ? -change : change;
+                bool regressed = slowdown > threshold;
+                passed = passed && !regressed;
+
+                std::cout << name << " " << metric << ": " << previous->asNumber() << " -> " << current->asNumber()
+                          << " (" << (change >= 0.0 ? "+" : "") << change * 100.0 << "%)" << (regressed ? " REGRESSION" : "") << std::endl;
+            }
+        }
+
+        return passed;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    try {
+        BenchSettings settings = parseArguments(argc, argv);
+
+        JsonValue scenes = JsonValue::array();
+        std::string deviceName;
+        for (const BenchScene& benchScene : g_benchScenes) {
+            if (!settings.m_scenes.empty() && std::find(settings.m_scenes.begin(), settings.m_scenes.end(), benchScene.m_name) == settings.m_scenes.end()) {
+                continue;
+            }
+            scenes.push(runScene(benchScene, settings, deviceName));
+        }
+
+        JsonValue report = JsonValue::object();
+        report.set("device", deviceName);
+        report.set("width", settings.m_width);
+        report.set("height", settings.m_height);
+        report.set("samples_per_pixel", settings.m_passSamples);
+        report.set("bounces", settings.m_bounces);
+        report.set("spectral", VkRenderer::isSpectral());
+        report.set("warmup_frames", settings.m_warmupFrames);
+        report.set("frames", settings.m_frames);
+        report.set("denoise", settings.m_denoise);
+        report.set("scenes", scenes);
+        report.writeFile(settings.m_output);
+        std::cout << "Report written to " << settings.m_output << std::endl;
+
+        if (!settings.m_baseline.empty()) {
+            JsonValue baseline = JsonValue::parseFile(settings.m_baseline);
+            if (!compareWithBaseline(report, baseline, settings.m_threshold)) {
+                std::cerr << "Performance regressed by more than " << settings.m_threshold * 100.0 << "% against " << settings.m_baseline << std::endl;
+                return 2;
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
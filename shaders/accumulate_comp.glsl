@@ -0,0 +1,33 @@
+#version 450
+
+// Progressive accumulation of the tiled render mode.
+// Blends the radiance traced for one tile into the running mean of the previous passes over it.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0, rgba32f) uniform readonly image2D traceColor;
+layout(set = 0, binding = 10, rgba32f) uniform image2D accumulation;
+
+layout(push_constant) uniform AccumulatePushConstants {
+    ivec2 tileOffset;
+    ivec2 tileSize;
+    // Number of passes already accumulated in this tile
+    int passIndex;
+} pushConstants;
+
+void main() {
+    ivec2 local = ivec2(gl_GlobalInvocationID.xy);
+    if (local.x >= pushConstants.tileSize.x || local.y >= pushConstants.tileSize.y) {
+        return;
+    }
+
+    ivec2 pixel = pushConstants.tileOffset + local;
+    vec3 color = imageLoad(traceColor, pixel).rgb;
+
+    if (pushConstants.passIndex > 0) {
+        vec3 accumulated = imageLoad(accumulation, pixel).rgb;
+        color = mix(accumulated, color, 1.0 / float(pushConstants.passIndex + 1));
+    }
+
+    imageStore(accumulation, pixel, vec4(color, 1.0));
+}
@@ -0,0 +1,94 @@
+#version 450
+
+// One iteration of the edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) with the
+// luminance variance guided weights of SVGF. Iterations are chained with a growing step size,
+// the last one modulates the albedo back into the filtered irradiance.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 1, rgba16f) uniform readonly image2D traceAlbedo;
+layout(set = 0, binding = 2, rgba32f) uniform readonly image2D traceNormalDepth;
+layout(set = 0, binding = 6, rgba32f) uniform readonly image2D inputColor;
+layout(set = 0, binding = 7, rgba32f) uniform writeonly image2D outputColor;
+
+layout(push_constant) uniform DenoisePushConstants {
+    int stepSize;
+    int finalPass;
+    int temporalEnabled;
+    int resetHistory;
+    int clampHistory;
+    float sigmaLuminance;
+    float sigmaNormal;
+    float sigmaDepth;
+    float temporalAlpha;
+    float momentsAlpha;
+    // The targets are allocated at the swapchain size, only this corner of them is rendered
+    ivec2 renderSize;
+    ivec2 previousRenderSize;
+} pushConstants;
+
+const float KERNEL[3] = float[3](3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0);
+
+float luminance(vec3 color) {
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = pushConstants.renderSize;
+    if (pixel.x >= size.x || pixel.y >= size.y) {
+        return;
+    }
+
+    vec4 center = imageLoad(inputColor, pixel);
+    vec4 centerNormalDepth = imageLoad(traceNormalDepth, pixel);
+    float centerLum = luminance(center.rgb);
+
+    // Pixels without geometry have nothing to filter
+    if (dot(centerNormalDepth.xyz, centerNormalDepth.xyz) < 0.5) {
+        vec3 background = center.rgb;
+        if (pushConstants.finalPass != 0) {
+            background *= max(imageLoad(traceAlbedo, pixel).rgb, vec3(1e-3));
+        }
+        imageStore(outputColor, pixel, vec4(background, center.a));
+        return;
+    }
+
+    float luminanceScale = pushConstants.sigmaLuminance * sqrt(max(center.a, 0.0)) + 1e-4;
+
+    vec3 colorSum = vec3(0.0);
+    float varianceSum = 0.0;
+    float weightSum = 0.0;
+
+    for (int y = -2; y <= 2; ++y) {
+        for (int x = -2; x <= 2; ++x) {
+            ivec2 offset = ivec2(x, y) * pushConstants.stepSize;
+            ivec2 sampleCoord = pixel + offset;
+            if (sampleCoord.x < 0 || sampleCoord.y < 0 || sampleCoord.x >= size.x || sampleCoord.y >= size.y) {
+                continue;
+            }
+
+            vec4 sampleColor = imageLoad(inputColor, sampleCoord);
+            vec4 sampleNormalDepth = imageLoad(traceNormalDepth, sampleCoord);
+
+            float kernelWeight = KERNEL[abs(x)] * KERNEL[abs(y)];
+            float luminanceWeight = exp(-abs(centerLum - luminance(sampleColor.rgb)) / luminanceScale);
+            float normalWeight = pow(max(dot(centerNormalDepth.xyz, sampleNormalDepth.xyz), 0.0), pushConstants.sigmaNormal);
+            float depthWeight = exp(-abs(centerNormalDepth.w - sampleNormalDepth.w) / (pushConstants.sigmaDepth * length(vec2(offset)) + 1e-4));
+
+            float weight = kernelWeight * luminanceWeight * normalWeight * depthWeight;
+            colorSum += sampleColor.rgb * weight;
+            varianceSum += sampleColor.a * weight * weight;
+            weightSum += weight;
+        }
+    }
+
+    vec3 filtered = colorSum / max(weightSum, 1e-6);
+    float variance = varianceSum / max(weightSum * weightSum, 1e-6);
+
+    if (pushConstants.finalPass != 0) {
+        filtered *= max(imageLoad(traceAlbedo, pixel).rgb, vec3(1e-3));
+    }
+
+    imageStore(outputColor, pixel, vec4(filtered, variance));
+}
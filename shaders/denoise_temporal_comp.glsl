@@ -0,0 +1,160 @@
+#version 450
+
+// First stage of the SVGF denoiser (Schied et al. 2017).
+// Demodulates the albedo out of the noisy radiance, blends it with the history of the previous
+// frames reprojected with the motion vectors of the trace pass, and estimates the per-pixel
+// luminance variance that guides the a-trous filter.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0, rgba32f) uniform readonly image2D traceColor;
+layout(set = 0, binding = 1, rgba16f) uniform readonly image2D traceAlbedo;
+layout(set = 0, binding = 2, rgba32f) uniform readonly image2D traceNormalDepth;
+layout(set = 0, binding = 3, rgba32f) uniform readonly image2D prevNormalDepth;
+layout(set = 0, binding = 4, rgba32f) uniform readonly image2D historyColor;
+layout(set = 0, binding = 5, rgba32f) uniform readonly image2D historyMoments;
+layout(set = 0, binding = 7, rgba32f) uniform writeonly image2D integratedColor;
+layout(set = 0, binding = 8, rgba32f) uniform readonly image2D traceMotion;
+// Reprojection reads the moments of neighbouring pixels, so the new ones cannot be written in place
+layout(set = 0, binding = 9, rgba32f) uniform writeonly image2D integratedMoments;
+
+layout(push_constant) uniform DenoisePushConstants {
+    int stepSize;
+    int finalPass;
+    int temporalEnabled;
+    int resetHistory;
+    int clampHistory;
+    float sigmaLuminance;
+    float sigmaNormal;
+    float sigmaDepth;
+    float temporalAlpha;
+    float momentsAlpha;
+    // The targets are allocated at the swapchain size, only this corner of them is rendered
+    ivec2 renderSize;
+    ivec2 previousRenderSize;
+} pushConstants;
+
+const float MAX_HISTORY_LENGTH = 32.0;
+
+float luminance(vec3 color) {
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+vec3 demodulate(ivec2 pixel) {
+    vec3 albedo = max(imageLoad(traceAlbedo, pixel).rgb, vec3(1e-3));
+    return imageLoad(traceColor, pixel).rgb / albedo;
+}
+
+// Fetches the history of the surface seen in this pixel at its position in the previous frame.
+// Each bilinear tap is only kept if it saw the same surface, if every tap is rejected the pixel
+// has been disoccluded and its history restarts.
+bool reprojectHistory(ivec2 pixel, ivec2 size, out vec3 history, out vec4 moments) {
+    ivec2 previousSize = pushConstants.previousRenderSize;
+    vec4 current = imageLoad(traceNormalDepth, pixel);
+    vec4 motion = imageLoad(traceMotion, pixel);
+    bool background = dot(current.xyz, current.xyz) < 0.5;
+
+    // The render scale may have changed since the previous frame, go through the screen uv
+    vec2 previousUV = (vec2(pixel) + 0.5) / vec2(size) + motion.xy;
+    vec2 previousPosition = previousUV * vec2(previousSize) - 0.5;
+    ivec2 base = ivec2(floor(previousPosition));
+    vec2 f = fract(previousPosition);
+
+    const ivec2 offsets[4] = ivec2[4](ivec2(0, 0), ivec2(1, 0), ivec2(0, 1), ivec2(1, 1));
+    float bilinearWeights[4] = float[4]((1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y), (1.0 - f.x) * f.y, f.x * f.y);
+
+    history = vec3(0.0);
+    moments = vec4(0.0);
+    float weightSum = 0.0;
+
+    for (int i = 0; i < 4; ++i) {
+        ivec2 tap = base + offsets[i];
+        if (tap.x < 0 || tap.y < 0 || tap.x >= previousSize.x || tap.y >= previousSize.y) {
+            continue;
+        }
+
+        vec4 previous = imageLoad(prevNormalDepth, tap);
+        bool previousBackground = dot(previous.xyz, previous.xyz) < 0.5;
+
+        // The depth of the reprojected hit is compared in the view space of the previous camera
+        bool consistent = background
+            ? previousBackground
+            : !previousBackground && abs(previous.w - motion.z) < 0.05 * max(motion.z, 1e-3) && dot(current.xyz, previous.xyz) > 0.9;
+
+        if (consistent) {
+            history += bilinearWeights[i] * imageLoad(historyColor, tap).rgb;
+            moments += bilinearWeights[i] * imageLoad(historyMoments, tap);
+            weightSum += bilinearWeights[i];
+        }
+    }
+
+    if (weightSum < 1e-3) {
+        return false;
+    }
+
+    history /= weightSum;
+    moments /= weightSum;
+    return true;
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = pushConstants.renderSize;
+    if (pixel.x >= size.x || pixel.y >= size.y) {
+        return;
+    }
+
+    vec3 color = demodulate(pixel);
+    float lum = luminance(color);
+
+    vec3 history;
+    vec4 previousMoments;
+    bool historyValid = pushConstants.temporalEnabled != 0 && pushConstants.resetHistory == 0 && reprojectHistory(pixel, size, history, previousMoments);
+
+    vec3 integrated = color;
+    vec2 moments = vec2(lum, lum * lum);
+    float historyLength = 1.0;
+
+    if (historyValid) {
+        if (pushConstants.clampHistory != 0) {
+            // Clamp the history to the color range of the current neighbourhood to limit ghosting
+            vec3 minColor = color;
+            vec3 maxColor = color;
+            for (int y = -1; y <= 1; ++y) {
+                for (int x = -1; x <= 1; ++x) {
+                    ivec2 neighbour = clamp(pixel + ivec2(x, y), ivec2(0), size - 1);
+                    vec3 neighbourColor = demodulate(neighbour);
+                    minColor = min(minColor, neighbourColor);
+                    maxColor = max(maxColor, neighbourColor);
+                }
+            }
+            history = clamp(history, minColor, maxColor);
+        }
+
+        historyLength = min(previousMoments.z + 1.0, MAX_HISTORY_LENGTH);
+        float alpha = max(pushConstants.temporalAlpha, 1.0 / historyLength);
+        float alphaMoments = max(pushConstants.momentsAlpha, 1.0 / historyLength);
+
+        integrated = mix(history, color, alpha);
+        moments = mix(previousMoments.xy, moments, alphaMoments);
+    }
+
+    float variance = max(moments.y - moments.x * moments.x, 0.0);
+
+    // A short history gives a poor temporal variance estimate, use the spatial one instead
+    if (historyLength < 4.0) {
+        vec2 spatialMoments = vec2(0.0);
+        for (int y = -1; y <= 1; ++y) {
+            for (int x = -1; x <= 1; ++x) {
+                ivec2 neighbour = clamp(pixel + ivec2(x, y), ivec2(0), size - 1);
+                float neighbourLum = luminance(demodulate(neighbour));
+                spatialMoments += vec2(neighbourLum, neighbourLum * neighbourLum);
+            }
+        }
+        spatialMoments /= 9.0;
+        variance = max(spatialMoments.y - spatialMoments.x * spatialMoments.x, 0.0) * 4.0 / historyLength;
+    }
+
+    imageStore(integratedMoments, pixel, vec4(moments, historyLength, 0.0));
+    imageStore(integratedColor, pixel, vec4(integrated, variance));
+}
@@ -1,19 +1,62 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
-#define SAMPLES 10
-#define BOUNCES 8
 #define PI 3.141592653589793238462643
 
-layout(push_constant) uniform PushConstants {
-    float uTime;
-    //add uViewportSize
-} pushConstants;
+// Material classes, each with its own sampling and evaluation code so opaque scenes only run the opaque one
+#define MATERIAL_OPAQUE 0
+#define MATERIAL_SMOOTH_DIELECTRIC 1
+#define MATERIAL_ROUGH_DIELECTRIC 2
+// Dielectrics below this roughness are treated as perfectly smooth
+#define SMOOTH_ROUGHNESS 0.02
+// Roughness the GGX lobe of opaque materials is clamped to, so it stays a distribution that can be sampled
+#define MIN_ROUGHNESS 0.03
+
+struct Camera {
+    vec3 position;
+    vec3 lookAt;
+    vec3 front;
+    vec3 up;
+    vec3 right;
+    vec3 worldUp;
+    float fov;
+    float aspectRatio;
+    float nearPlane;
+    float farPlane;
+};
+
+// VkRenderer::FrameUniforms, bound at the slice of the frame in flight of the uniform ring
+layout(std140, set = 0, binding = 0) uniform FrameUniforms {
+    Camera camera;
+    // Camera of the previous frame, used to reproject the primary hits for the denoiser history
+    Camera previousCamera;
+    float time;
+    uint frameIndex;
+    vec2 viewportSize;
+    // The light buffer has room for more lights than the scene holds
+    uint lightCount;
+    // Samples traced per pixel by one draw, and the bounces of each path, from the render configuration
+    uint samples;
+    uint bounces;
+    // While a scene streams in, the triangles past residentTriangles are not uploaded yet and nothing is until
+    // sceneResident, the BVH included
+    uint residentTriangles;
+    uint sceneResident;
+    // The textures are uploaded in order after the geometry, the ones from residentTextures on are not yet
+    uint residentTextures;
+} frame;
 
 // From https://github.com/asc-community/MxEngine
 float rand(vec2 co, float seed) {
     return fract(sin(dot(co.xy + seed, vec2(12.9898, 78.233))) * 43758.5453123);
 }
 
+// Decorrelates the random sequences between frames so the temporal pass of the denoiser
+// accumulates new samples instead of the same ones
+float frameSeed() {
+    return float(frame.bounces) + fract(float(frame.frameIndex) * 0.61803398875) * 64.0;
+}
+
 struct Ray {
     vec3 origin;
     vec3 direction;
@@ -25,17 +68,35 @@ struct Material {
     float emissionStrength;
     float roughness;
     float metallic;
+    float ior;
+    float transparency;
+    vec3 transparencyColor;
+    // Indices in the textures array, -1 for none
+    int albedoTexture;
+    int roughnessMetallicTexture;
+    int normalTexture;
 };
 
 struct HitRecord {
     vec3 position;
     vec3 normal;
     Material material;
+    float t;
+    // Primitive hit, -1 for the other kind, and the barycentric coordinates of v1 and v2 on a triangle
+    int sphereIndex;
+    int triangleIndex;
+    vec2 barycentrics;
+    // Filled by computeTextureFrame, only for the hits of the path and not for the shadow rays
+    vec2 uv;
+    vec3 tangent;
+    vec3 bitangent;
+    float lodBase;
 };
 
 struct Vertex {
     vec3 position;
     vec3 normal;
+    vec2 uv;
 };
 
 struct Triangle {
@@ -68,52 +129,223 @@ layout(std140, set = 0, binding = 3) buffer Lights {
 layout(location = 0) in vec2 fragUV;
 
 layout(location = 0) out vec4 outColor;
-
-layout(std140, set = 0, binding = 0) uniform UniformBufferObject {
-    vec3 position;
-    vec3 lookAt;
-    vec3 front;
-    vec3 up;
-    vec3 right;
-    vec3 worldUp;
-    float fov;
-    float aspectRatio;
-    float nearPlane;
-    float farPlane;
-} cameraUBO;
+// Feature buffers for the denoiser: primary hit albedo, and world normal + view depth
+layout(location = 1) out vec4 outAlbedo;
+layout(location = 2) out vec4 outNormalDepth;
+// Motion of the primary hit in UV space since the previous frame, and its view depth in that frame
+layout(location = 3) out vec4 outMotion;
 
 layout(std140, set = 0, binding = 1) buffer Triangles {
     Triangle triangles[];
 } trianglesBuffer;
 
+// Finest level of detail each texture was sampled with in this frame, read back by the texture streaming:
+// 0 when not sampled, otherwise 1 + TEXTURE_FEEDBACK_SCALE * -lod, lod being the log2 of the footprint in
+// texture coordinates. Bound at the slice of the frame in flight.
+layout(std430, set = 0, binding = 4) buffer TextureFeedback {
+    uint requests[];
+} textureFeedback;
+#define TEXTURE_FEEDBACK_SCALE 256.0
+
+struct BvhNode {
+    vec3 boundsMin;
+    int leftOrFirst;
+    vec3 boundsMax;
+    int count;
+};
+
+// Bounding volume hierarchy of the triangles and spheres, see Bvh.h. Inner nodes have a count of 0 and their
+// children at leftOrFirst and leftOrFirst + 1, leaves reference count primitives from leftOrFirst on.
+layout(std430, set = 0, binding = 5) readonly buffer BvhNodes {
+    BvhNode nodes[];
+} bvhNodes;
+
+// Sphere indices have BVH_SPHERE_BIT set, the others are triangle indices
+layout(std430, set = 0, binding = 6) readonly buffer BvhPrimitives {
+    uint primitives[];
+} bvhPrimitives;
+#define BVH_SPHERE_BIT 0x80000000u
+// Bvh::m_MAX_DEPTH, no path from the root is longer so the traversal stack never overflows
+#define BVH_MAX_DEPTH 32
+#define BVH_MISS 1e30
+
+// Textures of the materials, in a set of their own per frame in flight which only holds as many descriptors as
+// the scene has textures
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+#ifdef SPECTRAL
+// Spectral build only, compiled with -DSPECTRAL into frag_spectral.spv. Each path carries 4 wavelengths, a hero
+// wavelength sampled uniformly and 3 others rotated by a quarter of the range, so radiance and throughput are vec4
+// holding one value per wavelength. RGB materials and lights are upsampled to spectra at every hit.
+#define Spectrum vec4
+
+#define WAVELENGTH_MIN 380.0
+#define WAVELENGTH_RANGE 400.0
+
+// Abbe number given to every dielectric, between those of crown and flint glasses
+#define ABBE_NUMBER 45.0
+
+vec4 wavelengths;
+// Set once a dispersive event terminated the wavelengths other than the hero one
+bool heroWavelengthOnly;
+
+void sampleWavelengths(float u) {
+    float hero = u * WAVELENGTH_RANGE;
+    wavelengths = WAVELENGTH_MIN + mod(vec4(hero) + vec4(0.0, 0.25, 0.5, 0.75) * WAVELENGTH_RANGE, WAVELENGTH_RANGE);
+    heroWavelengthOnly = false;
+}
+
+// Cauchy's equation n = A + B / lambda^2, in micrometers, through the index of the material at the d line
+// (587.6 nm) and the Abbe number, evaluated at the hero wavelength
+float dispersedIOR(float ior) {
+    float B = (ior - 1.0) / (ABBE_NUMBER * (1.0 / (0.4861 * 0.4861) - 1.0 / (0.6563 * 0.6563)));
+    float A = ior - B / (0.5876 * 0.5876);
+    float lambda = wavelengths.x * 0.001;
+    return A + B / (lambda * lambda);
+}
+
+// The other wavelengths would leave a dielectric in other directions, they are dropped and the hero one
+// carries the whole estimate
+Spectrum keepHeroWavelength() {
+    if (heroWavelengthOnly) {
+        return Spectrum(1.0);
+    }
+    heroWavelengthOnly = true;
+    return vec4(4.0, 0.0, 0.0, 0.0);
+}
+
+// Smooth partition of unity between a blue, a green and a red band: white stays a constant 1 and a reflectance
+// in [0,1] stays in [0,1], the primaries round trip to RGB within a few percent
+Spectrum toSpectrum(vec3 rgb) {
+    vec4 blueToGreen = smoothstep(470.0, 510.0, wavelengths);
+    vec4 greenToRed = smoothstep(570.0, 610.0, wavelengths);
+    return rgb.b * (1.0 - blueToGreen) + rgb.g * (blueToGreen - greenToRed) + rgb.r * greenToRed;
+}
+
+// Piecewise gaussian of the multi-lobe fit of the CIE 1931 matching functions (Wyman, Sloan and Shirley 2013)
+vec4 gaussianLobe(vec4 x, float mean, float sigmaLow, float sigmaHigh) {
+    vec4 t = (x - mean) / mix(vec4(sigmaLow), vec4(sigmaHigh), step(mean, x));
+    return exp(-0.5 * t * t);
+}
+
+vec3 spectrumToRGB(Spectrum radiance) {
+    vec4 x = 1.056 * gaussianLobe(wavelengths, 599.8, 37.9, 31.0) + 0.362 * gaussianLobe(wavelengths, 442.0, 16.0, 26.7)
+           - 0.065 * gaussianLobe(wavelengths, 501.1, 20.4, 26.2);
+    vec4 y = 0.821 * gaussianLobe(wavelengths, 568.8, 46.9, 40.5) + 0.286 * gaussianLobe(wavelengths, 530.9, 16.3, 31.1);
+    vec4 z = 1.217 * gaussianLobe(wavelengths, 437.0, 11.8, 36.0) + 0.681 * gaussianLobe(wavelengths, 459.0, 26.0, 13.8);
+
+    // Monte Carlo estimate of the integral over the range, each wavelength has a pdf of 1 / range
+    vec4 weight = radiance * (WAVELENGTH_RANGE / 4.0);
+    vec3 xyz = vec3(dot(weight, x), dot(weight, y), dot(weight, z));
+
+    // XYZ to linear sRGB, divided by the response to a constant spectrum so a grey scene renders as in RGB mode
+    const mat3 xyzToRGB = mat3(
+         3.2404542, -0.9692660,  0.0556434,
+        -1.5371385,  1.8760108, -0.2040259,
+        -0.4985314,  0.0415560,  1.0572252
+    );
+    const vec3 constantSpectrumRGB = vec3(128.361, 101.538, 97.065);
+    return (xyzToRGB * xyz) / constantSpectrumRGB;
+}
+
+float spectrumAverage(Spectrum value) {
+    return dot(value, vec4(0.25));
+}
+#else
+#define Spectrum vec3
+
+Spectrum toSpectrum(vec3 rgb) {
+    return rgb;
+}
+
+vec3 spectrumToRGB(Spectrum radiance) {
+    return radiance;
+}
+
+float spectrumAverage(Spectrum value) {
+    return dot(value, vec3(1.0 / 3.0));
+}
+
+float dispersedIOR(float ior) {
+    return ior;
+}
+
+Spectrum keepHeroWavelength() {
+    return Spectrum(1.0);
+}
+#endif
+
+#ifdef RAY_STATS
+// Instrumented build only, compiled with -DRAY_STATS into frag_raystats.spv.
+// Totals of the frame as low and high words: primary rays, bounce rays, shadow rays, triangle tests, sphere tests,
+// BVH node visits
+layout(std430, set = 2, binding = 0) buffer RayStatistics {
+    uint counters[12];
+} rayStatistics;
+// Counters of each pixel: x rays (primary and bounce), y shadow rays, z triangle tests, w sphere tests
+layout(set = 2, binding = 1, rgba32ui) uniform writeonly uimage2D rayCounts;
+// BVH nodes visited by the rays of each pixel
+layout(set = 2, binding = 3, r32ui) uniform writeonly uimage2D rayNodeVisits;
+
+uint statPrimaryRays = 0u;
+uint statBounceRays = 0u;
+uint statShadowRays = 0u;
+uint statTriangleTests = 0u;
+uint statSphereTests = 0u;
+uint statNodeVisits = 0u;
+
+#define RAY_STAT(counter, count) counter += (count)
+
+void addRayStatistic(int index, uint count) {
+    uint previous = atomicAdd(rayStatistics.counters[2 * index], count);
+    // Carry into the high word, the tests of a frame easily exceed 32 bits
+    if (previous + count < previous) {
+        atomicAdd(rayStatistics.counters[2 * index + 1], 1u);
+    }
+}
+
+void writeRayStatistics() {
+    imageStore(rayCounts, ivec2(gl_FragCoord.xy), uvec4(statPrimaryRays + statBounceRays, statShadowRays, statTriangleTests, statSphereTests));
+    imageStore(rayNodeVisits, ivec2(gl_FragCoord.xy), uvec4(statNodeVisits));
+
+    addRayStatistic(0, statPrimaryRays);
+    addRayStatistic(1, statBounceRays);
+    addRayStatistic(2, statShadowRays);
+    addRayStatistic(3, statTriangleTests);
+    addRayStatistic(4, statSphereTests);
+    addRayStatistic(5, statNodeVisits);
+}
+#else
+#define RAY_STAT(counter, count)
+#endif
+
 Ray getCameraRay(vec2 uv, int sampleIndex) {
     // Convert UV coordinates from [0,1] to [-1,1].
     vec2 ndc = uv * 2.0 - 1.0;
 
-    //TODO use uViewportSize
-    float pixelScaleX = 2.0 / 1920.0;
-    float pixelScaleY = 2.0 / 1080.0;
+    float pixelScaleX = 2.0 / frame.viewportSize.x;
+    float pixelScaleY = 2.0 / frame.viewportSize.y;
 
     // Generate random offsets for anti-aliasing within the pixel
-    float randomOffsetX = (rand(vec2(uv.x, float(sampleIndex * 31)), BOUNCES) - 0.5) * pixelScaleX;
-    float randomOffsetY = (rand(vec2(uv.y, float(sampleIndex * 47)), BOUNCES) - 0.5) * pixelScaleY;
+    float randomOffsetX = (rand(vec2(uv.x, float(sampleIndex * 31)), frameSeed()) - 0.5) * pixelScaleX;
+    float randomOffsetY = (rand(vec2(uv.y, float(sampleIndex * 47)), frameSeed()) - 0.5) * pixelScaleY;
 
     // Apply random offsets to the UV coordinates
     ndc.x += randomOffsetX;
     ndc.y += randomOffsetY;
 
     // Field of view calculation in radians
-    float fov = radians(cameraUBO.fov);
+    float fov = radians(frame.camera.fov);
 
     // Calculation of the image plane at focal length
     float imagePlaneHalfHeight = tan(fov / 2.0);
-    float imagePlaneHalfWidth = imagePlaneHalfHeight * cameraUBO.aspectRatio;
+    float imagePlaneHalfWidth = imagePlaneHalfHeight * frame.camera.aspectRatio;
 
     // Calculation of beam direction in camera space
     vec3 rayDirCameraSpace = normalize(
-        ndc.x * imagePlaneHalfWidth * cameraUBO.right +
-        ndc.y * imagePlaneHalfHeight * cameraUBO.up +
-        cameraUBO.front
+        ndc.x * imagePlaneHalfWidth * frame.camera.right +
+        ndc.y * imagePlaneHalfHeight * frame.camera.up +
+        frame.camera.front
     );
 
     // In this case, world space and camera space are the same
@@ -121,12 +353,28 @@ Ray getCameraRay(vec2 uv, int sampleIndex) {
 
     // Create the ray
     Ray ray;
-    ray.origin = cameraUBO.position;
+    ray.origin = frame.camera.position;
     ray.direction = rayDirWorldSpace;
 
     return ray;
 }
 
+// Inverse of getCameraRay for the previous camera, xy is the UV of the point and z its view depth
+vec3 projectToPreviousFrame(vec3 worldPosition) {
+    vec3 direction = worldPosition - frame.previousCamera.position;
+    float viewDepth = dot(direction, frame.previousCamera.front);
+
+    float imagePlaneHalfHeight = tan(radians(frame.previousCamera.fov) / 2.0);
+    float imagePlaneHalfWidth = imagePlaneHalfHeight * frame.previousCamera.aspectRatio;
+
+    vec2 ndc = vec2(
+        dot(direction, frame.previousCamera.right) / (max(viewDepth, 1e-6) * imagePlaneHalfWidth),
+        dot(direction, frame.previousCamera.up) / (max(viewDepth, 1e-6) * imagePlaneHalfHeight)
+    );
+
+    return vec3(ndc * 0.5 + 0.5, viewDepth);
+}
+
 bool rayIntersectsTriangle(Ray ray, Triangle tri, out float t, out float u, out float v) {
     const float EPSILON = 1e-6;
     vec3 edge1 = tri.v1.position - tri.v0.position;
@@ -183,8 +431,8 @@ bool rayIntersectsSphere(Ray ray, Sphere sphere, out float t) {
 }
 
 vec3 sampleHemisphere(vec3 N, float seed) {
-    float Xi1 = rand(fragUV * vec2(12.9898, 78.233) + vec2(sin(seed), cos(seed)), BOUNCES);
-    float Xi2 = rand(fragUV * vec2(78.233, 12.9898) + vec2(cos(seed), sin(seed)), BOUNCES);
+    float Xi1 = rand(fragUV * vec2(12.9898, 78.233) + vec2(sin(seed), cos(seed)), frameSeed());
+    float Xi2 = rand(fragUV * vec2(78.233, 12.9898) + vec2(cos(seed), sin(seed)), frameSeed());
 
 
     float theta = acos(sqrt(1.0 - Xi1));
@@ -202,7 +450,15 @@ vec3 sampleHemisphere(vec3 N, float seed) {
     return normalize(direction);
 }
 
-vec3 fresnelSchlick(float cosTheta, vec3 F0) {
+// Two uniform numbers for the given seed, decorrelated from each other like in sampleHemisphere
+vec2 random2(float seed) {
+    return vec2(
+        rand(fragUV * vec2(12.9898, 78.233) + vec2(sin(seed), cos(seed)), frameSeed()),
+        rand(fragUV * vec2(78.233, 12.9898) + vec2(cos(seed), sin(seed)), frameSeed())
+    );
+}
+
+Spectrum fresnelSchlick(float cosTheta, Spectrum F0) {
     return F0 + (1.0 - F0) * pow(1.0 - cosTheta, 5.0);
 }
 
@@ -236,86 +492,459 @@ float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness) {
     return ggx1 * ggx2;
 }
 
-vec3 computeBRDF(Material material, vec3 N, vec3 V, vec3 L) {
+// Exact Fresnel reflectance of a dielectric interface, eta is the index of the incident side over the other one
+float fresnelDielectric(float cosThetaI, float eta) {
+    float sin2ThetaT = eta * eta * (1.0 - cosThetaI * cosThetaI);
+    if (sin2ThetaT >= 1.0) {
+        return 1.0; // Total internal reflection
+    }
+    float cosThetaT = sqrt(1.0 - sin2ThetaT);
+    float rs = (eta * cosThetaI - cosThetaT) / (eta * cosThetaI + cosThetaT);
+    float rp = (cosThetaI - eta * cosThetaT) / (cosThetaI + eta * cosThetaT);
+    return 0.5 * (rs * rs + rp * rp);
+}
+
+// Smith masking of the GGX distribution for the direction v, m the microfacet normal and N the macro normal
+float smithG1GGX(vec3 v, vec3 m, vec3 N, float alpha) {
+    float NdotV = dot(N, v);
+    if (dot(v, m) * NdotV <= 0.0) {
+        return 0.0;
+    }
+    float cos2 = NdotV * NdotV;
+    float tan2 = max(1.0 - cos2, 0.0) / cos2;
+    return 2.0 / (1.0 + sqrt(1.0 + alpha * alpha * tan2));
+}
+
+// Microfacet normal distributed as the normals of the GGX distribution visible from V, G1(V) max(V.m, 0) D(m) / N.V
+// (Heitz 2018). Far fewer samples are wasted below the surface than when sampling D(m) alone.
+vec3 sampleGGXVisibleNormal(vec3 N, vec3 V, float alpha, vec2 u) {
+    vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangentX = normalize(cross(up, N));
+    vec3 tangentY = cross(N, tangentX);
+
+    // Stretch the view direction to the hemisphere configuration of a unit roughness
+    vec3 localV = vec3(dot(V, tangentX), dot(V, tangentY), dot(V, N));
+    vec3 Vh = normalize(vec3(alpha * localV.x, alpha * localV.y, localV.z));
+
+    float lengthSquared = Vh.x * Vh.x + Vh.y * Vh.y;
+    vec3 T1 = lengthSquared > 0.0 ? vec3(-Vh.y, Vh.x, 0.0) * inversesqrt(lengthSquared) : vec3(1.0, 0.0, 0.0);
+    vec3 T2 = cross(Vh, T1);
+
+    // Uniform point on the projected half disk
+    float r = sqrt(u.x);
+    float phi = 2.0 * PI * u.y;
+    float t1 = r * cos(phi);
+    float t2 = r * sin(phi);
+    float s = 0.5 * (1.0 + Vh.z);
+    t2 = (1.0 - s) * sqrt(1.0 - t1 * t1) + s * t2;
+
+    vec3 Nh = t1 * T1 + t2 * T2 + sqrt(max(0.0, 1.0 - t1 * t1 - t2 * t2)) * Vh;
+    vec3 localM = normalize(vec3(alpha * Nh.x, alpha * Nh.y, max(0.0, Nh.z)));
+
+    return tangentX * localM.x + tangentY * localM.y + N * localM.z;
+}
+
+// Samples the reflection or the transmission of a dielectric, chosen with the Fresnel term. N is the outward
+// normal, V points away from the surface. The weight is the BSDF times the cosine over the pdf, and false is
+// returned for samples below the surface.
+bool sampleDielectric(Material material, vec3 N, vec3 V, bool rough, float seed, out vec3 direction, out Spectrum weight) {
+    bool entering = dot(V, N) > 0.0;
+    vec3 facingN = entering ? N : -N;
+    float ior = dispersedIOR(material.ior);
+    float eta = entering ? 1.0 / ior : ior;
+
+    float alpha = material.roughness * material.roughness;
+    vec3 M = rough ? sampleGGXVisibleNormal(facingN, V, alpha, random2(seed + 0.5)) : facingN;
+    float VdotM = dot(V, M);
+    if (VdotM <= 0.0) {
+        return false;
+    }
+
+    float F = fresnelDielectric(VdotM, eta);
+    bool reflected = random2(seed + 0.25).y < F;
+    direction = reflected ? reflect(-V, M) : refract(-V, M, eta);
+
+    float NdotL = dot(facingN, direction);
+    if (reflected ? NdotL <= 0.0 : NdotL >= 0.0) {
+        return false;
+    }
+
+    // Choosing the lobe with the Fresnel term cancels it from the weight, and sampling the visible normals
+    // leaves the masking of the outgoing direction
+    weight = (reflected ? Spectrum(1.0) : toSpectrum(material.transparencyColor)) * keepHeroWavelength();
+    if (rough) {
+        weight *= smithG1GGX(direction, M, facingN, alpha);
+    }
+    return true;
+}
+
+// Reflection lobe of a rough dielectric, the direct lighting of its transmission lobe is left to the path
+// since closed objects block the shadow rays from inside anyway
+Spectrum evaluateRoughDielectricReflection(Material material, vec3 N, vec3 V, vec3 L) {
+    bool entering = dot(V, N) > 0.0;
+    vec3 facingN = entering ? N : -N;
+    float NdotV = dot(facingN, V);
+    float NdotL = dot(facingN, L);
+    if (NdotV <= 0.0 || NdotL <= 0.0) {
+        return Spectrum(0.0);
+    }
+
+    float ior = dispersedIOR(material.ior);
+    vec3 H = normalize(V + L);
+    float F = fresnelDielectric(dot(V, H), entering ? 1.0 / ior : ior);
+    float alpha = material.roughness * material.roughness;
+    float D = DistributionGGX(facingN, H, material.roughness);
+    float G = smithG1GGX(V, H, facingN, alpha) * smithG1GGX(L, H, facingN, alpha);
+
+    return Spectrum(F * D * G / (4.0 * NdotV * NdotL));
+}
+
+// albedo is the albedo of the material as a spectrum, see toSpectrum
+Spectrum computeBRDF(Material material, Spectrum albedo, vec3 N, vec3 V, vec3 L) {
     vec3 H = normalize(V + L);
+    float roughness = max(material.roughness, MIN_ROUGHNESS);
 
     float NdotL = max(dot(N, L), 0.0);
     float NdotV = max(dot(N, V), 0.0);
     float NdotH = max(dot(N, H), 0.0);
     float VdotH = max(dot(V, H), 0.0);
 
-    vec3 F0 = mix(vec3(0.04), material.albedo, material.metallic);
-    vec3 F = fresnelSchlick(VdotH, F0);
+    Spectrum F0 = mix(Spectrum(0.04), albedo, material.metallic);
+    Spectrum F = fresnelSchlick(VdotH, F0);
 
-    float D = DistributionGGX(N, H, material.roughness);
-    float G = GeometrySmith(N, V, L, material.roughness);
+    float D = DistributionGGX(N, H, roughness);
+    float G = GeometrySmith(N, V, L, roughness);
 
-    vec3 numerator = D * F * G;
+    Spectrum numerator = D * F * G;
     float denominator = 4.0 * NdotV * NdotL + 0.001;
-    vec3 specular = numerator / denominator;
+    Spectrum specular = numerator / denominator;
 
-    vec3 kD = vec3(1.0) - F;
+    Spectrum kD = Spectrum(1.0) - F;
     kD *= 1.0 - material.metallic;
 
-    vec3 diffuse = kD * material.albedo / PI;
+    Spectrum diffuse = kD * albedo / PI;
 
     return diffuse + specular;
 }
 
+// Samples the opaque BSDF: the GGX lobe through its visible normals or the diffuse lobe by cosine, picked with
+// their Fresnel weighted albedos, so metals never waste samples on their missing diffuse lobe. The pdf is the one
+// of the mixture, the weight stays exact whichever lobe produced the direction. False for samples below the surface.
+bool sampleOpaque(Material material, Spectrum albedo, vec3 N, vec3 V, float seed, out vec3 direction, out Spectrum weight) {
+    vec3 facingN = dot(V, N) >= 0.0 ? N : -N;
+    float NdotV = max(dot(facingN, V), 1e-4);
+    float roughness = max(material.roughness, MIN_ROUGHNESS);
+    float alpha = roughness * roughness;
+
+    Spectrum F0 = mix(Spectrum(0.04), albedo, material.metallic);
+    float specularWeight = spectrumAverage(fresnelSchlick(NdotV, F0));
+    float diffuseWeight = (1.0 - material.metallic) * (1.0 - specularWeight) * spectrumAverage(albedo);
+    float specularProbability = specularWeight / max(specularWeight + diffuseWeight, 1e-6);
+
+    if (random2(seed + 0.75).x < specularProbability) {
+        vec3 M = sampleGGXVisibleNormal(facingN, V, alpha, random2(seed));
+        direction = reflect(-V, M);
+    } else {
+        direction = sampleHemisphere(facingN, seed);
+    }
+
+    float NdotL = dot(facingN, direction);
+    if (NdotL <= 0.0) {
+        return false;
+    }
+
+    vec3 H = normalize(V + direction);
+    float specularPdf = smithG1GGX(V, H, facingN, alpha) * DistributionGGX(facingN, H, roughness) / (4.0 * NdotV);
+    float diffusePdf = NdotL / PI;
+    float pdf = mix(diffusePdf, specularPdf, specularProbability);
+
+    weight = computeBRDF(material, albedo, facingN, V, direction) * NdotL / max(pdf, 1e-6);
+    return true;
+}
+
+// Distance the ray enters the bounds at, BVH_MISS when it misses them or only enters them past maxT
+float intersectBounds(Ray ray, vec3 inverseDirection, vec3 boundsMin, vec3 boundsMax, float maxT) {
+    vec3 t0 = (boundsMin - ray.origin) * inverseDirection;
+    vec3 t1 = (boundsMax - ray.origin) * inverseDirection;
+    vec3 tNear = min(t0, t1);
+    vec3 tFar = max(t0, t1);
+    float enter = max(max(tNear.x, tNear.y), max(tNear.z, 0.0));
+    float exit = min(min(tFar.x, tFar.y), min(tFar.z, maxT));
+    return enter <= exit ? enter : BVH_MISS;
+}
+
 bool traceRay(Ray ray, out HitRecord hitRecord) {
     float closestT = 1e20;
-    bool hitSomething = false;
-
-    for (int i = 0; i < sphereBuffer.spheres.length(); ++i) {
-        float t;
-        if (rayIntersectsSphere(ray, sphereBuffer.spheres[i], t)) {
-            if (t < closestT) {
-                closestT = t;
-                hitSomething = true;
-                hitRecord.position = ray.origin + t * ray.direction;
-                hitRecord.normal = normalize(hitRecord.position - sphereBuffer.spheres[i].center);
-                hitRecord.material = sphereBuffer.spheres[i].material;
+    int closestSphere = -1;
+    int closestTriangle = -1;
+    vec2 closestBarycentrics = vec2(0.0);
+
+    // Axis aligned directions would divide zero by zero on the planes of the bounds
+    vec3 safeDirection = mix(ray.direction, vec3(1e-8), lessThan(abs(ray.direction), vec3(1e-8)));
+    vec3 inverseDirection = 1.0 / safeDirection;
+
+    // Nodes still to visit with the distance the ray enters them at, the nearest child is visited first so the
+    // farther ones are often skipped once a closer hit is found
+    int stackNodes[BVH_MAX_DEPTH];
+    float stackT[BVH_MAX_DEPTH];
+    int stackSize = 0;
+
+    int node = 0;
+    float nodeT = frame.sceneResident != 0u ? intersectBounds(ray, inverseDirection, bvhNodes.nodes[0].boundsMin, bvhNodes.nodes[0].boundsMax, closestT) : BVH_MISS;
+    while (nodeT < BVH_MISS) {
+        BvhNode current = bvhNodes.nodes[node];
+        RAY_STAT(statNodeVisits, 1u);
+        if (current.count > 0) {
+            for (int i = current.leftOrFirst; i < current.leftOrFirst + current.count; ++i) {
+                uint primitive = bvhPrimitives.primitives[i];
+                if ((primitive & BVH_SPHERE_BIT) != 0u) {
+                    int sphere = int(primitive & ~BVH_SPHERE_BIT);
+                    RAY_STAT(statSphereTests, 1u);
+                    float t;
+                    if (rayIntersectsSphere(ray, sphereBuffer.spheres[sphere], t) && t < closestT) {
+                        closestT = t;
+                        closestSphere = sphere;
+                        closestTriangle = -1;
+                    }
+                }
+                else if (primitive < frame.residentTriangles) {
+                    int triangle = int(primitive);
+                    RAY_STAT(statTriangleTests, 1u);
+                    float t, u, v;
+                    if (rayIntersectsTriangle(ray, trianglesBuffer.triangles[triangle], t, u, v) && t < closestT) {
+                        closestT = t;
+                        closestSphere = -1;
+                        closestTriangle = triangle;
+                        closestBarycentrics = vec2(u, v);
+                    }
+                }
+            }
+        }
+        else {
+            int nearNode = current.leftOrFirst;
+            int farNode = current.leftOrFirst + 1;
+            float nearT = intersectBounds(ray, inverseDirection, bvhNodes.nodes[nearNode].boundsMin, bvhNodes.nodes[nearNode].boundsMax, closestT);
+            float farT = intersectBounds(ray, inverseDirection, bvhNodes.nodes[farNode].boundsMin, bvhNodes.nodes[farNode].boundsMax, closestT);
+            if (farT < nearT) {
+                int swappedNode = nearNode;
+                nearNode = farNode;
+                farNode = swappedNode;
+                float swappedT = nearT;
+                nearT = farT;
+                farT = swappedT;
+            }
+            if (nearT < BVH_MISS) {
+                if (farT < BVH_MISS) {
+                    stackNodes[stackSize] = farNode;
+                    stackT[stackSize] = farT;
+                    ++stackSize;
+                }
+                node = nearNode;
+                nodeT = nearT;
+                continue;
             }
         }
-    }
 
-    for (int i = 0; i < trianglesBuffer.triangles.length(); ++i) {
-        float t, u, v;
-        if (rayIntersectsTriangle(ray, trianglesBuffer.triangles[i], t, u, v)) {
-            if (t < closestT) {
-                closestT = t;
-                hitSomething = true;
-                hitRecord.position = ray.origin + t * ray.direction;
-                vec3 normal = normalize(
-                    (1.0 - u - v) * trianglesBuffer.triangles[i].v0.normal +
-                    u * trianglesBuffer.triangles[i].v1.normal +
-                    v * trianglesBuffer.triangles[i].v2.normal
-                );
-                hitRecord.normal = normal;
-                hitRecord.material = trianglesBuffer.triangles[i].material;
+        // Nodes the ray enters past the closest hit found since they were pushed are skipped
+        nodeT = BVH_MISS;
+        while (stackSize > 0 && nodeT >= BVH_MISS) {
+            --stackSize;
+            if (stackT[stackSize] < closestT) {
+                node = stackNodes[stackSize];
+                nodeT = stackT[stackSize];
             }
         }
     }
 
-    return hitSomething;
+    if (closestSphere >= 0) {
+        hitRecord.position = ray.origin + closestT * ray.direction;
+        hitRecord.normal = normalize(hitRecord.position - sphereBuffer.spheres[closestSphere].center);
+        hitRecord.material = sphereBuffer.spheres[closestSphere].material;
+        hitRecord.t = closestT;
+        hitRecord.sphereIndex = closestSphere;
+        hitRecord.triangleIndex = -1;
+        return true;
+    }
+    if (closestTriangle >= 0) {
+        float u = closestBarycentrics.x;
+        float v = closestBarycentrics.y;
+        hitRecord.position = ray.origin + closestT * ray.direction;
+        hitRecord.normal = normalize(
+            (1.0 - u - v) * trianglesBuffer.triangles[closestTriangle].v0.normal +
+            u * trianglesBuffer.triangles[closestTriangle].v1.normal +
+            v * trianglesBuffer.triangles[closestTriangle].v2.normal
+        );
+        hitRecord.material = trianglesBuffer.triangles[closestTriangle].material;
+        hitRecord.t = closestT;
+        hitRecord.sphereIndex = -1;
+        hitRecord.triangleIndex = closestTriangle;
+        hitRecord.barycentrics = closestBarycentrics;
+        return true;
+    }
+    return false;
+}
+
+// The materials are shaded without the textures that are not resident yet
+bool isTextureResident(int texture) {
+    return texture >= 0 && uint(texture) < frame.residentTextures;
+}
+
+bool hasTextures(Material material) {
+    return isTextureResident(material.albedoTexture) || isTextureResident(material.roughnessMetallicTexture) || isTextureResident(material.normalTexture);
+}
+
+// Texture coordinates of the hit, the tangent frame they vary along, and the log2 of the texture area per world
+// area which scales the footprint of the ray cones (Akenine-Moller et al. 2021)
+void computeTextureFrame(inout HitRecord hitRecord) {
+    vec3 N = normalize(hitRecord.normal);
+    vec3 tangent;
+    vec3 bitangent;
+
+    if (hitRecord.sphereIndex >= 0) {
+        // Longitude and colatitude, as in the tessellation of Sphere::sphereGeometry
+        float phi = atan(N.y, N.x);
+        hitRecord.uv = vec2((phi < 0.0 ? phi + 2.0 * PI : phi) / (2.0 * PI), acos(clamp(N.z, -1.0, 1.0)) / PI);
+        tangent = vec3(-N.y, N.x, 0.0);
+        bitangent = cross(tangent, N);
+
+        // The whole texture covers the sphere, its stretching towards the poles is ignored
+        float radius = sphereBuffer.spheres[hitRecord.sphereIndex].radius;
+        hitRecord.lodBase = 0.5 * log2(1.0 / (4.0 * PI * radius * radius));
+    } else {
+        Triangle triangle = trianglesBuffer.triangles[hitRecord.triangleIndex];
+        vec2 b = hitRecord.barycentrics;
+        hitRecord.uv = (1.0 - b.x - b.y) * triangle.v0.uv + b.x * triangle.v1.uv + b.y * triangle.v2.uv;
+
+        vec3 edge1 = triangle.v1.position - triangle.v0.position;
+        vec3 edge2 = triangle.v2.position - triangle.v0.position;
+        vec2 deltaUV1 = triangle.v1.uv - triangle.v0.uv;
+        vec2 deltaUV2 = triangle.v2.uv - triangle.v0.uv;
+        float determinant = deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x;
+
+        hitRecord.lodBase = 0.5 * log2(max(abs(determinant), 1e-12) / max(length(cross(edge1, edge2)), 1e-12));
+        if (abs(determinant) > 1e-12) {
+            tangent = (edge1 * deltaUV2.y - edge2 * deltaUV1.y) / determinant;
+            bitangent = (edge2 * deltaUV1.x - edge1 * deltaUV2.x) / determinant;
+        } else {
+            tangent = vec3(0.0);
+            bitangent = vec3(0.0);
+        }
+    }
+
+    // Orthonormalized against the shading normal, the bitangent keeps the handedness of the texture coordinates
+    vec3 T = tangent - N * dot(N, tangent);
+    if (dot(T, T) < 1e-12) {
+        vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+        T = cross(up, N);
+    }
+    T = normalize(T);
+    vec3 B = cross(N, T);
+    hitRecord.tangent = T;
+    hitRecord.bitangent = dot(B, bitangent) < 0.0 ? -B : B;
+}
+
+// Spread angle of the cone of a primary ray, the angle a pixel subtends
+float pixelSpreadAngle() {
+    return atan(2.0 * tan(radians(frame.camera.fov) / 2.0) / frame.viewportSize.y);
+}
+
+// Only one pixel of each 8x8 tile writes the texture feedback, a different one every frame, so the atomics stay
+// cheap and the streaming still sees every surface within 64 frames
+bool writeTextureFeedback = false;
+
+// lod is the log2 of the footprint of the cone in texture space, the size of each texture turns it into a level.
+// The size is the one of the finest resident level when the texture is streamed.
+vec4 sampleTexture(int index, vec2 uv, float lod) {
+    if (writeTextureFeedback) {
+        atomicMax(textureFeedback.requests[index], uint(clamp(-lod, 0.0, 63.0) * TEXTURE_FEEDBACK_SCALE) + 1u);
+    }
+    vec2 size = vec2(textureSize(textures[nonuniformEXT(index)], 0));
+    return textureLod(textures[nonuniformEXT(index)], uv, lod + 0.5 * log2(size.x * size.y));
+}
+
+// Replaces the albedo, roughness, metallic and shading normal of the hit by their textured values, coneWidth is
+// the width of the ray cone at the hit
+void applyTextures(inout HitRecord hitRecord, float coneWidth, vec3 rayDirection) {
+    computeTextureFrame(hitRecord);
+
+    // The footprint grows as the surface turns away from the ray
+    vec3 N = normalize(hitRecord.normal);
+    float lod = hitRecord.lodBase + log2(max(coneWidth, 1e-8) / max(abs(dot(N, rayDirection)), 1e-4));
+
+    if (isTextureResident(hitRecord.material.albedoTexture)) {
+        hitRecord.material.albedo *= sampleTexture(hitRecord.material.albedoTexture, hitRecord.uv, lod).rgb;
+    }
+    if (isTextureResident(hitRecord.material.roughnessMetallicTexture)) {
+        vec4 roughnessMetallic = sampleTexture(hitRecord.material.roughnessMetallicTexture, hitRecord.uv, lod);
+        hitRecord.material.roughness *= roughnessMetallic.g;
+        hitRecord.material.metallic *= roughnessMetallic.b;
+    }
+    if (isTextureResident(hitRecord.material.normalTexture)) {
+        // Z is rebuilt from X and Y, the block compressed normal maps only store those two
+        vec2 tangentXY = sampleTexture(hitRecord.material.normalTexture, hitRecord.uv, lod).xy * 2.0 - 1.0;
+        vec3 tangentNormal = vec3(tangentXY, sqrt(max(1.0 - dot(tangentXY, tangentXY), 0.0)));
+        hitRecord.normal = normalize(tangentNormal.x * hitRecord.tangent + tangentNormal.y * hitRecord.bitangent + tangentNormal.z * N);
+    }
 }
 
 void main() {
     vec3 color = vec3(0.0);
+    uvec2 feedbackPixel = uvec2(gl_FragCoord.xy) & 7u;
+    writeTextureFeedback = feedbackPixel.x + 8u * feedbackPixel.y == frame.frameIndex % 64u;
 
-    for (int sampleIndex = 0; sampleIndex < SAMPLES; ++sampleIndex) {
-        Ray ray = getCameraRay(fragUV, sampleIndex);
-        vec3 throughput = vec3(1.0);
+    // Background values for the feature buffers, kept if the primary ray misses
+    vec3 primaryAlbedo = vec3(0.0);
+    vec3 primaryNormal = vec3(0.0);
+    float primaryDepth = frame.camera.farPlane;
+    vec3 primaryPosition = frame.camera.position + getCameraRay(fragUV, 0).direction * frame.camera.farPlane;
 
-        for (int bounce = 0; bounce < BOUNCES; ++bounce) {
+    for (int sampleIndex = 0; sampleIndex < int(frame.samples); ++sampleIndex) {
+        Ray ray = getCameraRay(fragUV, sampleIndex);
+        Spectrum throughput = Spectrum(1.0);
+        Spectrum radiance = Spectrum(0.0);
+        // Ray cone selecting the mip levels of the textures, it starts as the footprint of the pixel and each
+        // bounce widens it by the roughness of the surface
+        float coneWidth = 0.0;
+        float coneSpread = pixelSpreadAngle();
+#ifdef SPECTRAL
+        sampleWavelengths(rand(fragUV + vec2(float(sampleIndex) * 0.1031, 0.7), frameSeed()));
+#endif
+
+        for (int bounce = 0; bounce < int(frame.bounces); ++bounce) {
             HitRecord hitRecord;
+            RAY_STAT(statPrimaryRays, bounce == 0 ? 1u : 0u);
+            RAY_STAT(statBounceRays, bounce == 0 ? 0u : 1u);
             if (traceRay(ray, hitRecord)) {
-                color += throughput * hitRecord.material.emission * hitRecord.material.emissionStrength;
+                coneWidth += coneSpread * hitRecord.t;
+                // Ray offsets keep the interpolated normal, a normal map may tilt the shading one below the surface
+                vec3 offsetNormal = normalize(hitRecord.normal);
+                if (hasTextures(hitRecord.material)) {
+                    applyTextures(hitRecord, coneWidth, ray.direction);
+                }
+
+                if (sampleIndex == 0 && bounce == 0) {
+                    primaryAlbedo = hitRecord.material.albedo;
+                    primaryNormal = normalize(hitRecord.normal);
+                    primaryDepth = dot(hitRecord.position - frame.camera.position, frame.camera.front);
+                    primaryPosition = hitRecord.position;
+                }
+
+                radiance += throughput * toSpectrum(hitRecord.material.emission) * hitRecord.material.emissionStrength;
+                Spectrum albedo = toSpectrum(hitRecord.material.albedo);
 
                 vec3 N = normalize(hitRecord.normal);
                 vec3 V = normalize(-ray.direction);
+                float seed = float(sampleIndex * int(frame.bounces) + bounce);
+
+                // The dielectric BSDF is picked with the probability given by the transparency of the material
+                int materialClass = MATERIAL_OPAQUE;
+                if (hitRecord.material.transparency > 0.0 &&
+                    (hitRecord.material.transparency >= 1.0 || random2(seed + 0.25).x < hitRecord.material.transparency)) {
+                    materialClass = hitRecord.material.roughness < SMOOTH_ROUGHNESS ? MATERIAL_SMOOTH_DIELECTRIC : MATERIAL_ROUGH_DIELECTRIC;
+                }
 
-                int numLights = lightBuffer.lights.length();
+                // A smooth dielectric only scatters in delta directions, no light is hit by a shadow ray
+                int numLights = materialClass == MATERIAL_SMOOTH_DIELECTRIC ? 0 : int(frame.lightCount);
                 for (int i = 0; i < numLights; ++i) {
                     Light light = lightBuffer.lights[i];
                     vec3 L = normalize(light.position - hitRecord.position);
@@ -323,38 +952,62 @@ void main() {
                     float attenuation = 1.0 / (distance * distance);
 
                     Ray shadowRay;
-                    shadowRay.origin = hitRecord.position + N * 0.001;
+                    shadowRay.origin = hitRecord.position + offsetNormal * 0.001;
                     shadowRay.direction = L;
 
                     HitRecord shadowHit;
+                    RAY_STAT(statShadowRays, 1u);
                     if (!traceRay(shadowRay, shadowHit) || length(shadowHit.position - hitRecord.position) > distance) {
-                        vec3 BRDF = computeBRDF(hitRecord.material, N, V, L);
+                        Spectrum BRDF = materialClass == MATERIAL_OPAQUE
+                            ? computeBRDF(hitRecord.material, albedo, N, V, L)
+                            : evaluateRoughDielectricReflection(hitRecord.material, N, V, L);
 
                         float NdotL = max(dot(N, L), 0.0);
 
-                        vec3 radiance = light.color * light.intensity * attenuation;
-                        color += throughput * BRDF * radiance * NdotL;
+                        Spectrum lightRadiance = toSpectrum(light.color) * light.intensity * attenuation;
+                        radiance += throughput * BRDF * lightRadiance * NdotL;
                     }
                 }
 
-                vec3 randomDir = sampleHemisphere(N, float(sampleIndex * BOUNCES + bounce));
-
-                ray.origin = hitRecord.position + N * 0.001;
-                ray.direction = randomDir;
-
-                float NdotRandomDir = max(dot(N, randomDir), 0.0);
-                float pdf = NdotRandomDir / PI;
-
-                vec3 BRDF = computeBRDF(hitRecord.material, N, V, randomDir);
+                vec3 direction;
+                Spectrum weight;
+                bool sampled;
+                if (materialClass == MATERIAL_OPAQUE) {
+                    sampled = sampleOpaque(hitRecord.material, albedo, N, V, seed, direction, weight);
+                } else {
+                    sampled = sampleDielectric(hitRecord.material, N, V, materialClass == MATERIAL_ROUGH_DIELECTRIC, seed, direction, weight);
+                }
+                if (!sampled) {
+                    break;
+                }
 
-                throughput *= BRDF * NdotRandomDir / pdf;
+                // Offset to the side the path continues on, inside the object for a transmission
+                ray.origin = hitRecord.position + offsetNormal * (dot(direction, offsetNormal) > 0.0 ? 0.001 : -0.001);
+                ray.direction = direction;
+                throughput *= weight;
+                // Smooth dielectrics keep the cone as it is, the rougher the lobe the wider the cone
+                if (materialClass != MATERIAL_SMOOTH_DIELECTRIC) {
+                    float roughness = max(hitRecord.material.roughness, MIN_ROUGHNESS);
+                    coneSpread += 2.0 * roughness * roughness;
+                }
             } else {
                 break;
             }
         }
+
+        color += spectrumToRGB(radiance);
     }
 
-    color /= float(SAMPLES);
-    color = pow(color, vec3(1.0 / 2.6));
+    // The radiance stays linear here, it is tone mapped by tonemap_comp.glsl once the image is denoised
+    color /= float(frame.samples);
     outColor = vec4(color, 1.0);
+    outAlbedo = vec4(primaryAlbedo, 1.0);
+    outNormalDepth = vec4(primaryNormal, primaryDepth);
+
+    vec3 previous = projectToPreviousFrame(primaryPosition);
+    outMotion = vec4(previous.xy - fragUV, previous.z, 0.0);
+
+#ifdef RAY_STATS
+    writeRayStatistics();
+#endif
 }
\ No newline at end of file
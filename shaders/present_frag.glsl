@@ -0,0 +1,28 @@
+#version 450
+
+// Draws the tone mapped image, or the ray statistics heat map, on the swapchain image, bilinearly upscaling it
+// when the trace pass rendered at a lower resolution. Both are display linear, the sRGB swapchain encodes them.
+
+layout(set = 0, binding = 0) uniform sampler2D displayImage;
+
+layout(push_constant) uniform PresentPushConstants {
+    // Fraction of the radiance image covered by the rendered region
+    vec2 uvScale;
+    // Last texel center of the rendered region, so the filter does not read past it
+    vec2 uvMax;
+    // Set when the swapchain format is not sRGB, which then stores the values written as they are
+    int encodeSrgb;
+} pushConstants;
+
+layout(location = 0) in vec2 fragUV;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    vec2 uv = min(fragUV * pushConstants.uvScale, pushConstants.uvMax);
+    vec3 color = texture(displayImage, uv).rgb;
+    if (pushConstants.encodeSrgb != 0) {
+        color = mix(12.92 * color, 1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055, greaterThan(color, vec3(0.0031308)));
+    }
+    outColor = vec4(color, 1.0);
+}
@@ -0,0 +1,55 @@
+#version 450
+
+// Heat map of the per pixel counters written by the instrumented trace pass (frag_raystats.spv).
+// Shown by the present pass instead of the radiance when selected in the UI.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// x rays (primary and bounce), y shadow rays, z triangle tests, w sphere tests
+layout(set = 0, binding = 1, rgba32ui) uniform readonly uimage2D rayCounts;
+layout(set = 0, binding = 2, rgba32f) uniform writeonly image2D heatmap;
+// BVH nodes visited
+layout(set = 0, binding = 3, r32ui) uniform readonly uimage2D rayNodeVisits;
+
+layout(push_constant) uniform HeatmapPushConstants {
+    // 0 to 3 one counter, 4 all rays, 5 all intersection tests, 6 BVH node visits
+    int channel;
+    // Count mapped to the top of the color scale
+    float maxValue;
+    ivec2 renderSize;
+} pushConstants;
+
+// Blue, cyan, green, yellow, red
+vec3 heatColor(float t) {
+    t = clamp(t, 0.0, 1.0);
+    return clamp(vec3(1.5 - abs(4.0 * t - 3.0), 1.5 - abs(4.0 * t - 2.0), 1.5 - abs(4.0 * t - 1.0)), 0.0, 1.0);
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (pixel.x >= pushConstants.renderSize.x || pixel.y >= pushConstants.renderSize.y) {
+        return;
+    }
+
+    uvec4 counts = imageLoad(rayCounts, pixel);
+
+    float value;
+    if (pushConstants.channel == 4) {
+        value = float(counts.x + counts.y);
+    }
+    else if (pushConstants.channel == 5) {
+        value = float(counts.z + counts.w);
+    }
+    else if (pushConstants.channel == 6) {
+        value = float(imageLoad(rayNodeVisits, pixel).x);
+    }
+    else {
+        value = float(counts[clamp(pushConstants.channel, 0, 3)]);
+    }
+
+    // Logarithmic, so the few pixels with the most work do not flatten the rest of the image
+    float t = log2(1.0 + value) / log2(1.0 + max(pushConstants.maxValue, 1.0));
+
+    // Presented as is, without tone mapping: decode the sRGB colors of the scale, the swapchain encodes them
+    imageStore(heatmap, pixel, vec4(pow(heatColor(t), vec3(2.2)), 1.0));
+}
@@ -0,0 +1,90 @@
+#version 450
+
+// Tone mapping of the linear radiance produced by the trace, denoise or accumulate passes.
+// Applies the exposure and white balance, then the curve of the operator, and writes display linear colors
+// that present_frag.glsl encodes to sRGB. Must match ToneMapping.h.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0, rgba32f) uniform readonly image2D radianceImage;
+layout(set = 0, binding = 1, rgba16f) uniform writeonly image2D tonemapOutput;
+
+layout(push_constant) uniform TonemapPushConstants {
+    // Exposure and white balance, the columns of a 3x3 matrix
+    vec4 colorTransform[3];
+    ivec2 renderSize;
+    int operatorIndex;
+} pushConstants;
+
+const int OPERATOR_ACES = 0;
+const int OPERATOR_AGX = 1;
+const int OPERATOR_FILMIC = 2;
+
+// Fit of the ACES reference rendering and sRGB output transforms by Stephen Hill
+vec3 aces(vec3 color) {
+    const mat3 inputMatrix = mat3(
+        0.59719, 0.07600, 0.02840,
+        0.35458, 0.90834, 0.13383,
+        0.04823, 0.01566, 0.83777);
+    const mat3 outputMatrix = mat3(
+        1.60475, -0.10208, -0.00327,
+        -0.53108, 1.10813, -0.07276,
+        -0.07367, -0.00605, 1.07602);
+    vec3 v = inputMatrix * color;
+    vec3 a = v * (v + 0.0245786) - 0.000090537;
+    vec3 b = v * (0.983729 * v + 0.4329510) + 0.238081;
+    return outputMatrix * (a / b);
+}
+
+// Polynomial fit of the default AgX contrast curve over its log2 encoding
+vec3 agx(vec3 color) {
+    const mat3 inset = mat3(
+        0.842479062253094, 0.0423282422610123, 0.0423756549057051,
+        0.0784335999999992, 0.878468636469772, 0.0784336,
+        0.0792237451477643, 0.0791661274605434, 0.879142973793104);
+    const mat3 outset = mat3(
+        1.19687900512017, -0.0528968517574562, -0.0529716355144438,
+        -0.0980208811401368, 1.15190312990417, -0.0980434501171241,
+        -0.0990297440797205, -0.0989611768448433, 1.15107367264116);
+    const float minEv = -12.47393;
+    const float maxEv = 4.026069;
+
+    vec3 x = inset * color;
+    x = clamp(log2(max(x, vec3(1e-10))), minEv, maxEv);
+    x = (x - minEv) / (maxEv - minEv);
+    vec3 x2 = x * x;
+    vec3 x4 = x2 * x2;
+    x = 15.5 * x4 * x2 - 40.14 * x4 * x + 31.96 * x4 - 6.868 * x2 * x + 0.4298 * x2 + 0.1191 * x - 0.00232;
+    // The curve ends in a 2.2 gamma encoding
+    return pow(max(outset * x, vec3(0.0)), vec3(2.2));
+}
+
+vec3 hableCurve(vec3 x) {
+    const float a = 0.15, b = 0.50, c = 0.10, d = 0.20, e = 0.02, f = 0.30;
+    return (x * (a * x + c * b) + d * e) / (x * (a * x + b) + d * f) - e / f;
+}
+
+// Curve of John Hable, white at 11.2 after doubling the exposure
+vec3 filmic(vec3 color) {
+    return hableCurve(2.0 * color) / hableCurve(vec3(11.2));
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (pixel.x >= pushConstants.renderSize.x || pixel.y >= pushConstants.renderSize.y) {
+        return;
+    }
+
+    mat3 colorTransform = mat3(pushConstants.colorTransform[0].xyz, pushConstants.colorTransform[1].xyz, pushConstants.colorTransform[2].xyz);
+    vec3 color = max(colorTransform * imageLoad(radianceImage, pixel).rgb, vec3(0.0));
+
+    if (pushConstants.operatorIndex == OPERATOR_ACES) {
+        color = aces(color);
+    } else if (pushConstants.operatorIndex == OPERATOR_AGX) {
+        color = agx(color);
+    } else if (pushConstants.operatorIndex == OPERATOR_FILMIC) {
+        color = filmic(color);
+    }
+
+    imageStore(tonemapOutput, pixel, vec4(clamp(color, 0.0, 1.0), 1.0));
+}
@@ -0,0 +1,94 @@
+#include "AnimationRenderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+#include "application/CameraPath.h"
+#include "scene/Scene.h"
+#include "scene/SceneFile.h"
+#include "vulkan/VkRenderer.h"
+
+void AnimationRenderer::run(const RenderConfig& config, const Settings& settings) {
+    CameraPath cameraPath = CameraPath::load(settings.m_cameraPath);
+    uint32_t frameCount = cameraPath.getFrameCount();
+    std::string outputDirectory = config.m_outputPath.empty() ? "frames" : config.m_outputPath;
+    std::filesystem::create_directories(outputDirectory);
+
+    VkRenderer renderer;
+    renderer.setWorkerCount(config.m_threads);
+    renderer.setCaptureWorkerCount(settings.m_encodeWorkers);
+    renderer.setProfiling(config.m_gpuTimestamps, config.m_profileCsvPath);
+    renderer.setTraceSettings(config.m_passSamples, config.m_bounces);
+    renderer.initHeadless(config.m_width, config.m_height, config.m_scenePath.empty() ? Scene::cornellBox() : SceneFile::read(config.m_scenePath));
+
+    // The tiled mode accumulates the raw radiance, the denoiser only applies to single pass frames
+    bool tiled = config.m_samples > renderer.getSamplesPerFrame();
+    renderer.setTiledRendering(tiled, config.m_samples);
+    renderer.setDenoiseEnabled(settings.m_denoise && !tiled);
+
+    std::cout << "Rendering " << frameCount << " frames of " << settings.m_cameraPath << " at " << config.m_width << "x" << config.m_height
+              << ", " << config.m_samples << " spp, on " << renderer.getDeviceName() << std::endl;
+
+    double renderTime = 0.0;
+    double maxFrameTime = 0.0;
+    double gpuTime = 0.0;
+    uint64_t submissions = 0;
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+        cameraPath.applyFrame(frame, renderer.getRendererCamera());
+
+        char fileName[64];
+        std::snprintf(fileName, sizeof(fileName), "frame_%05u.%s", frame, ImageWriter::extension(settings.m_format));
+        std::string path = (std::filesystem::path(outputDirectory) / fileName).string();
+
+        // Moving the camera restarts the tiled accumulation, which then runs until every tile is done. Every
+        // frame is written, so the capture waits for a slot when the readbacks or the encoders fall behind.
+        auto frameStart = std::chrono::high_resolution_clock::now();
+        if (tiled) {
+            do {
+                renderer.renderHeadlessFrame();
+                gpuTime += renderer.getTraceGpuTime();
+                ++submissions;
+            } while (!renderer.isTiledRenderComplete());
+
+            // The last tile is already submitted, one more frame records no tile and only carries the capture
+            renderer.requestCapture(path, settings.m_format, true);
+            renderer.renderHeadlessFrame();
+        }
+        else {
+            renderer.requestCapture(path, settings.m_format, true);
+            renderer.renderHeadlessFrame();
+            gpuTime += renderer.getTraceGpuTime() + (settings.m_denoise ? renderer.getDenoiseGpuTime() : 0.0f);
+            ++submissions;
+        }
+        double frameTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count();
+        renderTime += frameTime;
+        maxFrameTime = std::max(maxFrameTime, frameTime);
+
+        std::cout << "Frame " << frame + 1 << "/" << frameCount << ": " << fileName << std::endl;
+    }
+
+    renderer.finishCaptures();
+    auto endTime = std::chrono::high_resolution_clock::now();
+
+    bool gpuTimings = renderer.isProfilerAvailable();
+    VkRenderer::CaptureStatistics captureStatistics = renderer.getCaptureStatistics();
+    renderer.cleanupVulkan();
+
+    double totalTime = std::chrono::duration<double>(endTime - startTime).count();
+    double frames = static_cast<double>(frameCount);
+    const FrameEncoder::Statistics& statistics = captureStatistics.m_encoder;
+
+    std::cout << "Rendered " << frameCount << " frames in " << totalTime << " s: " << (totalTime > 0.0 ? frames * 60.0 / totalTime : 0.0) << " frames/min" << std::endl;
+    std::cout << "  render:   " << renderTime / frames << " ms/frame (max " << maxFrameTime << " ms) over " << submissions << " submissions";
+    if (gpuTimings) {
+        std::cout << ", " << gpuTime / frames << " ms/frame on the GPU";
+    }
+    std::cout << std::endl;
+    std::cout << "  encode:   " << statistics.m_encodeTime / frames << " ms/frame (max " << statistics.m_maxEncodeTime << " ms)" << std::endl;
+    std::cout << "  the render loop waited " << captureStatistics.m_slotWaitTime << " ms for a readback slot" << std::endl;
+}
@@ -0,0 +1,28 @@
+#ifndef ANIMATION_RENDERER_H
+#define ANIMATION_RENDERER_H
+
+#include <cstdint>
+#include <string>
+
+#include "application/RenderConfig.h"
+#include "io/ImageWriter.h"
+
+// Renders every frame of a camera path headlessly and writes them to disk through the captures of the renderer.
+// The readback of a frame overlaps with the rendering of the next one, and its encoding runs on worker threads.
+class AnimationRenderer {
+public:
+	// On top of the render configuration, whose output is the directory the frames go to, frames when empty.
+	// Above the samples of one trace pass, frames are rendered with the tiled progressive mode.
+	struct Settings {
+		std::string m_cameraPath;
+		ImageWriter::Format m_format = ImageWriter::Format::Png;
+		bool m_denoise = false;
+		// Half of the threads of the configuration when 0
+		unsigned int m_encodeWorkers = 0;
+	};
+
+	// Throws std::runtime_error on a failed frame write or a Vulkan error, the configuration is already validated
+	static void run(const RenderConfig& config, const Settings& settings);
+};
+
+#endif
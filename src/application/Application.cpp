@@ -1,6 +1,8 @@
 #include "Application.h"
 
-Application::Application() {
+#include "scene/SceneFile.h"
+
+Application::Application(const RenderConfig& config) : m_config(config) {
 	initGlfw();
 	initVulkanCtx(m_window);
 }
@@ -31,7 +33,7 @@ void Application::initGlfw() {
 		throw std::runtime_error("GLFW: Vulkan not supported!");
 	}
 
-	m_window = glfwCreateWindow(Config::INIT_WINDOW_WIDTH, Config::INIT_WINDOW_HEIGHT, "Raytracer", nullptr, nullptr);
+	m_window = glfwCreateWindow(static_cast<int>(m_config.m_width), static_cast<int>(m_config.m_height), "Raytracer", nullptr, nullptr);
 
 	// Add a pointer that allows GLFW to reference our instance
 	glfwSetWindowUserPointer(m_window, this);
@@ -50,7 +52,26 @@ void Application::initGlfw() {
 	}
 }
 
-void Application::initVulkanCtx(GLFWwindow* window) { m_vulkanCtx.initVulkan(window); }
+void Application::initVulkanCtx(GLFWwindow* window) {
+	m_vulkanCtx.setWorkerCount(m_config.m_threads);
+	if (!m_config.m_outputPath.empty()) {
+		m_vulkanCtx.setCaptureDirectory(m_config.m_outputPath);
+	}
+	m_vulkanCtx.setProfiling(m_config.m_gpuTimestamps, m_config.m_profileCsvPath);
+	m_vulkanCtx.setTraceSettings(m_config.m_passSamples, m_config.m_bounces);
+	if (m_config.m_samples > m_config.m_passSamples) {
+		m_vulkanCtx.setTiledRendering(true, m_config.m_samples);
+	}
+	if (m_config.m_scenePath.empty()) {
+		m_vulkanCtx.initVulkan(window, Scene::cornellBox());
+		return;
+	}
+
+	// The window opens on an empty scene, the file is read and uploaded while the frames keep coming
+	m_vulkanCtx.initVulkan(window, Scene{});
+	std::string scenePath = m_config.m_scenePath;
+	m_vulkanCtx.loadScene([scenePath]() { return SceneFile::read(scenePath); });
+}
 
 void Application::cleanupVulkan() {
 	m_vulkanCtx.cleanupVulkan();
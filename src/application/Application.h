@@ -9,13 +9,14 @@
 #include <iostream>
 #include <stdexcept>
 
+#include "application/RenderConfig.h"
 #include "vulkan/VkRenderer.h"
-#include "globals/globals.h"
 
 class Application
 {
 public:
-    Application();
+    // The configuration must be validated, see RenderConfig::parse
+    explicit Application(const RenderConfig& config);
     ~Application();
 
     GLFWwindow *m_window;
@@ -33,6 +34,8 @@ public:
     double m_lastMouseY = 0.0;
 
 private:
+    RenderConfig m_config;
+
     void initGlfw();
     void initVulkanCtx(GLFWwindow *window);
 
@@ -45,9 +48,6 @@ inline static void framebufferResizeCallback(GLFWwindow *window, int width, int
     auto app = reinterpret_cast<Application *>(glfwGetWindowUserPointer(window));
     app->m_framebufferResized = true;
     app->m_vulkanCtx.m_framebufferResized = true;
-
-    Config::INIT_WINDOW_WIDTH = width;
-    Config::INIT_WINDOW_HEIGHT = height;
 }
 
 inline static void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
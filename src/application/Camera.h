@@ -1,3 +1,6 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -89,4 +92,6 @@ struct Camera
         m_cameraUBO.m_lookAt = m_cameraUBO.m_position + direction;
         updateCameraVectors();
     }
-};
\ No newline at end of file
+};
+
+#endif
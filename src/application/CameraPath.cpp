@@ -0,0 +1,124 @@
+#include "CameraPath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "io/Json.h"
+
+namespace {
+
+    glm::vec3 readVector(const JsonValue& keyframe, const std::string& key) {
+        const JsonValue& value = keyframe[key];
+        if (!value.isArray() || value.size() != 3) {
+            throw std::runtime_error("Camera path: \"" + key + "\" must be an array of 3 numbers");
+        }
+        return glm::vec3(value[0].asNumber(), value[1].asNumber(), value[2].asNumber());
+    }
+
+    // Uniform Catmull-Rom segment between p1 and p2
+    glm::vec3 catmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t) {
+        float t2 = t * t;
+        float t3 = t2 * t;
+        return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+    }
+
+}
+
+CameraPath CameraPath::load(const std::string& path) {
+    JsonValue document = JsonValue::parseFile(path);
+
+    CameraPath cameraPath;
+    cameraPath.m_fps = static_cast<float>(document.getNumber("fps", 24.0));
+    if (cameraPath.m_fps <= 0.0f) {
+        throw std::runtime_error("Camera path: fps must be positive");
+    }
+
+    std::string interpolation = document.getString("interpolation", "catmull_rom");
+    if (interpolation == "linear") {
+        cameraPath.m_interpolation = Interpolation::Linear;
+    }
+    else if (interpolation == "catmull_rom") {
+        cameraPath.m_interpolation = Interpolation::CatmullRom;
+    }
+    else {
+        throw std::runtime_error("Camera path: unknown interpolation " + interpolation);
+    }
+
+    const JsonValue& keyframes = document["keyframes"];
+    if (!keyframes.isArray() || keyframes.size() == 0) {
+        throw std::runtime_error("Camera path: \"keyframes\" must be a non empty array");
+    }
+
+    float fov = 45.0f;
+    for (size_t i = 0; i < keyframes.size(); ++i) {
+        Keyframe keyframe;
+        keyframe.m_time = static_cast<float>(keyframes[i]["time"].asNumber());
+        keyframe.m_position = readVector(keyframes[i], "position");
+        keyframe.m_lookAt = readVector(keyframes[i], "lookAt");
+        fov = static_cast<float>(keyframes[i].getNumber("fov", fov));
+        keyframe.m_fov = fov;
+
+        if (!cameraPath.m_keyframes.empty() && keyframe.m_time <= cameraPath.m_keyframes.back().m_time) {
+            throw std::runtime_error("Camera path: keyframe times must increase");
+        }
+        if (glm::length(keyframe.m_lookAt - keyframe.m_position) <= 0.0f) {
+            throw std::runtime_error("Camera path: a keyframe looks at its own position");
+        }
+        cameraPath.m_keyframes.push_back(keyframe);
+    }
+
+    return cameraPath;
+}
+
+uint32_t CameraPath::getFrameCount() const {
+    return static_cast<uint32_t>(std::floor(getDuration() * m_fps + 1e-3f)) + 1;
+}
+
+CameraPath::Keyframe CameraPath::evaluate(float time) const {
+    if (m_keyframes.size() == 1 || time <= m_keyframes.front().m_time) {
+        return m_keyframes.front();
+    }
+    if (time >= m_keyframes.back().m_time) {
+        return m_keyframes.back();
+    }
+
+    // First keyframe after time, the segment goes from the one before it
+    auto next = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), time, [](float t, const Keyframe& keyframe) { return t < keyframe.m_time; });
+    size_t i2 = static_cast<size_t>(next - m_keyframes.begin());
+    size_t i1 = i2 - 1;
+
+    const Keyframe& k1 = m_keyframes[i1];
+    const Keyframe& k2 = m_keyframes[i2];
+    float t = (time - k1.m_time) / (k2.m_time - k1.m_time);
+
+    Keyframe result;
+    result.m_time = time;
+    result.m_fov = glm::mix(k1.m_fov, k2.m_fov, t);
+
+    if (m_interpolation == Interpolation::Linear) {
+        result.m_position = glm::mix(k1.m_position, k2.m_position, t);
+        result.m_lookAt = glm::mix(k1.m_lookAt, k2.m_lookAt, t);
+    }
+    else {
+        // The end keyframes are repeated so the curve still passes through them
+        const Keyframe& k0 = m_keyframes[i1 > 0 ? i1 - 1 : i1];
+        const Keyframe& k3 = m_keyframes[std::min(i2 + 1, m_keyframes.size() - 1)];
+        result.m_position = catmullRom(k0.m_position, k1.m_position, k2.m_position, k3.m_position, t);
+        result.m_lookAt = catmullRom(k0.m_lookAt, k1.m_lookAt, k2.m_lookAt, k3.m_lookAt, t);
+    }
+
+    return result;
+}
+
+CameraPath::Keyframe CameraPath::evaluateFrame(uint32_t frame) const {
+    return evaluate(m_keyframes.front().m_time + static_cast<float>(frame) / m_fps);
+}
+
+void CameraPath::applyFrame(uint32_t frame, Camera& camera) const {
+    Keyframe keyframe = evaluateFrame(frame);
+    camera.m_cameraUBO.m_position = keyframe.m_position;
+    camera.m_cameraUBO.m_lookAt = keyframe.m_lookAt;
+    camera.m_cameraUBO.m_fov = keyframe.m_fov;
+    camera.updateCameraVectors();
+}
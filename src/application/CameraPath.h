@@ -0,0 +1,54 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include "application/Camera.h"
+
+// Camera animation read from a JSON keyframe file, for turntables and fly-throughs rendered offline:
+//
+//   {
+//     "fps": 24,
+//     "interpolation": "catmull_rom",
+//     "keyframes": [
+//       { "time": 0.0, "position": [0, 4, 1], "lookAt": [0, 0, 1], "fov": 45 },
+//       { "time": 2.0, "position": [4, 0, 1], "lookAt": [0, 0, 1] }
+//     ]
+//   }
+//
+// Positions and lookAts map onto Camera::UniformBufferObject, the fov is optional and keeps the value of the
+// previous keyframe. Keyframe times are in seconds and must increase.
+class CameraPath {
+public:
+	enum class Interpolation { Linear, CatmullRom };
+
+	struct Keyframe {
+		float m_time = 0.0f;
+		glm::vec3 m_position{ 0.0f };
+		glm::vec3 m_lookAt{ 0.0f };
+		float m_fov = 45.0f;
+	};
+
+	// Throws std::runtime_error when the file is missing or invalid
+	static CameraPath load(const std::string& path);
+
+	inline float getFramesPerSecond() const { return m_fps; }
+	inline float getDuration() const { return m_keyframes.back().m_time - m_keyframes.front().m_time; }
+	// Both ends of the path are rendered
+	uint32_t getFrameCount() const;
+
+	Keyframe evaluate(float time) const;
+	Keyframe evaluateFrame(uint32_t frame) const;
+	// Writes the pose of a frame into the camera, the other parameters of the camera are kept
+	void applyFrame(uint32_t frame, Camera& camera) const;
+
+private:
+	float m_fps = 24.0f;
+	Interpolation m_interpolation = Interpolation::CatmullRom;
+	std::vector<Keyframe> m_keyframes;
+};
+
+#endif
@@ -0,0 +1,230 @@
+#include "RenderConfig.h"
+
+#include <cmath>
+#include <filesystem>
+#include <stdexcept>
+
+#include "vulkan/VkRenderer.h"
+
+namespace {
+
+    std::string nextValue(int argc, char** argv, int& i) {
+        if (i + 1 >= argc) {
+            throw std::runtime_error(std::string("Missing value for ") + argv[i]);
+        }
+        return argv[++i];
+    }
+
+    // Whole numbers only, the range is checked by validate
+    long long readInteger(const JsonValue& value, const std::string& key) {
+        double number = value.asNumber();
+        if (number != std::floor(number) || std::abs(number) > 1e15) {
+            throw std::runtime_error("Config: \"" + key + "\" must be an integer");
+        }
+        return static_cast<long long>(number);
+    }
+
+    uint32_t readCount(const JsonValue& value, const std::string& key) {
+        long long number = readInteger(value, key);
+        if (number < 0 || number > UINT32_MAX) {
+            throw std::runtime_error("Config: \"" + key + "\" must not be negative");
+        }
+        return static_cast<uint32_t>(number);
+    }
+
+    int readInt(const std::string& value, const std::string& argument) {
+        size_t end = 0;
+        int number = 0;
+        try {
+            number = std::stoi(value, &end);
+        }
+        catch (const std::exception&) {
+            end = 0;
+        }
+        if (end == 0 || end != value.size()) {
+            throw std::runtime_error("Config: " + argument + " expects an integer, got " + value);
+        }
+        return number;
+    }
+
+    uint32_t readCount(const std::string& value, const std::string& argument) {
+        int number = readInt(value, argument);
+        if (number < 0) {
+            throw std::runtime_error("Config: " + argument + " must not be negative");
+        }
+        return static_cast<uint32_t>(number);
+    }
+
+}
+
+void RenderConfig::parse(int argc, char** argv, int first, const ArgumentHandler& handler) {
+    // The file is read first wherever it is given, so the other arguments override it
+    for (int i = first; i < argc; ++i) {
+        if (std::string(argv[i]) == "--config") {
+            read(JsonValue::parseFile(nextValue(argc, argv, i)));
+        }
+    }
+
+    for (int i = first; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument == "--config") {
+            ++i;
+        }
+        else if (argument == "--width") {
+            m_width = readCount(nextValue(argc, argv, i), argument);
+        }
+        else if (argument == "--height") {
+            m_height = readCount(nextValue(argc, argv, i), argument);
+        }
+        else if (argument == "--samples") {
+            m_samples = readInt(nextValue(argc, argv, i), argument);
+        }
+        else if (argument == "--pass-samples") {
+            m_passSamples = readInt(nextValue(argc, argv, i), argument);
+        }
+        else if (argument == "--bounces") {
+            m_bounces = readInt(nextValue(argc, argv, i), argument);
+        }
+        else if (argument == "--backend") {
+            m_backend = parseBackend(nextValue(argc, argv, i));
+        }
+        else if (argument == "--threads") {
+            m_threads = readCount(nextValue(argc, argv, i), argument);
+        }
+        else if (argument == "--scene") {
+            m_scenePath = nextValue(argc, argv, i);
+        }
+        else if (argument == "--output") {
+            m_outputPath = nextValue(argc, argv, i);
+        }
+        else if (argument == "--no-gpu-timestamps") {
+            m_gpuTimestamps = false;
+        }
+        else if (argument == "--profile-csv") {
+            m_profileCsvPath = nextValue(argc, argv, i);
+        }
+        else if (!handler || !handler(argc, argv, i)) {
+            throw std::runtime_error("Unknown argument " + argument);
+        }
+    }
+
+    validate();
+}
+
+void RenderConfig::read(const JsonValue& json) {
+    if (!json.isObject()) {
+        throw std::runtime_error("Config: the file must hold a JSON object");
+    }
+
+    for (const auto& [key, value] : json.members()) {
+        if (key == "width") {
+            m_width = readCount(value, key);
+        }
+        else if (key == "height") {
+            m_height = readCount(value, key);
+        }
+        else if (key == "samples") {
+            m_samples = static_cast<int>(readCount(value, key));
+        }
+        else if (key == "pass_samples") {
+            m_passSamples = static_cast<int>(readCount(value, key));
+        }
+        else if (key == "bounces") {
+            m_bounces = static_cast<int>(readCount(value, key));
+        }
+        else if (key == "backend") {
+            m_backend = parseBackend(value.asString());
+        }
+        else if (key == "threads") {
+            m_threads = readCount(value, key);
+        }
+        else if (key == "scene") {
+            m_scenePath = value.asString();
+        }
+        else if (key == "output") {
+            m_outputPath = value.asString();
+        }
+        else if (key == "gpu_timestamps") {
+            m_gpuTimestamps = value.asBool();
+        }
+        else if (key == "profile_csv") {
+            m_profileCsvPath = value.asString();
+        }
+        else {
+            throw std::runtime_error("Config: unknown setting \"" + key + "\"");
+        }
+    }
+}
+
+void RenderConfig::validate() const {
+    if (m_width == 0 || m_height == 0 || m_width > m_MAX_RESOLUTION || m_height > m_MAX_RESOLUTION) {
+        throw std::runtime_error("Config: the resolution must be between 1 and " + std::to_string(m_MAX_RESOLUTION) + " pixels per side");
+    }
+    if (m_samples <= 0) {
+        throw std::runtime_error("Config: the sample count must be positive");
+    }
+    if (m_passSamples <= 0 || m_passSamples > VkRenderer::m_MAX_TRACE_SAMPLES) {
+        throw std::runtime_error("Config: the samples of a pass must be between 1 and " + std::to_string(VkRenderer::m_MAX_TRACE_SAMPLES));
+    }
+    if (m_bounces <= 0 || m_bounces > VkRenderer::m_MAX_TRACE_BOUNCES) {
+        throw std::runtime_error("Config: the bounces must be between 1 and " + std::to_string(VkRenderer::m_MAX_TRACE_BOUNCES));
+    }
+    if (m_backend != Backend::Vulkan) {
+        throw std::runtime_error(std::string("Config: the ") + getBackendName(m_backend) + " backend is not available in this build");
+    }
+    if (!m_scenePath.empty() && !std::filesystem::is_regular_file(m_scenePath)) {
+        throw std::runtime_error("Config: scene file " + m_scenePath + " not found");
+    }
+    if (!m_profileCsvPath.empty() && !m_gpuTimestamps) {
+        throw std::runtime_error("Config: the profile CSV needs the GPU timestamps");
+    }
+}
+
+JsonValue RenderConfig::toJson() const {
+    JsonValue json = JsonValue::object();
+    json.set("width", m_width);
+    json.set("height", m_height);
+    json.set("samples", m_samples);
+    json.set("pass_samples", m_passSamples);
+    json.set("bounces", m_bounces);
+    json.set("backend", getBackendName(m_backend));
+    json.set("threads", m_threads);
+    json.set("scene", m_scenePath);
+    json.set("output", m_outputPath);
+    json.set("gpu_timestamps", m_gpuTimestamps);
+    json.set("profile_csv", m_profileCsvPath);
+    return json;
+}
+
+const char* RenderConfig::getUsage() {
+    return "  --config <file>         JSON file with the settings below, overridden by the arguments\n"
+           "  --width <pixels>        render width\n"
+           "  --height <pixels>       render height\n"
+           "  --samples <count>       samples per pixel, above the samples of a pass the tiled mode is used\n"
+           "  --pass-samples <count>  samples per pixel traced by one pass (default 10)\n"
+           "  --bounces <count>       bounces per path (default 8)\n"
+           "  --backend <vulkan|cpu>  renderer backend, only vulkan is available (default vulkan)\n"
+           "  --threads <count>       threads of the BVH refits, texture decoding and encoding (default all cores)\n"
+           "  --scene <file>          binary scene file (default Cornell box)\n"
+           "  --output <path>         where the images are written\n"
+           "  --no-gpu-timestamps     do not measure the GPU time of the passes\n"
+           "  --profile-csv <file>    write the GPU time of every frame as CSV\n";
+}
+
+RenderConfig::Backend RenderConfig::parseBackend(const std::string& name) {
+    if (name == "vulkan") {
+        return Backend::Vulkan;
+    }
+    if (name == "cpu") {
+        return Backend::Cpu;
+    }
+    throw std::runtime_error("Config: unknown backend " + name);
+}
+
+const char* RenderConfig::getBackendName(Backend backend) {
+    switch (backend) {
+    case Backend::Vulkan: return "vulkan";
+    case Backend::Cpu: return "cpu";
+    }
+    return "";
+}
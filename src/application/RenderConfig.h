@@ -0,0 +1,70 @@
+#ifndef RENDER_CONFIG_H
+#define RENDER_CONFIG_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "io/Json.h"
+
+// Settings shared by the viewer and the headless tools, read once at startup from the command line and from an
+// optional JSON file given with --config, whose values the other arguments override:
+//
+//   {
+//     "width": 1920,
+//     "height": 1080,
+//     "samples": 256,
+//     "bounces": 6,
+//     "threads": 8,
+//     "scene": "scenes/sponza.rtsc",
+//     "gpu_timestamps": true,
+//     "profile_csv": "profile.csv"
+//   }
+//
+// Every tool sets its own defaults before parsing. Everything is validated together once read, so an invalid
+// setting fails the startup before a device is created instead of the first frame.
+class RenderConfig {
+public:
+	enum class Backend { Vulkan, Cpu };
+
+	static constexpr uint32_t m_MAX_RESOLUTION = 16384;
+
+	uint32_t m_width = 1280;
+	uint32_t m_height = 720;
+	// Samples per pixel of an image, above m_passSamples images are accumulated over tiled passes
+	int m_samples = 10;
+	// Samples per pixel traced by one draw of the trace pass and bounces of each path
+	int m_passSamples = 10;
+	int m_bounces = 8;
+	// Only the Vulkan backend exists, the CPU one is refused by validate
+	Backend m_backend = Backend::Vulkan;
+	// Threads of the BVH refits, the texture decoding and the frame encoding, all the cores when 0
+	unsigned int m_threads = 0;
+	// Binary scene file, see SceneFile, the Cornell box when empty
+	std::string m_scenePath;
+	// Where the tool writes its images, its own default when empty
+	std::string m_outputPath;
+	// Without timestamps no GPU time is measured, which also disables the dynamic render scale
+	bool m_gpuTimestamps = true;
+	// GPU times of every frame written as CSV, none when empty
+	std::string m_profileCsvPath;
+
+	// Called with the arguments the shared options do not know, at argv[i]. Returns false when the tool does
+	// not know them either, values are consumed by advancing i.
+	using ArgumentHandler = std::function<bool(int argc, char** argv, int& i)>;
+	// Reads the arguments from argv[first] on and validates the result. Throws std::runtime_error on an unknown
+	// argument, an unreadable configuration file or an invalid setting.
+	void parse(int argc, char** argv, int first, const ArgumentHandler& handler);
+	// Members of a JSON object named as in toJson, unknown members are refused
+	void read(const JsonValue& json);
+	// Throws std::runtime_error naming the first invalid setting
+	void validate() const;
+	JsonValue toJson() const;
+
+	// Help of the shared options, one per line
+	static const char* getUsage();
+	static Backend parseBackend(const std::string& name);
+	static const char* getBackendName(Backend backend);
+};
+
+#endif
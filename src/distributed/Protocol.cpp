@@ -0,0 +1,149 @@
+#include "Protocol.h"
+
+#include <stdexcept>
+
+#include "io/ByteStream.h"
+
+namespace {
+
+    constexpr uint32_t g_magic = 0x50445452; // "RTDP"
+
+    // Larger payloads are treated as a corrupted stream rather than allocated
+    constexpr uint64_t g_maxPayloadSize = 1ull << 31;
+
+    struct MessageHeader {
+        uint32_t m_magic;
+        uint32_t m_type;
+        uint64_t m_size;
+    };
+
+}
+
+void Protocol::send(Socket& socket, MessageType type, const std::vector<uint8_t>& payload) {
+    MessageHeader header{ g_magic, static_cast<uint32_t>(type), payload.size() };
+    socket.sendAll(&header, sizeof(header));
+    if (!payload.empty()) {
+        socket.sendAll(payload.data(), payload.size());
+    }
+}
+
+bool Protocol::receive(Socket& socket, Message& message) {
+    MessageHeader header{};
+    if (!socket.receiveAll(&header, sizeof(header))) {
+        return false;
+    }
+    if (header.m_magic != g_magic || header.m_size > g_maxPayloadSize) {
+        throw std::runtime_error("Protocol: invalid message header");
+    }
+
+    message.m_type = static_cast<MessageType>(header.m_type);
+    message.m_payload.resize(header.m_size);
+    if (header.m_size > 0 && !socket.receiveAll(message.m_payload.data(), message.m_payload.size())) {
+        throw std::runtime_error("Protocol: connection closed in the middle of a message");
+    }
+    return true;
+}
+
+Protocol::Message Protocol::expect(Socket& socket, MessageType type) {
+    Message message;
+    if (!receive(socket, message)) {
+        throw std::runtime_error("Protocol: connection closed by the peer");
+    }
+    if (message.m_type != type) {
+        throw std::runtime_error("Protocol: unexpected message " + std::to_string(static_cast<uint32_t>(message.m_type)));
+    }
+    return message;
+}
+
+std::vector<uint8_t> Protocol::encode(const Hello& hello) {
+    ByteWriter writer;
+    writer.write(hello.m_version);
+    writer.writeString(hello.m_name);
+    return std::move(writer.getData());
+}
+
+std::vector<uint8_t> Protocol::encode(const Job& job) {
+    ByteWriter writer;
+    writer.write(job.m_width);
+    writer.write(job.m_height);
+    writer.write(job.m_samples);
+    writer.write(job.m_tileSize);
+    writer.write(static_cast<uint8_t>(job.m_hasCamera));
+    writer.write(job.m_cameraPosition);
+    writer.write(job.m_cameraLookAt);
+    writer.write(job.m_cameraFov);
+    writer.write(static_cast<uint64_t>(job.m_scene.size()));
+    writer.writeBytes(job.m_scene.data(), job.m_scene.size());
+    return std::move(writer.getData());
+}
+
+std::vector<uint8_t> Protocol::encodeTile(uint32_t tile) {
+    ByteWriter writer;
+    writer.write(tile);
+    return std::move(writer.getData());
+}
+
+std::vector<uint8_t> Protocol::encode(const TileResult& result) {
+    ByteWriter writer;
+    writer.write(result.m_tile);
+    writer.write(result.m_x);
+    writer.write(result.m_y);
+    writer.write(result.m_width);
+    writer.write(result.m_height);
+    writer.write(result.m_renderTime);
+    writer.writeBytes(result.m_pixels.data(), result.m_pixels.size() * sizeof(float));
+    return std::move(writer.getData());
+}
+
+Protocol::Hello Protocol::decodeHello(const std::vector<uint8_t>& payload) {
+    ByteReader reader(payload);
+    Hello hello;
+    hello.m_version = reader.read<uint32_t>();
+    hello.m_name = reader.readString();
+    return hello;
+}
+
+Protocol::Job Protocol::decodeJob(const std::vector<uint8_t>& payload) {
+    ByteReader reader(payload);
+    Job job;
+    job.m_width = reader.read<uint32_t>();
+    job.m_height = reader.read<uint32_t>();
+    job.m_samples = reader.read<int32_t>();
+    job.m_tileSize = reader.read<uint32_t>();
+    job.m_hasCamera = reader.read<uint8_t>() != 0;
+    job.m_cameraPosition = reader.read<glm::vec3>();
+    job.m_cameraLookAt = reader.read<glm::vec3>();
+    job.m_cameraFov = reader.read<float>();
+
+    uint64_t sceneSize = reader.read<uint64_t>();
+    if (sceneSize != reader.getRemaining()) {
+        throw std::runtime_error("Protocol: invalid job");
+    }
+    job.m_scene.resize(sceneSize);
+    reader.readBytes(job.m_scene.data(), job.m_scene.size());
+    return job;
+}
+
+uint32_t Protocol::decodeTile(const std::vector<uint8_t>& payload) {
+    ByteReader reader(payload);
+    return reader.read<uint32_t>();
+}
+
+Protocol::TileResult Protocol::decodeTileResult(const std::vector<uint8_t>& payload) {
+    ByteReader reader(payload);
+    TileResult result;
+    result.m_tile = reader.read<uint32_t>();
+    result.m_x = reader.read<uint32_t>();
+    result.m_y = reader.read<uint32_t>();
+    result.m_width = reader.read<uint32_t>();
+    result.m_height = reader.read<uint32_t>();
+    result.m_renderTime = reader.read<float>();
+
+    size_t floatCount = static_cast<size_t>(result.m_width) * result.m_height * 4;
+    if (floatCount * sizeof(float) != reader.getRemaining()) {
+        throw std::runtime_error("Protocol: invalid tile result");
+    }
+    result.m_pixels.resize(floatCount);
+    reader.readBytes(result.m_pixels.data(), floatCount * sizeof(float));
+    return result;
+}
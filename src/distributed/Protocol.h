@@ -0,0 +1,79 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "distributed/Socket.h"
+
+// Messages exchanged by the distributed coordinator and its workers. Each one is a header holding its type
+// and payload size, followed by the payload:
+//
+//   worker      -> coordinator  Hello       protocol version and the name of the worker
+//   coordinator -> worker       Job         resolution, samples, tile size, camera and the binary scene
+//   coordinator -> worker       Tile        index of a tile to render, several may be queued
+//   worker      -> coordinator  TileResult  the tile as RGBA32F, rows from top to bottom
+//   coordinator -> worker       Done        the image is complete, the worker exits
+namespace Protocol {
+
+	constexpr uint32_t g_version = 1;
+
+	enum class MessageType : uint32_t { Hello = 1, Job, Tile, TileResult, Done };
+
+	struct Message {
+		MessageType m_type = MessageType::Done;
+		std::vector<uint8_t> m_payload;
+	};
+
+	struct Hello {
+		uint32_t m_version = g_version;
+		std::string m_name;
+	};
+
+	struct Job {
+		uint32_t m_width = 0;
+		uint32_t m_height = 0;
+		int32_t m_samples = 0;
+		uint32_t m_tileSize = 0;
+		// Without a camera, the workers keep the default one of the renderer
+		bool m_hasCamera = false;
+		glm::vec3 m_cameraPosition{ 0.0f };
+		glm::vec3 m_cameraLookAt{ 0.0f };
+		float m_cameraFov = 45.0f;
+		// SceneFile encoding
+		std::vector<uint8_t> m_scene;
+	};
+
+	struct TileResult {
+		uint32_t m_tile = 0;
+		uint32_t m_x = 0;
+		uint32_t m_y = 0;
+		uint32_t m_width = 0;
+		uint32_t m_height = 0;
+		// Wall clock time the worker spent on the tile, in milliseconds
+		float m_renderTime = 0.0f;
+		std::vector<float> m_pixels;
+	};
+
+	void send(Socket& socket, MessageType type, const std::vector<uint8_t>& payload);
+	// Returns false when the peer closed the connection between two messages
+	bool receive(Socket& socket, Message& message);
+	// Receives the next message and throws std::runtime_error unless it has the expected type
+	Message expect(Socket& socket, MessageType type);
+
+	std::vector<uint8_t> encode(const Hello& hello);
+	std::vector<uint8_t> encode(const Job& job);
+	std::vector<uint8_t> encodeTile(uint32_t tile);
+	std::vector<uint8_t> encode(const TileResult& result);
+
+	Hello decodeHello(const std::vector<uint8_t>& payload);
+	Job decodeJob(const std::vector<uint8_t>& payload);
+	uint32_t decodeTile(const std::vector<uint8_t>& payload);
+	TileResult decodeTileResult(const std::vector<uint8_t>& payload);
+
+}
+
+#endif
@@ -0,0 +1,206 @@
+#include "RenderCoordinator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "application/CameraPath.h"
+#include "distributed/Protocol.h"
+#include "distributed/Socket.h"
+#include "distributed/TileScheduler.h"
+#include "io/ImageWriter.h"
+#include "scene/SceneFile.h"
+
+namespace {
+
+    // Tiles queued on a worker, so it starts the next one while the result of the previous one is on the wire
+    constexpr uint32_t g_tilesInFlight = 2;
+    // Workers rendering the same straggling tile at once
+    constexpr uint32_t g_maxTileCopies = 2;
+
+    struct WorkerConnection {
+        Socket m_socket;
+        std::string m_name;
+        uint32_t m_tiles = 0;
+        // Results that arrived after another worker completed the same tile
+        uint32_t m_wastedTiles = 0;
+        double m_renderTime = 0.0;
+        std::string m_error;
+    };
+
+    struct ImageAssembly {
+        uint32_t m_width = 0;
+        uint32_t m_height = 0;
+        uint32_t m_tileSize = 0;
+        uint32_t m_tilesX = 0;
+        std::vector<float> m_pixels;
+        std::mutex m_mutex;
+    };
+
+    void storeTile(ImageAssembly& image, const Protocol::TileResult& result) {
+        uint32_t x = (result.m_tile % image.m_tilesX) * image.m_tileSize;
+        uint32_t y = (result.m_tile / image.m_tilesX) * image.m_tileSize;
+        uint32_t width = std::min(image.m_tileSize, image.m_width - x);
+        uint32_t height = std::min(image.m_tileSize, image.m_height - y);
+        if (result.m_x != x || result.m_y != y || result.m_width != width || result.m_height != height) {
+            throw std::runtime_error("Tile " + std::to_string(result.m_tile) + " does not match the tile grid");
+        }
+
+        std::lock_guard<std::mutex> lock(image.m_mutex);
+        for (uint32_t row = 0; row < height; ++row) {
+            const float* source = result.m_pixels.data() + static_cast<size_t>(row) * width * 4;
+            float* destination = image.m_pixels.data() + (static_cast<size_t>(y + row) * image.m_width + x) * 4;
+            std::memcpy(destination, source, static_cast<size_t>(width) * 4 * sizeof(float));
+        }
+    }
+
+    // Runs on a thread of its own per worker, until the image is done or the worker fails
+    void serveWorker(uint32_t index, WorkerConnection& worker, TileScheduler& scheduler, ImageAssembly& image) {
+        try {
+            uint32_t inFlight = 0;
+            auto handOut = [&] {
+                while (inFlight < g_tilesInFlight) {
+                    // Only an idle worker waits, for the tiles given back by others or for the end of the image
+                    int tile = scheduler.acquire(index, inFlight == 0);
+                    if (tile < 0) {
+                        return;
+                    }
+                    Protocol::send(worker.m_socket, Protocol::MessageType::Tile, Protocol::encodeTile(static_cast<uint32_t>(tile)));
+                    ++inFlight;
+                }
+            };
+
+            handOut();
+            while (inFlight > 0) {
+                Protocol::Message message = Protocol::expect(worker.m_socket, Protocol::MessageType::TileResult);
+                Protocol::TileResult result = Protocol::decodeTileResult(message.m_payload);
+                --inFlight;
+
+                if (result.m_tile >= image.m_tilesX * ((image.m_height + image.m_tileSize - 1) / image.m_tileSize)) {
+                    throw std::runtime_error("Invalid tile " + std::to_string(result.m_tile));
+                }
+                if (scheduler.complete(index, result.m_tile)) {
+                    storeTile(image, result);
+                    ++worker.m_tiles;
+                }
+                else {
+                    ++worker.m_wastedTiles;
+                }
+                worker.m_renderTime += result.m_renderTime;
+
+                handOut();
+            }
+
+            Protocol::send(worker.m_socket, Protocol::MessageType::Done, {});
+        }
+        catch (const std::exception& e) {
+            worker.m_error = e.what();
+            scheduler.abandon(index);
+            std::cerr << worker.m_name << " left: " << e.what() << std::endl;
+        }
+    }
+
+}
+
+void RenderCoordinator::run(const Settings& settings) {
+    if (settings.m_width == 0 || settings.m_height == 0 || settings.m_samples <= 0 || settings.m_workers == 0) {
+        throw std::runtime_error("The resolution, the sample count and the worker count must be positive");
+    }
+    // The range of the tiled mode of the renderer
+    if (settings.m_tileSize < 16 || settings.m_tileSize > 1024) {
+        throw std::runtime_error("The tile size must be between 16 and 1024");
+    }
+
+    std::string extension = std::filesystem::path(settings.m_output).extension().string();
+    ImageWriter::Format format = ImageWriter::parseFormat(extension.empty() ? extension : extension.substr(1));
+
+    Scene scene = settings.m_scenePath.empty() ? Scene::cornellBox() : SceneFile::read(settings.m_scenePath);
+
+    Protocol::Job job;
+    job.m_width = settings.m_width;
+    job.m_height = settings.m_height;
+    job.m_samples = settings.m_samples;
+    job.m_tileSize = static_cast<uint32_t>(settings.m_tileSize);
+    if (!settings.m_cameraPath.empty()) {
+        CameraPath::Keyframe camera = CameraPath::load(settings.m_cameraPath).evaluateFrame(settings.m_cameraFrame);
+        job.m_hasCamera = true;
+        job.m_cameraPosition = camera.m_position;
+        job.m_cameraLookAt = camera.m_lookAt;
+        job.m_cameraFov = camera.m_fov;
+    }
+    job.m_scene = SceneFile::encode(scene);
+    std::vector<uint8_t> jobPayload = Protocol::encode(job);
+
+    Socket server = Socket::listen(settings.m_address);
+    std::cout << "Waiting for " << settings.m_workers << " workers on " << settings.m_address << std::endl;
+
+    std::vector<WorkerConnection> workers(settings.m_workers);
+    for (uint32_t i = 0; i < workers.size(); ++i) {
+        WorkerConnection& worker = workers[i];
+        worker.m_socket = server.accept();
+
+        Protocol::Hello hello = Protocol::decodeHello(Protocol::expect(worker.m_socket, Protocol::MessageType::Hello).m_payload);
+        if (hello.m_version != Protocol::g_version) {
+            throw std::runtime_error("Worker speaks protocol version " + std::to_string(hello.m_version) + ", expected " + std::to_string(Protocol::g_version));
+        }
+        worker.m_name = "worker " + std::to_string(i) + (hello.m_name.empty() ? "" : " (" + hello.m_name + ")");
+
+        // Sent right away, so the workers upload the scene while the others connect
+        Protocol::send(worker.m_socket, Protocol::MessageType::Job, jobPayload);
+        std::cout << worker.m_name << " connected" << std::endl;
+    }
+    server.close();
+
+    ImageAssembly image;
+    image.m_width = settings.m_width;
+    image.m_height = settings.m_height;
+    image.m_tileSize = static_cast<uint32_t>(settings.m_tileSize);
+    image.m_tilesX = (settings.m_width + image.m_tileSize - 1) / image.m_tileSize;
+    image.m_pixels.assign(static_cast<size_t>(settings.m_width) * settings.m_height * 4, 0.0f);
+    uint32_t tilesY = (settings.m_height + image.m_tileSize - 1) / image.m_tileSize;
+    uint32_t tileCount = image.m_tilesX * tilesY;
+
+    std::cout << "Rendering " << settings.m_width << "x" << settings.m_height << " at " << settings.m_samples << " spp as "
+              << tileCount << " tiles of " << settings.m_tileSize << " pixels" << std::endl;
+
+    TileScheduler scheduler(tileCount, g_maxTileCopies);
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < workers.size(); ++i) {
+        threads.emplace_back(serveWorker, i, std::ref(workers[i]), std::ref(scheduler), std::ref(image));
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    double totalTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    if (!scheduler.isDone()) {
+        throw std::runtime_error("Every worker left before the image was complete");
+    }
+
+    ImageWriter::write(settings.m_output, format, image.m_pixels.data(), image.m_width, image.m_height);
+
+    std::cout << "Rendered " << tileCount << " tiles in " << totalTime << " s, written to " << settings.m_output << std::endl;
+    for (const WorkerConnection& worker : workers) {
+        uint32_t rendered = worker.m_tiles + worker.m_wastedTiles;
+        std::cout << "  " << worker.m_name << ": " << worker.m_tiles << " tiles (" << 100.0 * worker.m_tiles / tileCount << "%)";
+        if (rendered > 0) {
+            std::cout << ", " << worker.m_renderTime / rendered << " ms/tile";
+        }
+        if (worker.m_wastedTiles > 0) {
+            std::cout << ", " << worker.m_wastedTiles << " wasted";
+        }
+        if (!worker.m_error.empty()) {
+            std::cout << ", left: " << worker.m_error;
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "  " << scheduler.getReassignedTiles() << " tiles handed out again to idle workers" << std::endl;
+}
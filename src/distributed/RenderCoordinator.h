@@ -0,0 +1,33 @@
+#ifndef RENDER_COORDINATOR_H
+#define RENDER_COORDINATOR_H
+
+#include <cstdint>
+#include <string>
+
+// Splits one still image into tiles rendered by several RenderWorker processes, on this machine or others,
+// and assembles their results. The coordinator renders nothing itself, it only needs the scene.
+class RenderCoordinator {
+public:
+	struct Settings {
+		// "unix:<path>" or "<host>:<port>", see Socket
+		std::string m_address = "unix:/tmp/raytracer.sock";
+		// Workers to wait for before rendering starts
+		unsigned int m_workers = 2;
+		// Written in the format of its extension, png, pfm or exr
+		std::string m_output = "render.exr";
+		// Binary scene file, the Cornell box when empty
+		std::string m_scenePath;
+		// Camera path and frame giving the camera, the default camera of the renderer when empty
+		std::string m_cameraPath;
+		uint32_t m_cameraFrame = 0;
+		uint32_t m_width = 1920;
+		uint32_t m_height = 1080;
+		int m_samples = 256;
+		int m_tileSize = 128;
+	};
+
+	// Throws std::runtime_error on invalid settings, when every worker left early or on a write error
+	static void run(const Settings& settings);
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "RenderWorker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "distributed/Protocol.h"
+#include "distributed/Socket.h"
+#include "scene/SceneFile.h"
+#include "vulkan/VkRenderer.h"
+
+namespace {
+
+    // Renders one tile with the tiled mode restricted to it, then reads it back
+    Protocol::TileResult renderTile(VkRenderer& renderer, const Protocol::Job& job, uint32_t tile) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        uint32_t tilesX = (job.m_width + job.m_tileSize - 1) / job.m_tileSize;
+        Protocol::TileResult result;
+        result.m_tile = tile;
+        result.m_x = (tile % tilesX) * job.m_tileSize;
+        result.m_y = (tile / tilesX) * job.m_tileSize;
+        result.m_width = std::min(job.m_tileSize, job.m_width - result.m_x);
+        result.m_height = std::min(job.m_tileSize, job.m_height - result.m_y);
+
+        renderer.setTiledSelection(static_cast<int>(job.m_tileSize), { tile });
+        do {
+            renderer.renderHeadlessFrame();
+        } while (!renderer.isTiledRenderComplete());
+
+        // The tile is complete, one more frame records nothing and only carries the capture
+        VkRect2D area{ { static_cast<int32_t>(result.m_x), static_cast<int32_t>(result.m_y) }, { result.m_width, result.m_height } };
+        renderer.requestCapture(area, [&result](const float* pixels, uint32_t width, uint32_t height) {
+            result.m_pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+        }, true);
+        renderer.renderHeadlessFrame();
+        renderer.finishCaptures();
+
+        result.m_renderTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+        return result;
+    }
+
+    void serveCoordinator(Socket& socket, VkRenderer& renderer, const Protocol::Job& job) {
+        uint32_t tileCount = ((job.m_width + job.m_tileSize - 1) / job.m_tileSize) * ((job.m_height + job.m_tileSize - 1) / job.m_tileSize);
+        uint32_t tiles = 0;
+
+        while (true) {
+            Protocol::Message message;
+            if (!Protocol::receive(socket, message)) {
+                throw std::runtime_error("The coordinator closed the connection");
+            }
+            if (message.m_type == Protocol::MessageType::Done) {
+                break;
+            }
+            if (message.m_type != Protocol::MessageType::Tile) {
+                throw std::runtime_error("Protocol: unexpected message " + std::to_string(static_cast<uint32_t>(message.m_type)));
+            }
+
+            uint32_t tile = Protocol::decodeTile(message.m_payload);
+            if (tile >= tileCount) {
+                throw std::runtime_error("Invalid tile " + std::to_string(tile));
+            }
+
+            Protocol::send(socket, Protocol::MessageType::TileResult, Protocol::encode(renderTile(renderer, job, tile)));
+            ++tiles;
+        }
+
+        std::cout << "Rendered " << tiles << " tiles" << std::endl;
+    }
+
+}
+
+void RenderWorker::run(const Settings& settings) {
+    Socket socket = Socket::connect(settings.m_address, settings.m_connectTimeout);
+
+    Protocol::Hello hello;
+    hello.m_name = settings.m_name;
+    Protocol::send(socket, Protocol::MessageType::Hello, Protocol::encode(hello));
+
+    Protocol::Job job = Protocol::decodeJob(Protocol::expect(socket, Protocol::MessageType::Job).m_payload);
+    if (job.m_width == 0 || job.m_height == 0 || job.m_samples <= 0 || job.m_tileSize == 0) {
+        throw std::runtime_error("Invalid job");
+    }
+    Scene scene = SceneFile::decode(job.m_scene);
+
+    VkRenderer renderer;
+    renderer.initHeadless(job.m_width, job.m_height, scene);
+    // The denoiser needs the whole image, the tiles are only accumulated
+    renderer.setDenoiseEnabled(false);
+    renderer.setTiledRendering(true, job.m_samples);
+    if (job.m_hasCamera) {
+        Camera& camera = renderer.getRendererCamera();
+        camera.m_cameraUBO.m_position = job.m_cameraPosition;
+        camera.m_cameraUBO.m_lookAt = job.m_cameraLookAt;
+        camera.m_cameraUBO.m_fov = job.m_cameraFov;
+        camera.updateCameraVectors();
+    }
+
+    std::cout << "Rendering tiles of " << scene.m_name << " from " << settings.m_address << " on " << renderer.getDeviceName() << std::endl;
+
+    try {
+        serveCoordinator(socket, renderer, job);
+    }
+    catch (...) {
+        renderer.cleanupVulkan();
+        throw;
+    }
+    renderer.cleanupVulkan();
+}
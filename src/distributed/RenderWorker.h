@@ -0,0 +1,21 @@
+#ifndef RENDER_WORKER_H
+#define RENDER_WORKER_H
+
+#include <string>
+
+// Connects to a RenderCoordinator, receives the scene and renders the tiles it hands out headlessly with the
+// tiled mode of the Vulkan renderer, until the image is complete.
+class RenderWorker {
+public:
+	struct Settings {
+		std::string m_address = "unix:/tmp/raytracer.sock";
+		// Shown in the report of the coordinator next to the worker index, optional
+		std::string m_name;
+		float m_connectTimeout = 30.0f;
+	};
+
+	// Throws std::runtime_error when the connection fails or breaks, or on a Vulkan error
+	static void run(const Settings& settings);
+};
+
+#endif
@@ -0,0 +1,287 @@
+#include "Socket.h"
+
+#include <stdexcept>
+#include <utility>
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+    struct Address {
+        bool m_unix = false;
+        std::string m_path;
+        std::string m_host;
+        std::string m_port;
+    };
+
+    Address parseAddress(const std::string& address) {
+        Address parsed;
+        if (address.rfind("unix:", 0) == 0) {
+            parsed.m_unix = true;
+            parsed.m_path = address.substr(5);
+            if (parsed.m_path.empty() || parsed.m_path.size() >= sizeof(sockaddr_un::sun_path)) {
+                throw std::runtime_error("Socket: invalid Unix socket path in " + address);
+            }
+            return parsed;
+        }
+
+        std::string hostPort = address.rfind("tcp:", 0) == 0 ? address.substr(4) : address;
+        size_t separator = hostPort.rfind(':');
+        if (separator == std::string::npos || separator + 1 == hostPort.size()) {
+            throw std::runtime_error("Socket: expected <host>:<port> or unix:<path>, got " + address);
+        }
+        parsed.m_host = hostPort.substr(0, separator);
+        parsed.m_port = hostPort.substr(separator + 1);
+        return parsed;
+    }
+
+    std::runtime_error socketError(const std::string& message) {
+        return std::runtime_error("Socket: " + message + ": " + std::strerror(errno));
+    }
+
+    sockaddr_un unixAddress(const std::string& path) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        return address;
+    }
+
+    // The messages are small and answered right away, Nagle's algorithm would only delay them
+    void disableNagle(int fd) {
+        int enabled = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+    }
+
+}
+
+Socket::~Socket() {
+    close();
+}
+
+Socket::Socket(Socket&& other) noexcept
+    : m_fd(std::exchange(other.m_fd, -1)), m_unixPath(std::move(other.m_unixPath)) {
+    other.m_unixPath.clear();
+}
+
+Socket& Socket::operator=(Socket&& other) noexcept {
+    if (this != &other) {
+        close();
+        m_fd = std::exchange(other.m_fd, -1);
+        m_unixPath = std::move(other.m_unixPath);
+        other.m_unixPath.clear();
+    }
+    return *this;
+}
+
+Socket Socket::listen(const std::string& address) {
+    Address parsed = parseAddress(address);
+
+    if (parsed.m_unix) {
+        Socket socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+        if (!socket.isOpen()) {
+            throw socketError("unable to create a Unix socket");
+        }
+
+        // A socket file left by a previous run would make bind fail
+        ::unlink(parsed.m_path.c_str());
+        sockaddr_un bindAddress = unixAddress(parsed.m_path);
+        if (::bind(socket.m_fd, reinterpret_cast<sockaddr*>(&bindAddress), sizeof(bindAddress)) != 0) {
+            throw socketError("unable to bind " + parsed.m_path);
+        }
+        socket.m_unixPath = parsed.m_path;
+
+        if (::listen(socket.m_fd, SOMAXCONN) != 0) {
+            throw socketError("unable to listen on " + parsed.m_path);
+        }
+        return socket;
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    addrinfo* results = nullptr;
+    const char* host = parsed.m_host.empty() || parsed.m_host == "*" ? nullptr : parsed.m_host.c_str();
+    int status = ::getaddrinfo(host, parsed.m_port.c_str(), &hints, &results);
+    if (status != 0) {
+        throw std::runtime_error("Socket: unable to resolve " + address + ": " + gai_strerror(status));
+    }
+
+    Socket socket;
+    for (addrinfo* result = results; result != nullptr && !socket.isOpen(); result = result->ai_next) {
+        Socket candidate(::socket(result->ai_family, result->ai_socktype, result->ai_protocol));
+        if (!candidate.isOpen()) {
+            continue;
+        }
+
+        int reuse = 1;
+        setsockopt(candidate.m_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (::bind(candidate.m_fd, result->ai_addr, result->ai_addrlen) == 0 && ::listen(candidate.m_fd, SOMAXCONN) == 0) {
+            socket = std::move(candidate);
+        }
+    }
+    ::freeaddrinfo(results);
+
+    if (!socket.isOpen()) {
+        throw socketError("unable to listen on " + address);
+    }
+    return socket;
+}
+
+Socket Socket::connect(const std::string& address, float timeoutSeconds) {
+    Address parsed = parseAddress(address);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<float>(timeoutSeconds);
+
+    while (true) {
+        if (parsed.m_unix) {
+            Socket socket(::socket(AF_UNIX, SOCK_STREAM, 0));
+            if (!socket.isOpen()) {
+                throw socketError("unable to create a Unix socket");
+            }
+
+            sockaddr_un connectAddress = unixAddress(parsed.m_path);
+            if (::connect(socket.m_fd, reinterpret_cast<sockaddr*>(&connectAddress), sizeof(connectAddress)) == 0) {
+                return socket;
+            }
+        }
+        else {
+            addrinfo hints{};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+
+            addrinfo* results = nullptr;
+            int status = ::getaddrinfo(parsed.m_host.c_str(), parsed.m_port.c_str(), &hints, &results);
+            if (status != 0) {
+                throw std::runtime_error("Socket: unable to resolve " + address + ": " + gai_strerror(status));
+            }
+
+            Socket socket;
+            for (addrinfo* result = results; result != nullptr && !socket.isOpen(); result = result->ai_next) {
+                Socket candidate(::socket(result->ai_family, result->ai_socktype, result->ai_protocol));
+                if (candidate.isOpen() && ::connect(candidate.m_fd, result->ai_addr, result->ai_addrlen) == 0) {
+                    disableNagle(candidate.m_fd);
+                    socket = std::move(candidate);
+                }
+            }
+            ::freeaddrinfo(results);
+
+            if (socket.isOpen()) {
+                return socket;
+            }
+        }
+
+        if (std::chrono::steady_clock::now() >= deadline) {
+            throw socketError("unable to connect to " + address);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+}
+
+Socket Socket::accept() {
+    int fd = ::accept(m_fd, nullptr, nullptr);
+    if (fd < 0) {
+        throw socketError("accept failed");
+    }
+    if (m_unixPath.empty()) {
+        disableNagle(fd);
+    }
+    return Socket(fd);
+}
+
+void Socket::sendAll(const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+#ifdef MSG_NOSIGNAL
+    // A worker leaving must be an error of this connection, not a SIGPIPE killing the coordinator
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+
+    while (size > 0) {
+        ssize_t sent = ::send(m_fd, bytes, size, flags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw socketError("send failed");
+        }
+        bytes += sent;
+        size -= static_cast<size_t>(sent);
+    }
+}
+
+bool Socket::receiveAll(void* data, size_t size) {
+    char* bytes = static_cast<char*>(data);
+    size_t received = 0;
+
+    while (received < size) {
+        ssize_t count = ::recv(m_fd, bytes + received, size - received, 0);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw socketError("receive failed");
+        }
+        if (count == 0) {
+            if (received == 0) {
+                return false;
+            }
+            throw std::runtime_error("Socket: connection closed in the middle of a message");
+        }
+        received += static_cast<size_t>(count);
+    }
+
+    return true;
+}
+
+void Socket::close() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    if (!m_unixPath.empty()) {
+        ::unlink(m_unixPath.c_str());
+        m_unixPath.clear();
+    }
+}
+
+#else
+
+namespace {
+
+    std::runtime_error unsupported() {
+        return std::runtime_error("Socket: distributed rendering needs POSIX sockets");
+    }
+
+}
+
+Socket::~Socket() = default;
+
+Socket::Socket(Socket&& other) noexcept : m_fd(std::exchange(other.m_fd, -1)) {}
+
+Socket& Socket::operator=(Socket&& other) noexcept {
+    m_fd = std::exchange(other.m_fd, -1);
+    return *this;
+}
+
+Socket Socket::listen(const std::string&) { throw unsupported(); }
+Socket Socket::connect(const std::string&, float) { throw unsupported(); }
+Socket Socket::accept() { throw unsupported(); }
+void Socket::sendAll(const void*, size_t) { throw unsupported(); }
+bool Socket::receiveAll(void*, size_t) { throw unsupported(); }
+void Socket::close() {}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef SOCKET_H
+#define SOCKET_H
+
+#include <cstddef>
+#include <string>
+
+// Blocking stream socket, over TCP or a Unix domain socket. Addresses are "unix:<path>" for a local socket,
+// or "<host>:<port>", optionally prefixed by "tcp:". Errors throw std::runtime_error.
+// Only implemented on POSIX systems, elsewhere every call throws.
+class Socket {
+public:
+	Socket() = default;
+	~Socket();
+
+	Socket(Socket&& other) noexcept;
+	Socket& operator=(Socket&& other) noexcept;
+	Socket(const Socket&) = delete;
+	Socket& operator=(const Socket&) = delete;
+
+	static Socket listen(const std::string& address);
+	// Retries until timeoutSeconds, so the workers can be started before the coordinator
+	static Socket connect(const std::string& address, float timeoutSeconds);
+
+	Socket accept();
+
+	void sendAll(const void* data, size_t size);
+	// Returns false when the peer closed the connection before sending anything, throws when it closed in the middle
+	bool receiveAll(void* data, size_t size);
+
+	void close();
+	inline bool isOpen() const { return m_fd >= 0; }
+
+private:
+	explicit Socket(int fd) : m_fd(fd) {}
+
+	int m_fd = -1;
+	// Path of a listening Unix socket, removed when it is closed
+	std::string m_unixPath;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "TileScheduler.h"
+
+#include <algorithm>
+
+TileScheduler::TileScheduler(uint32_t tileCount, uint32_t maxCopies)
+    : m_maxCopies(std::max(maxCopies, 1u)), m_tiles(tileCount), m_remaining(tileCount) {
+    for (uint32_t tile = 0; tile < tileCount; ++tile) {
+        m_pending.push_back(tile);
+    }
+}
+
+int TileScheduler::acquire(uint32_t worker, bool wait) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        if (m_remaining == 0) {
+            return -1;
+        }
+
+        int tile = takeTile(worker);
+        if (tile >= 0 || !wait) {
+            return tile;
+        }
+
+        m_changed.wait(lock);
+    }
+}
+
+bool TileScheduler::complete(uint32_t worker, uint32_t tile) {
+    bool first = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        TileState& state = m_tiles[tile];
+        state.m_workers.erase(std::remove(state.m_workers.begin(), state.m_workers.end(), worker), state.m_workers.end());
+        if (!state.m_done) {
+            state.m_done = true;
+            --m_remaining;
+            first = true;
+        }
+    }
+    m_changed.notify_all();
+    return first;
+}
+
+void TileScheduler::abandon(uint32_t worker) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (uint32_t tile = 0; tile < m_tiles.size(); ++tile) {
+            TileState& state = m_tiles[tile];
+            auto it = std::find(state.m_workers.begin(), state.m_workers.end(), worker);
+            if (it == state.m_workers.end()) {
+                continue;
+            }
+            state.m_workers.erase(it);
+            // Rendered first by the others, it would otherwise wait for the stragglers to be handed out again
+            if (!state.m_done && state.m_workers.empty()) {
+                m_pending.push_front(tile);
+            }
+        }
+    }
+    m_changed.notify_all();
+}
+
+bool TileScheduler::isDone() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_remaining == 0;
+}
+
+uint32_t TileScheduler::getReassignedTiles() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_reassigned;
+}
+
+int TileScheduler::takeTile(uint32_t worker) {
+    while (!m_pending.empty()) {
+        uint32_t tile = m_pending.front();
+        m_pending.pop_front();
+
+        TileState& state = m_tiles[tile];
+        if (!state.m_done && state.m_workers.empty()) {
+            state.m_workers.push_back(worker);
+            state.m_startTime = std::chrono::steady_clock::now();
+            return static_cast<int>(tile);
+        }
+    }
+
+    // Nothing pending, the tile rendered for the longest time is the most likely to hold the image back
+    int oldest = -1;
+    for (uint32_t tile = 0; tile < m_tiles.size(); ++tile) {
+        const TileState& state = m_tiles[tile];
+        if (state.m_done || state.m_workers.empty() || state.m_workers.size() >= m_maxCopies ||
+            std::find(state.m_workers.begin(), state.m_workers.end(), worker) != state.m_workers.end()) {
+            continue;
+        }
+        if (oldest < 0 || state.m_startTime < m_tiles[oldest].m_startTime) {
+            oldest = static_cast<int>(tile);
+        }
+    }
+
+    if (oldest >= 0) {
+        m_tiles[oldest].m_workers.push_back(worker);
+        ++m_reassigned;
+    }
+    return oldest;
+}
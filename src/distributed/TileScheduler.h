@@ -0,0 +1,52 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Hands the tiles of an image out to the workers of the coordinator, one thread per worker.
+// Tiles are handed out in order while some are pending, so fast workers naturally take more of them. Once
+// none is pending, the tiles still rendered by slow workers are handed out again to the idle ones and the
+// first result wins, so the end of the image never waits for the slowest node. The tiles of a worker that
+// left go back to the pending ones.
+class TileScheduler {
+public:
+	// maxCopies bounds how many workers render the same tile at once
+	TileScheduler(uint32_t tileCount, uint32_t maxCopies);
+
+	// Returns the next tile for the worker, or -1 when there is nothing to hand out. With wait, blocks until
+	// there is, and only returns -1 once every tile is done.
+	int acquire(uint32_t worker, bool wait);
+	// True for the first result of a tile, the copies still rendered elsewhere are then wasted
+	bool complete(uint32_t worker, uint32_t tile);
+	// Gives back the tiles the worker was rendering
+	void abandon(uint32_t worker);
+
+	bool isDone() const;
+	// Tiles handed out to a second worker while another one was still rendering them
+	uint32_t getReassignedTiles() const;
+
+private:
+	struct TileState {
+		bool m_done = false;
+		std::vector<uint32_t> m_workers;
+		std::chrono::steady_clock::time_point m_startTime;
+	};
+
+	uint32_t m_maxCopies;
+	std::vector<TileState> m_tiles;
+	std::deque<uint32_t> m_pending;
+	uint32_t m_remaining;
+	uint32_t m_reassigned = 0;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_changed;
+
+	int takeTile(uint32_t worker);
+};
+
+#endif
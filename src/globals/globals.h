@@ -8,13 +8,6 @@
 
 namespace Config {
 
-    inline int SAMPLES = 1;
-    inline uint32_t INIT_WINDOW_WIDTH = 1200;
-	inline uint32_t INIT_WINDOW_HEIGHT = 1000;
-
-    inline bool SHOW_DEMO_WINDOW = true;
-    inline bool SHOW_ANOTHER_WINDOW = false;
-
     inline std::vector<char> readFile(const std::string& filename) {
         std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
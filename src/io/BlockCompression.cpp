@@ -0,0 +1,372 @@
+#include "BlockCompression.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+    // Interpolation weights of the 4 bit indices of BC7, out of 64
+    const std::array<int, 16> g_bc7Weights = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    // Below this many blocks an image is compressed on the calling thread
+    constexpr size_t g_parallelBlocks = 1024;
+
+    // Mean of the points and the direction they spread the most along, found by power iteration on their
+    // covariance. A flat block gets an arbitrary unit axis, every point then projects onto the mean.
+    template<size_t N>
+    void fitLine(const std::array<float, N>* points, size_t count, std::array<float, N>& mean, std::array<float, N>& axis) {
+        mean.fill(0.0f);
+        for (size_t i = 0; i < count; ++i) {
+            for (size_t c = 0; c < N; ++c) {
+                mean[c] += points[i][c];
+            }
+        }
+        for (float& value : mean) {
+            value /= static_cast<float>(count);
+        }
+
+        std::array<std::array<float, N>, N> covariance{};
+        for (size_t i = 0; i < count; ++i) {
+            for (size_t a = 0; a < N; ++a) {
+                for (size_t b = 0; b < N; ++b) {
+                    covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+                }
+            }
+        }
+
+        axis.fill(1.0f);
+        for (int iteration = 0; iteration < 8; ++iteration) {
+            std::array<float, N> next{};
+            for (size_t a = 0; a < N; ++a) {
+                for (size_t b = 0; b < N; ++b) {
+                    next[a] += covariance[a][b] * axis[b];
+                }
+            }
+
+            float length = 0.0f;
+            for (float value : next) {
+                length = std::max(length, std::abs(value));
+            }
+            if (length < 1e-6f) {
+                break;
+            }
+            for (size_t c = 0; c < N; ++c) {
+                axis[c] = next[c] / length;
+            }
+        }
+
+        float length = 0.0f;
+        for (float value : axis) {
+            length += value * value;
+        }
+        length = std::sqrt(length);
+        for (float& value : axis) {
+            value /= length;
+        }
+    }
+
+    // The points projected onto the line furthest apart on each side, lower end first
+    template<size_t N>
+    void lineEndpoints(const std::array<float, N>* points, size_t count, std::array<float, N>& low, std::array<float, N>& high) {
+        std::array<float, N> mean;
+        std::array<float, N> axis;
+        fitLine(points, count, mean, axis);
+
+        float minT = 0.0f;
+        float maxT = 0.0f;
+        for (size_t i = 0; i < count; ++i) {
+            float t = 0.0f;
+            for (size_t c = 0; c < N; ++c) {
+                t += (points[i][c] - mean[c]) * axis[c];
+            }
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+
+        for (size_t c = 0; c < N; ++c) {
+            low[c] = std::clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+            high[c] = std::clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+        }
+    }
+
+    template<size_t N>
+    float distanceSquared(const std::array<float, N>& a, const std::array<float, N>& b) {
+        float distance = 0.0f;
+        for (size_t c = 0; c < N; ++c) {
+            distance += (a[c] - b[c]) * (a[c] - b[c]);
+        }
+        return distance;
+    }
+
+    template<size_t N, size_t P>
+    uint32_t nearestIndex(const std::array<float, N>& point, const std::array<std::array<float, N>, P>& palette) {
+        uint32_t best = 0;
+        float bestDistance = distanceSquared(point, palette[0]);
+        for (uint32_t i = 1; i < P; ++i) {
+            float distance = distanceSquared(point, palette[i]);
+            if (distance < bestDistance) {
+                best = i;
+                bestDistance = distance;
+            }
+        }
+        return best;
+    }
+
+    uint16_t packRgb565(const std::array<float, 3>& color) {
+        uint32_t r = static_cast<uint32_t>(std::lround(color[0] * 31.0f / 255.0f));
+        uint32_t g = static_cast<uint32_t>(std::lround(color[1] * 63.0f / 255.0f));
+        uint32_t b = static_cast<uint32_t>(std::lround(color[2] * 31.0f / 255.0f));
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    std::array<float, 3> unpackRgb565(uint16_t color) {
+        uint32_t r = (color >> 11) & 31;
+        uint32_t g = (color >> 5) & 63;
+        uint32_t b = color & 31;
+        return {
+            static_cast<float>((r << 3) | (r >> 2)),
+            static_cast<float>((g << 2) | (g >> 4)),
+            static_cast<float>((b << 3) | (b >> 2))
+        };
+    }
+
+    void storeLittleEndian(uint8_t* out, uint64_t value, size_t bytes) {
+        for (size_t i = 0; i < bytes; ++i) {
+            out[i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+    }
+
+    // One channel of the texels into a BC4 block, the 8 value mode between the extremes of the block
+    void encodeBc4(const uint8_t* texels, size_t channel, uint8_t* block) {
+        uint8_t low = 255;
+        uint8_t high = 0;
+        for (size_t i = 0; i < 16; ++i) {
+            low = std::min(low, texels[i * 4 + channel]);
+            high = std::max(high, texels[i * 4 + channel]);
+        }
+
+        block[0] = high;
+        block[1] = low;
+        uint64_t indices = 0;
+        if (high > low) {
+            std::array<std::array<float, 1>, 8> palette;
+            palette[0][0] = high;
+            palette[1][0] = low;
+            for (size_t i = 2; i < 8; ++i) {
+                palette[i][0] = (static_cast<float>(8 - i) * high + static_cast<float>(i - 1) * low) / 7.0f;
+            }
+            for (size_t i = 0; i < 16; ++i) {
+                std::array<float, 1> value = { static_cast<float>(texels[i * 4 + channel]) };
+                indices |= static_cast<uint64_t>(nearestIndex(value, palette)) << (3 * i);
+            }
+        }
+        storeLittleEndian(block + 2, indices, 6);
+    }
+
+    // Appends bits to a 128 bit block, least significant bit first
+    class BitWriter {
+    public:
+        explicit BitWriter(uint8_t* block) : m_block(block) {
+            std::fill(m_block, m_block + 16, uint8_t(0));
+        }
+
+        void write(uint32_t value, int count) {
+            for (int i = 0; i < count; ++i, ++m_bit) {
+                if ((value >> i) & 1) {
+                    m_block[m_bit / 8] |= static_cast<uint8_t>(1u << (m_bit % 8));
+                }
+            }
+        }
+
+    private:
+        uint8_t* m_block;
+        int m_bit = 0;
+    };
+
+    // 7 bits per channel and a parity bit shared by the channels, the one closest to the endpoint
+    void quantizeBc7Endpoint(const std::array<float, 4>& endpoint, std::array<uint32_t, 4>& quantized, uint32_t& parity) {
+        float bestError = 0.0f;
+        for (uint32_t p = 0; p < 2; ++p) {
+            std::array<uint32_t, 4> candidate;
+            float error = 0.0f;
+            for (size_t c = 0; c < 4; ++c) {
+                candidate[c] = static_cast<uint32_t>(std::clamp<long>(std::lround((endpoint[c] - static_cast<float>(p)) / 2.0f), 0, 127));
+                float value = static_cast<float>(candidate[c] * 2 + p);
+                error += (value - endpoint[c]) * (value - endpoint[c]);
+            }
+            if (p == 0 || error < bestError) {
+                quantized = candidate;
+                parity = p;
+                bestError = error;
+            }
+        }
+    }
+
+}
+
+namespace BlockCompression {
+
+    size_t getBlockSize(Format format) {
+        return format == Format::Bc1 ? 8 : 16;
+    }
+
+    size_t getCompressedSize(uint32_t width, uint32_t height, Format format) {
+        return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * getBlockSize(format);
+    }
+
+    void encodeBc1(const uint8_t* texels, uint8_t* block) {
+        std::array<std::array<float, 3>, 16> colors;
+        for (size_t i = 0; i < 16; ++i) {
+            colors[i] = { static_cast<float>(texels[i * 4]), static_cast<float>(texels[i * 4 + 1]), static_cast<float>(texels[i * 4 + 2]) };
+        }
+
+        // Pulled in by a sixteenth of the range, the extremes are usually outliers and the interpolated
+        // colors end up closer to the bulk of the texels
+        std::array<float, 3> low;
+        std::array<float, 3> high;
+        lineEndpoints(colors.data(), colors.size(), low, high);
+        for (size_t c = 0; c < 3; ++c) {
+            float inset = (high[c] - low[c]) / 16.0f;
+            low[c] += inset;
+            high[c] -= inset;
+        }
+
+        // The 4 color mode needs the first endpoint to be the larger one
+        uint16_t color0 = packRgb565(high);
+        uint16_t color1 = packRgb565(low);
+        if (color0 < color1) {
+            std::swap(color0, color1);
+        }
+
+        uint32_t indices = 0;
+        if (color0 != color1) {
+            std::array<std::array<float, 3>, 4> palette;
+            palette[0] = unpackRgb565(color0);
+            palette[1] = unpackRgb565(color1);
+            for (size_t c = 0; c < 3; ++c) {
+                palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+                palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+            }
+            for (size_t i = 0; i < 16; ++i) {
+                indices |= nearestIndex(colors[i], palette) << (2 * i);
+            }
+        }
+
+        storeLittleEndian(block, color0, 2);
+        storeLittleEndian(block + 2, color1, 2);
+        storeLittleEndian(block + 4, indices, 4);
+    }
+
+    void encodeBc5(const uint8_t* texels, uint8_t* block) {
+        encodeBc4(texels, 0, block);
+        encodeBc4(texels, 1, block + 8);
+    }
+
+    void encodeBc7(const uint8_t* texels, uint8_t* block) {
+        std::array<std::array<float, 4>, 16> colors;
+        for (size_t i = 0; i < 16; ++i) {
+            for (size_t c = 0; c < 4; ++c) {
+                colors[i][c] = static_cast<float>(texels[i * 4 + c]);
+            }
+        }
+
+        std::array<float, 4> low;
+        std::array<float, 4> high;
+        lineEndpoints(colors.data(), colors.size(), low, high);
+
+        std::array<std::array<uint32_t, 4>, 2> endpoints;
+        std::array<uint32_t, 2> parities;
+        quantizeBc7Endpoint(low, endpoints[0], parities[0]);
+        quantizeBc7Endpoint(high, endpoints[1], parities[1]);
+
+        std::array<std::array<float, 4>, 16> palette;
+        for (size_t i = 0; i < 16; ++i) {
+            for (size_t c = 0; c < 4; ++c) {
+                int value0 = static_cast<int>(endpoints[0][c] * 2 + parities[0]);
+                int value1 = static_cast<int>(endpoints[1][c] * 2 + parities[1]);
+                palette[i][c] = static_cast<float>(((64 - g_bc7Weights[i]) * value0 + g_bc7Weights[i] * value1 + 32) >> 6);
+            }
+        }
+
+        std::array<uint32_t, 16> indices;
+        for (size_t i = 0; i < 16; ++i) {
+            indices[i] = nearestIndex(colors[i], palette);
+        }
+
+        // The index of the first texel is stored without its top bit, which must then be zero
+        if (indices[0] & 8) {
+            std::swap(endpoints[0], endpoints[1]);
+            std::swap(parities[0], parities[1]);
+            for (uint32_t& index : indices) {
+                index = 15 - index;
+            }
+        }
+
+        // Mode 6: the mode bit, the endpoints channel by channel, the parity bits, then the indices
+        BitWriter writer(block);
+        writer.write(1u << 6, 7);
+        for (size_t c = 0; c < 4; ++c) {
+            writer.write(endpoints[0][c], 7);
+            writer.write(endpoints[1][c], 7);
+        }
+        writer.write(parities[0], 1);
+        writer.write(parities[1], 1);
+        writer.write(indices[0], 3);
+        for (size_t i = 1; i < 16; ++i) {
+            writer.write(indices[i], 4);
+        }
+    }
+
+    std::vector<uint8_t> compress(const uint8_t* pixels, uint32_t width, uint32_t height, Format format, unsigned int workerCount) {
+        if (width == 0 || height == 0) {
+            throw std::runtime_error("Cannot compress an empty image");
+        }
+
+        uint32_t blocksX = (width + 3) / 4;
+        uint32_t blocksY = (height + 3) / 4;
+        size_t blockSize = getBlockSize(format);
+        std::vector<uint8_t> blocks(static_cast<size_t>(blocksX) * blocksY * blockSize);
+
+        auto encodeRows = [&](uint32_t firstRow, uint32_t endRow) {
+            std::array<uint8_t, 64> texels;
+            for (uint32_t by = firstRow; by < endRow; ++by) {
+                for (uint32_t bx = 0; bx < blocksX; ++bx) {
+                    for (uint32_t y = 0; y < 4; ++y) {
+                        uint32_t sourceY = std::min(by * 4 + y, height - 1);
+                        for (uint32_t x = 0; x < 4; ++x) {
+                            uint32_t sourceX = std::min(bx * 4 + x, width - 1);
+                            const uint8_t* texel = pixels + (static_cast<size_t>(sourceY) * width + sourceX) * 4;
+                            std::copy(texel, texel + 4, texels.begin() + (y * 4 + x) * 4);
+                        }
+                    }
+
+                    uint8_t* block = blocks.data() + (static_cast<size_t>(by) * blocksX + bx) * blockSize;
+                    switch (format) {
+                    case Format::Bc1: encodeBc1(texels.data(), block); break;
+                    case Format::Bc5: encodeBc5(texels.data(), block); break;
+                    case Format::Bc7: encodeBc7(texels.data(), block); break;
+                    }
+                }
+            }
+        };
+
+        uint32_t threadCount = static_cast<size_t>(blocksX) * blocksY < g_parallelBlocks ? 1u : std::clamp(workerCount, 1u, blocksY);
+        if (threadCount == 1) {
+            encodeRows(0, blocksY);
+            return blocks;
+        }
+
+        std::vector<std::thread> threads;
+        for (uint32_t i = 0; i < threadCount; ++i) {
+            threads.emplace_back(encodeRows, blocksY * i / threadCount, blocksY * (i + 1) / threadCount);
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        return blocks;
+    }
+
+}
@@ -0,0 +1,33 @@
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Encoders of the block compressed formats the streamed textures are stored in. Every format packs 4x4
+// texels into a fixed size block, the blocks of an image are stored row by row, and the edge blocks of
+// images whose size is not a multiple of 4 repeat the last row and column.
+//  - BC1: RGB at 4 bits per texel, for the albedo maps
+//  - BC5: two independent channels at 8 bits per texel, for the X and Y of the normal maps
+//  - BC7: RGBA at 8 bits per texel, for the other maps. Only mode 6 is encoded, a single pair of
+//    RGBA endpoints with 16 interpolation steps, which keeps the encoder simple and fast.
+// The encoders fit the endpoints along the principal axis of the texels, they favor speed over quality.
+namespace BlockCompression {
+
+	enum class Format : uint32_t { Bc1, Bc5, Bc7 };
+
+	size_t getBlockSize(Format format);
+	size_t getCompressedSize(uint32_t width, uint32_t height, Format format);
+
+	// texels are the 16 RGBA8 texels of the block, row by row
+	void encodeBc1(const uint8_t* texels, uint8_t* block);
+	void encodeBc5(const uint8_t* texels, uint8_t* block);
+	void encodeBc7(const uint8_t* texels, uint8_t* block);
+
+	// RGBA8 pixels, rows from top to bottom. Large images are split over workerCount threads.
+	std::vector<uint8_t> compress(const uint8_t* pixels, uint32_t width, uint32_t height, Format format, unsigned int workerCount);
+
+}
+
+#endif
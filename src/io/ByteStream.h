@@ -0,0 +1,77 @@
+#ifndef BYTE_STREAM_H
+#define BYTE_STREAM_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Packing of plain values for the binary scene files and the distributed protocol. Values keep the byte
+// order of the host, the nodes exchanging them are all expected to be little endian.
+class ByteWriter {
+public:
+	template<typename T>
+	void write(const T& value) {
+		static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be written");
+		writeBytes(&value, sizeof(T));
+	}
+
+	inline void writeBytes(const void* data, size_t size) {
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		m_data.insert(m_data.end(), bytes, bytes + size);
+	}
+
+	inline void writeString(const std::string& value) {
+		write(static_cast<uint32_t>(value.size()));
+		writeBytes(value.data(), value.size());
+	}
+
+	inline std::vector<uint8_t>& getData() { return m_data; }
+
+private:
+	std::vector<uint8_t> m_data;
+};
+
+// Throws std::runtime_error when reading past the end of the data
+class ByteReader {
+public:
+	ByteReader(const uint8_t* data, size_t size) : m_data(data), m_size(size) {}
+	explicit ByteReader(const std::vector<uint8_t>& data) : m_data(data.data()), m_size(data.size()) {}
+
+	template<typename T>
+	T read() {
+		static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be read");
+		T value;
+		readBytes(&value, sizeof(T));
+		return value;
+	}
+
+	inline void readBytes(void* out, size_t size) {
+		if (size > getRemaining()) {
+			throw std::runtime_error("Unexpected end of data");
+		}
+		std::memcpy(out, m_data + m_offset, size);
+		m_offset += size;
+	}
+
+	inline std::string readString() {
+		uint32_t size = read<uint32_t>();
+		if (size > getRemaining()) {
+			throw std::runtime_error("Unexpected end of data");
+		}
+		std::string value(reinterpret_cast<const char*>(m_data + m_offset), size);
+		m_offset += size;
+		return value;
+	}
+
+	inline size_t getRemaining() const { return m_size - m_offset; }
+
+private:
+	const uint8_t* m_data;
+	size_t m_size;
+	size_t m_offset = 0;
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include "FrameEncoder.h"
+
+#include <algorithm>
+#include <chrono>
+
+FrameEncoder::FrameEncoder(unsigned int workerCount, size_t maxQueuedFrames)
+    : m_maxQueuedFrames(std::max<size_t>(maxQueuedFrames, 1)) {
+    workerCount = std::max(workerCount, 1u);
+    for (unsigned int i = 0; i < workerCount; ++i) {
+        m_workers.emplace_back(&FrameEncoder::workerLoop, this);
+    }
+}
+
+FrameEncoder::~FrameEncoder() {
+    stopWorkers();
+}
+
+void FrameEncoder::submit(Frame&& frame) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_frameTaken.wait(lock, [this] { return m_queue.size() < m_maxQueuedFrames || m_error; });
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+
+    m_queue.push_back(std::move(frame));
+    m_statistics.m_submitWaitTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+    lock.unlock();
+
+    m_frameQueued.notify_one();
+}
+
+void FrameEncoder::finish() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return (m_queue.empty() && m_busyWorkers == 0) || m_error; });
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+}
+
+FrameEncoder::Statistics FrameEncoder::getStatistics() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
+
+void FrameEncoder::workerLoop() {
+    while (true) {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_frameQueued.wait(lock, [this] { return !m_queue.empty() || m_stopping; });
+            if (m_queue.empty()) {
+                return;
+            }
+            frame = std::move(m_queue.front());
+            m_queue.pop_front();
+            ++m_busyWorkers;
+        }
+        m_frameTaken.notify_one();
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        std::exception_ptr error;
+        try {
+            ImageWriter::write(frame.m_path, frame.m_format, frame.m_pixels, frame.m_width, frame.m_height, frame.m_toneMapping);
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        if (frame.m_release) {
+            frame.m_release();
+        }
+        double encodeTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_busyWorkers;
+            if (error && !m_error) {
+                m_error = error;
+            }
+            if (!error) {
+                ++m_statistics.m_frames;
+                m_statistics.m_encodeTime += encodeTime;
+                m_statistics.m_maxEncodeTime = std::max(m_statistics.m_maxEncodeTime, encodeTime);
+            }
+        }
+        // A failure also wakes up the render loop, which rethrows it
+        m_frameTaken.notify_all();
+        m_idle.notify_all();
+    }
+}
+
+void FrameEncoder::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_frameQueued.notify_all();
+
+    for (std::thread& worker : m_workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    m_workers.clear();
+}
@@ -0,0 +1,74 @@
+#ifndef FRAME_ENCODER_H
+#define FRAME_ENCODER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "io/ImageWriter.h"
+
+// Encodes and writes frames on worker threads, so the render loop only pays for handing the pixels over.
+// The queue is bounded: when the disk cannot keep up, submit blocks instead of buffering every frame in memory.
+class FrameEncoder {
+public:
+	struct Frame {
+		std::string m_path;
+		ImageWriter::Format m_format = ImageWriter::Format::Png;
+		uint32_t m_width = 0;
+		uint32_t m_height = 0;
+		// Linear RGBA32F, rows from top to bottom. Borrowed, usually from a mapped readback buffer, it must
+		// stay valid until m_release is called by the worker, whether the write succeeded or not.
+		const float* m_pixels = nullptr;
+		std::function<void()> m_release;
+		// For the 8 bit formats
+		ToneMapping m_toneMapping;
+	};
+
+	// Totals over every frame written so far, in milliseconds
+	struct Statistics {
+		uint64_t m_frames = 0;
+		// Summed over the workers, so it can exceed the wall clock time
+		double m_encodeTime = 0.0;
+		double m_maxEncodeTime = 0.0;
+		// Time submit spent waiting for a free slot in the queue
+		double m_submitWaitTime = 0.0;
+	};
+
+	FrameEncoder(unsigned int workerCount, size_t maxQueuedFrames);
+	~FrameEncoder();
+
+	FrameEncoder(const FrameEncoder&) = delete;
+	FrameEncoder& operator=(const FrameEncoder&) = delete;
+
+	void submit(Frame&& frame);
+	// Waits for the queued frames and rethrows the first error of a worker
+	void finish();
+
+	Statistics getStatistics() const;
+
+private:
+	size_t m_maxQueuedFrames;
+
+	std::vector<std::thread> m_workers;
+	std::deque<Frame> m_queue;
+	size_t m_busyWorkers = 0;
+	bool m_stopping = false;
+	std::exception_ptr m_error;
+	Statistics m_statistics;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_frameQueued;
+	std::condition_variable m_frameTaken;
+	std::condition_variable m_idle;
+
+	void workerLoop();
+	void stopWorkers();
+};
+
+#endif
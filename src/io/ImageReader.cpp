@@ -0,0 +1,452 @@
+#include "ImageReader.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+    // Larger images are treated as corrupted data rather than allocated
+    constexpr uint32_t g_maxDimension = 16384;
+
+    const uint8_t g_pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    void checkDimensions(uint32_t width, uint32_t height) {
+        if (width == 0 || height == 0 || width > g_maxDimension || height > g_maxDimension) {
+            throw std::runtime_error("Image: invalid size " + std::to_string(width) + "x" + std::to_string(height));
+        }
+    }
+
+    // Least significant bit first, as deflate packs its codes
+    class BitReader {
+    public:
+        BitReader(const uint8_t* data, size_t size) : m_data(data), m_size(size) {}
+
+        uint32_t bits(int count) {
+            while (m_bitCount < count) {
+                if (m_offset >= m_size) {
+                    throw std::runtime_error("Image: truncated deflate stream");
+                }
+                m_bitBuffer |= static_cast<uint32_t>(m_data[m_offset++]) << m_bitCount;
+                m_bitCount += 8;
+            }
+            uint32_t value = m_bitBuffer & ((1u << count) - 1);
+            m_bitBuffer >>= count;
+            m_bitCount -= count;
+            return value;
+        }
+
+        // Drops the bits left in the current byte, stored blocks start on a byte boundary
+        void alignToByte() {
+            m_bitBuffer = 0;
+            m_bitCount = 0;
+        }
+
+        uint8_t byte() {
+            if (m_offset >= m_size) {
+                throw std::runtime_error("Image: truncated deflate stream");
+            }
+            return m_data[m_offset++];
+        }
+
+    private:
+        const uint8_t* m_data;
+        size_t m_size;
+        size_t m_offset = 0;
+        uint32_t m_bitBuffer = 0;
+        int m_bitCount = 0;
+    };
+
+    // Canonical Huffman code given by its code lengths, decoded one bit at a time
+    struct Huffman {
+        std::array<uint16_t, 16> m_counts{};
+        std::vector<uint16_t> m_symbols;
+
+        Huffman(const uint8_t* lengths, size_t count) : m_symbols(count) {
+            for (size_t i = 0; i < count; ++i) {
+                ++m_counts[lengths[i]];
+            }
+            m_counts[0] = 0;
+
+            std::array<uint16_t, 16> offsets{};
+            for (size_t length = 1; length < 15; ++length) {
+                offsets[length + 1] = offsets[length] + m_counts[length];
+            }
+            for (size_t i = 0; i < count; ++i) {
+                if (lengths[i] != 0) {
+                    m_symbols[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+                }
+            }
+        }
+
+        int decode(BitReader& reader) const {
+            int code = 0;
+            int first = 0;
+            int index = 0;
+            for (size_t length = 1; length < 16; ++length) {
+                code |= static_cast<int>(reader.bits(1));
+                int count = m_counts[length];
+                if (code - count < first) {
+                    return m_symbols[index + (code - first)];
+                }
+                index += count;
+                first = (first + count) << 1;
+                code <<= 1;
+            }
+            throw std::runtime_error("Image: invalid Huffman code");
+        }
+    };
+
+    constexpr std::array<uint16_t, 29> g_lengthBase = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    constexpr std::array<uint8_t, 29> g_lengthExtra = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    constexpr std::array<uint16_t, 30> g_distanceBase = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    constexpr std::array<uint8_t, 30> g_distanceExtra = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    void inflateBlock(BitReader& reader, const Huffman& literals, const Huffman& distances, std::vector<uint8_t>& out, size_t maxSize) {
+        while (true) {
+            int symbol = literals.decode(reader);
+            if (symbol < 256) {
+                out.push_back(static_cast<uint8_t>(symbol));
+            }
+            else if (symbol == 256) {
+                return;
+            }
+            else {
+                symbol -= 257;
+                if (symbol >= 29) {
+                    throw std::runtime_error("Image: invalid deflate length");
+                }
+                size_t length = g_lengthBase[symbol] + reader.bits(g_lengthExtra[symbol]);
+
+                int distanceSymbol = distances.decode(reader);
+                if (distanceSymbol >= 30) {
+                    throw std::runtime_error("Image: invalid deflate distance");
+                }
+                size_t distance = g_distanceBase[distanceSymbol] + reader.bits(g_distanceExtra[distanceSymbol]);
+                if (distance > out.size()) {
+                    throw std::runtime_error("Image: deflate distance out of range");
+                }
+
+                // The copy may overlap the bytes it produces, it goes one byte at a time
+                size_t start = out.size() - distance;
+                for (size_t i = 0; i < length; ++i) {
+                    out.push_back(out[start + i]);
+                }
+            }
+            if (out.size() > maxSize) {
+                throw std::runtime_error("Image: more image data than the header announces");
+            }
+        }
+    }
+
+    // zlib stream, the Adler-32 checksum is not verified
+    std::vector<uint8_t> inflate(const std::vector<uint8_t>& data, size_t expectedSize) {
+        if (data.size() < 2 || (data[0] & 0x0F) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20)) {
+            throw std::runtime_error("Image: invalid zlib header");
+        }
+
+        BitReader reader(data.data() + 2, data.size() - 2);
+        std::vector<uint8_t> out;
+        out.reserve(expectedSize);
+
+        bool lastBlock = false;
+        while (!lastBlock) {
+            lastBlock = reader.bits(1) != 0;
+            uint32_t type = reader.bits(2);
+
+            if (type == 0) {
+                reader.alignToByte();
+                uint32_t length = reader.byte();
+                length |= static_cast<uint32_t>(reader.byte()) << 8;
+                uint32_t complement = reader.byte();
+                complement |= static_cast<uint32_t>(reader.byte()) << 8;
+                if ((length ^ 0xFFFF) != complement) {
+                    throw std::runtime_error("Image: invalid stored block");
+                }
+                for (uint32_t i = 0; i < length; ++i) {
+                    out.push_back(reader.byte());
+                }
+            }
+            else if (type == 1) {
+                static const Huffman fixedLiterals = [] {
+                    std::array<uint8_t, 288> lengths{};
+                    std::fill(lengths.begin(), lengths.begin() + 144, 8);
+                    std::fill(lengths.begin() + 144, lengths.begin() + 256, 9);
+                    std::fill(lengths.begin() + 256, lengths.begin() + 280, 7);
+                    std::fill(lengths.begin() + 280, lengths.end(), 8);
+                    return Huffman(lengths.data(), lengths.size());
+                }();
+                static const Huffman fixedDistances = [] {
+                    std::array<uint8_t, 30> lengths{};
+                    lengths.fill(5);
+                    return Huffman(lengths.data(), lengths.size());
+                }();
+                inflateBlock(reader, fixedLiterals, fixedDistances, out, expectedSize);
+            }
+            else if (type == 2) {
+                uint32_t literalCount = reader.bits(5) + 257;
+                uint32_t distanceCount = reader.bits(5) + 1;
+                uint32_t codeLengthCount = reader.bits(4) + 4;
+
+                constexpr std::array<uint8_t, 19> order = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+                std::array<uint8_t, 19> codeLengthLengths{};
+                for (uint32_t i = 0; i < codeLengthCount; ++i) {
+                    codeLengthLengths[order[i]] = static_cast<uint8_t>(reader.bits(3));
+                }
+                Huffman codeLengths(codeLengthLengths.data(), codeLengthLengths.size());
+
+                std::array<uint8_t, 320> lengths{};
+                uint32_t index = 0;
+                while (index < literalCount + distanceCount) {
+                    int symbol = codeLengths.decode(reader);
+                    if (symbol < 16) {
+                        lengths[index++] = static_cast<uint8_t>(symbol);
+                        continue;
+                    }
+
+                    uint8_t value = 0;
+                    uint32_t repeat = 0;
+                    if (symbol == 16) {
+                        if (index == 0) {
+                            throw std::runtime_error("Image: repeated code length without a previous one");
+                        }
+                        value = lengths[index - 1];
+                        repeat = 3 + reader.bits(2);
+                    }
+                    else if (symbol == 17) {
+                        repeat = 3 + reader.bits(3);
+                    }
+                    else {
+                        repeat = 11 + reader.bits(7);
+                    }
+                    if (index + repeat > literalCount + distanceCount) {
+                        throw std::runtime_error("Image: too many code lengths");
+                    }
+                    std::fill(lengths.begin() + index, lengths.begin() + index + repeat, value);
+                    index += repeat;
+                }
+
+                Huffman literals(lengths.data(), literalCount);
+                Huffman distances(lengths.data() + literalCount, distanceCount);
+                inflateBlock(reader, literals, distances, out, expectedSize);
+            }
+            else {
+                throw std::runtime_error("Image: invalid deflate block type");
+            }
+
+            if (out.size() > expectedSize) {
+                throw std::runtime_error("Image: more image data than the header announces");
+            }
+        }
+
+        if (out.size() != expectedSize) {
+            throw std::runtime_error("Image: truncated image data");
+        }
+        return out;
+    }
+
+    uint32_t readBigEndian(const uint8_t* bytes) {
+        return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) |
+               (static_cast<uint32_t>(bytes[2]) << 8) | static_cast<uint32_t>(bytes[3]);
+    }
+
+    uint8_t paeth(int a, int b, int c) {
+        int p = a + b - c;
+        int pa = std::abs(p - a);
+        int pb = std::abs(p - b);
+        int pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc) {
+            return static_cast<uint8_t>(a);
+        }
+        return static_cast<uint8_t>(pb <= pc ? b : c);
+    }
+
+}
+
+ImageReader::Image ImageReader::decodePng(const std::vector<uint8_t>& data) {
+    if (data.size() < 8 || !std::equal(std::begin(g_pngSignature), std::end(g_pngSignature), data.begin())) {
+        throw std::runtime_error("Image: not a PNG file");
+    }
+
+    Image image;
+    uint8_t colorType = 0;
+    std::vector<uint8_t> palette;
+    std::vector<uint8_t> paletteAlpha;
+    std::vector<uint8_t> compressed;
+    bool headerRead = false;
+
+    size_t offset = 8;
+    while (true) {
+        if (offset + 8 > data.size()) {
+            throw std::runtime_error("Image: truncated PNG chunk");
+        }
+        uint32_t length = readBigEndian(&data[offset]);
+        const uint8_t* type = &data[offset + 4];
+        if (length > data.size() - offset - 8 || data.size() - offset - 8 - length < 4) {
+            throw std::runtime_error("Image: truncated PNG chunk");
+        }
+        const uint8_t* chunk = &data[offset + 8];
+        offset += 12 + static_cast<size_t>(length);
+
+        if (std::equal(type, type + 4, "IHDR")) {
+            if (length != 13) {
+                throw std::runtime_error("Image: invalid PNG header");
+            }
+            image.m_width = readBigEndian(chunk);
+            image.m_height = readBigEndian(chunk + 4);
+            checkDimensions(image.m_width, image.m_height);
+            colorType = chunk[9];
+            if (chunk[8] != 8 || chunk[12] != 0) {
+                throw std::runtime_error("Image: only non interlaced PNG of 8 bits per channel are supported");
+            }
+            if (colorType != 0 && colorType != 2 && colorType != 3 && colorType != 4 && colorType != 6) {
+                throw std::runtime_error("Image: invalid PNG color type");
+            }
+            headerRead = true;
+        }
+        else if (std::equal(type, type + 4, "PLTE")) {
+            palette.assign(chunk, chunk + length);
+        }
+        else if (std::equal(type, type + 4, "tRNS")) {
+            paletteAlpha.assign(chunk, chunk + length);
+        }
+        else if (std::equal(type, type + 4, "IDAT")) {
+            compressed.insert(compressed.end(), chunk, chunk + length);
+        }
+        else if (std::equal(type, type + 4, "IEND")) {
+            break;
+        }
+    }
+    if (!headerRead) {
+        throw std::runtime_error("Image: PNG without header");
+    }
+
+    const size_t channelsOfType[7] = { 1, 0, 3, 1, 2, 0, 4 };
+    size_t channels = channelsOfType[colorType];
+    size_t rowSize = image.m_width * channels;
+    std::vector<uint8_t> scanlines = inflate(compressed, (rowSize + 1) * image.m_height);
+
+    // Undo the filter of each row in place, the filter type byte stays in front of it
+    for (uint32_t y = 0; y < image.m_height; ++y) {
+        uint8_t* row = &scanlines[y * (rowSize + 1)];
+        uint8_t filter = row[0];
+        ++row;
+        const uint8_t* previous = y > 0 ? row - (rowSize + 1) : nullptr;
+
+        for (size_t x = 0; x < rowSize; ++x) {
+            int left = x >= channels ? row[x - channels] : 0;
+            int up = previous ? previous[x] : 0;
+            int upLeft = previous && x >= channels ? previous[x - channels] : 0;
+            switch (filter) {
+            case 0: break;
+            case 1: row[x] = static_cast<uint8_t>(row[x] + left); break;
+            case 2: row[x] = static_cast<uint8_t>(row[x] + up); break;
+            case 3: row[x] = static_cast<uint8_t>(row[x] + (left + up) / 2); break;
+            case 4: row[x] = static_cast<uint8_t>(row[x] + paeth(left, up, upLeft)); break;
+            default: throw std::runtime_error("Image: invalid PNG filter");
+            }
+        }
+    }
+
+    image.m_pixels.resize(static_cast<size_t>(image.m_width) * image.m_height * 4);
+    for (uint32_t y = 0; y < image.m_height; ++y) {
+        const uint8_t* row = &scanlines[y * (rowSize + 1) + 1];
+        uint8_t* out = &image.m_pixels[static_cast<size_t>(y) * image.m_width * 4];
+        for (uint32_t x = 0; x < image.m_width; ++x, out += 4) {
+            const uint8_t* pixel = row + x * channels;
+            switch (colorType) {
+            case 0: out[0] = out[1] = out[2] = pixel[0]; out[3] = 255; break;
+            case 2: out[0] = pixel[0]; out[1] = pixel[1]; out[2] = pixel[2]; out[3] = 255; break;
+            case 4: out[0] = out[1] = out[2] = pixel[0]; out[3] = pixel[1]; break;
+            case 6: std::copy(pixel, pixel + 4, out); break;
+            case 3:
+                if (static_cast<size_t>(pixel[0]) * 3 + 3 > palette.size()) {
+                    throw std::runtime_error("Image: PNG palette index out of range");
+                }
+                std::copy(&palette[pixel[0] * 3], &palette[pixel[0] * 3] + 3, out);
+                out[3] = pixel[0] < paletteAlpha.size() ? paletteAlpha[pixel[0]] : 255;
+                break;
+            }
+        }
+    }
+
+    return image;
+}
+
+ImageReader::Image ImageReader::decodePnm(const std::vector<uint8_t>& data) {
+    if (data.size() < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6')) {
+        throw std::runtime_error("Image: not a binary PPM or PGM file");
+    }
+    size_t channels = data[1] == '6' ? 3 : 1;
+
+    // Width, height and maximum value, separated by whitespace and comments running to the end of the line
+    size_t offset = 2;
+    uint32_t fields[3] = {};
+    for (uint32_t& field : fields) {
+        while (offset < data.size() && (std::isspace(data[offset]) || data[offset] == '#')) {
+            if (data[offset] == '#') {
+                while (offset < data.size() && data[offset] != '\n') {
+                    ++offset;
+                }
+            }
+            else {
+                ++offset;
+            }
+        }
+        if (offset >= data.size() || !std::isdigit(data[offset])) {
+            throw std::runtime_error("Image: invalid PNM header");
+        }
+        uint64_t value = 0;
+        while (offset < data.size() && std::isdigit(data[offset]) && value <= g_maxDimension) {
+            value = value * 10 + (data[offset++] - '0');
+        }
+        field = static_cast<uint32_t>(value);
+    }
+    // A single whitespace separates the header from the samples
+    ++offset;
+
+    Image image;
+    image.m_width = fields[0];
+    image.m_height = fields[1];
+    uint32_t maxValue = fields[2];
+    checkDimensions(image.m_width, image.m_height);
+    if (maxValue == 0 || maxValue > 255) {
+        throw std::runtime_error("Image: only PNM files of 8 bits per sample are supported");
+    }
+
+    size_t count = static_cast<size_t>(image.m_width) * image.m_height;
+    if (offset > data.size() || data.size() - offset < count * channels) {
+        throw std::runtime_error("Image: truncated PNM data");
+    }
+
+    image.m_pixels.resize(count * 4);
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t c = 0; c < 3; ++c) {
+            uint32_t value = data[offset + i * channels + (channels == 3 ? c : 0)];
+            image.m_pixels[i * 4 + c] = static_cast<uint8_t>(std::min(value, maxValue) * 255 / maxValue);
+        }
+        image.m_pixels[i * 4 + 3] = 255;
+    }
+
+    return image;
+}
+
+ImageReader::Image ImageReader::read(const std::string& path) {
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Image: unable to open " + path);
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if (data.size() >= 8 && std::equal(std::begin(g_pngSignature), std::end(g_pngSignature), data.begin())) {
+        return decodePng(data);
+    }
+    if (data.size() >= 2 && data[0] == 'P' && (data[1] == '5' || data[1] == '6')) {
+        return decodePnm(data);
+    }
+    throw std::runtime_error("Image: unsupported format of " + path);
+}
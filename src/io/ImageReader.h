@@ -0,0 +1,28 @@
+#ifndef IMAGE_READER_H
+#define IMAGE_READER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Decoders for the textures of the scenes, every format is expanded to RGBA8 rows from top to bottom.
+// They all throw std::runtime_error on a file they cannot read or do not support.
+namespace ImageReader {
+
+	struct Image {
+		uint32_t m_width = 0;
+		uint32_t m_height = 0;
+		std::vector<uint8_t> m_pixels;
+	};
+
+	// Non interlaced PNG of 8 bits per channel, grey, grey alpha, RGB, RGBA or palette
+	Image decodePng(const std::vector<uint8_t>& data);
+	// Binary PPM (P6) and PGM (P5) with a maximum value of at most 255
+	Image decodePnm(const std::vector<uint8_t>& data);
+
+	// Picks the decoder from the signature of the file, not its extension
+	Image read(const std::string& path);
+
+}
+
+#endif
@@ -0,0 +1,280 @@
+#include "ImageWriter.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+    const std::array<uint32_t, 256>& crcTable() {
+        static const std::array<uint32_t, 256> table = [] {
+            std::array<uint32_t, 256> values{};
+            for (uint32_t n = 0; n < 256; ++n) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                values[n] = c;
+            }
+            return values;
+        }();
+        return table;
+    }
+
+    uint32_t updateCrc(uint32_t crc, const uint8_t* data, size_t size) {
+        const std::array<uint32_t, 256>& table = crcTable();
+        for (size_t i = 0; i < size; ++i) {
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+    void appendBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+        out.push_back(static_cast<uint8_t>(value >> 24));
+        out.push_back(static_cast<uint8_t>(value >> 16));
+        out.push_back(static_cast<uint8_t>(value >> 8));
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    void writeChunk(std::ofstream& file, const char* type, const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> header;
+        appendBigEndian(header, static_cast<uint32_t>(data.size()));
+        header.insert(header.end(), type, type + 4);
+
+        uint32_t crc = updateCrc(0xFFFFFFFFu, header.data() + 4, 4);
+        crc = updateCrc(crc, data.data(), data.size()) ^ 0xFFFFFFFFu;
+
+        std::vector<uint8_t> footer;
+        appendBigEndian(footer, crc);
+
+        file.write(reinterpret_cast<const char*>(header.data()), static_cast<std::streamsize>(header.size()));
+        file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        file.write(reinterpret_cast<const char*>(footer.data()), static_cast<std::streamsize>(footer.size()));
+    }
+
+    template<typename T>
+    void appendLittleEndian(std::vector<uint8_t>& out, T value) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    void appendExrAttribute(std::vector<uint8_t>& out, const char* name, const char* type, const std::vector<uint8_t>& value) {
+        out.insert(out.end(), name, name + std::char_traits<char>::length(name) + 1);
+        out.insert(out.end(), type, type + std::char_traits<char>::length(type) + 1);
+        appendLittleEndian(out, static_cast<int32_t>(value.size()));
+        out.insert(out.end(), value.begin(), value.end());
+    }
+
+    std::ofstream openForWriting(const std::string& path) {
+        std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("Image: unable to write " + path);
+        }
+        return file;
+    }
+
+}
+
+ImageWriter::Format ImageWriter::parseFormat(const std::string& name) {
+    if (name == "png") {
+        return Format::Png;
+    }
+    if (name == "pfm") {
+        return Format::Pfm;
+    }
+    if (name == "exr") {
+        return Format::Exr;
+    }
+    throw std::runtime_error("Image: unknown format " + name);
+}
+
+const char* ImageWriter::extension(Format format) {
+    switch (format) {
+    case Format::Png: return "png";
+    case Format::Pfm: return "pfm";
+    case Format::Exr: return "exr";
+    }
+    return "";
+}
+
+std::vector<uint8_t> ImageWriter::toDisplayRGBA8(const float* pixels, uint32_t width, uint32_t height, const ToneMapping& toneMapping) {
+    size_t count = static_cast<size_t>(width) * height;
+    std::vector<uint8_t> rgba(count * 4);
+
+    glm::mat3 colorTransform = toneMapping.colorTransform();
+    for (size_t i = 0; i < count; ++i) {
+        const float* pixel = pixels + i * 4;
+        glm::vec3 color = ToneMapping::apply(toneMapping.m_operator, colorTransform * glm::vec3(pixel[0], pixel[1], pixel[2]));
+        for (int c = 0; c < 3; ++c) {
+            rgba[i * 4 + c] = static_cast<uint8_t>(ToneMapping::encodeSrgb(color[c]) * 255.0f + 0.5f);
+        }
+        rgba[i * 4 + 3] = 255;
+    }
+
+    return rgba;
+}
+
+void ImageWriter::writePng(const std::string& path, const std::vector<uint8_t>& rgba, uint32_t width, uint32_t height) {
+    std::ofstream file = openForWriting(path);
+
+    const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    // 8 bit RGBA, no interlacing
+    std::vector<uint8_t> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    header.insert(header.end(), { 8, 6, 0, 0, 0 });
+    writeChunk(file, "IHDR", header);
+
+    // Every row starts with the filter type, 0 leaves it unfiltered
+    size_t rowSize = static_cast<size_t>(width) * 4;
+    std::vector<uint8_t> scanlines;
+    scanlines.reserve((rowSize + 1) * height);
+    for (uint32_t y = 0; y < height; ++y) {
+        scanlines.push_back(0);
+        scanlines.insert(scanlines.end(), rgba.begin() + y * rowSize, rgba.begin() + (y + 1) * rowSize);
+    }
+
+    // zlib stream made of stored deflate blocks of at most 65535 bytes, followed by the Adler-32 checksum
+    std::vector<uint8_t> compressed;
+    compressed.reserve(scanlines.size() + scanlines.size() / 65535 * 5 + 16);
+    compressed.push_back(0x78);
+    compressed.push_back(0x01);
+
+    size_t offset = 0;
+    do {
+        size_t blockSize = std::min<size_t>(scanlines.size() - offset, 65535);
+        bool lastBlock = offset + blockSize == scanlines.size();
+        compressed.push_back(lastBlock ? 1 : 0);
+        compressed.push_back(static_cast<uint8_t>(blockSize));
+        compressed.push_back(static_cast<uint8_t>(blockSize >> 8));
+        compressed.push_back(static_cast<uint8_t>(~blockSize));
+        compressed.push_back(static_cast<uint8_t>(~blockSize >> 8));
+        compressed.insert(compressed.end(), scanlines.begin() + offset, scanlines.begin() + offset + blockSize);
+        offset += blockSize;
+    } while (offset < scanlines.size());
+
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (uint8_t value : scanlines) {
+        a = (a + value) % 65521;
+        b = (b + a) % 65521;
+    }
+    appendBigEndian(compressed, (b << 16) | a);
+
+    writeChunk(file, "IDAT", compressed);
+    writeChunk(file, "IEND", {});
+
+    if (!file.good()) {
+        throw std::runtime_error("Image: failed writing " + path);
+    }
+}
+
+void ImageWriter::writePfm(const std::string& path, const float* pixels, uint32_t width, uint32_t height) {
+    std::ofstream file = openForWriting(path);
+
+    // A negative scale marks little endian floats
+    file << "PF\n" << width << " " << height << "\n-1.0\n";
+
+    std::vector<float> row(static_cast<size_t>(width) * 3);
+    for (uint32_t y = height; y-- > 0;) {
+        for (uint32_t x = 0; x < width; ++x) {
+            size_t source = (static_cast<size_t>(y) * width + x) * 4;
+            row[x * 3 + 0] = pixels[source + 0];
+            row[x * 3 + 1] = pixels[source + 1];
+            row[x * 3 + 2] = pixels[source + 2];
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size() * sizeof(float)));
+    }
+
+    if (!file.good()) {
+        throw std::runtime_error("Image: failed writing " + path);
+    }
+}
+
+void ImageWriter::writeExr(const std::string& path, const float* pixels, uint32_t width, uint32_t height) {
+    std::ofstream file = openForWriting(path);
+
+    // Magic number, then version 2 with no flags: single part scanline image
+    std::vector<uint8_t> header = { 0x76, 0x2F, 0x31, 0x01, 2, 0, 0, 0 };
+
+    // Channels are stored in alphabetical order, all as 32 bit floats
+    const char* channelNames[] = { "B", "G", "R" };
+    std::vector<uint8_t> channels;
+    for (const char* name : channelNames) {
+        channels.push_back(static_cast<uint8_t>(name[0]));
+        channels.push_back(0);
+        appendLittleEndian(channels, static_cast<int32_t>(2));
+        // pLinear and 3 reserved bytes
+        channels.insert(channels.end(), { 0, 0, 0, 0 });
+        appendLittleEndian(channels, static_cast<int32_t>(1));
+        appendLittleEndian(channels, static_cast<int32_t>(1));
+    }
+    channels.push_back(0);
+
+    std::vector<uint8_t> window;
+    appendLittleEndian(window, static_cast<int32_t>(0));
+    appendLittleEndian(window, static_cast<int32_t>(0));
+    appendLittleEndian(window, static_cast<int32_t>(width - 1));
+    appendLittleEndian(window, static_cast<int32_t>(height - 1));
+
+    std::vector<uint8_t> aspectRatio;
+    appendLittleEndian(aspectRatio, 1.0f);
+    std::vector<uint8_t> windowCenter;
+    appendLittleEndian(windowCenter, 0.0f);
+    appendLittleEndian(windowCenter, 0.0f);
+
+    appendExrAttribute(header, "channels", "chlist", channels);
+    appendExrAttribute(header, "compression", "compression", { 0 });
+    appendExrAttribute(header, "dataWindow", "box2i", window);
+    appendExrAttribute(header, "displayWindow", "box2i", window);
+    appendExrAttribute(header, "lineOrder", "lineOrder", { 0 });
+    appendExrAttribute(header, "pixelAspectRatio", "float", aspectRatio);
+    appendExrAttribute(header, "screenWindowCenter", "v2f", windowCenter);
+    appendExrAttribute(header, "screenWindowWidth", "float", aspectRatio);
+    header.push_back(0);
+
+    // Without compression every block is one scanline: its y, its size and the channels one after the other
+    size_t lineDataSize = static_cast<size_t>(width) * 3 * sizeof(float);
+    size_t blockSize = 2 * sizeof(int32_t) + lineDataSize;
+    uint64_t firstBlock = header.size() + static_cast<uint64_t>(height) * sizeof(uint64_t);
+    for (uint32_t y = 0; y < height; ++y) {
+        appendLittleEndian(header, firstBlock + static_cast<uint64_t>(y) * blockSize);
+    }
+    file.write(reinterpret_cast<const char*>(header.data()), static_cast<std::streamsize>(header.size()));
+
+    std::vector<uint8_t> block;
+    block.reserve(blockSize);
+    for (uint32_t y = 0; y < height; ++y) {
+        block.clear();
+        appendLittleEndian(block, static_cast<int32_t>(y));
+        appendLittleEndian(block, static_cast<int32_t>(lineDataSize));
+        for (int channel = 2; channel >= 0; --channel) {
+            for (uint32_t x = 0; x < width; ++x) {
+                appendLittleEndian(block, pixels[(static_cast<size_t>(y) * width + x) * 4 + channel]);
+            }
+        }
+        file.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(block.size()));
+    }
+
+    if (!file.good()) {
+        throw std::runtime_error("Image: failed writing " + path);
+    }
+}
+
+void ImageWriter::write(const std::string& path, Format format, const float* pixels, uint32_t width, uint32_t height, const ToneMapping& toneMapping) {
+    switch (format) {
+    case Format::Png:
+        writePng(path, toDisplayRGBA8(pixels, width, height, toneMapping), width, height);
+        break;
+    case Format::Pfm:
+        writePfm(path, pixels, width, height);
+        break;
+    case Format::Exr:
+        writeExr(path, pixels, width, height);
+        break;
+    }
+}
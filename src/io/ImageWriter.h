@@ -0,0 +1,35 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "math/ToneMapping.h"
+
+// Writers for the frames read back from the renderer, which are linear RGBA32F rows from top to bottom.
+// They all throw std::runtime_error when the file cannot be written.
+namespace ImageWriter {
+
+	enum class Format { Png, Pfm, Exr };
+
+	// "png", "pfm" or "exr", throws for anything else
+	Format parseFormat(const std::string& name);
+	const char* extension(Format format);
+
+	// Tone maps as the tone mapping pass does, encodes to sRGB as the swapchain and quantizes to 8 bits per channel
+	std::vector<uint8_t> toDisplayRGBA8(const float* pixels, uint32_t width, uint32_t height, const ToneMapping& toneMapping = {});
+
+	// 8 bit RGBA, the deflate stream uses stored blocks so writing costs no more than a copy
+	void writePng(const std::string& path, const std::vector<uint8_t>& rgba, uint32_t width, uint32_t height);
+	// Linear RGB floats, rows stored from bottom to top as the format requires
+	void writePfm(const std::string& path, const float* pixels, uint32_t width, uint32_t height);
+	// Linear RGB floats, uncompressed scanlines
+	void writeExr(const std::string& path, const float* pixels, uint32_t width, uint32_t height);
+
+	// The tone mapping only applies to the 8 bit formats, the float ones keep the linear radiance
+	void write(const std::string& path, Format format, const float* pixels, uint32_t width, uint32_t height, const ToneMapping& toneMapping = {});
+
+}
+
+#endif
@@ -0,0 +1,415 @@
+#include "Json.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+    class JsonParser {
+    public:
+        explicit JsonParser(const std::string& text) : m_text(text) {}
+
+        JsonValue parseDocument() {
+            JsonValue value = parseValue();
+            skipWhitespace();
+            if (m_position != m_text.size()) {
+                fail("unexpected trailing characters");
+            }
+            return value;
+        }
+
+    private:
+        const std::string& m_text;
+        size_t m_position = 0;
+
+        [[noreturn]] void fail(const std::string& message) const {
+            throw std::runtime_error("JSON: " + message + " at offset " + std::to_string(m_position));
+        }
+
+        void skipWhitespace() {
+            while (m_position < m_text.size() && (m_text[m_position] == ' ' || m_text[m_position] == '\t' || m_text[m_position] == '\n' || m_text[m_position] == '\r')) {
+                ++m_position;
+            }
+        }
+
+        char peek() {
+            skipWhitespace();
+            if (m_position >= m_text.size()) {
+                fail("unexpected end of document");
+            }
+            return m_text[m_position];
+        }
+
+        void expect(char c) {
+            if (peek() != c) {
+                fail(std::string("expected '") + c + "'");
+            }
+            ++m_position;
+        }
+
+        bool consumeLiteral(const char* literal) {
+            size_t length = std::char_traits<char>::length(literal);
+            if (m_text.compare(m_position, length, literal) == 0) {
+                m_position += length;
+                return true;
+            }
+            return false;
+        }
+
+        JsonValue parseValue() {
+            char c = peek();
+            if (c == '{') {
+                return parseObject();
+            }
+            if (c == '[') {
+                return parseArray();
+            }
+            if (c == '"') {
+                return JsonValue(parseString());
+            }
+            if (consumeLiteral("true")) {
+                return JsonValue(true);
+            }
+            if (consumeLiteral("false")) {
+                return JsonValue(false);
+            }
+            if (consumeLiteral("null")) {
+                return JsonValue();
+            }
+            return parseNumber();
+        }
+
+        JsonValue parseObject() {
+            JsonValue object = JsonValue::object();
+            expect('{');
+            if (peek() == '}') {
+                ++m_position;
+                return object;
+            }
+
+            while (true) {
+                if (peek() != '"') {
+                    fail("expected a member name");
+                }
+                std::string key = parseString();
+                expect(':');
+                object.set(key, parseValue());
+
+                char c = peek();
+                ++m_position;
+                if (c == '}') {
+                    return object;
+                }
+                if (c != ',') {
+                    fail("expected ',' or '}'");
+                }
+            }
+        }
+
+        JsonValue parseArray() {
+            JsonValue array = JsonValue::array();
+            expect('[');
+            if (peek() == ']') {
+                ++m_position;
+                return array;
+            }
+
+            while (true) {
+                array.push(parseValue());
+
+                char c = peek();
+                ++m_position;
+                if (c == ']') {
+                    return array;
+                }
+                if (c != ',') {
+                    fail("expected ',' or ']'");
+                }
+            }
+        }
+
+        std::string parseString() {
+            expect('"');
+            std::string result;
+            while (true) {
+                if (m_position >= m_text.size()) {
+                    fail("unterminated string");
+                }
+                char c = m_text[m_position++];
+                if (c == '"') {
+                    return result;
+                }
+                if (c != '\\') {
+                    result += c;
+                    continue;
+                }
+
+                if (m_position >= m_text.size()) {
+                    fail("unterminated escape sequence");
+                }
+                char escaped = m_text[m_position++];
+                switch (escaped) {
+                case '"': result += '"'; break;
+                case '\\': result += '\\'; break;
+                case '/': result += '/'; break;
+                case 'b': result += '\b'; break;
+                case 'f': result += '\f'; break;
+                case 'n': result += '\n'; break;
+                case 'r': result += '\r'; break;
+                case 't': result += '\t'; break;
+                case 'u': {
+                    if (m_position + 4 > m_text.size()) {
+                        fail("truncated unicode escape");
+                    }
+                    unsigned int codePoint = static_cast<unsigned int>(std::strtoul(m_text.substr(m_position, 4).c_str(), nullptr, 16));
+                    m_position += 4;
+                    // Basic multilingual plane only, encoded as UTF-8
+                    if (codePoint < 0x80) {
+                        result += static_cast<char>(codePoint);
+                    }
+                    else if (codePoint < 0x800) {
+                        result += static_cast<char>(0xC0 | (codePoint >> 6));
+                        result += static_cast<char>(0x80 | (codePoint & 0x3F));
+                    }
+                    else {
+                        result += static_cast<char>(0xE0 | (codePoint >> 12));
+                        result += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+                        result += static_cast<char>(0x80 | (codePoint & 0x3F));
+                    }
+                    break;
+                }
+                default:
+                    fail("invalid escape sequence");
+                }
+            }
+        }
+
+        JsonValue parseNumber() {
+            const char* begin = m_text.c_str() + m_position;
+            char* end = nullptr;
+            double value = std::strtod(begin, &end);
+            if (end == begin) {
+                fail("unexpected character");
+            }
+            m_position += static_cast<size_t>(end - begin);
+            return JsonValue(value);
+        }
+    };
+
+    void escapeString(std::string& out, const std::string& value) {
+        out += '"';
+        for (char c : value) {
+            switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    out += buffer;
+                }
+                else {
+                    out += c;
+                }
+            }
+        }
+        out += '"';
+    }
+
+}
+
+JsonValue JsonValue::array() {
+    JsonValue value;
+    value.m_type = Type::Array;
+    return value;
+}
+
+JsonValue JsonValue::object() {
+    JsonValue value;
+    value.m_type = Type::Object;
+    return value;
+}
+
+JsonValue JsonValue::parse(const std::string& text) {
+    return JsonParser(text).parseDocument();
+}
+
+JsonValue JsonValue::parseFile(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("JSON: unable to open " + path);
+    }
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return parse(buffer.str());
+}
+
+bool JsonValue::asBool() const {
+    if (m_type != Type::Bool) {
+        throw std::runtime_error("JSON: value is not a boolean");
+    }
+    return m_bool;
+}
+
+double JsonValue::asNumber() const {
+    if (m_type != Type::Number) {
+        throw std::runtime_error("JSON: value is not a number");
+    }
+    return m_number;
+}
+
+const std::string& JsonValue::asString() const {
+    if (m_type != Type::String) {
+        throw std::runtime_error("JSON: value is not a string");
+    }
+    return m_string;
+}
+
+size_t JsonValue::size() const {
+    return m_type == Type::Array ? m_elements.size() : (m_type == Type::Object ? m_members.size() : 0);
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const {
+    if (m_type != Type::Array || index >= m_elements.size()) {
+        throw std::runtime_error("JSON: array index out of range");
+    }
+    return m_elements[index];
+}
+
+void JsonValue::push(const JsonValue& value) {
+    if (m_type != Type::Array) {
+        throw std::runtime_error("JSON: value is not an array");
+    }
+    m_elements.push_back(value);
+}
+
+bool JsonValue::contains(const std::string& key) const {
+    return find(key) != nullptr;
+}
+
+const JsonValue* JsonValue::find(const std::string& key) const {
+    if (m_type != Type::Object) {
+        return nullptr;
+    }
+    for (const auto& member : m_members) {
+        if (member.first == key) {
+            return &member.second;
+        }
+    }
+    return nullptr;
+}
+
+const JsonValue& JsonValue::operator[](const std::string& key) const {
+    const JsonValue* value = find(key);
+    if (value == nullptr) {
+        throw std::runtime_error("JSON: missing member \"" + key + "\"");
+    }
+    return *value;
+}
+
+void JsonValue::set(const std::string& key, const JsonValue& value) {
+    if (m_type != Type::Object) {
+        throw std::runtime_error("JSON: value is not an object");
+    }
+    for (auto& member : m_members) {
+        if (member.first == key) {
+            member.second = value;
+            return;
+        }
+    }
+    m_members.emplace_back(key, value);
+}
+
+double JsonValue::getNumber(const std::string& key, double fallback) const {
+    const JsonValue* value = find(key);
+    return value != nullptr ? value->asNumber() : fallback;
+}
+
+std::string JsonValue::getString(const std::string& key, const std::string& fallback) const {
+    const JsonValue* value = find(key);
+    return value != nullptr ? value->asString() : fallback;
+}
+
+bool JsonValue::getBool(const std::string& key, bool fallback) const {
+    const JsonValue* value = find(key);
+    return value != nullptr ? value->asBool() : fallback;
+}
+
+std::string JsonValue::dump(int indent) const {
+    std::string out;
+    dump(out, indent, 0);
+    return out;
+}
+
+void JsonValue::writeFile(const std::string& path, int indent) const {
+    std::ofstream file(path, std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("JSON: unable to write " + path);
+    }
+    file << dump(indent) << std::endl;
+}
+
+void JsonValue::dump(std::string& out, int indent, int depth) const {
+    std::string newline = indent > 0 ? "\n" : "";
+    std::string padding(static_cast<size_t>(indent * (depth + 1)), ' ');
+    std::string closingPadding(static_cast<size_t>(indent * depth), ' ');
+
+    switch (m_type) {
+    case Type::Null:
+        out += "null";
+        break;
+    case Type::Bool:
+        out += m_bool ? "true" : "false";
+        break;
+    case Type::Number: {
+        // JSON has no representation for infinities and NaN
+        if (!std::isfinite(m_number)) {
+            out += "null";
+            break;
+        }
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.10g", m_number);
+        out += buffer;
+        break;
+    }
+    case Type::String:
+        escapeString(out, m_string);
+        break;
+    case Type::Array:
+        if (m_elements.empty()) {
+            out += "[]";
+            break;
+        }
+        out += "[" + newline;
+        for (size_t i = 0; i < m_elements.size(); ++i) {
+            out += padding;
+            m_elements[i].dump(out, indent, depth + 1);
+            out += (i + 1 < m_elements.size() ? "," : "") + newline;
+        }
+        out += closingPadding + "]";
+        break;
+    case Type::Object:
+        if (m_members.empty()) {
+            out += "{}";
+            break;
+        }
+        out += "{" + newline;
+        for (size_t i = 0; i < m_members.size(); ++i) {
+            out += padding;
+            escapeString(out, m_members[i].first);
+            out += indent > 0 ? ": " : ":";
+            m_members[i].second.dump(out, indent, depth + 1);
+            out += (i + 1 < m_members.size() ? "," : "") + newline;
+        }
+        out += closingPadding + "}";
+        break;
+    }
+}
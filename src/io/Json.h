@@ -0,0 +1,75 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal JSON document, enough for the benchmark reports and small configuration files.
+// Objects keep the order their members were inserted in, so written files stay diffable.
+class JsonValue {
+public:
+	enum class Type { Null, Bool, Number, String, Array, Object };
+
+	JsonValue() = default;
+	JsonValue(bool value) : m_type(Type::Bool), m_bool(value) {}
+	JsonValue(double value) : m_type(Type::Number), m_number(value) {}
+	JsonValue(int value) : m_type(Type::Number), m_number(value) {}
+	JsonValue(unsigned int value) : m_type(Type::Number), m_number(value) {}
+	JsonValue(uint64_t value) : m_type(Type::Number), m_number(static_cast<double>(value)) {}
+	JsonValue(const char* value) : m_type(Type::String), m_string(value) {}
+	JsonValue(const std::string& value) : m_type(Type::String), m_string(value) {}
+
+	static JsonValue array();
+	static JsonValue object();
+
+	// Throws std::runtime_error with the offset of the first syntax error
+	static JsonValue parse(const std::string& text);
+	static JsonValue parseFile(const std::string& path);
+
+	inline Type getType() const { return m_type; }
+	inline bool isNull() const { return m_type == Type::Null; }
+	inline bool isBool() const { return m_type == Type::Bool; }
+	inline bool isNumber() const { return m_type == Type::Number; }
+	inline bool isString() const { return m_type == Type::String; }
+	inline bool isArray() const { return m_type == Type::Array; }
+	inline bool isObject() const { return m_type == Type::Object; }
+
+	// Throw std::runtime_error when the value has another type
+	bool asBool() const;
+	double asNumber() const;
+	const std::string& asString() const;
+
+	// Arrays
+	size_t size() const;
+	const JsonValue& operator[](size_t index) const;
+	void push(const JsonValue& value);
+
+	// Objects, find returns nullptr for a missing member
+	bool contains(const std::string& key) const;
+	const JsonValue* find(const std::string& key) const;
+	const JsonValue& operator[](const std::string& key) const;
+	void set(const std::string& key, const JsonValue& value);
+	inline const std::vector<std::pair<std::string, JsonValue>>& members() const { return m_members; }
+
+	// Members of an object read with a fallback for the missing ones
+	double getNumber(const std::string& key, double fallback) const;
+	std::string getString(const std::string& key, const std::string& fallback) const;
+	bool getBool(const std::string& key, bool fallback) const;
+
+	std::string dump(int indent = 2) const;
+	void writeFile(const std::string& path, int indent = 2) const;
+
+private:
+	Type m_type = Type::Null;
+	bool m_bool = false;
+	double m_number = 0.0;
+	std::string m_string;
+	std::vector<JsonValue> m_elements;
+	std::vector<std::pair<std::string, JsonValue>> m_members;
+
+	void dump(std::string& out, int indent, int depth) const;
+};
+
+#endif
@@ -0,0 +1,322 @@
+#include "TextureCache.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+
+#include "io/ByteStream.h"
+#include "io/TextureLoader.h"
+#include "scene/Scene.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+    constexpr uint32_t g_magic = 0x43545452; // "RTTC"
+    constexpr uint32_t g_version = 1;
+    constexpr uint64_t g_headerSize = 32;
+    constexpr uint64_t g_levelAlignment = 16;
+    // A 16384 texel texture has 15 levels
+    constexpr uint32_t g_maxLevels = 32;
+
+    // FNV-1a over 64 bit words, the textures generated by the scenes are hashed whole
+    class Hasher {
+    public:
+        void add(const void* data, size_t size) {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            while (size >= 8) {
+                uint64_t word;
+                std::memcpy(&word, bytes, 8);
+                mix(word);
+                bytes += 8;
+                size -= 8;
+            }
+            uint64_t tail = 0;
+            std::memcpy(&tail, bytes, size);
+            mix(tail ^ (static_cast<uint64_t>(size) << 56));
+        }
+
+        template<typename T>
+        void add(const T& value) {
+            add(&value, sizeof(T));
+        }
+
+        inline uint64_t getHash() const { return m_hash; }
+
+    private:
+        uint64_t m_hash = 0xCBF29CE484222325ull;
+
+        void mix(uint64_t word) {
+            m_hash = (m_hash ^ word) * 0x100000001B3ull;
+        }
+    };
+
+    uint64_t hashTextures(const std::vector<Texture>& textures, const std::vector<BlockCompression::Format>& formats) {
+        Hasher hasher;
+        hasher.add(g_version);
+        for (size_t i = 0; i < textures.size(); ++i) {
+            const Texture& texture = textures[i];
+            hasher.add(formats[i]);
+            hasher.add(texture.m_encoding);
+            hasher.add(texture.m_path.data(), texture.m_path.size());
+            if (texture.m_pixels.empty()) {
+                // The file is not read, an edited texture changes its size or its modification time
+                std::error_code error;
+                uint64_t size = std::filesystem::file_size(texture.m_path, error);
+                int64_t time = std::filesystem::last_write_time(texture.m_path, error).time_since_epoch().count();
+                hasher.add(size);
+                hasher.add(time);
+            }
+            else {
+                hasher.add(texture.m_width);
+                hasher.add(texture.m_height);
+                hasher.add(texture.m_pixels.data(), texture.m_pixels.size());
+            }
+        }
+        return hasher.getHash();
+    }
+
+}
+
+std::vector<BlockCompression::Format> TextureCache::pickFormats(const Scene& scene) {
+    enum Usage : uint32_t { Albedo = 1, RoughnessMetallic = 2, Normal = 4 };
+    std::vector<uint32_t> usages(scene.m_textures.size(), 0);
+    auto addUsages = [&usages](const Material& material) {
+        const std::pair<int32_t, Usage> maps[] = {
+            { material.m_albedoTexture, Albedo },
+            { material.m_roughnessMetallicTexture, RoughnessMetallic },
+            { material.m_normalTexture, Normal }
+        };
+        for (const auto& [texture, usage] : maps) {
+            if (texture >= 0 && static_cast<size_t>(texture) < usages.size()) {
+                usages[texture] |= usage;
+            }
+        }
+    };
+    for (const Triangle& triangle : scene.m_triangles) {
+        addUsages(triangle.m_material);
+    }
+    for (const Sphere& sphere : scene.m_spheres) {
+        addUsages(sphere.m_material);
+    }
+
+    std::vector<BlockCompression::Format> formats(usages.size(), BlockCompression::Format::Bc7);
+    for (size_t i = 0; i < usages.size(); ++i) {
+        if (usages[i] & Normal) {
+            if (usages[i] != Normal) {
+                throw std::runtime_error("Texture " + std::to_string(i) + " is used both as a normal map and as another map");
+            }
+            formats[i] = BlockCompression::Format::Bc5;
+        }
+        else if (usages[i] == Albedo) {
+            formats[i] = BlockCompression::Format::Bc1;
+        }
+    }
+    return formats;
+}
+
+TextureCache::~TextureCache() {
+    close();
+}
+
+void TextureCache::open(const std::string& path, const std::vector<Texture>& textures, const std::vector<BlockCompression::Format>& formats, unsigned int workerCount) {
+    close();
+    if (formats.size() != textures.size()) {
+        throw std::runtime_error("Texture cache: one format is needed per texture");
+    }
+
+    uint64_t hash = hashTextures(textures, formats);
+    m_rebuilt = false;
+    m_buildTime = 0.0;
+    if (map(path, hash, textures.size())) {
+        return;
+    }
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    build(path, textures, formats, hash, workerCount);
+    m_buildTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+    m_rebuilt = true;
+
+    if (!map(path, hash, textures.size())) {
+        throw std::runtime_error("Texture cache: cannot read back " + path);
+    }
+}
+
+void TextureCache::close() {
+#if defined(__linux__) || defined(__APPLE__)
+    if (m_data != nullptr && m_fileData.empty()) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+#endif
+    m_fileData.clear();
+    m_fileData.shrink_to_fit();
+    m_data = nullptr;
+    m_size = 0;
+    m_entries.clear();
+}
+
+bool TextureCache::map(const std::string& path, uint64_t hash, size_t textureCount) {
+#if defined(__linux__) || defined(__APPLE__)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat status{};
+    if (fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(g_headerSize)) {
+        ::close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(data);
+    m_size = static_cast<size_t>(status.st_size);
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    m_fileData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (m_fileData.empty()) {
+        return false;
+    }
+    m_data = m_fileData.data();
+    m_size = m_fileData.size();
+#endif
+
+    // Anything unexpected is treated as a stale cache, it is rebuilt rather than reported
+    try {
+        ByteReader header(m_data, m_size);
+        if (header.read<uint32_t>() != g_magic || header.read<uint32_t>() != g_version || header.read<uint64_t>() != hash) {
+            close();
+            return false;
+        }
+        uint32_t count = header.read<uint32_t>();
+        header.read<uint32_t>();
+        uint64_t tableOffset = header.read<uint64_t>();
+        if (count != textureCount || tableOffset < g_headerSize || tableOffset > m_size) {
+            close();
+            return false;
+        }
+
+        ByteReader table(m_data + tableOffset, m_size - tableOffset);
+        m_entries.resize(count);
+        for (Entry& entry : m_entries) {
+            uint32_t format = table.read<uint32_t>();
+            uint32_t encoding = table.read<uint32_t>();
+            uint32_t levelCount = table.read<uint32_t>();
+            if (format > static_cast<uint32_t>(BlockCompression::Format::Bc7) || encoding > static_cast<uint32_t>(Texture::Encoding::Linear) || levelCount == 0 || levelCount > g_maxLevels) {
+                close();
+                return false;
+            }
+            entry.m_format = static_cast<BlockCompression::Format>(format);
+            entry.m_encoding = static_cast<Texture::Encoding>(encoding);
+            entry.m_levels.resize(levelCount);
+            for (Level& level : entry.m_levels) {
+                level.m_width = table.read<uint32_t>();
+                level.m_height = table.read<uint32_t>();
+                level.m_offset = table.read<uint64_t>();
+                level.m_size = table.read<uint64_t>();
+                if (level.m_width == 0 || level.m_height == 0 || level.m_size != BlockCompression::getCompressedSize(level.m_width, level.m_height, entry.m_format) ||
+                    level.m_offset < g_headerSize || level.m_offset > tableOffset || level.m_size > tableOffset - level.m_offset) {
+                    close();
+                    return false;
+                }
+            }
+        }
+    }
+    catch (const std::runtime_error&) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void TextureCache::build(const std::string& path, const std::vector<Texture>& textures, const std::vector<BlockCompression::Format>& formats, uint64_t hash, unsigned int workerCount) {
+    // Written next to the cache then renamed over it, an interrupted build never leaves a truncated cache
+    std::string temporaryPath = path + ".tmp";
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("Texture cache: cannot write " + temporaryPath);
+    }
+
+    std::vector<uint8_t> header(g_headerSize, 0);
+    file.write(reinterpret_cast<const char*>(header.data()), header.size());
+    uint64_t offset = g_headerSize;
+
+    std::vector<Entry> entries(textures.size());
+    {
+        TextureLoader loader(textures, workerCount);
+        TextureLoader::DecodedTexture decoded;
+        while (loader.next(decoded)) {
+            Entry& entry = entries[decoded.m_index];
+            entry.m_format = formats[decoded.m_index];
+            entry.m_encoding = decoded.m_encoding;
+
+            for (const TextureLoader::Level& decodedLevel : decoded.m_levels) {
+                std::vector<uint8_t> blocks = BlockCompression::compress(decodedLevel.m_pixels.data(), decodedLevel.m_width, decodedLevel.m_height, entry.m_format, workerCount);
+
+                uint64_t padding = (g_levelAlignment - offset % g_levelAlignment) % g_levelAlignment;
+                const char zeros[g_levelAlignment] = {};
+                file.write(zeros, static_cast<std::streamsize>(padding));
+                offset += padding;
+
+                Level level;
+                level.m_width = decodedLevel.m_width;
+                level.m_height = decodedLevel.m_height;
+                level.m_offset = offset;
+                level.m_size = blocks.size();
+                entry.m_levels.push_back(level);
+
+                file.write(reinterpret_cast<const char*>(blocks.data()), static_cast<std::streamsize>(blocks.size()));
+                offset += blocks.size();
+            }
+        }
+    }
+
+    ByteWriter table;
+    for (const Entry& entry : entries) {
+        table.write(static_cast<uint32_t>(entry.m_format));
+        table.write(static_cast<uint32_t>(entry.m_encoding));
+        table.write(static_cast<uint32_t>(entry.m_levels.size()));
+        for (const Level& level : entry.m_levels) {
+            table.write(level.m_width);
+            table.write(level.m_height);
+            table.write(level.m_offset);
+            table.write(level.m_size);
+        }
+    }
+    file.write(reinterpret_cast<const char*>(table.getData().data()), static_cast<std::streamsize>(table.getData().size()));
+
+    ByteWriter headerWriter;
+    headerWriter.write(g_magic);
+    headerWriter.write(g_version);
+    headerWriter.write(hash);
+    headerWriter.write(static_cast<uint32_t>(textures.size()));
+    headerWriter.write(uint32_t(0));
+    headerWriter.write(offset);
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(headerWriter.getData().data()), static_cast<std::streamsize>(headerWriter.getData().size()));
+
+    file.close();
+    if (!file) {
+        throw std::runtime_error("Texture cache: failed to write " + temporaryPath);
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error) {
+        throw std::runtime_error("Texture cache: cannot replace " + path + ": " + error.message());
+    }
+}
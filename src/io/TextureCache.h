@@ -0,0 +1,74 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "io/BlockCompression.h"
+#include "scene/Texture.h"
+
+struct Scene;
+
+// File holding the block compressed mip chains of the textures of a scene, memory mapped so the streamed
+// levels are copied straight out of it. The file records a hash of the textures it was built from (their
+// pixels, or the path, size and modification time of their file), and is rebuilt by open when the scene
+// no longer matches. The levels are 16 byte aligned, the layout is:
+//  - header: magic, version, hash, texture count, offset of the table
+//  - the blocks of every level, texture by texture in the order they were decoded
+//  - table: format, encoding and size of each texture, then the size, offset and byte count of its levels
+class TextureCache {
+public:
+	struct Level {
+		uint32_t m_width = 0;
+		uint32_t m_height = 0;
+		uint64_t m_offset = 0;
+		uint64_t m_size = 0;
+	};
+
+	struct Entry {
+		BlockCompression::Format m_format = BlockCompression::Format::Bc7;
+		Texture::Encoding m_encoding = Texture::Encoding::Srgb;
+		// Down to 1x1, like the chains of TextureLoader
+		std::vector<Level> m_levels;
+	};
+
+	// BC5 for the normal maps, BC1 for the albedo maps and BC7 for the others. Throws std::runtime_error when
+	// a texture is used both as a normal map and as another map, BC5 drops the channels the others need.
+	static std::vector<BlockCompression::Format> pickFormats(const Scene& scene);
+
+	TextureCache() = default;
+	~TextureCache();
+
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+
+	// Maps the cache at path, building it first when it is missing, unreadable or made from other textures.
+	// Throws std::runtime_error when a texture cannot be decoded or the file cannot be written.
+	void open(const std::string& path, const std::vector<Texture>& textures, const std::vector<BlockCompression::Format>& formats, unsigned int workerCount);
+	void close();
+
+	inline size_t getTextureCount() const { return m_entries.size(); }
+	inline const Entry& getEntry(size_t texture) const { return m_entries[texture]; }
+	inline const uint8_t* getLevelData(size_t texture, size_t level) const { return m_data + m_entries[texture].m_levels[level].m_offset; }
+
+	inline uint64_t getFileSize() const { return m_size; }
+	// Whether the last open had to build the file, and how long that took in milliseconds
+	inline bool wasRebuilt() const { return m_rebuilt; }
+	inline double getBuildTime() const { return m_buildTime; }
+
+private:
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+	// Holds the file when it cannot be memory mapped on this platform
+	std::vector<uint8_t> m_fileData;
+	std::vector<Entry> m_entries;
+	bool m_rebuilt = false;
+	double m_buildTime = 0.0;
+
+	// Returns false when the file is missing, invalid or was built from other textures
+	bool map(const std::string& path, uint64_t hash, size_t textureCount);
+	static void build(const std::string& path, const std::vector<Texture>& textures, const std::vector<BlockCompression::Format>& formats, uint64_t hash, unsigned int workerCount);
+};
+
+#endif
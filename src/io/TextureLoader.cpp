@@ -0,0 +1,210 @@
+#include "TextureLoader.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include "io/ImageReader.h"
+
+namespace {
+
+    float srgbToLinear(float value) {
+        return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+
+    float linearToSrgb(float value) {
+        return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    }
+
+    const std::array<float, 256>& srgbDecodeTable() {
+        static const std::array<float, 256> table = [] {
+            std::array<float, 256> values{};
+            for (size_t i = 0; i < values.size(); ++i) {
+                values[i] = srgbToLinear(static_cast<float>(i) / 255.0f);
+            }
+            return values;
+        }();
+        return table;
+    }
+
+    // Average of the up to 2x2 texels covering each texel of the next level, the last row or column of an odd
+    // size is folded into its neighbour. Alpha is always linear.
+    TextureLoader::Level downsample(const TextureLoader::Level& level, bool srgb) {
+        TextureLoader::Level next;
+        next.m_width = std::max(level.m_width / 2, 1u);
+        next.m_height = std::max(level.m_height / 2, 1u);
+        next.m_pixels.resize(static_cast<size_t>(next.m_width) * next.m_height * 4);
+
+        const std::array<float, 256>& decode = srgbDecodeTable();
+        for (uint32_t y = 0; y < next.m_height; ++y) {
+            uint32_t y0 = std::min(y * 2, level.m_height - 1);
+            uint32_t y1 = std::min(y * 2 + 1, level.m_height - 1);
+            for (uint32_t x = 0; x < next.m_width; ++x) {
+                uint32_t x0 = std::min(x * 2, level.m_width - 1);
+                uint32_t x1 = std::min(x * 2 + 1, level.m_width - 1);
+                const uint8_t* texels[4] = {
+                    &level.m_pixels[(static_cast<size_t>(y0) * level.m_width + x0) * 4],
+                    &level.m_pixels[(static_cast<size_t>(y0) * level.m_width + x1) * 4],
+                    &level.m_pixels[(static_cast<size_t>(y1) * level.m_width + x0) * 4],
+                    &level.m_pixels[(static_cast<size_t>(y1) * level.m_width + x1) * 4]
+                };
+
+                uint8_t* out = &next.m_pixels[(static_cast<size_t>(y) * next.m_width + x) * 4];
+                for (size_t c = 0; c < 4; ++c) {
+                    float sum = 0.0f;
+                    for (const uint8_t* texel : texels) {
+                        sum += srgb && c < 3 ? decode[texel[c]] : static_cast<float>(texel[c]) / 255.0f;
+                    }
+                    float value = sum * 0.25f;
+                    if (srgb && c < 3) {
+                        value = linearToSrgb(value);
+                    }
+                    out[c] = static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+                }
+            }
+        }
+
+        return next;
+    }
+
+    TextureLoader::DecodedTexture decode(const Texture& texture, uint32_t index) {
+        TextureLoader::Level base;
+        if (texture.m_pixels.empty()) {
+            ImageReader::Image image = ImageReader::read(texture.m_path);
+            base.m_width = image.m_width;
+            base.m_height = image.m_height;
+            base.m_pixels = std::move(image.m_pixels);
+        }
+        else {
+            if (texture.m_width == 0 || texture.m_height == 0 || texture.m_pixels.size() != static_cast<size_t>(texture.m_width) * texture.m_height * 4) {
+                throw std::runtime_error("the pixels do not match the size of the texture");
+            }
+            base.m_width = texture.m_width;
+            base.m_height = texture.m_height;
+            base.m_pixels = texture.m_pixels;
+        }
+
+        TextureLoader::DecodedTexture decoded;
+        decoded.m_index = index;
+        decoded.m_encoding = texture.m_encoding;
+        decoded.m_levels = TextureLoader::buildMipChain(std::move(base), texture.m_encoding);
+        return decoded;
+    }
+
+}
+
+TextureLoader::TextureLoader(const std::vector<Texture>& textures, unsigned int workerCount)
+    : m_textures(textures) {
+    workerCount = std::clamp<unsigned int>(workerCount, 1u, static_cast<unsigned int>(std::max<size_t>(textures.size(), 1)));
+    m_maxQueuedTextures = 2 * static_cast<size_t>(workerCount);
+    for (unsigned int i = 0; i < workerCount; ++i) {
+        m_workers.emplace_back(&TextureLoader::workerLoop, this);
+    }
+}
+
+TextureLoader::~TextureLoader() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_textureTaken.notify_all();
+
+    for (std::thread& worker : m_workers) {
+        worker.join();
+    }
+}
+
+bool TextureLoader::next(DecodedTexture& texture) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_handedOut == m_textures.size()) {
+        return false;
+    }
+
+    m_textureDecoded.wait(lock, [this] { return !m_decoded.empty() || m_error; });
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+
+    texture = std::move(m_decoded.front());
+    m_decoded.pop_front();
+    ++m_handedOut;
+    lock.unlock();
+
+    m_textureTaken.notify_one();
+    return true;
+}
+
+bool TextureLoader::poll(DecodedTexture& texture) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+    if (m_decoded.empty()) {
+        return false;
+    }
+
+    texture = std::move(m_decoded.front());
+    m_decoded.pop_front();
+    ++m_handedOut;
+    lock.unlock();
+
+    m_textureTaken.notify_one();
+    return true;
+}
+
+std::vector<TextureLoader::Level> TextureLoader::buildMipChain(Level&& base, Texture::Encoding encoding) {
+    std::vector<Level> levels;
+    levels.push_back(std::move(base));
+    while (levels.back().m_width > 1 || levels.back().m_height > 1) {
+        levels.push_back(downsample(levels.back(), encoding == Texture::Encoding::Srgb));
+    }
+    return levels;
+}
+
+double TextureLoader::getDecodeTime() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_decodeTime;
+}
+
+void TextureLoader::workerLoop() {
+    while (true) {
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_textureTaken.wait(lock, [this] { return m_decoded.size() < m_maxQueuedTextures || m_stopping || m_error; });
+            if (m_stopping || m_error || m_nextTexture == m_textures.size()) {
+                return;
+            }
+            index = m_nextTexture++;
+        }
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        DecodedTexture texture;
+        std::exception_ptr error;
+        try {
+            texture = decode(m_textures[index], static_cast<uint32_t>(index));
+        }
+        catch (const std::exception& e) {
+            const std::string& path = m_textures[index].m_path;
+            error = std::make_exception_ptr(std::runtime_error("Texture " + std::to_string(index) + (path.empty() ? "" : " (" + path + ")") + ": " + e.what()));
+        }
+        double decodeTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_decodeTime += decodeTime;
+            if (error) {
+                if (!m_error) {
+                    m_error = error;
+                }
+            }
+            else {
+                m_decoded.push_back(std::move(texture));
+            }
+        }
+        m_textureDecoded.notify_all();
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "scene/Texture.h"
+
+// Decodes the textures of a scene and builds their mip chains on worker threads. The textures are handed
+// out in the order they finish, so the upload of the first ones overlaps the decoding of the others. Like
+// the queue of FrameEncoder, the decoded textures waiting for next are bounded to keep the memory in check.
+class TextureLoader {
+public:
+	struct Level {
+		uint32_t m_width = 0;
+		uint32_t m_height = 0;
+		// RGBA8, rows from top to bottom
+		std::vector<uint8_t> m_pixels;
+	};
+
+	struct DecodedTexture {
+		// Index of the texture in the list given to the loader
+		uint32_t m_index = 0;
+		Texture::Encoding m_encoding = Texture::Encoding::Srgb;
+		// Down to 1x1, each level half the size of the previous one rounded down
+		std::vector<Level> m_levels;
+	};
+
+	// The textures must outlive the loader, the decoding starts right away
+	TextureLoader(const std::vector<Texture>& textures, unsigned int workerCount);
+	~TextureLoader();
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	// Blocks until a texture is decoded, returns false once all of them were handed out. Rethrows the first
+	// error of a worker, naming the texture that failed.
+	bool next(DecodedTexture& texture);
+	// Like next without blocking, false when no texture is decoded yet or all of them were handed out
+	bool poll(DecodedTexture& texture);
+
+	// Box filtered mip chain of an RGBA8 image, averaged in linear space for the sRGB encoding
+	static std::vector<Level> buildMipChain(Level&& base, Texture::Encoding encoding);
+
+	// Decoding and filtering time summed over the workers, in milliseconds
+	double getDecodeTime() const;
+
+private:
+	const std::vector<Texture>& m_textures;
+	size_t m_maxQueuedTextures;
+
+	std::vector<std::thread> m_workers;
+	size_t m_nextTexture = 0;
+	size_t m_handedOut = 0;
+	std::deque<DecodedTexture> m_decoded;
+	bool m_stopping = false;
+	std::exception_ptr m_error;
+	double m_decodeTime = 0.0;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_textureDecoded;
+	std::condition_variable m_textureTaken;
+
+	void workerLoop();
+};
+
+#endif
@@ -1,11 +1,175 @@
 #include "application/Application.h"
+#include "application/AnimationRenderer.h"
+#include "application/RenderConfig.h"
+#include "distributed/RenderCoordinator.h"
+#include "distributed/RenderWorker.h"
 
 #include <iostream>
+#include <string>
 
-int main() {
-    Application app;
+namespace {
+
+    void printUsage() {
+        std::cout << "Usage: raytracer [options]\n"
+                  << "Without --camera-path the interactive viewer opens, at the given resolution, with the captures written\n"
+                  << "to the output directory (default captures). With --camera-path, the frames of the path are rendered\n"
+                  << "headlessly and written to the output directory (default frames). Shared options:\n"
+                  << RenderConfig::getUsage()
+                  << "Resolution 1280x720 and 10 spp by default. Frame rendering options:\n"
+                  << "  --camera-path <file>    JSON camera keyframes to render\n"
+                  << "  --format <png|pfm|exr>  8 bit PNG, linear float PFM or EXR (default png)\n"
+                  << "  --denoise               denoise the frames rendered in a single pass\n"
+                  << "  --workers <count>       encoding threads (default half of the threads)\n"
+                  << "\n"
+                  << "raytracer --coordinator [options] renders one image split in tiles across worker processes:\n"
+                  << "  --address <address>     unix:<path> or <host>:<port> to listen on (default unix:/tmp/raytracer.sock)\n"
+                  << "  --workers <count>       workers to wait for (default 2)\n"
+                  << "  --scene <file>          binary scene file (default Cornell box)\n"
+                  << "  --camera-path <file>    JSON camera keyframes giving the camera\n"
+                  << "  --frame <index>         frame of the camera path (default 0)\n"
+                  << "  --output <file>         image written, png, pfm or exr by extension (default render.exr)\n"
+                  << "  --width, --height, --samples as above (default 1920x1080, 256 spp)\n"
+                  << "  --tile-size <pixels>    edge of the tiles handed out (default 128)\n"
+                  << "\n"
+                  << "raytracer --worker [options] renders tiles for a coordinator:\n"
+                  << "  --address <address>     address of the coordinator (default unix:/tmp/raytracer.sock)\n"
+                  << "  --name <name>           shown in the report of the coordinator\n"
+                  << "  --timeout <seconds>     how long to retry connecting (default 30)\n";
+    }
+
+    std::string nextValue(int argc, char** argv, int& i) {
+        if (i + 1 >= argc) {
+            throw std::runtime_error(std::string("Missing value for ") + argv[i]);
+        }
+        return argv[++i];
+    }
+
+    // The options of the frame rendering on top of the shared ones, none of which open the viewer
+    bool parseAnimationArgument(int argc, char** argv, int& i, AnimationRenderer::Settings& settings) {
+        std::string argument = argv[i];
+        if (argument == "--camera-path") {
+            settings.m_cameraPath = nextValue(argc, argv, i);
+        }
+        else if (argument == "--format") {
+            settings.m_format = ImageWriter::parseFormat(nextValue(argc, argv, i));
+        }
+        else if (argument == "--denoise") {
+            settings.m_denoise = true;
+        }
+        else if (argument == "--workers") {
+            settings.m_encodeWorkers = static_cast<unsigned int>(std::stoul(nextValue(argc, argv, i)));
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+
+    RenderCoordinator::Settings parseCoordinatorArguments(int argc, char** argv) {
+        RenderCoordinator::Settings settings;
+
+        for (int i = 2; i < argc; ++i) {
+            std::string argument = argv[i];
+            if (argument == "--address") {
+                settings.m_address = nextValue(argc, argv, i);
+            }
+            else if (argument == "--workers") {
+                settings.m_workers = static_cast<unsigned int>(std::stoul(nextValue(argc, argv, i)));
+            }
+            else if (argument == "--scene") {
+                settings.m_scenePath = nextValue(argc, argv, i);
+            }
+            else if (argument == "--camera-path") {
+                settings.m_cameraPath = nextValue(argc, argv, i);
+            }
+            else if (argument == "--frame") {
+                settings.m_cameraFrame = static_cast<uint32_t>(std::stoul(nextValue(argc, argv, i)));
+            }
+            else if (argument == "--output") {
+                settings.m_output = nextValue(argc, argv, i);
+            }
+            else if (argument == "--width") {
+                settings.m_width = static_cast<uint32_t>(std::stoul(nextValue(argc, argv, i)));
+            }
+            else if (argument == "--height") {
+                settings.m_height = static_cast<uint32_t>(std::stoul(nextValue(argc, argv, i)));
+            }
+            else if (argument == "--samples") {
+                settings.m_samples = std::stoi(nextValue(argc, argv, i));
+            }
+            else if (argument == "--tile-size") {
+                settings.m_tileSize = std::stoi(nextValue(argc, argv, i));
+            }
+            else {
+                throw std::runtime_error("Unknown argument " + argument);
+            }
+        }
+
+        return settings;
+    }
+
+    RenderWorker::Settings parseWorkerArguments(int argc, char** argv) {
+        RenderWorker::Settings settings;
+
+        for (int i = 2; i < argc; ++i) {
+            std::string argument = argv[i];
+            if (argument == "--address") {
+                settings.m_address = nextValue(argc, argv, i);
+            }
+            else if (argument == "--name") {
+                settings.m_name = nextValue(argc, argv, i);
+            }
+            else if (argument == "--timeout") {
+                settings.m_connectTimeout = std::stof(nextValue(argc, argv, i));
+            }
+            else {
+                throw std::runtime_error("Unknown argument " + argument);
+            }
+        }
+
+        return settings;
+    }
+
+}
+
+int main(int argc, char** argv) {
+    std::string mode = argc > 1 ? argv[1] : "";
+    if (mode == "--help" || mode == "-h") {
+        printUsage();
+        return EXIT_SUCCESS;
+    }
 
     try {
+        if (mode == "--coordinator") {
+            RenderCoordinator::run(parseCoordinatorArguments(argc, argv));
+            return EXIT_SUCCESS;
+        }
+        if (mode == "--worker") {
+            RenderWorker::run(parseWorkerArguments(argc, argv));
+            return EXIT_SUCCESS;
+        }
+
+        // Validated here, before any window or device is created
+        RenderConfig config;
+        AnimationRenderer::Settings animationSettings;
+        bool animationOption = false;
+        config.parse(argc, argv, 1, [&](int argc, char** argv, int& i) {
+            if (!parseAnimationArgument(argc, argv, i, animationSettings)) {
+                return false;
+            }
+            animationOption = true;
+            return true;
+        });
+
+        if (!animationSettings.m_cameraPath.empty()) {
+            AnimationRenderer::run(config, animationSettings);
+            return EXIT_SUCCESS;
+        }
+        if (animationOption) {
+            throw std::runtime_error("--camera-path is required to render frames");
+        }
+
+        Application app(config);
         app.run();
     }
     catch (const std::exception& e) {
@@ -14,4 +178,4 @@ int main() {
     }
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
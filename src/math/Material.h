@@ -3,16 +3,28 @@
 
 #include <glm/glm.hpp>
 
+#include <cstdint>
+
 struct Material {
     alignas(16) glm::vec3 m_albedo;
     alignas(16) glm::vec3 m_emission;
     alignas(4) float m_emissionStrength;
     alignas(4) float m_roughness;
     alignas(4) float m_metallic;
-    //TODO add
-    //alignas(4) float m_ior;
-    //alignas(4) float m_transparency;
-    //alignas(16) glm::vec3 m_transparencyColor;
+    // Index of refraction of the dielectric part, at 587.6 nm in the spectral mode
+    alignas(4) float m_ior = 1.5f;
+    // Probability of the dielectric BSDF over the opaque one, 0 for opaque materials
+    alignas(4) float m_transparency = 0.0f;
+    // Filter applied to the light transmitted through the surface
+    alignas(16) glm::vec3 m_transparencyColor{ 1.0f };
+    // Indices in the textures of the scene, -1 for none. The albedo map multiplies the albedo, the green and blue
+    // channels of the roughness/metallic map multiply the roughness and the metallic factors, as in glTF.
+    alignas(4) int32_t m_albedoTexture = -1;
+    alignas(4) int32_t m_roughnessMetallicTexture = -1;
+    // Tangent space normal map, the tangents follow the texture coordinates
+    alignas(4) int32_t m_normalTexture = -1;
+
+    bool operator==(const Material& other) const = default;
 };
 
 #endif // MATERIAL_H
@@ -55,19 +55,25 @@ struct Sphere {
                 glm::vec3 n3 = glm::normalize(v3 - m_center);
                 glm::vec3 n4 = glm::normalize(v4 - m_center);
 
+                // Longitude and colatitude over [0,1], the mapping the trace pass uses for the analytic spheres
+                glm::vec2 uv1(static_cast<float>(j) / slices, static_cast<float>(i) / stacks);
+                glm::vec2 uv2(static_cast<float>(j) / slices, static_cast<float>(i + 1) / stacks);
+                glm::vec2 uv3(static_cast<float>(j + 1) / slices, static_cast<float>(i + 1) / stacks);
+                glm::vec2 uv4(static_cast<float>(j + 1) / slices, static_cast<float>(i) / stacks);
+
                 // First triangle of the quad
-                Vertex3D vertex0(v1, n1);
-                Vertex3D vertex1(v2, n2);
-                Vertex3D vertex2(v3, n3);
+                Vertex3D vertex0(v1, n1, uv1);
+                Vertex3D vertex1(v2, n2, uv2);
+                Vertex3D vertex2(v3, n3, uv3);
 
                 triangles.emplace_back(
                     Triangle(vertex0, vertex1, vertex2, m_material)
                 );
 
                 // Second triangle of the quad
-                Vertex3D vertex3(v1, n1);
-                Vertex3D vertex4(v3, n3);
-                Vertex3D vertex5(v4, n4);
+                Vertex3D vertex3(v1, n1, uv1);
+                Vertex3D vertex4(v3, n3, uv3);
+                Vertex3D vertex5(v4, n4, uv4);
 
                 triangles.emplace_back(
                     Triangle(vertex3, vertex4, vertex5, m_material)
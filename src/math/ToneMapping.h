@@ -0,0 +1,163 @@
+#ifndef TONE_MAPPING_H
+#define TONE_MAPPING_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Maps the linear radiance to the display, as tonemap_comp.glsl does on the GPU: exposure and white balance
+// first, as a single matrix, then the curve of the operator. The result is display linear, encoded to sRGB by
+// the swapchain or by encodeSrgb when writing 8 bit images.
+struct ToneMapping {
+	// Must match the operators of tonemap_comp.glsl
+	enum class Operator : int32_t { Aces, Agx, Filmic, Clamp };
+
+	Operator m_operator = Operator::Aces;
+	// In stops
+	float m_exposure = 0.0f;
+	// Color temperature of the light the image is balanced for, in kelvin, 6500 leaves it unchanged.
+	// The tint moves that white off the Planckian locus, positive values towards magenta.
+	float m_temperature = 6500.0f;
+	float m_tint = 0.0f;
+
+	bool operator==(const ToneMapping& other) const = default;
+
+	// Exposure and white balance of linear sRGB colors
+	glm::mat3 colorTransform() const;
+
+	static glm::vec3 apply(Operator op, glm::vec3 color);
+	static float encodeSrgb(float value);
+};
+
+namespace ToneMappingDetail {
+
+	// Matrices written row by row, glm stores them column by column
+	inline glm::mat3 fromRows(glm::vec3 r0, glm::vec3 r1, glm::vec3 r2) {
+		return glm::transpose(glm::mat3(r0, r1, r2));
+	}
+
+	// CIE xy of the Planckian locus, cubic spline fit of Kang et al. over [1667, 25000] K
+	inline glm::vec2 planckianLocus(float temperature) {
+		float t = std::clamp(temperature, 1667.0f, 25000.0f);
+		float t1 = 1000.0f / t;
+		float t2 = t1 * t1;
+		float t3 = t2 * t1;
+		float x = t <= 4000.0f ? -0.2661239f * t3 - 0.2343589f * t2 + 0.8776956f * t1 + 0.179910f
+			: -3.0258469f * t3 + 2.1070379f * t2 + 0.2226347f * t1 + 0.240390f;
+		float x2 = x * x;
+		float x3 = x2 * x;
+		float y;
+		if (t <= 2222.0f) {
+			y = -1.1063814f * x3 - 1.34811020f * x2 + 2.18555832f * x - 0.20219683f;
+		} else if (t <= 4000.0f) {
+			y = -0.9549476f * x3 - 1.37418593f * x2 + 2.09137015f * x - 0.16748867f;
+		} else {
+			y = 3.0817580f * x3 - 5.87338670f * x2 + 3.75112997f * x - 0.37001483f;
+		}
+		return glm::vec2(x, y);
+	}
+
+	// XYZ of unit luminance of the white at the temperature, the tint offsets it along v in CIE 1960 UCS
+	inline glm::vec3 whitePoint(float temperature, float tint) {
+		glm::vec2 xy = planckianLocus(temperature);
+		float d = -2.0f * xy.x + 12.0f * xy.y + 3.0f;
+		float u = 4.0f * xy.x / d;
+		float v = 6.0f * xy.y / d + tint * 0.02f;
+		d = 2.0f * u - 8.0f * v + 4.0f;
+		xy = glm::vec2(3.0f * u / d, 2.0f * v / d);
+		return glm::vec3(xy.x / xy.y, 1.0f, (1.0f - xy.x - xy.y) / xy.y);
+	}
+
+	inline float hableCurve(float x) {
+		constexpr float a = 0.15f, b = 0.50f, c = 0.10f, d = 0.20f, e = 0.02f, f = 0.30f;
+		return (x * (a * x + c * b) + d * e) / (x * (a * x + b) + d * f) - e / f;
+	}
+
+}
+
+inline glm::mat3 ToneMapping::colorTransform() const {
+	using namespace ToneMappingDetail;
+
+	const glm::mat3 rgbToXyz = fromRows(
+		glm::vec3(0.4124564f, 0.3575761f, 0.1804375f),
+		glm::vec3(0.2126729f, 0.7151522f, 0.0721750f),
+		glm::vec3(0.0193339f, 0.1191920f, 0.9503041f));
+	const glm::mat3 bradford = fromRows(
+		glm::vec3(0.8951f, 0.2664f, -0.1614f),
+		glm::vec3(-0.7502f, 1.7135f, 0.0367f),
+		glm::vec3(0.0389f, -0.0685f, 1.0296f));
+
+	// Von Kries adaptation in the Bradford cone space, from the chosen white to the one of the defaults rather
+	// than to D65, which lies slightly off the locus
+	glm::vec3 source = bradford * whitePoint(m_temperature, m_tint);
+	glm::vec3 target = bradford * whitePoint(6500.0f, 0.0f);
+	glm::mat3 adaptation = glm::inverse(bradford) * glm::mat3(
+		glm::vec3(target.x / source.x, 0.0f, 0.0f),
+		glm::vec3(0.0f, target.y / source.y, 0.0f),
+		glm::vec3(0.0f, 0.0f, target.z / source.z)) * bradford;
+
+	return glm::inverse(rgbToXyz) * adaptation * rgbToXyz * std::exp2(m_exposure);
+}
+
+inline glm::vec3 ToneMapping::apply(Operator op, glm::vec3 color) {
+	using namespace ToneMappingDetail;
+
+	color = glm::max(color, glm::vec3(0.0f));
+	switch (op) {
+	case Operator::Aces: {
+		// Fit of the ACES reference rendering and sRGB output transforms by Stephen Hill
+		const glm::mat3 input = fromRows(
+			glm::vec3(0.59719f, 0.35458f, 0.04823f),
+			glm::vec3(0.07600f, 0.90834f, 0.01566f),
+			glm::vec3(0.02840f, 0.13383f, 0.83777f));
+		const glm::mat3 output = fromRows(
+			glm::vec3(1.60475f, -0.53108f, -0.07367f),
+			glm::vec3(-0.10208f, 1.10813f, -0.00605f),
+			glm::vec3(-0.00327f, -0.07276f, 1.07602f));
+		glm::vec3 v = input * color;
+		glm::vec3 a = v * (v + 0.0245786f) - 0.000090537f;
+		glm::vec3 b = v * (0.983729f * v + 0.4329510f) + 0.238081f;
+		color = output * (a / b);
+		break;
+	}
+	case Operator::Agx: {
+		// Polynomial fit of the default AgX contrast curve over its log2 encoding
+		const glm::mat3 inset = fromRows(
+			glm::vec3(0.842479062253094f, 0.0784335999999992f, 0.0792237451477643f),
+			glm::vec3(0.0423282422610123f, 0.878468636469772f, 0.0791661274605434f),
+			glm::vec3(0.0423756549057051f, 0.0784336f, 0.879142973793104f));
+		const glm::mat3 outset = fromRows(
+			glm::vec3(1.19687900512017f, -0.0980208811401368f, -0.0990297440797205f),
+			glm::vec3(-0.0528968517574562f, 1.15190312990417f, -0.0989611768448433f),
+			glm::vec3(-0.0529716355144438f, -0.0980434501171241f, 1.15107367264116f));
+		constexpr float minEv = -12.47393f;
+		constexpr float maxEv = 4.026069f;
+		glm::vec3 x = inset * color;
+		x = glm::clamp(glm::log2(glm::max(x, glm::vec3(1e-10f))), minEv, maxEv);
+		x = (x - minEv) / (maxEv - minEv);
+		glm::vec3 x2 = x * x;
+		glm::vec3 x4 = x2 * x2;
+		x = 15.5f * x4 * x2 - 40.14f * x4 * x + 31.96f * x4 - 6.868f * x2 * x + 0.4298f * x2 + 0.1191f * x - 0.00232f;
+		// The curve ends in a 2.2 gamma encoding
+		color = glm::pow(glm::max(outset * x, glm::vec3(0.0f)), glm::vec3(2.2f));
+		break;
+	}
+	case Operator::Filmic: {
+		// Curve of John Hable, white at 11.2 after doubling the exposure
+		float white = hableCurve(11.2f);
+		color = glm::vec3(hableCurve(2.0f * color.x), hableCurve(2.0f * color.y), hableCurve(2.0f * color.z)) / white;
+		break;
+	}
+	case Operator::Clamp:
+		break;
+	}
+	return glm::clamp(color, 0.0f, 1.0f);
+}
+
+inline float ToneMapping::encodeSrgb(float value) {
+	return value <= 0.0031308f ? 12.92f * value : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+#endif // TONE_MAPPING_H
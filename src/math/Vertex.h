@@ -38,6 +38,8 @@ struct Vertex2D {
 struct Vertex3D {
     alignas(16) glm::vec3 m_position;
     alignas(16) glm::vec3 m_normal;
+    // Texture coordinates, interpolated at the hits of the trace pass
+    alignas(8) glm::vec2 m_uv{ 0.0f };
 
     static VkVertexInputBindingDescription getBindingDescription() {
         VkVertexInputBindingDescription bindingDescription{};
@@ -0,0 +1,367 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+namespace {
+
+    // Calls work on threadCount contiguous parts of [0, count), on as many threads when there is more than one
+    void runSplit(size_t count, size_t threadCount, const std::function<void(size_t, size_t)>& work) {
+        if (threadCount <= 1) {
+            work(0, count);
+            return;
+        }
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < threadCount; ++i) {
+            threads.emplace_back(work, count * i / threadCount, count * (i + 1) / threadCount);
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+}
+
+void Bvh::Bounds::grow(const glm::vec3& point) {
+    m_min = glm::min(m_min, point);
+    m_max = glm::max(m_max, point);
+}
+
+void Bvh::Bounds::grow(const Bounds& bounds) {
+    m_min = glm::min(m_min, bounds.m_min);
+    m_max = glm::max(m_max, bounds.m_max);
+}
+
+float Bvh::Bounds::getArea() const {
+    if (m_min.x > m_max.x || m_min.y > m_max.y || m_min.z > m_max.z) {
+        return 0.0f;
+    }
+    glm::vec3 extent = m_max - m_min;
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+void Bvh::build(const std::vector<Triangle>& triangles, const std::vector<Sphere>& spheres, unsigned int workerCount) {
+    uint32_t triangleCount = static_cast<uint32_t>(triangles.size());
+    uint32_t primitiveCount = triangleCount + static_cast<uint32_t>(spheres.size());
+
+    m_primitives.clear();
+    m_primitives.reserve(primitiveCount);
+    for (uint32_t i = 0; i < triangleCount; ++i) {
+        m_primitives.push_back(i);
+    }
+    for (uint32_t i = 0; i < spheres.size(); ++i) {
+        m_primitives.push_back(i | m_SPHERE_BIT);
+    }
+
+    bool parallel = workerCount > 1 && primitiveCount >= 2 * m_PARALLEL_BUILD_PRIMITIVES;
+    size_t threadCount = parallel ? workerCount : 1;
+
+    BuildInput input;
+    input.m_triangleCount = triangleCount;
+    input.m_bounds.resize(primitiveCount);
+    input.m_centroids.resize(primitiveCount);
+    // Each slot is written by a single thread, m_primitives is still in scene order here
+    runSplit(primitiveCount, threadCount, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Bounds bounds = getPrimitiveBounds(triangles, spheres, m_primitives[i]);
+            input.m_bounds[i] = bounds;
+            input.m_centroids[i] = (bounds.m_min + bounds.m_max) * 0.5f;
+        }
+    });
+
+    m_nodes.clear();
+    m_nodes.reserve(getMaxNodeCount(primitiveCount));
+    m_nodes.push_back(Node{});
+    m_parents.assign(1, 0);
+
+    // The top of the hierarchy is split here until the ranges are small enough to give every worker a few of
+    // them, the subtrees below are built concurrently, each on its own range of m_primitives
+    std::vector<BuildTask> tasks = { { 0, 0, primitiveCount, 0 } };
+    std::vector<BuildTask> subtrees;
+    uint32_t subtreeSize = parallel ? std::max(primitiveCount / (4 * workerCount), m_PARALLEL_BUILD_PRIMITIVES) : 0;
+    buildNodes(input, tasks, m_nodes, m_parents, subtreeSize, parallel ? &subtrees : nullptr);
+
+    if (!subtrees.empty()) {
+        // Largest first, so the last ones taken do not keep a single worker busy
+        std::sort(subtrees.begin(), subtrees.end(), [](const BuildTask& a, const BuildTask& b) { return a.m_count > b.m_count; });
+
+        // Rooted at their own node 0, whose parent is meaningless until spliced
+        std::vector<std::vector<Node>> subtreeNodes(subtrees.size());
+        std::vector<std::vector<uint32_t>> subtreeParents(subtrees.size());
+        std::atomic<size_t> next = 0;
+        // The parts are ignored, every worker takes the next subtree left until there is none
+        auto buildSubtrees = [&](size_t, size_t) {
+            for (size_t i = next++; i < subtrees.size(); i = next++) {
+                std::vector<BuildTask> subtreeTasks = { { 0, subtrees[i].m_first, subtrees[i].m_count, subtrees[i].m_depth } };
+                subtreeNodes[i].push_back(Node{});
+                subtreeParents[i].push_back(0);
+                buildNodes(input, subtreeTasks, subtreeNodes[i], subtreeParents[i], 0, nullptr);
+            }
+        };
+        runSplit(subtrees.size(), std::min<size_t>(threadCount, subtrees.size()), buildSubtrees);
+
+        // The root of a subtree replaces the node it was deferred from, its other nodes are appended in order,
+        // which keeps the children next to each other and after their parent
+        for (size_t i = 0; i < subtrees.size(); ++i) {
+            uint32_t root = subtrees[i].m_node;
+            uint32_t base = static_cast<uint32_t>(m_nodes.size());
+            auto place = [root, base](uint32_t node) { return node == 0 ? root : base + node - 1; };
+            for (uint32_t node = 0; node < subtreeNodes[i].size(); ++node) {
+                Node current = subtreeNodes[i][node];
+                if (current.m_count == 0) {
+                    current.m_leftOrFirst = static_cast<int32_t>(place(static_cast<uint32_t>(current.m_leftOrFirst)));
+                }
+                if (node == 0) {
+                    m_nodes[root] = current;
+                }
+                else {
+                    m_nodes.push_back(current);
+                    m_parents.push_back(place(subtreeParents[i][node]));
+                }
+            }
+        }
+    }
+
+    m_triangleLeaves.assign(triangles.size(), 0);
+    m_sphereLeaves.assign(spheres.size(), 0);
+    m_costSum = 0.0f;
+    for (uint32_t node = 0; node < m_nodes.size(); ++node) {
+        const Node& current = m_nodes[node];
+        m_costSum += getNodeCost(current);
+        for (int32_t i = 0; i < current.m_count; ++i) {
+            uint32_t primitive = m_primitives[current.m_leftOrFirst + i];
+            if (primitive & m_SPHERE_BIT) {
+                m_sphereLeaves[primitive & ~m_SPHERE_BIT] = node;
+            }
+            else {
+                m_triangleLeaves[primitive] = node;
+            }
+        }
+    }
+    m_buildCost = getCost();
+
+    m_refitMarks.assign(m_nodes.size(), 0);
+    m_refitIndex = 0;
+    m_dirtyNodes.clear();
+    m_dirtyNodes.add(0, static_cast<uint32_t>(m_nodes.size()));
+    m_primitivesDirty = true;
+}
+
+void Bvh::buildNodes(const BuildInput& input, std::vector<BuildTask>& tasks, std::vector<Node>& nodes, std::vector<uint32_t>& parents,
+    uint32_t subtreeSize, std::vector<BuildTask>* subtrees) {
+    auto slot = [&input](uint32_t primitive) { return input.getSlot(primitive); };
+    while (!tasks.empty()) {
+        BuildTask task = tasks.back();
+        tasks.pop_back();
+
+        if (subtrees && task.m_count <= subtreeSize) {
+            subtrees->push_back(task);
+            continue;
+        }
+
+        Bounds nodeBounds;
+        Bounds centroidBounds;
+        for (uint32_t i = task.m_first; i < task.m_first + task.m_count; ++i) {
+            nodeBounds.grow(input.m_bounds[slot(m_primitives[i])]);
+            centroidBounds.grow(input.m_centroids[slot(m_primitives[i])]);
+        }
+        setNodeBounds(nodes[task.m_node], nodeBounds);
+        nodes[task.m_node].m_leftOrFirst = static_cast<int32_t>(task.m_first);
+        nodes[task.m_node].m_count = static_cast<int32_t>(task.m_count);
+        if (task.m_count <= 1 || task.m_depth + 1 >= m_MAX_DEPTH) {
+            continue;
+        }
+
+        // Splits between bins of the centroids along each axis, the cheapest one wins
+        float nodeArea = std::max(nodeBounds.getArea(), 1e-12f);
+        float bestCost = 3.0e38f;
+        int bestAxis = -1;
+        uint32_t bestSplit = 0;
+        for (int axis = 0; axis < 3; ++axis) {
+            float extent = centroidBounds.m_max[axis] - centroidBounds.m_min[axis];
+            if (extent <= 0.0f) {
+                continue;
+            }
+            float scale = m_BIN_COUNT / extent;
+
+            std::array<Bounds, m_BIN_COUNT> bins{};
+            std::array<uint32_t, m_BIN_COUNT> counts{};
+            for (uint32_t i = task.m_first; i < task.m_first + task.m_count; ++i) {
+                uint32_t primitive = slot(m_primitives[i]);
+                uint32_t bin = std::min(static_cast<uint32_t>((input.m_centroids[primitive][axis] - centroidBounds.m_min[axis]) * scale), m_BIN_COUNT - 1);
+                bins[bin].grow(input.m_bounds[primitive]);
+                ++counts[bin];
+            }
+
+            // Area and count left of each split, accumulated from the left, then the right side from the right
+            std::array<float, m_BIN_COUNT - 1> leftCosts{};
+            Bounds leftBounds;
+            uint32_t leftCount = 0;
+            for (uint32_t split = 1; split < m_BIN_COUNT; ++split) {
+                leftBounds.grow(bins[split - 1]);
+                leftCount += counts[split - 1];
+                leftCosts[split - 1] = leftBounds.getArea() * leftCount;
+            }
+            Bounds rightBounds;
+            uint32_t rightCount = 0;
+            for (uint32_t split = m_BIN_COUNT - 1; split > 0; --split) {
+                rightBounds.grow(bins[split]);
+                rightCount += counts[split];
+                if (rightCount == 0 || rightCount == task.m_count) {
+                    continue;
+                }
+                float cost = m_TRAVERSAL_COST + m_INTERSECTION_COST * (leftCosts[split - 1] + rightBounds.getArea() * rightCount) / nodeArea;
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        // Every centroid in one place, nothing to split along
+        if (bestAxis < 0) {
+            continue;
+        }
+        if (bestCost >= m_INTERSECTION_COST * task.m_count && task.m_count <= m_MAX_LEAF_SIZE) {
+            continue;
+        }
+
+        float binMin = centroidBounds.m_min[bestAxis];
+        float scale = m_BIN_COUNT / (centroidBounds.m_max[bestAxis] - binMin);
+        auto middle = std::partition(m_primitives.begin() + task.m_first, m_primitives.begin() + task.m_first + task.m_count, [&](uint32_t primitive) {
+            uint32_t bin = std::min(static_cast<uint32_t>((input.m_centroids[slot(primitive)][bestAxis] - binMin) * scale), m_BIN_COUNT - 1);
+            return bin < bestSplit;
+        });
+        uint32_t leftCount = static_cast<uint32_t>(middle - m_primitives.begin()) - task.m_first;
+
+        uint32_t left = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(Node{});
+        nodes.push_back(Node{});
+        parents.push_back(task.m_node);
+        parents.push_back(task.m_node);
+        nodes[task.m_node].m_leftOrFirst = static_cast<int32_t>(left);
+        nodes[task.m_node].m_count = 0;
+
+        tasks.push_back({ left + 1, task.m_first + leftCount, task.m_count - leftCount, task.m_depth + 1 });
+        tasks.push_back({ left, task.m_first, leftCount, task.m_depth + 1 });
+    }
+}
+
+uint32_t Bvh::refit(const std::vector<Triangle>& triangles, const std::vector<Sphere>& spheres,
+    const std::vector<uint32_t>& dirtyTriangles, const std::vector<uint32_t>& dirtySpheres, unsigned int workerCount) {
+    if (++m_refitIndex == 0) {
+        std::fill(m_refitMarks.begin(), m_refitMarks.end(), 0);
+        m_refitIndex = 1;
+    }
+
+    std::vector<uint32_t> leaves;
+    auto addLeaf = [&](uint32_t leaf) {
+        if (m_refitMarks[leaf] != m_refitIndex) {
+            m_refitMarks[leaf] = m_refitIndex;
+            leaves.push_back(leaf);
+        }
+    };
+    for (uint32_t triangle : dirtyTriangles) {
+        addLeaf(m_triangleLeaves[triangle]);
+    }
+    for (uint32_t sphere : dirtySpheres) {
+        addLeaf(m_sphereLeaves[sphere]);
+    }
+
+    for (uint32_t leaf : leaves) {
+        m_costSum -= getNodeCost(m_nodes[leaf]);
+    }
+
+    // Each leaf is written by a single thread, the primitives are only read
+    auto refitLeaves = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Node& node = m_nodes[leaves[i]];
+            Bounds bounds;
+            for (int32_t primitive = 0; primitive < node.m_count; ++primitive) {
+                bounds.grow(getPrimitiveBounds(triangles, spheres, m_primitives[node.m_leftOrFirst + primitive]));
+            }
+            setNodeBounds(node, bounds);
+        }
+    };
+    size_t threadCount = leaves.size() < m_PARALLEL_REFIT_LEAVES ? 1 : std::clamp<size_t>(workerCount, 1, leaves.size());
+    runSplit(leaves.size(), threadCount, refitLeaves);
+
+    for (uint32_t leaf : leaves) {
+        m_costSum += getNodeCost(m_nodes[leaf]);
+        m_dirtyNodes.add(leaf);
+    }
+
+    // Ancestors of the leaves, each once, children before their parents
+    std::vector<uint32_t> innerNodes;
+    for (uint32_t leaf : leaves) {
+        uint32_t node = leaf;
+        while (node != 0) {
+            node = m_parents[node];
+            if (m_refitMarks[node] == m_refitIndex) {
+                break;
+            }
+            m_refitMarks[node] = m_refitIndex;
+            innerNodes.push_back(node);
+        }
+    }
+    std::sort(innerNodes.begin(), innerNodes.end(), std::greater<uint32_t>());
+
+    for (uint32_t node : innerNodes) {
+        Node& inner = m_nodes[node];
+        m_costSum -= getNodeCost(inner);
+        Bounds bounds = getNodeBounds(m_nodes[inner.m_leftOrFirst]);
+        bounds.grow(getNodeBounds(m_nodes[inner.m_leftOrFirst + 1]));
+        setNodeBounds(inner, bounds);
+        m_costSum += getNodeCost(inner);
+        m_dirtyNodes.add(node);
+    }
+
+    return static_cast<uint32_t>(leaves.size() + innerNodes.size());
+}
+
+void Bvh::clearDirtyNodes() {
+    m_dirtyNodes.clear();
+    m_primitivesDirty = false;
+}
+
+float Bvh::getCost() const {
+    float rootArea = m_nodes.empty() ? 0.0f : getNodeBounds(m_nodes[0]).getArea();
+    return rootArea > 0.0f ? m_costSum / rootArea : 0.0f;
+}
+
+Bvh::Bounds Bvh::getPrimitiveBounds(const std::vector<Triangle>& triangles, const std::vector<Sphere>& spheres, uint32_t primitive) {
+    Bounds bounds;
+    if (primitive & m_SPHERE_BIT) {
+        const Sphere& sphere = spheres[primitive & ~m_SPHERE_BIT];
+        bounds.m_min = sphere.m_center - glm::vec3(sphere.m_radius);
+        bounds.m_max = sphere.m_center + glm::vec3(sphere.m_radius);
+    }
+    else {
+        const Triangle& triangle = triangles[primitive];
+        bounds.grow(triangle.m_v0.m_position);
+        bounds.grow(triangle.m_v1.m_position);
+        bounds.grow(triangle.m_v2.m_position);
+    }
+    return bounds;
+}
+
+Bvh::Bounds Bvh::getNodeBounds(const Node& node) {
+    Bounds bounds;
+    bounds.m_min = node.m_min;
+    bounds.m_max = node.m_max;
+    return bounds;
+}
+
+void Bvh::setNodeBounds(Node& node, const Bounds& bounds) {
+    node.m_min = bounds.m_min;
+    node.m_max = bounds.m_max;
+}
+
+float Bvh::getNodeCost(const Node& node) const {
+    float area = getNodeBounds(node).getArea();
+    return node.m_count == 0 ? area * m_TRAVERSAL_COST : area * m_INTERSECTION_COST * node.m_count;
+}
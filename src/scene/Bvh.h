@@ -0,0 +1,128 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "math/Sphere.h"
+#include "math/Triangle.h"
+#include "scene/DirtyRanges.h"
+
+// Bounding volume hierarchy over the triangles and the spheres of a scene, traversed by the trace pass.
+// It is built with binned SAH splits, and refitted when primitives move: the bounds of the leaves holding them
+// and of their ancestors are recomputed, the topology is kept. A refit hierarchy degrades as the primitives
+// move away from the groups they were built in, its SAH cost tells when to build it again.
+//
+// The children of an inner node are stored next to each other, after their parent, so refitting in reverse
+// order of the nodes always finds the children up to date.
+class Bvh {
+public:
+	// GPU layout of the nodes, std430 compatible. Inner nodes have a count of 0 and their children at
+	// m_leftOrFirst and m_leftOrFirst + 1, leaves reference m_count primitives from m_leftOrFirst on.
+	struct Node {
+		alignas(16) glm::vec3 m_min;
+		int32_t m_leftOrFirst = 0;
+		glm::vec3 m_max;
+		int32_t m_count = 0;
+	};
+
+	// Primitive references with this bit set are sphere indices, the others triangle indices
+	static constexpr uint32_t m_SPHERE_BIT = 0x80000000u;
+	// Depth of the deepest leaf, the traversal stack of the trace pass holds as many nodes
+	static constexpr uint32_t m_MAX_DEPTH = 32;
+
+	// Upper bound of the node count of the hierarchy of primitiveCount primitives, whatever their positions
+	static inline size_t getMaxNodeCount(size_t primitiveCount) { return primitiveCount > 0 ? 2 * primitiveCount - 1 : 1; }
+
+	// Splits the subtrees below the top levels over workerCount threads when there are many primitives, the
+	// hierarchy is the same whatever the worker count
+	void build(const std::vector<Triangle>& triangles, const std::vector<Sphere>& spheres, unsigned int workerCount = 1);
+	// Recomputes the bounds of the leaves holding the given primitives, split over workerCount threads when
+	// there are many, then the bounds of their ancestors. Returns the number of nodes refitted.
+	uint32_t refit(const std::vector<Triangle>& triangles, const std::vector<Sphere>& spheres,
+		const std::vector<uint32_t>& dirtyTriangles, const std::vector<uint32_t>& dirtySpheres, unsigned int workerCount);
+
+	inline const std::vector<Node>& getNodes() const { return m_nodes; }
+	inline const std::vector<uint32_t>& getPrimitives() const { return m_primitives; }
+	// Nodes changed by the builds and refits since the last call to clearDirtyNodes, the primitive references
+	// only change with a build
+	inline const DirtyRanges& getDirtyNodes() const { return m_dirtyNodes; }
+	inline bool arePrimitivesDirty() const { return m_primitivesDirty; }
+	void clearDirtyNodes();
+
+	// Expected cost of a ray through the hierarchy: the nodes it visits and the primitives it tests, weighted by
+	// the area of their bounds relative to the root. Kept up to date by the refits.
+	float getCost() const;
+	inline float getBuildCost() const { return m_buildCost; }
+
+private:
+	// Relative costs of visiting a node and of testing a primitive
+	static constexpr float m_TRAVERSAL_COST = 1.0f;
+	static constexpr float m_INTERSECTION_COST = 1.0f;
+	static constexpr uint32_t m_BIN_COUNT = 16;
+	// Leaves larger than this are split even when the SAH finds no better split
+	static constexpr uint32_t m_MAX_LEAF_SIZE = 8;
+	// Dirty leaves below which a refit stays on the calling thread
+	static constexpr size_t m_PARALLEL_REFIT_LEAVES = 2048;
+	// Smallest subtree a parallel build hands to a worker, below twice as many primitives it stays on the
+	// calling thread
+	static constexpr uint32_t m_PARALLEL_BUILD_PRIMITIVES = 4096;
+
+	struct Bounds {
+		glm::vec3 m_min = glm::vec3(3.0e38f);
+		glm::vec3 m_max = glm::vec3(-3.0e38f);
+
+		void grow(const glm::vec3& point);
+		void grow(const Bounds& bounds);
+		float getArea() const;
+	};
+
+	// Range of m_primitives the node of index m_node is built over
+	struct BuildTask {
+		uint32_t m_node;
+		uint32_t m_first;
+		uint32_t m_count;
+		uint32_t m_depth;
+	};
+	// Bounds and centroids of the primitives, indexed by their position in the scene, triangles first, as
+	// m_primitives gets reordered
+	struct BuildInput {
+		std::vector<Bounds> m_bounds;
+		std::vector<glm::vec3> m_centroids;
+		uint32_t m_triangleCount = 0;
+
+		inline uint32_t getSlot(uint32_t primitive) const {
+			return (primitive & m_SPHERE_BIT) ? m_triangleCount + (primitive & ~m_SPHERE_BIT) : primitive;
+		}
+	};
+
+	std::vector<Node> m_nodes;
+	std::vector<uint32_t> m_primitives;
+	std::vector<uint32_t> m_parents;
+	// Leaf holding each triangle and sphere
+	std::vector<uint32_t> m_triangleLeaves;
+	std::vector<uint32_t> m_sphereLeaves;
+
+	DirtyRanges m_dirtyNodes;
+	bool m_primitivesDirty = false;
+
+	// Sum of the costs of the nodes not divided by the area of the root, and its value after the build
+	float m_costSum = 0.0f;
+	float m_buildCost = 0.0f;
+	// Refit the node was last visited by, so shared ancestors are only refitted once
+	std::vector<uint32_t> m_refitMarks;
+	uint32_t m_refitIndex = 0;
+
+	static Bounds getPrimitiveBounds(const std::vector<Triangle>& triangles, const std::vector<Sphere>& spheres, uint32_t primitive);
+	static Bounds getNodeBounds(const Node& node);
+	static void setNodeBounds(Node& node, const Bounds& bounds);
+	float getNodeCost(const Node& node) const;
+	// Splits the tasks into nodes appended to nodes and parents, until the leaves. With subtrees, the tasks of
+	// at most subtreeSize primitives are moved there instead, their node left for the caller to fill.
+	void buildNodes(const BuildInput& input, std::vector<BuildTask>& tasks, std::vector<Node>& nodes, std::vector<uint32_t>& parents,
+		uint32_t subtreeSize, std::vector<BuildTask>* subtrees);
+};
+
+#endif
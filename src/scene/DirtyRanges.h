@@ -0,0 +1,57 @@
+#ifndef DIRTY_RANGES_H
+#define DIRTY_RANGES_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Indices of the elements of an array changed since the last upload, kept as ranges so a buffer only copies
+// what changed. Consecutive indices extend the last range, the others are sorted and merged by getRanges.
+class DirtyRanges {
+public:
+	// [m_begin, m_end)
+	struct Range {
+		uint32_t m_begin = 0;
+		uint32_t m_end = 0;
+	};
+
+	inline void add(uint32_t index) { add(index, index + 1); }
+
+	void add(uint32_t begin, uint32_t end) {
+		if (begin >= end) {
+			return;
+		}
+		if (!m_ranges.empty() && begin <= m_ranges.back().m_end && end >= m_ranges.back().m_begin) {
+			m_ranges.back().m_begin = std::min(m_ranges.back().m_begin, begin);
+			m_ranges.back().m_end = std::max(m_ranges.back().m_end, end);
+			return;
+		}
+		m_ranges.push_back({ begin, end });
+	}
+
+	inline void clear() { m_ranges.clear(); }
+	inline bool empty() const { return m_ranges.empty(); }
+
+	// Sorted and disjoint. Ranges separated by at most maxGap clean elements are merged, copying a few clean
+	// elements is cheaper than another copy region.
+	std::vector<Range> getRanges(uint32_t maxGap) const {
+		std::vector<Range> ranges = m_ranges;
+		std::sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) { return a.m_begin < b.m_begin; });
+
+		std::vector<Range> merged;
+		for (const Range& range : ranges) {
+			if (!merged.empty() && range.m_begin <= merged.back().m_end + maxGap) {
+				merged.back().m_end = std::max(merged.back().m_end, range.m_end);
+			}
+			else {
+				merged.push_back(range);
+			}
+		}
+		return merged;
+	}
+
+private:
+	std::vector<Range> m_ranges;
+};
+
+#endif
@@ -0,0 +1,363 @@
+#include "Scene.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+    // Texels of the generated tile textures, 2x2 tiles separated by grout lines
+    constexpr uint32_t g_tileTextureSize = 256;
+    constexpr float g_groutWidth = 0.03f;
+    constexpr float g_bevelWidth = 0.05f;
+    constexpr float g_bevelHeight = 0.01f;
+
+    // Distance to the nearest grout line, in tiles, for texture coordinates in [0,1)
+    float tileEdgeDistance(float u, float v) {
+        float x = std::fmod(u * 2.0f, 1.0f);
+        float y = std::fmod(v * 2.0f, 1.0f);
+        return std::min(std::min(x, 1.0f - x), std::min(y, 1.0f - y));
+    }
+
+    // texel returns the packed RGBA8 value at the texture coordinates of the center of a texel
+    template<typename Texel>
+    Texture generateTexture(uint32_t size, Texture::Encoding encoding, Texel texel) {
+        Texture texture;
+        texture.m_encoding = encoding;
+        texture.m_width = size;
+        texture.m_height = size;
+        texture.m_pixels.resize(static_cast<size_t>(size) * size * 4);
+        for (uint32_t y = 0; y < size; ++y) {
+            for (uint32_t x = 0; x < size; ++x) {
+                uint32_t value = texel((x + 0.5f) / size, (y + 0.5f) / size);
+                uint8_t* out = &texture.m_pixels[(static_cast<size_t>(y) * size + x) * 4];
+                out[0] = static_cast<uint8_t>(value);
+                out[1] = static_cast<uint8_t>(value >> 8);
+                out[2] = static_cast<uint8_t>(value >> 16);
+                out[3] = static_cast<uint8_t>(value >> 24);
+            }
+        }
+        return texture;
+    }
+
+    uint32_t packTexel(float r, float g, float b) {
+        auto quantize = [](float value) { return static_cast<uint32_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f); };
+        return quantize(r) | (quantize(g) << 8) | (quantize(b) << 16) | 0xFF000000u;
+    }
+
+    // Height of the tiles above the grout in texture space, their edges are beveled
+    float tileHeight(float u, float v) {
+        return std::clamp((tileEdgeDistance(u, v) - g_groutWidth) / g_bevelWidth, 0.0f, 1.0f) * g_bevelHeight;
+    }
+
+    // Fully saturated color of a hue in [0,1)
+    glm::vec3 hueColor(float hue) {
+        glm::vec3 color(std::fabs(hue * 6.0f - 3.0f) - 1.0f, 2.0f - std::fabs(hue * 6.0f - 2.0f), 2.0f - std::fabs(hue * 6.0f - 4.0f));
+        return glm::clamp(color, 0.0f, 1.0f);
+    }
+
+}
+
+Scene Scene::cornellBox() {
+    Scene scene;
+    scene.m_name = "cornell_box";
+
+    Material whiteMat({1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}, 0.0f, 0.0f, 0.0f);
+    Material leftWall({1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, 0.0f, 0.0f, 0.0f);
+    Material rightWall({0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, 0.0f, 0.0f, 0.0f);
+    Material emissive({1.0f, 1.0f, 1.0f}, {1.0f, 1.0f, 1.0f}, 0.5f, 0.0f, 0.0f);
+
+    scene.m_triangles = {
+        //ground
+        Triangle(Vertex3D({-2.0f, 2.0f, 0.0f}, {0.0f, 0.0f, 1.0f}),
+                 Vertex3D({2.0f, 2.0f, 0.0f}, {0.0f, 0.0f, 1.0f}),
+                 Vertex3D({-2.0f, -2.0f, 0.0f}, {0.0f, 0.0f, 1.0f}),
+                 whiteMat
+        ),
+        Triangle(Vertex3D({-2.0f, -2.0f, 0.0f}, {0.0f, 0.0f, 1.0f}),
+                 Vertex3D({2.0f, 2.0f, 0.0f}, {0.0f, 0.0f, 1.0f}),
+                 Vertex3D({2.0f, -2.0f, 0.0f}, {0.0f, 0.0f, 1.0f}),
+                 whiteMat
+        ),
+        //back wall
+        Triangle(Vertex3D({2.0f, -2.0f, 0.0f}, {0.0f, 1.0f, 0.0f}),
+                 Vertex3D({2.0f, -2.0f, 2.0f}, {0.0f, 1.0f, 0.0f}),
+                 Vertex3D({-2.0f, -2.0f, 0.0f}, {0.0f, 1.0f, 0.0f}),
+                 whiteMat
+        ),
+        Triangle(Vertex3D({-2.0f, -2.0f, 0.0f}, {0.0f, 1.0f, 0.0f}),
+                 Vertex3D({2.0f, -2.0f, 2.0f}, {0.0f, 1.0f, 0.0f}),
+                 Vertex3D({-2.0f, -2.0f, 2.0f}, {0.0f, 1.0f, 0.0f}),
+                 whiteMat
+        ),
+        //left wall
+        Triangle(Vertex3D({-2.0f, 2.0f, 0.0f}, {1.0f, 0.0f, 0.0f}),
+                 Vertex3D({-2.0f, -2.0f, 0.0f}, {1.0f, 0.0f, 0.0f}),
+                 Vertex3D({-2.0f, -2.0f, 2.0f}, {1.0f, 0.0f, 0.0f}),
+                 leftWall
+        ),
+        Triangle(Vertex3D({-2.0f, 2.0f, 0.0f}, {1.0f, 0.0f, 0.0f}),
+                 Vertex3D({-2.0f, -2.0f, 2.0f}, {1.0f, 0.0f, 0.0f}),
+                 Vertex3D({-2.0f, 2.0f, 2.0f}, {1.0f, 0.0f, 0.0f}),
+                 leftWall
+        ),
+        //right wall
+        Triangle(Vertex3D({2.0f, -2.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}),
+                 Vertex3D({2.0f, 2.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}),
+                 Vertex3D({2.0f, -2.0f, 2.0f}, {-1.0f, 0.0f, 0.0f}),
+                 rightWall
+        ),
+        Triangle(Vertex3D({2.0f, -2.0f, 2.0f}, {-1.0f, 0.0f, 0.0f}),
+                 Vertex3D({2.0f, 2.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}),
+                 Vertex3D({2.0f, 2.0f, 2.0f}, {-1.0f, 0.0f, 0.0f}),
+                 rightWall
+        ),
+        //ceiling
+        Triangle(Vertex3D({-2.0f, 2.0f, 2.0f}, {0.0f, 0.0f, -1.0f}),
+                 Vertex3D({-2.0f, -2.0f, 2.0f}, {0.0f, 0.0f, -1.0f}),
+                 Vertex3D({2.0f, 2.0f, 2.0f}, {0.0f, 0.0f, -1.0f}),
+                 whiteMat
+        ),
+        Triangle(Vertex3D({-2.0f, -2.0f, 2.0f}, {0.0f, 0.0f, -1.0f}),
+                 Vertex3D({2.0f, 2.0f, 2.0f}, {0.0f, 0.0f, -1.0f}),
+                 Vertex3D({2.0f, -2.0f, 2.0f}, {0.0f, 0.0f, -1.0f}),
+                 whiteMat
+        ),
+        //light
+        Triangle(Vertex3D({-1.0f, 1.0f, 1.99f}, {0.0f, 0.0f, -1.0f}),
+                 Vertex3D({-1.0f, -1.0f, 1.99f}, {0.0f, 0.0f, -1.0f}),
+                 Vertex3D({1.0f, 1.0f, 1.99f}, {0.0f, 0.0f, -1.0f}),
+                 emissive
+        ),
+        Triangle(Vertex3D({-1.0f, -1.0f, 1.99f}, {0.0f, 0.0f, -1.0f}),
+                 Vertex3D({1.0f, 1.0f, 1.99f}, {0.0f, 0.0f, -1.0f}),
+                 Vertex3D({1.0f, -1.0f, 1.99f}, {0.0f, 0.0f, -1.0f}),
+                 emissive
+        )
+    };
+
+    Material gold({1.0f, 0.9f, 0.0f}, {0.0f, 0.0f, 0.0f}, 0.0f, 0.1f, 1.0f);
+    Sphere sphere({-1.0, 0.0, 0.2}, 0.2, gold);
+    Material silver({0.7, 0.7, 0.7}, {0.0f, 0.0f, 0.0f}, 0.0f, 0.1f, 1.0f);
+    Sphere sphere2({0.0, 0.0, 0.2}, 0.2, silver);
+    Material flatBlue({0.0, 0.0, 1.0}, {0.0f, 0.0f, 0.0f}, 0.0f, 1.0f, 0.0f);
+    Sphere sphere3({1.0, 0.0, 0.2}, 0.2, flatBlue);
+    scene.m_spheres = {
+        sphere, sphere2, sphere3
+    };
+
+    return scene;
+}
+
+Scene Scene::highTriangleMesh(unsigned int stacks, unsigned int slices) {
+    Scene scene = cornellBox();
+    scene.m_name = "high_triangle_mesh";
+
+    Material silver({0.7, 0.7, 0.7}, {0.0f, 0.0f, 0.0f}, 0.0f, 0.1f, 1.0f);
+    Sphere mesh({0.0f, -0.5f, 0.8f}, 0.8f, silver);
+    std::vector<Triangle> meshGeometry = mesh.sphereGeometry(stacks, slices);
+    scene.m_triangles.insert(std::end(scene.m_triangles), std::begin(meshGeometry), std::end(meshGeometry));
+
+    return scene;
+}
+
+Scene Scene::manyLights(unsigned int lightCount) {
+    Scene scene = cornellBox();
+    scene.m_name = "many_lights";
+
+    // Drop the emissive quad, the point lights replace it
+    scene.m_triangles.erase(scene.m_triangles.end() - 2, scene.m_triangles.end());
+
+    // Square grid just below the ceiling, the total intensity does not depend on the light count
+    unsigned int gridSize = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(lightCount))));
+    float intensity = 4.0f / static_cast<float>(std::max(lightCount, 1u));
+
+    for (unsigned int i = 0; i < lightCount; ++i) {
+        float u = (static_cast<float>(i % gridSize) + 0.5f) / static_cast<float>(gridSize);
+        float v = (static_cast<float>(i / gridSize) + 0.5f) / static_cast<float>(gridSize);
+        glm::vec3 color = glm::mix(glm::vec3(1.0f, 0.8f, 0.6f), glm::vec3(0.6f, 0.8f, 1.0f), u);
+        scene.m_lights.push_back(Light{ glm::vec3(-1.8f + 3.6f * u, -1.8f + 3.6f * v, 1.9f), color, intensity });
+    }
+
+    return scene;
+}
+
+Scene Scene::instanced(unsigned int instancesPerRow, unsigned int stacks, unsigned int slices) {
+    Scene scene = cornellBox();
+    scene.m_name = "instanced";
+    scene.m_spheres.clear();
+
+    Material gold({1.0f, 0.9f, 0.0f}, {0.0f, 0.0f, 0.0f}, 0.0f, 0.1f, 1.0f);
+    float spacing = 3.6f / static_cast<float>(instancesPerRow);
+    Sphere prototype({0.0f, 0.0f, 0.0f}, 0.35f * spacing, gold);
+    std::vector<Triangle> prototypeGeometry = prototype.sphereGeometry(stacks, slices);
+
+    for (unsigned int y = 0; y < instancesPerRow; ++y) {
+        for (unsigned int x = 0; x < instancesPerRow; ++x) {
+            glm::vec3 offset(-1.8f + spacing * (x + 0.5f), -1.8f + spacing * (y + 0.5f), prototype.m_radius);
+
+            for (Triangle triangle : prototypeGeometry) {
+                triangle.m_v0.m_position += offset;
+                triangle.m_v1.m_position += offset;
+                triangle.m_v2.m_position += offset;
+                scene.m_triangles.push_back(triangle);
+            }
+        }
+    }
+
+    return scene;
+}
+
+Scene Scene::dielectrics() {
+    Scene scene = cornellBox();
+    scene.m_name = "dielectrics";
+
+    Material glass({1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}, 0.0f, 0.0f, 0.0f);
+    glass.m_ior = 1.5f;
+    glass.m_transparency = 1.0f;
+    Material frosted = glass;
+    frosted.m_roughness = 0.3f;
+    Material tinted = glass;
+    tinted.m_ior = 1.33f;
+    tinted.m_transparencyColor = glm::vec3(0.6f, 0.8f, 1.0f);
+
+    scene.m_spheres = {
+        Sphere({-1.0f, 0.0f, 0.4f}, 0.4f, glass),
+        Sphere({0.0f, 0.0f, 0.4f}, 0.4f, frosted),
+        Sphere({1.0f, 0.0f, 0.4f}, 0.4f, tinted)
+    };
+
+    return scene;
+}
+
+Scene Scene::textured() {
+    Scene scene = cornellBox();
+    scene.m_name = "textured";
+
+    // 0: albedo of a checker of cream and terracotta tiles, the grout is grey
+    scene.m_textures.push_back(generateTexture(g_tileTextureSize, Texture::Encoding::Srgb, [](float u, float v) {
+        if (tileEdgeDistance(u, v) < g_groutWidth) {
+            return packTexel(0.35f, 0.35f, 0.33f);
+        }
+        bool dark = (u < 0.5f) != (v < 0.5f);
+        return dark ? packTexel(0.55f, 0.22f, 0.12f) : packTexel(0.9f, 0.85f, 0.7f);
+    }));
+    // 1: roughness in green, glazed tiles and a rough grout, no metal
+    scene.m_textures.push_back(generateTexture(g_tileTextureSize, Texture::Encoding::Linear, [](float u, float v) {
+        bool dark = (u < 0.5f) != (v < 0.5f);
+        float roughness = tileEdgeDistance(u, v) < g_groutWidth ? 1.0f : (dark ? 0.45f : 0.2f);
+        return packTexel(0.0f, roughness, 0.0f);
+    }));
+    // 2: tangent space normals of the beveled tile edges, from central differences of their height
+    scene.m_textures.push_back(generateTexture(g_tileTextureSize, Texture::Encoding::Linear, [](float u, float v) {
+        const float step = 1.0f / g_tileTextureSize;
+        float du = (tileHeight(std::fmod(u + step, 1.0f), v) - tileHeight(std::fmod(u + 1.0f - step, 1.0f), v)) / (2.0f * step);
+        float dv = (tileHeight(u, std::fmod(v + step, 1.0f)) - tileHeight(u, std::fmod(v + 1.0f - step, 1.0f))) / (2.0f * step);
+        glm::vec3 normal = glm::normalize(glm::vec3(-du, -dv, 1.0f));
+        return packTexel(normal.x * 0.5f + 0.5f, normal.y * 0.5f + 0.5f, normal.z * 0.5f + 0.5f);
+    }));
+    // 3: albedo of bands of latitude and longitude, shows the mapping of the spheres
+    scene.m_textures.push_back(generateTexture(g_tileTextureSize, Texture::Encoding::Srgb, [](float u, float v) {
+        bool band = (static_cast<int>(u * 16.0f) + static_cast<int>(v * 8.0f)) % 2 == 0;
+        return band ? packTexel(0.9f, 0.9f, 0.9f) : packTexel(0.1f, 0.3f, 0.6f);
+    }));
+
+    Material tiles({1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}, 0.0f, 1.0f, 0.0f);
+    tiles.m_albedoTexture = 0;
+    tiles.m_roughnessMetallicTexture = 1;
+    tiles.m_normalTexture = 2;
+
+    // The floor is repeated twice over each axis, each repetition holding 2x2 tiles
+    auto floorVertex = [](float x, float y) {
+        return Vertex3D({x, y, 0.0f}, {0.0f, 0.0f, 1.0f}, {(x + 2.0f) * 0.5f, (2.0f - y) * 0.5f});
+    };
+    scene.m_triangles[0] = Triangle(floorVertex(-2.0f, 2.0f), floorVertex(2.0f, 2.0f), floorVertex(-2.0f, -2.0f), tiles);
+    scene.m_triangles[1] = Triangle(floorVertex(-2.0f, -2.0f), floorVertex(2.0f, 2.0f), floorVertex(2.0f, -2.0f), tiles);
+
+    Material banded({1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}, 0.0f, 0.4f, 0.0f);
+    banded.m_albedoTexture = 3;
+    scene.m_spheres[1].m_material = banded;
+
+    return scene;
+}
+
+Scene Scene::textureStreaming(unsigned int tilesPerSide, unsigned int textureSize) {
+    Scene scene = cornellBox();
+    scene.m_name = "texture_streaming";
+    tilesPerSide = std::max(tilesPerSide, 1u);
+    textureSize = std::max(textureSize, 4u);
+
+    // Last two textures: roughness and normals shared by every quad of the floor
+    uint32_t albedoCount = tilesPerSide * tilesPerSide;
+    scene.m_textures.reserve(albedoCount + 2);
+
+    // Albedos of one hue per quad, with a fine checker so the finest levels differ from the coarse ones
+    for (uint32_t i = 0; i < albedoCount; ++i) {
+        glm::vec3 hue = glm::mix(glm::vec3(1.0f), hueColor(static_cast<float>(i) / albedoCount), 0.6f);
+        scene.m_textures.push_back(generateTexture(textureSize, Texture::Encoding::Srgb, [hue](float u, float v) {
+            if (tileEdgeDistance(u, v) < g_groutWidth) {
+                return packTexel(0.35f, 0.35f, 0.33f);
+            }
+            bool checker = (static_cast<int>(u * 64.0f) + static_cast<int>(v * 64.0f)) % 2 == 0;
+            glm::vec3 color = hue * (checker ? 0.9f : 0.6f);
+            return packTexel(color.x, color.y, color.z);
+        }));
+    }
+    scene.m_textures.push_back(generateTexture(textureSize, Texture::Encoding::Linear, [](float u, float v) {
+        float roughness = tileEdgeDistance(u, v) < g_groutWidth ? 1.0f : 0.3f;
+        return packTexel(0.0f, roughness, 0.0f);
+    }));
+    float step = 1.0f / static_cast<float>(textureSize);
+    scene.m_textures.push_back(generateTexture(textureSize, Texture::Encoding::Linear, [step](float u, float v) {
+        float du = (tileHeight(std::fmod(u + step, 1.0f), v) - tileHeight(std::fmod(u + 1.0f - step, 1.0f), v)) / (2.0f * step);
+        float dv = (tileHeight(u, std::fmod(v + step, 1.0f)) - tileHeight(u, std::fmod(v + 1.0f - step, 1.0f))) / (2.0f * step);
+        glm::vec3 normal = glm::normalize(glm::vec3(-du, -dv, 1.0f));
+        return packTexel(normal.x * 0.5f + 0.5f, normal.y * 0.5f + 0.5f, normal.z * 0.5f + 0.5f);
+    }));
+
+    // The floor is split into tilesPerSide x tilesPerSide quads, each mapping the whole of its own albedo
+    std::vector<Triangle> floor;
+    float quadSize = 4.0f / tilesPerSide;
+    for (uint32_t y = 0; y < tilesPerSide; ++y) {
+        for (uint32_t x = 0; x < tilesPerSide; ++x) {
+            Material material({1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}, 0.0f, 1.0f, 0.0f);
+            material.m_albedoTexture = static_cast<int32_t>(y * tilesPerSide + x);
+            material.m_roughnessMetallicTexture = static_cast<int32_t>(albedoCount);
+            material.m_normalTexture = static_cast<int32_t>(albedoCount + 1);
+
+            float x0 = -2.0f + quadSize * x;
+            float y0 = -2.0f + quadSize * y;
+            auto floorVertex = [&](float u, float v) {
+                return Vertex3D({x0 + u * quadSize, y0 + (1.0f - v) * quadSize, 0.0f}, {0.0f, 0.0f, 1.0f}, {u, v});
+            };
+            floor.push_back(Triangle(floorVertex(0.0f, 0.0f), floorVertex(1.0f, 0.0f), floorVertex(0.0f, 1.0f), material));
+            floor.push_back(Triangle(floorVertex(0.0f, 1.0f), floorVertex(1.0f, 0.0f), floorVertex(1.0f, 1.0f), material));
+        }
+    }
+    scene.m_triangles.erase(scene.m_triangles.begin(), scene.m_triangles.begin() + 2);
+    scene.m_triangles.insert(scene.m_triangles.begin(), floor.begin(), floor.end());
+
+    return scene;
+}
+
+Scene Scene::movingSpheres(unsigned int sphereCount) {
+    Scene scene = cornellBox();
+    scene.m_name = "moving_spheres";
+
+    unsigned int perRow = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(std::max(sphereCount, 1u)))));
+    float radius = 0.35f * 3.6f / perRow;
+    for (unsigned int i = 0; i < sphereCount; ++i) {
+        Material material(glm::mix(glm::vec3(1.0f), hueColor(static_cast<float>(i) / sphereCount), 0.7f), {0.0f, 0.0f, 0.0f}, 0.0f, 0.4f, 0.0f);
+        scene.m_spheres.push_back(Sphere(getMovingSpherePosition(sphereCount, i, 0.0f), radius, material));
+    }
+
+    return scene;
+}
+
+glm::vec3 Scene::getMovingSpherePosition(unsigned int sphereCount, unsigned int sphere, float time) {
+    unsigned int perRow = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(std::max(sphereCount, 1u)))));
+    float spacing = 3.6f / perRow;
+    float x = -1.8f + spacing * (sphere % perRow + 0.5f);
+    float y = -1.8f + spacing * (sphere / perRow + 0.5f);
+    float phase = static_cast<float>(sphere) * 2.39996f;
+    return glm::vec3(x, y, 0.35f * spacing + 0.5f + 0.4f * std::sin(time * 2.0f + phase));
+}
@@ -0,0 +1,49 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include "math/Triangle.h"
+#include "math/Material.h"
+#include "math/Sphere.h"
+#include "math/Light.h"
+#include "scene/Texture.h"
+
+// Geometry and lights uploaded to the storage buffers of the trace pass.
+// The factories build the canonical scenes shared by the application and the benchmark, they all
+// fit the default camera of the renderer.
+struct Scene {
+    std::string m_name;
+    std::vector<Triangle> m_triangles;
+    std::vector<Sphere> m_spheres;
+    std::vector<Light> m_lights;
+    // Indexed by the texture fields of the materials
+    std::vector<Texture> m_textures;
+
+    // The scene the application starts with
+    static Scene cornellBox();
+    // Cornell box with a tessellated sphere of 2 * stacks * slices triangles
+    static Scene highTriangleMesh(unsigned int stacks, unsigned int slices);
+    // Cornell box lit by a grid of point lights instead of its emissive ceiling
+    static Scene manyLights(unsigned int lightCount);
+    // Cornell box with a grid of copies of the same tessellated sphere. The trace pass has no
+    // instancing, the copies are flattened into the triangle buffer.
+    static Scene instanced(unsigned int instancesPerRow, unsigned int stacks, unsigned int slices);
+    // Cornell box with a smooth glass, a frosted glass and a tinted water sphere
+    static Scene dielectrics();
+    // Cornell box with a tiled floor using albedo, roughness/metallic and normal maps, and a textured sphere.
+    // The textures are generated, the scene needs no file.
+    static Scene textured();
+    // Cornell box whose floor is split into tilesPerSide x tilesPerSide quads, each with its own albedo of
+    // textureSize texels, sharing a roughness and a normal map. Made to exceed the texture streaming budget.
+    static Scene textureStreaming(unsigned int tilesPerSide, unsigned int textureSize);
+    // Cornell box with sphereCount small spheres in a grid above the floor, to animate with getMovingSpherePosition
+    static Scene movingSpheres(unsigned int sphereCount);
+    // Center of a sphere of movingSpheres at time, in seconds: each one bounces at its own phase
+    static glm::vec3 getMovingSpherePosition(unsigned int sphereCount, unsigned int sphere, float time);
+};
+
+#endif
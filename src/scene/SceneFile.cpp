@@ -0,0 +1,216 @@
+#include "SceneFile.h"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include "io/ByteStream.h"
+
+namespace {
+
+    constexpr uint32_t g_magic = 0x43535452; // "RTSC"
+    // 2 added the dielectric fields of the materials, 3 the texture coordinates, the textures and the texture
+    // indices of the materials
+    constexpr uint32_t g_version = 3;
+
+    // Counts above this are treated as corrupted data rather than allocated
+    constexpr uint64_t g_maxElements = 1ull << 28;
+
+    void writeMaterial(ByteWriter& writer, const Material& material) {
+        writer.write(material.m_albedo);
+        writer.write(material.m_emission);
+        writer.write(material.m_emissionStrength);
+        writer.write(material.m_roughness);
+        writer.write(material.m_metallic);
+        writer.write(material.m_ior);
+        writer.write(material.m_transparency);
+        writer.write(material.m_transparencyColor);
+        writer.write(material.m_albedoTexture);
+        writer.write(material.m_roughnessMetallicTexture);
+        writer.write(material.m_normalTexture);
+    }
+
+    // Materials of version 1 files keep the defaults of the dielectric fields, they are opaque
+    Material readMaterial(ByteReader& reader, uint32_t version) {
+        Material material{};
+        material.m_albedo = reader.read<glm::vec3>();
+        material.m_emission = reader.read<glm::vec3>();
+        material.m_emissionStrength = reader.read<float>();
+        material.m_roughness = reader.read<float>();
+        material.m_metallic = reader.read<float>();
+        if (version >= 2) {
+            material.m_ior = reader.read<float>();
+            material.m_transparency = reader.read<float>();
+            material.m_transparencyColor = reader.read<glm::vec3>();
+        }
+        if (version >= 3) {
+            material.m_albedoTexture = reader.read<int32_t>();
+            material.m_roughnessMetallicTexture = reader.read<int32_t>();
+            material.m_normalTexture = reader.read<int32_t>();
+        }
+        return material;
+    }
+
+    void writeVertex(ByteWriter& writer, const Vertex3D& vertex) {
+        writer.write(vertex.m_position);
+        writer.write(vertex.m_normal);
+        writer.write(vertex.m_uv);
+    }
+
+    Vertex3D readVertex(ByteReader& reader, uint32_t version) {
+        Vertex3D vertex{};
+        vertex.m_position = reader.read<glm::vec3>();
+        vertex.m_normal = reader.read<glm::vec3>();
+        if (version >= 3) {
+            vertex.m_uv = reader.read<glm::vec2>();
+        }
+        return vertex;
+    }
+
+    // The texels of the generated textures are embedded, the others are referenced by their path
+    void writeTexture(ByteWriter& writer, const Texture& texture) {
+        writer.writeString(texture.m_path);
+        writer.write(texture.m_encoding);
+        writer.write(texture.m_width);
+        writer.write(texture.m_height);
+        writer.write(static_cast<uint64_t>(texture.m_pixels.size()));
+        writer.writeBytes(texture.m_pixels.data(), texture.m_pixels.size());
+    }
+
+    Texture readTexture(ByteReader& reader) {
+        Texture texture;
+        texture.m_path = reader.readString();
+        texture.m_encoding = reader.read<Texture::Encoding>();
+        if (texture.m_encoding != Texture::Encoding::Srgb && texture.m_encoding != Texture::Encoding::Linear) {
+            throw std::runtime_error("Scene: invalid texture encoding");
+        }
+        texture.m_width = reader.read<uint32_t>();
+        texture.m_height = reader.read<uint32_t>();
+        uint64_t size = reader.read<uint64_t>();
+        if (size != 0 && size != static_cast<uint64_t>(texture.m_width) * texture.m_height * 4) {
+            throw std::runtime_error("Scene: invalid texture size");
+        }
+        texture.m_pixels.resize(static_cast<size_t>(size));
+        reader.readBytes(texture.m_pixels.data(), texture.m_pixels.size());
+        return texture;
+    }
+
+    uint64_t readCount(ByteReader& reader) {
+        uint64_t count = reader.read<uint64_t>();
+        if (count > g_maxElements) {
+            throw std::runtime_error("Scene: invalid element count");
+        }
+        return count;
+    }
+
+}
+
+std::vector<uint8_t> SceneFile::encode(const Scene& scene) {
+    ByteWriter writer;
+    writer.write(g_magic);
+    writer.write(g_version);
+    writer.writeString(scene.m_name);
+
+    writer.write(static_cast<uint64_t>(scene.m_triangles.size()));
+    for (const Triangle& triangle : scene.m_triangles) {
+        writeVertex(writer, triangle.m_v0);
+        writeVertex(writer, triangle.m_v1);
+        writeVertex(writer, triangle.m_v2);
+        writeMaterial(writer, triangle.m_material);
+    }
+
+    writer.write(static_cast<uint64_t>(scene.m_spheres.size()));
+    for (const Sphere& sphere : scene.m_spheres) {
+        writer.write(sphere.m_center);
+        writer.write(sphere.m_radius);
+        writeMaterial(writer, sphere.m_material);
+    }
+
+    writer.write(static_cast<uint64_t>(scene.m_lights.size()));
+    for (const Light& light : scene.m_lights) {
+        writer.write(light.m_position);
+        writer.write(light.m_color);
+        writer.write(light.m_intensity);
+    }
+
+    writer.write(static_cast<uint64_t>(scene.m_textures.size()));
+    for (const Texture& texture : scene.m_textures) {
+        writeTexture(writer, texture);
+    }
+
+    return std::move(writer.getData());
+}
+
+Scene SceneFile::decode(const std::vector<uint8_t>& data) {
+    ByteReader reader(data);
+    if (reader.read<uint32_t>() != g_magic) {
+        throw std::runtime_error("Scene: not a binary scene");
+    }
+    uint32_t version = reader.read<uint32_t>();
+    if (version == 0 || version > g_version) {
+        throw std::runtime_error("Scene: unsupported version " + std::to_string(version));
+    }
+
+    Scene scene;
+    scene.m_name = reader.readString();
+
+    uint64_t triangleCount = readCount(reader);
+    scene.m_triangles.reserve(triangleCount);
+    for (uint64_t i = 0; i < triangleCount; ++i) {
+        Vertex3D v0 = readVertex(reader, version);
+        Vertex3D v1 = readVertex(reader, version);
+        Vertex3D v2 = readVertex(reader, version);
+        scene.m_triangles.emplace_back(v0, v1, v2, readMaterial(reader, version));
+    }
+
+    uint64_t sphereCount = readCount(reader);
+    scene.m_spheres.reserve(sphereCount);
+    for (uint64_t i = 0; i < sphereCount; ++i) {
+        glm::vec3 center = reader.read<glm::vec3>();
+        float radius = reader.read<float>();
+        scene.m_spheres.emplace_back(center, radius, readMaterial(reader, version));
+    }
+
+    uint64_t lightCount = readCount(reader);
+    scene.m_lights.reserve(lightCount);
+    for (uint64_t i = 0; i < lightCount; ++i) {
+        Light light{};
+        light.m_position = reader.read<glm::vec3>();
+        light.m_color = reader.read<glm::vec3>();
+        light.m_intensity = reader.read<float>();
+        scene.m_lights.push_back(light);
+    }
+
+    if (version >= 3) {
+        uint64_t textureCount = readCount(reader);
+        scene.m_textures.reserve(textureCount);
+        for (uint64_t i = 0; i < textureCount; ++i) {
+            scene.m_textures.push_back(readTexture(reader));
+        }
+    }
+
+    return scene;
+}
+
+void SceneFile::write(const std::string& path, const Scene& scene) {
+    std::vector<uint8_t> data = encode(scene);
+
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Scene: unable to write " + path);
+    }
+    file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    if (!file.good()) {
+        throw std::runtime_error("Scene: failed writing " + path);
+    }
+}
+
+Scene SceneFile::read(const std::string& path) {
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Scene: unable to open " + path);
+    }
+
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return decode(data);
+}
@@ -0,0 +1,24 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "scene/Scene.h"
+
+// Binary scene format, sent as is to the distributed render workers: a "RTSC" magic and a version, the name
+// of the scene, then the triangles, the spheres, the lights and the textures, each preceded by its count. Values
+// are stored field by field, without the padding of the GPU layout. Textures read from a file only store its
+// path, which must then be valid on the workers too. Decoding throws std::runtime_error on invalid data.
+namespace SceneFile {
+
+	std::vector<uint8_t> encode(const Scene& scene);
+	Scene decode(const std::vector<uint8_t>& data);
+
+	void write(const std::string& path, const Scene& scene);
+	Scene read(const std::string& path);
+
+}
+
+#endif
@@ -0,0 +1,71 @@
+#include "SceneLoader.h"
+
+#include <stdexcept>
+
+SceneLoader::~SceneLoader() {
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void SceneLoader::start(std::function<Scene()> source, unsigned int workerCount) {
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    m_result = Result{};
+    m_error = nullptr;
+    m_startTime = std::chrono::steady_clock::now();
+    m_stage.store(Stage::Reading, std::memory_order_release);
+    m_thread = std::thread(&SceneLoader::load, this, std::move(source), workerCount);
+}
+
+SceneLoader::Result SceneLoader::take() {
+    Stage stage = getStage();
+    if (stage != Stage::Ready && stage != Stage::Failed) {
+        throw std::runtime_error("No scene loaded to take!");
+    }
+    m_thread.join();
+    m_stage.store(Stage::Idle, std::memory_order_release);
+
+    if (stage == Stage::Failed) {
+        std::exception_ptr error = m_error;
+        m_error = nullptr;
+        std::rethrow_exception(error);
+    }
+    return std::move(m_result);
+}
+
+double SceneLoader::getElapsedTime() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_startTime).count();
+}
+
+const char* SceneLoader::getStageName(Stage stage) {
+    switch (stage) {
+    case Stage::Idle: return "idle";
+    case Stage::Reading: return "reading";
+    case Stage::Building: return "building the BVH";
+    case Stage::Ready: return "ready";
+    case Stage::Failed: return "failed";
+    }
+    return "";
+}
+
+void SceneLoader::load(std::function<Scene()> source, unsigned int workerCount) {
+    try {
+        auto startTime = std::chrono::steady_clock::now();
+        m_result.m_scene = source();
+        auto readTime = std::chrono::steady_clock::now();
+        m_result.m_readTime = std::chrono::duration<double, std::milli>(readTime - startTime).count();
+
+        m_stage.store(Stage::Building, std::memory_order_release);
+        m_result.m_bvh.build(m_result.m_scene.m_triangles, m_result.m_scene.m_spheres, workerCount);
+        m_result.m_buildTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - readTime).count();
+
+        m_stage.store(Stage::Ready, std::memory_order_release);
+    }
+    catch (...) {
+        m_error = std::current_exception();
+        m_stage.store(Stage::Failed, std::memory_order_release);
+    }
+}
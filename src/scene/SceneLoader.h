@@ -0,0 +1,58 @@
+#ifndef SCENE_LOADER_H
+#define SCENE_LOADER_H
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <thread>
+
+#include "scene/Bvh.h"
+#include "scene/Scene.h"
+
+// Reads a scene and builds its hierarchy on a background thread, so the render loop keeps drawing while a large
+// scene loads. The render thread polls getStage every frame and takes the result once it is Ready or Failed.
+class SceneLoader {
+public:
+	enum class Stage { Idle, Reading, Building, Ready, Failed };
+
+	struct Result {
+		Scene m_scene;
+		Bvh m_bvh;
+		// In milliseconds
+		double m_readTime = 0.0;
+		double m_buildTime = 0.0;
+	};
+
+	SceneLoader() = default;
+	SceneLoader(const SceneLoader&) = delete;
+	SceneLoader& operator=(const SceneLoader&) = delete;
+	// Waits for the load in progress, its result is dropped
+	~SceneLoader();
+
+	// Calls source on the background thread, usually to read a scene file, then builds the hierarchy of its
+	// result over workerCount threads. Waits for the previous load if it was not taken.
+	void start(std::function<Scene()> source, unsigned int workerCount);
+	// The result once the stage is Ready, the loader is then Idle again. Rethrows the exception of a failed
+	// load.
+	Result take();
+
+	inline Stage getStage() const { return m_stage.load(std::memory_order_acquire); }
+	inline bool isLoading() const { Stage stage = getStage(); return stage == Stage::Reading || stage == Stage::Building; }
+	// Milliseconds since start
+	double getElapsedTime() const;
+
+	static const char* getStageName(Stage stage);
+
+private:
+	std::thread m_thread;
+	std::atomic<Stage> m_stage{ Stage::Idle };
+	std::chrono::steady_clock::time_point m_startTime;
+	// Only touched by the background thread until the stage is Ready or Failed
+	Result m_result;
+	std::exception_ptr m_error;
+
+	void load(std::function<Scene()> source, unsigned int workerCount);
+};
+
+#endif
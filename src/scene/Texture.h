@@ -0,0 +1,22 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Image referenced by the texture indices of the materials. Either decoded from m_path when the scene is
+// uploaded, or held in m_pixels for the textures generated by the scene factories.
+struct Texture {
+    // Albedo maps are sRGB encoded, roughness/metallic and normal maps hold linear data
+    enum class Encoding : uint32_t { Srgb, Linear };
+
+    std::string m_path;
+    Encoding m_encoding = Encoding::Srgb;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    // RGBA8, rows from top to bottom, empty when the texture is read from m_path
+    std::vector<uint8_t> m_pixels;
+};
+
+#endif
@@ -0,0 +1,288 @@
+#include "AsyncReadback.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+void AsyncReadback::init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, VkQueue queue, uint32_t slotCount, CompletionCallback callback) {
+    m_device = device;
+    m_physicalDevice = physicalDevice;
+    m_queue = queue;
+    m_slotCount = std::min(std::max(slotCount, 1u), m_MAX_SLOTS);
+    m_callback = std::move(callback);
+
+    // Prefer cached memory, the encoders read every byte of it
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &memoryProperties);
+
+    const VkMemoryPropertyFlags cached = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    const VkMemoryPropertyFlags coherent = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    int cachedType = -1;
+    int coherentType = -1;
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
+        VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[i].propertyFlags;
+        if (cachedType < 0 && (flags & cached) == cached) {
+            cachedType = static_cast<int>(i);
+        }
+        if (coherentType < 0 && (flags & coherent) == coherent) {
+            coherentType = static_cast<int>(i);
+        }
+    }
+    if (cachedType < 0 && coherentType < 0) {
+        throw std::runtime_error("No host visible memory for the readback buffers!");
+    }
+    m_memoryTypeIndex = static_cast<uint32_t>(cachedType >= 0 ? cachedType : coherentType);
+    m_coherent = (memoryProperties.memoryTypes[m_memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = queueFamilyIndex;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+    if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create readback command pool!");
+    }
+
+    std::vector<VkCommandBuffer> commandBuffers(m_slotCount);
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = m_commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = m_slotCount;
+
+    if (vkAllocateCommandBuffers(m_device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate readback command buffers!");
+    }
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    for (uint32_t i = 0; i < m_slotCount; ++i) {
+        Slot& slot = m_slots[i];
+        slot.m_commandBuffer = commandBuffers[i];
+        if (vkCreateFence(m_device, &fenceInfo, nullptr, &slot.m_fence) != VK_SUCCESS ||
+            vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &slot.m_renderSemaphore) != VK_SUCCESS ||
+            vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &slot.m_copySemaphore) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create readback synchronization objects!");
+        }
+        slot.m_state = SlotState::Free;
+    }
+}
+
+void AsyncReadback::cleanup() {
+    if (m_device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    // The consumers must have released their slots, their data is about to be unmapped
+    for (uint32_t i = 0; i < m_slotCount; ++i) {
+        Slot& slot = m_slots[i];
+        freeSlotBuffer(slot);
+        vkDestroyFence(m_device, slot.m_fence, nullptr);
+        vkDestroySemaphore(m_device, slot.m_renderSemaphore, nullptr);
+        vkDestroySemaphore(m_device, slot.m_copySemaphore, nullptr);
+        slot.m_fence = VK_NULL_HANDLE;
+        slot.m_renderSemaphore = VK_NULL_HANDLE;
+        slot.m_copySemaphore = VK_NULL_HANDLE;
+        slot.m_commandBuffer = VK_NULL_HANDLE;
+    }
+    vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+    m_commandPool = VK_NULL_HANDLE;
+    m_device = VK_NULL_HANDLE;
+}
+
+int AsyncReadback::acquire(bool wait) {
+    while (true) {
+        poll();
+
+        bool copying = false;
+        for (uint32_t i = 0; i < m_slotCount; ++i) {
+            SlotState expected = SlotState::Free;
+            if (m_slots[i].m_state.compare_exchange_strong(expected, SlotState::Acquired)) {
+                return static_cast<int>(i);
+            }
+            copying = copying || expected == SlotState::Copying;
+        }
+
+        if (!wait) {
+            return -1;
+        }
+
+        if (copying) {
+            // The oldest copy is usually the first one done, any of them frees the loop
+            std::vector<VkFence> fences;
+            for (uint32_t i = 0; i < m_slotCount; ++i) {
+                if (m_slots[i].m_state == SlotState::Copying) {
+                    fences.push_back(m_slots[i].m_fence);
+                }
+            }
+            vkWaitForFences(m_device, static_cast<uint32_t>(fences.size()), fences.data(), VK_FALSE, UINT64_MAX);
+        }
+        else {
+            std::unique_lock<std::mutex> lock(m_releaseMutex);
+            m_released.wait(lock, [this] {
+                for (uint32_t i = 0; i < m_slotCount; ++i) {
+                    if (m_slots[i].m_state == SlotState::Free) {
+                        return true;
+                    }
+                }
+                return false;
+            });
+        }
+    }
+}
+
+void AsyncReadback::submit(uint32_t slotIndex, VkImage image, const VkRect2D& area, VkDeviceSize texelSize) {
+    Slot& slot = m_slots[slotIndex];
+
+    VkDeviceSize size = static_cast<VkDeviceSize>(area.extent.width) * area.extent.height * texelSize;
+    if (slot.m_size < size) {
+        freeSlotBuffer(slot);
+        allocateSlotBuffer(slot, size);
+    }
+
+    vkResetCommandBuffer(slot.m_commandBuffer, 0);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(slot.m_commandBuffer, &beginInfo);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = { area.offset.x, area.offset.y, 0 };
+    region.imageExtent = { area.extent.width, area.extent.height, 1 };
+    vkCmdCopyImageToBuffer(slot.m_commandBuffer, image, VK_IMAGE_LAYOUT_GENERAL, slot.m_buffer, 1, &region);
+
+    // Makes the copy visible to the host reads done once the fence is signaled
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = slot.m_buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(slot.m_commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    vkEndCommandBuffer(slot.m_commandBuffer);
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &slot.m_renderSemaphore;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &slot.m_commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &slot.m_copySemaphore;
+
+    vkResetFences(m_device, 1, &slot.m_fence);
+    if (vkQueueSubmit(m_queue, 1, &submitInfo, slot.m_fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit readback copy!");
+    }
+
+    slot.m_state = SlotState::Copying;
+}
+
+void AsyncReadback::cancel(uint32_t slot) {
+    release(slot);
+}
+
+void AsyncReadback::release(uint32_t slot) {
+    {
+        std::lock_guard<std::mutex> lock(m_releaseMutex);
+        m_slots[slot].m_state = SlotState::Free;
+    }
+    m_released.notify_all();
+}
+
+void AsyncReadback::poll() {
+    for (uint32_t i = 0; i < m_slotCount; ++i) {
+        if (m_slots[i].m_state == SlotState::Copying && vkGetFenceStatus(m_device, m_slots[i].m_fence) == VK_SUCCESS) {
+            completeCopy(i);
+        }
+    }
+}
+
+void AsyncReadback::waitForCopies() {
+    for (uint32_t i = 0; i < m_slotCount; ++i) {
+        if (m_slots[i].m_state == SlotState::Copying) {
+            vkWaitForFences(m_device, 1, &m_slots[i].m_fence, VK_TRUE, UINT64_MAX);
+            completeCopy(i);
+        }
+    }
+}
+
+void AsyncReadback::completeCopy(uint32_t slotIndex) {
+    Slot& slot = m_slots[slotIndex];
+
+    if (!m_coherent) {
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = slot.m_memory;
+        range.offset = 0;
+        range.size = VK_WHOLE_SIZE;
+        vkInvalidateMappedMemoryRanges(m_device, 1, &range);
+    }
+
+    slot.m_state = SlotState::Consuming;
+    m_callback(slotIndex, slot.m_mapped);
+}
+
+void AsyncReadback::allocateSlotBuffer(Slot& slot, VkDeviceSize size) {
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &slot.m_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create readback buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(m_device, slot.m_buffer, &memRequirements);
+    if ((memRequirements.memoryTypeBits & (1u << m_memoryTypeIndex)) == 0) {
+        throw std::runtime_error("Readback buffers cannot use host visible memory!");
+    }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = m_memoryTypeIndex;
+
+    if (vkAllocateMemory(m_device, &allocInfo, nullptr, &slot.m_memory) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate readback buffer memory!");
+    }
+
+    vkBindBufferMemory(m_device, slot.m_buffer, slot.m_memory, 0);
+    // Mapped for the lifetime of the buffer
+    vkMapMemory(m_device, slot.m_memory, 0, VK_WHOLE_SIZE, 0, &slot.m_mapped);
+    slot.m_size = size;
+}
+
+void AsyncReadback::freeSlotBuffer(Slot& slot) {
+    if (slot.m_buffer == VK_NULL_HANDLE) {
+        return;
+    }
+
+    vkUnmapMemory(m_device, slot.m_memory);
+    vkDestroyBuffer(m_device, slot.m_buffer, nullptr);
+    vkFreeMemory(m_device, slot.m_memory, nullptr);
+    slot.m_buffer = VK_NULL_HANDLE;
+    slot.m_memory = VK_NULL_HANDLE;
+    slot.m_mapped = nullptr;
+    slot.m_size = 0;
+}
@@ -0,0 +1,83 @@
+#ifndef ASYNCREADBACK_H
+#define ASYNCREADBACK_H
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+// Copies images into persistently mapped host buffers without the render loop waiting for the copy.
+// Each slot goes through acquire (render thread), submit of the copy on the readback queue, poll which
+// hands the mapped data to the completion callback once the fence of the copy is signaled, and release,
+// which may come from any thread once the consumer (usually an encoder worker) is done with the data.
+//
+// The copy waits on the render semaphore of its slot, to be signaled by the submission that wrote the
+// image, and signals the copy semaphore, to be waited on by the next submission writing it.
+class AsyncReadback {
+public:
+	static constexpr uint32_t m_MAX_SLOTS = 8;
+
+	// Called by poll on the render thread, data stays valid until release(slot)
+	using CompletionCallback = std::function<void(uint32_t slot, const void* data)>;
+
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, VkQueue queue, uint32_t slotCount, CompletionCallback callback);
+	void cleanup();
+
+	// Returns a free slot, or -1 if they are all busy and wait is false. Waiting polls the copies and
+	// blocks until a consumer releases a slot.
+	int acquire(bool wait);
+	// Copies the area of image, in the general layout, tightly packed into the slot. Its buffer grows on demand.
+	void submit(uint32_t slot, VkImage image, const VkRect2D& area, VkDeviceSize texelSize);
+	// Gives back a slot acquired but never submitted
+	void cancel(uint32_t slot);
+	void release(uint32_t slot);
+
+	// Hands the finished copies to the callback, never blocks
+	void poll();
+	// Waits for every copy in flight and hands them to the callback
+	void waitForCopies();
+
+	inline VkSemaphore getRenderSemaphore(uint32_t slot) const { return m_slots[slot].m_renderSemaphore; }
+	inline VkSemaphore getCopySemaphore(uint32_t slot) const { return m_slots[slot].m_copySemaphore; }
+	inline bool isInitialized() const { return m_device != VK_NULL_HANDLE; }
+
+private:
+	enum class SlotState { Free, Acquired, Copying, Consuming };
+
+	struct Slot {
+		std::atomic<SlotState> m_state{ SlotState::Free };
+		VkBuffer m_buffer = VK_NULL_HANDLE;
+		VkDeviceMemory m_memory = VK_NULL_HANDLE;
+		VkDeviceSize m_size = 0;
+		void* m_mapped = nullptr;
+		VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
+		VkFence m_fence = VK_NULL_HANDLE;
+		VkSemaphore m_renderSemaphore = VK_NULL_HANDLE;
+		VkSemaphore m_copySemaphore = VK_NULL_HANDLE;
+	};
+
+	VkDevice m_device = VK_NULL_HANDLE;
+	VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+	VkQueue m_queue = VK_NULL_HANDLE;
+	VkCommandPool m_commandPool = VK_NULL_HANDLE;
+	uint32_t m_slotCount = 0;
+	std::array<Slot, m_MAX_SLOTS> m_slots;
+	// Host cached memory is much faster to read from the CPU, but may not be coherent
+	bool m_coherent = true;
+	uint32_t m_memoryTypeIndex = 0;
+	CompletionCallback m_callback;
+
+	std::mutex m_releaseMutex;
+	std::condition_variable m_released;
+
+	void allocateSlotBuffer(Slot& slot, VkDeviceSize size);
+	void freeSlotBuffer(Slot& slot);
+	void completeCopy(uint32_t slot);
+};
+
+#endif
@@ -0,0 +1,306 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <iostream>
+#include <stdexcept>
+
+#include "imgui.h"
+
+void GpuProfiler::init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, uint32_t framesInFlight, bool timestamps, bool pipelineStatisticsSupported) {
+    m_device = device;
+    m_frames.assign(framesInFlight, FrameQueries{});
+
+    if (!timestamps) {
+        return;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    uint32_t validBits = queueFamilyIndex < queueFamilyCount ? queueFamilies[queueFamilyIndex].timestampValidBits : 0;
+    if (!properties.limits.timestampComputeAndGraphics || validBits == 0) {
+        std::cerr << "Timestamp queries are not supported, GPU pass times will not be reported" << std::endl;
+        return;
+    }
+
+    m_timestampPeriod = properties.limits.timestampPeriod;
+    m_timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    // A begin and an end timestamp per scope, for each frame in flight
+    VkQueryPoolCreateInfo queryPoolInfo{};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2 * m_MAX_SCOPES * framesInFlight;
+
+    if (vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &m_timestampPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create timestamp query pool!");
+    }
+
+    if (!pipelineStatisticsSupported) {
+        return;
+    }
+
+    // The order of the flags is the order of the counters in the results, see PipelineStatistics
+    VkQueryPoolCreateInfo statisticsPoolInfo{};
+    statisticsPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    statisticsPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    statisticsPoolInfo.queryCount = m_MAX_SCOPES * framesInFlight;
+    statisticsPoolInfo.pipelineStatistics =
+        VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+    if (vkCreateQueryPool(m_device, &statisticsPoolInfo, nullptr, &m_statisticsPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline statistics query pool!");
+    }
+}
+
+void GpuProfiler::cleanup() {
+    stopCsvExport();
+
+    if (m_timestampPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(m_device, m_timestampPool, nullptr);
+        m_timestampPool = VK_NULL_HANDLE;
+    }
+    if (m_statisticsPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(m_device, m_statisticsPool, nullptr);
+        m_statisticsPool = VK_NULL_HANDLE;
+    }
+}
+
+uint32_t GpuProfiler::addScope(const std::string& name) {
+    if (m_scopes.size() >= m_MAX_SCOPES) {
+        throw std::runtime_error("Too many GPU profiler scopes!");
+    }
+
+    Scope scope;
+    scope.m_name = name;
+    m_scopes.push_back(scope);
+    return static_cast<uint32_t>(m_scopes.size() - 1);
+}
+
+uint32_t GpuProfiler::timestampQuery(uint32_t frameIndex, uint32_t scope) const {
+    return (frameIndex * m_MAX_SCOPES + scope) * 2;
+}
+
+uint32_t GpuProfiler::statisticsQuery(uint32_t frameIndex, uint32_t scope) const {
+    return frameIndex * m_MAX_SCOPES + scope;
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+    m_recordingFrame = frameIndex;
+
+    FrameQueries& frame = m_frames[frameIndex];
+    frame.m_recorded = false;
+    frame.m_scopeWritten.fill(false);
+    frame.m_statisticsRecorded = m_statisticsEnabled && m_statisticsPool != VK_NULL_HANDLE;
+
+    if (!isAvailable()) {
+        return;
+    }
+
+    vkCmdResetQueryPool(commandBuffer, m_timestampPool, timestampQuery(frameIndex, 0), 2 * m_MAX_SCOPES);
+    if (frame.m_statisticsRecorded) {
+        vkCmdResetQueryPool(commandBuffer, m_statisticsPool, statisticsQuery(frameIndex, 0), m_MAX_SCOPES);
+    }
+    frame.m_recorded = true;
+}
+
+void GpuProfiler::beginScope(VkCommandBuffer commandBuffer, uint32_t scope) {
+    FrameQueries& frame = m_frames[m_recordingFrame];
+    if (!frame.m_recorded) {
+        return;
+    }
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestampPool, timestampQuery(m_recordingFrame, scope));
+    if (frame.m_statisticsRecorded) {
+        vkCmdBeginQuery(commandBuffer, m_statisticsPool, statisticsQuery(m_recordingFrame, scope), 0);
+    }
+}
+
+void GpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t scope) {
+    FrameQueries& frame = m_frames[m_recordingFrame];
+    if (!frame.m_recorded) {
+        return;
+    }
+
+    if (frame.m_statisticsRecorded) {
+        vkCmdEndQuery(commandBuffer, m_statisticsPool, statisticsQuery(m_recordingFrame, scope));
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampPool, timestampQuery(m_recordingFrame, scope) + 1);
+    frame.m_scopeWritten[scope] = true;
+}
+
+bool GpuProfiler::collect(uint32_t frameIndex, float cpuFrameTime) {
+    FrameQueries& frame = m_frames[frameIndex];
+    if (!frame.m_recorded) {
+        return false;
+    }
+
+    // No wait flag: the fence of this frame has been signaled, if a result is still missing the
+    // frame is skipped rather than stalling. Only the written scopes are read, the others of the
+    // slice stay unavailable.
+    std::array<uint64_t, 2 * m_MAX_SCOPES> timestamps{};
+    for (uint32_t scope = 0; scope < m_scopes.size(); ++scope) {
+        if (!frame.m_scopeWritten[scope]) {
+            continue;
+        }
+        VkResult result = vkGetQueryPoolResults(
+            m_device, m_timestampPool, timestampQuery(frameIndex, scope), 2,
+            2 * sizeof(uint64_t), &timestamps[scope * 2], sizeof(uint64_t), VK_QUERY_RESULT_64_BIT
+        );
+        if (result != VK_SUCCESS) {
+            return false;
+        }
+    }
+
+    std::array<PipelineStatistics, m_MAX_SCOPES> statistics{};
+    bool statisticsValid = frame.m_statisticsRecorded;
+    for (uint32_t scope = 0; statisticsValid && scope < m_scopes.size(); ++scope) {
+        if (frame.m_scopeWritten[scope] && vkGetQueryPoolResults(m_device, m_statisticsPool, statisticsQuery(frameIndex, scope), 1,
+                sizeof(PipelineStatistics), &statistics[scope], sizeof(PipelineStatistics), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+            statisticsValid = false;
+        }
+    }
+
+    for (uint32_t scope = 0; scope < m_scopes.size(); ++scope) {
+        Scope& entry = m_scopes[scope];
+        if (frame.m_scopeWritten[scope]) {
+            uint64_t begin = timestamps[scope * 2] & m_timestampMask;
+            uint64_t end = timestamps[scope * 2 + 1] & m_timestampMask;
+            entry.m_time = static_cast<float>((end - begin) & m_timestampMask) * m_timestampPeriod / 1000000.0f;
+        }
+        else {
+            entry.m_time = 0.0f;
+        }
+        entry.m_statistics = statisticsValid && frame.m_scopeWritten[scope] ? statistics[scope] : PipelineStatistics{};
+        entry.m_history[m_historyOffset] = entry.m_time;
+    }
+
+    m_cpuFrameTime = cpuFrameTime;
+    m_cpuHistory[m_historyOffset] = cpuFrameTime;
+    m_historyOffset = (m_historyOffset + 1) % m_HISTORY_SIZE;
+    ++m_collectedFrames;
+
+    frame.m_recorded = false;
+
+    if (m_csv.is_open()) {
+        writeCsvRow();
+    }
+
+    return true;
+}
+
+bool GpuProfiler::startCsvExport(const std::string& path) {
+    stopCsvExport();
+
+    m_csv.open(path, std::ios::out | std::ios::trunc);
+    if (!m_csv.is_open()) {
+        std::cerr << "Unable to open " << path << " for the profiler export" << std::endl;
+        return false;
+    }
+
+    m_csv << "frame,cpu_ms";
+    for (const Scope& scope : m_scopes) {
+        m_csv << "," << scope.m_name << "_ms";
+    }
+    if (m_statisticsPool != VK_NULL_HANDLE) {
+        for (const Scope& scope : m_scopes) {
+            m_csv << "," << scope.m_name << "_vertices," << scope.m_name << "_fragments," << scope.m_name << "_compute";
+        }
+    }
+    m_csv << "\n";
+    return true;
+}
+
+void GpuProfiler::stopCsvExport() {
+    if (m_csv.is_open()) {
+        m_csv.close();
+    }
+}
+
+void GpuProfiler::writeCsvRow() {
+    m_csv << m_collectedFrames << "," << m_cpuFrameTime;
+    for (const Scope& scope : m_scopes) {
+        m_csv << "," << scope.m_time;
+    }
+    if (m_statisticsPool != VK_NULL_HANDLE) {
+        for (const Scope& scope : m_scopes) {
+            m_csv << "," << scope.m_statistics.m_vertexShaderInvocations
+                  << "," << scope.m_statistics.m_fragmentShaderInvocations
+                  << "," << scope.m_statistics.m_computeShaderInvocations;
+        }
+    }
+    m_csv << "\n";
+}
+
+void GpuProfiler::drawUI() {
+    if (!ImGui::CollapsingHeader("Profiler")) {
+        return;
+    }
+
+    ImGui::PlotLines("##cpu", m_cpuHistory.data(), static_cast<int>(m_HISTORY_SIZE), static_cast<int>(m_historyOffset), nullptr, 0.0f, FLT_MAX, ImVec2(0.0f, 40.0f));
+    ImGui::SameLine();
+    ImGui::Text("CPU frame\n%.3f ms", m_cpuFrameTime);
+
+    if (!isAvailable()) {
+        ImGui::TextDisabled("GPU timestamps are disabled or not supported");
+        return;
+    }
+
+    for (const Scope& scope : m_scopes) {
+        ImGui::PushID(scope.m_name.c_str());
+        ImGui::PlotLines("##gpu", scope.m_history.data(), static_cast<int>(m_HISTORY_SIZE), static_cast<int>(m_historyOffset), nullptr, 0.0f, FLT_MAX, ImVec2(0.0f, 40.0f));
+        ImGui::SameLine();
+        ImGui::Text("%s\n%.3f ms", scope.m_name.c_str(), scope.m_time);
+        ImGui::PopID();
+    }
+
+    if (m_statisticsPool != VK_NULL_HANDLE) {
+        ImGui::Checkbox("Pipeline statistics", &m_statisticsEnabled);
+        if (m_statisticsEnabled && ImGui::BeginTable("statistics", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+            ImGui::TableSetupColumn("Scope");
+            ImGui::TableSetupColumn("Vertices");
+            ImGui::TableSetupColumn("VS invocations");
+            ImGui::TableSetupColumn("FS invocations");
+            ImGui::TableSetupColumn("CS invocations");
+            ImGui::TableHeadersRow();
+            for (const Scope& scope : m_scopes) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(scope.m_name.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", static_cast<unsigned long long>(scope.m_statistics.m_inputAssemblyVertices));
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", static_cast<unsigned long long>(scope.m_statistics.m_vertexShaderInvocations));
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", static_cast<unsigned long long>(scope.m_statistics.m_fragmentShaderInvocations));
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", static_cast<unsigned long long>(scope.m_statistics.m_computeShaderInvocations));
+            }
+            ImGui::EndTable();
+        }
+    }
+    else {
+        ImGui::TextDisabled("Pipeline statistics are not supported");
+    }
+
+    ImGui::InputText("CSV file", m_csvPath.data(), m_csvPath.size());
+    if (m_csv.is_open()) {
+        if (ImGui::Button("Stop CSV export")) {
+            stopCsvExport();
+        }
+        ImGui::SameLine();
+        ImGui::Text("Recording to %s", m_csvPath.data());
+    }
+    else if (ImGui::Button("Start CSV export")) {
+        startCsvExport(m_csvPath.data());
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef GPUPROFILER_H
+#define GPUPROFILER_H
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Measures the GPU time of named scopes (usually one per pass) with timestamp queries and,
+// when the device supports it, counts the shader invocations of each scope with pipeline
+// statistics queries. Every frame in flight owns its own slice of the query pools, the results
+// of a frame are only read once its fence has been waited on, so reading them never stalls.
+class GpuProfiler {
+public:
+	static constexpr uint32_t m_MAX_SCOPES = 16;
+	static constexpr size_t m_HISTORY_SIZE = 256;
+
+	struct PipelineStatistics {
+		uint64_t m_inputAssemblyVertices = 0;
+		uint64_t m_vertexShaderInvocations = 0;
+		uint64_t m_fragmentShaderInvocations = 0;
+		uint64_t m_computeShaderInvocations = 0;
+	};
+
+	// Without timestamps no query is recorded and isAvailable is false, as on devices that do not support them
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, uint32_t framesInFlight, bool timestamps, bool pipelineStatisticsSupported);
+	void cleanup();
+
+	// Scopes are registered once, before the first frame
+	uint32_t addScope(const std::string& name);
+
+	// Must be recorded outside of any render pass, before the scopes of the frame
+	void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+	void beginScope(VkCommandBuffer commandBuffer, uint32_t scope);
+	void endScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+	// Reads the results of a frame in flight whose fence has been waited on, returns false if there
+	// were none. Scopes that were not recorded in that frame report zero.
+	bool collect(uint32_t frameIndex, float cpuFrameTime);
+
+	inline bool isAvailable() const { return m_timestampPool != VK_NULL_HANDLE; }
+	inline float getTime(uint32_t scope) const { return m_scopes[scope].m_time; }
+
+	bool startCsvExport(const std::string& path);
+	void stopCsvExport();
+
+	void drawUI();
+
+private:
+	struct Scope {
+		std::string m_name;
+		float m_time = 0.0f;
+		PipelineStatistics m_statistics;
+		std::array<float, m_HISTORY_SIZE> m_history{};
+	};
+
+	struct FrameQueries {
+		bool m_recorded = false;
+		bool m_statisticsRecorded = false;
+		std::array<bool, m_MAX_SCOPES> m_scopeWritten{};
+	};
+
+	VkDevice m_device = VK_NULL_HANDLE;
+	VkQueryPool m_timestampPool = VK_NULL_HANDLE;
+	VkQueryPool m_statisticsPool = VK_NULL_HANDLE;
+	float m_timestampPeriod = 0.0f;
+	uint64_t m_timestampMask = ~0ull;
+
+	std::vector<Scope> m_scopes;
+	std::vector<FrameQueries> m_frames;
+	uint32_t m_recordingFrame = 0;
+	bool m_statisticsEnabled = false;
+
+	std::array<float, m_HISTORY_SIZE> m_cpuHistory{};
+	size_t m_historyOffset = 0;
+	float m_cpuFrameTime = 0.0f;
+	uint64_t m_collectedFrames = 0;
+
+	std::ofstream m_csv;
+	std::array<char, 256> m_csvPath{ "profile.csv" };
+
+	uint32_t timestampQuery(uint32_t frameIndex, uint32_t scope) const;
+	uint32_t statisticsQuery(uint32_t frameIndex, uint32_t scope) const;
+	void writeCsvRow();
+};
+
+#endif
@@ -0,0 +1,780 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+
+namespace {
+
+    constexpr VkAccessFlags g_writeAccess = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+    std::string getStageNames(VkPipelineStageFlags stages) {
+        const std::pair<VkPipelineStageFlags, const char*> names[] = {
+            { VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, "top" },
+            { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, "vertex input" },
+            { VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, "vertex" },
+            { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, "fragment" },
+            { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, "color output" },
+            { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, "compute" },
+            { VK_PIPELINE_STAGE_TRANSFER_BIT, "transfer" },
+            { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, "bottom" },
+            { VK_PIPELINE_STAGE_HOST_BIT, "host" }
+        };
+
+        std::string result;
+        for (const auto& [stage, name] : names) {
+            if (stages & stage) {
+                result += result.empty() ? name : std::string("|") + name;
+            }
+        }
+        return result.empty() ? "none" : result;
+    }
+
+    const char* getLayoutName(VkImageLayout layout) {
+        switch (layout) {
+        case VK_IMAGE_LAYOUT_UNDEFINED: return "undefined";
+        case VK_IMAGE_LAYOUT_GENERAL: return "general";
+        case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: return "color attachment";
+        case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: return "shader read";
+        case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL: return "transfer source";
+        case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL: return "transfer destination";
+        case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR: return "present";
+        default: return "other";
+        }
+    }
+
+    double toMegabytes(VkDeviceSize bytes) {
+        return static_cast<double>(bytes) / (1024.0 * 1024.0);
+    }
+
+    const char* getQueueName(RenderGraph::Queue queue) {
+        return queue == RenderGraph::Queue::Graphics ? "graphics" : "compute";
+    }
+
+    void addUnique(std::vector<uint32_t>& values, uint32_t value) {
+        if (std::find(values.begin(), values.end(), value) == values.end()) {
+            values.push_back(value);
+        }
+    }
+
+}
+
+RenderGraph::Resource RenderGraph::findResource(const std::string& name) {
+    for (size_t i = 0; i < m_resources.size(); ++i) {
+        if (m_resources[i].m_name == name) {
+            return static_cast<Resource>(i);
+        }
+    }
+
+    m_resources.emplace_back();
+    m_resources.back().m_name = name;
+    return static_cast<Resource>(m_resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::importImage(const std::string& name, VkImage image, VkImageLayout layout, const VkMemoryRequirements& memory, bool transient) {
+    Resource handle = findResource(name);
+    ResourceState& resource = m_resources[handle];
+    if (resource.m_image != image) {
+        ResourceState previous = std::move(resource);
+        resource = ResourceState{};
+        resource.m_name = std::move(previous.m_name);
+        resource.m_image = image;
+        resource.m_layout = layout;
+        resource.m_used = previous.m_used;
+        resource.m_interferences = std::move(previous.m_interferences);
+    }
+    resource.m_memory = memory;
+    resource.m_transient = transient;
+    return handle;
+}
+
+RenderGraph::Resource RenderGraph::importBuffer(const std::string& name) {
+    return findResource(name);
+}
+
+void RenderGraph::setAsyncCompute(uint32_t graphicsFamily, uint32_t computeFamily, VkSemaphore graphicsTimeline, VkSemaphore computeTimeline) {
+    m_graphicsFamily = graphicsFamily;
+    m_computeFamily = computeFamily;
+    m_graphicsTimeline = graphicsTimeline;
+    m_computeTimeline = computeTimeline;
+}
+
+uint32_t RenderGraph::getFamily(Queue queue) const {
+    return queue == Queue::Graphics ? m_graphicsFamily : m_computeFamily;
+}
+
+void RenderGraph::reset() {
+    for (ResourceState& resource : m_resources) {
+        resource.m_writeStages = 0;
+        resource.m_writeAccess = 0;
+        resource.m_readStages = 0;
+        resource.m_visibleStages = 0;
+        resource.m_visibleAccess = 0;
+    }
+}
+
+bool RenderGraph::isAliased(const ResourceState& resource) const {
+    return resource.m_aliasSlot >= 0 && m_aliasSlots[resource.m_aliasSlot].m_resources.size() > 1;
+}
+
+std::vector<RenderGraph::AliasSlot> RenderGraph::planAliasSlots(bool enabled) const {
+    std::vector<Resource> transients;
+    for (size_t i = 0; i < m_resources.size(); ++i) {
+        if (m_resources[i].m_transient && m_resources[i].m_image != VK_NULL_HANDLE) {
+            transients.push_back(static_cast<Resource>(i));
+        }
+    }
+    // The smaller images then fit in the slots of the larger ones
+    std::stable_sort(transients.begin(), transients.end(), [this](Resource a, Resource b) {
+        return m_resources[a].m_memory.size > m_resources[b].m_memory.size;
+    });
+
+    // Each image takes the first slot of a common memory type whose images it was never used at the same time
+    // as. Nothing is known of the images no frame used yet, they are left alone.
+    std::vector<AliasSlot> slots;
+    for (Resource handle : transients) {
+        const ResourceState& resource = m_resources[handle];
+        auto fits = [&](const AliasSlot& slot) {
+            if ((slot.m_memoryTypeBits & resource.m_memory.memoryTypeBits) == 0) {
+                return false;
+            }
+            return std::none_of(slot.m_resources.begin(), slot.m_resources.end(), [&](Resource other) {
+                return !m_resources[other].m_used ||
+                    std::find(resource.m_interferences.begin(), resource.m_interferences.end(), other) != resource.m_interferences.end();
+            });
+        };
+
+        auto slot = enabled && resource.m_used ? std::find_if(slots.begin(), slots.end(), fits) : slots.end();
+        if (slot == slots.end()) {
+            slot = slots.emplace(slots.end());
+        }
+        slot->m_size = std::max(slot->m_size, resource.m_memory.size);
+        slot->m_alignment = std::max(slot->m_alignment, resource.m_memory.alignment);
+        slot->m_memoryTypeBits &= resource.m_memory.memoryTypeBits;
+        slot->m_resources.push_back(handle);
+    }
+    return slots;
+}
+
+const std::vector<RenderGraph::AliasSlot>& RenderGraph::aliasTransientImages(bool enabled) {
+    m_aliasingEnabled = enabled;
+    m_aliasSlots = planAliasSlots(enabled);
+
+    for (ResourceState& resource : m_resources) {
+        resource.m_aliasSlot = -1;
+    }
+    for (size_t i = 0; i < m_aliasSlots.size(); ++i) {
+        for (Resource handle : m_aliasSlots[i].m_resources) {
+            m_resources[handle].m_aliasSlot = static_cast<int32_t>(i);
+        }
+    }
+    return m_aliasSlots;
+}
+
+void RenderGraph::beginFrame() {
+    m_passes.clear();
+}
+
+void RenderGraph::addPass(Pass pass) {
+    m_passes.push_back(std::move(pass));
+}
+
+void RenderGraph::computeLifetimes() {
+    for (ResourceState& resource : m_resources) {
+        resource.m_lastWriter = -1;
+        resource.m_readers.clear();
+        resource.m_firstPass = -1;
+        resource.m_lastPass = -1;
+    }
+
+    for (size_t i = 0; i < m_passes.size(); ++i) {
+        for (const Access& access : m_passes[i].m_accesses) {
+            ResourceState& resource = m_resources[access.m_resource];
+            if (resource.m_firstPass < 0) {
+                resource.m_firstPass = static_cast<int32_t>(i);
+            }
+            resource.m_lastPass = static_cast<int32_t>(i);
+        }
+    }
+}
+
+bool RenderGraph::checkAliasing() {
+    computeLifetimes();
+
+    bool overlap = false;
+    bool firstUse = false;
+    for (size_t i = 0; i < m_resources.size(); ++i) {
+        ResourceState& resource = m_resources[i];
+        if (!resource.m_transient || resource.m_firstPass < 0) {
+            continue;
+        }
+        firstUse |= !resource.m_used;
+        resource.m_used = true;
+
+        for (size_t j = i + 1; j < m_resources.size(); ++j) {
+            ResourceState& other = m_resources[j];
+            if (!other.m_transient || other.m_firstPass < 0 || other.m_lastPass < resource.m_firstPass || resource.m_lastPass < other.m_firstPass) {
+                continue;
+            }
+            addUnique(resource.m_interferences, static_cast<Resource>(j));
+            addUnique(other.m_interferences, static_cast<Resource>(i));
+            overlap |= resource.m_aliasSlot >= 0 && resource.m_aliasSlot == other.m_aliasSlot;
+        }
+    }
+
+    if (overlap) {
+        return true;
+    }
+    if (!firstUse || !m_aliasingEnabled) {
+        return false;
+    }
+
+    auto getMemory = [](const std::vector<AliasSlot>& slots) {
+        VkDeviceSize memory = 0;
+        for (const AliasSlot& slot : slots) {
+            memory += slot.m_size;
+        }
+        return memory;
+    };
+    return getMemory(planAliasSlots(true)) < getMemory(m_aliasSlots);
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer, VkCommandBuffer computeCommandBuffer) {
+    m_compiled.assign(m_passes.size(), CompiledPass{});
+    m_statistics = Statistics{};
+    m_statistics.m_passes = static_cast<uint32_t>(m_passes.size());
+    computeLifetimes();
+    computeDependencies();
+    placeAsyncPasses(computeCommandBuffer != VK_NULL_HANDLE && m_computeTimeline != VK_NULL_HANDLE && m_computeFamily != m_graphicsFamily);
+
+    // The graphics passes wait for the last frame using the compute queue, the compute ones for the graphics
+    // passes of their frame
+    m_graphicsHandoff = QueueHandoff{};
+    m_graphicsHandoff.m_waitValue = m_timelineValue;
+    m_computeHandoff = QueueHandoff{};
+
+    for (uint32_t i = 0; i < m_passes.size(); ++i) {
+        if (m_compiled[i].m_async) {
+            continue;
+        }
+        recordBarriers(commandBuffer, i, Queue::Graphics);
+        if (m_passes[i].m_record) {
+            m_passes[i].m_record(commandBuffer);
+        }
+    }
+
+    // No graphics pass depends on the async ones, they all run once the graphics command buffer is done
+    if (hasAsyncPasses()) {
+        release(commandBuffer, Queue::Graphics);
+        m_computeHandoff.m_waitValue = ++m_timelineValue;
+
+        for (uint32_t i = 0; i < m_passes.size(); ++i) {
+            if (m_compiled[i].m_async) {
+                recordBarriers(computeCommandBuffer, i, Queue::AsyncCompute);
+                m_passes[i].m_record(computeCommandBuffer);
+            }
+        }
+        release(computeCommandBuffer, Queue::AsyncCompute);
+    }
+
+    computeTransientMemory();
+}
+
+void RenderGraph::computeDependencies() {
+    // Simulated ahead of the recording: the last writer of each resource and its readers since, every pass
+    // using it for the images sharing its memory, and its layout for the transitions, which are writes
+    std::vector<int32_t> lastWriters(m_resources.size(), -1);
+    std::vector<std::vector<uint32_t>> readers(m_resources.size());
+    std::vector<std::vector<uint32_t>> users(m_resources.size());
+    std::vector<VkImageLayout> layouts(m_resources.size());
+    for (size_t i = 0; i < m_resources.size(); ++i) {
+        layouts[i] = m_resources[i].m_layout;
+    }
+
+    for (uint32_t i = 0; i < m_passes.size(); ++i) {
+        std::vector<uint32_t>& dependencies = m_compiled[i].m_dependencies;
+        auto depend = [&](uint32_t pass) {
+            if (pass != i) {
+                addUnique(dependencies, pass);
+            }
+        };
+
+        for (const Access& access : m_passes[i].m_accesses) {
+            Resource handle = access.m_resource;
+            const ResourceState& resource = m_resources[handle];
+            if (isAliased(resource) && static_cast<int32_t>(i) == resource.m_firstPass && users[handle].empty()) {
+                for (Resource other : m_aliasSlots[resource.m_aliasSlot].m_resources) {
+                    std::for_each(users[other].begin(), users[other].end(), depend);
+                }
+                layouts[handle] = VK_IMAGE_LAYOUT_UNDEFINED;
+            }
+
+            bool write = (access.m_access & g_writeAccess) != 0;
+            bool transition = resource.m_image != VK_NULL_HANDLE && access.m_layout != VK_IMAGE_LAYOUT_UNDEFINED && access.m_layout != layouts[handle];
+            if (lastWriters[handle] >= 0) {
+                depend(static_cast<uint32_t>(lastWriters[handle]));
+            }
+            if (write || transition) {
+                std::for_each(readers[handle].begin(), readers[handle].end(), depend);
+            }
+
+            if (write) {
+                lastWriters[handle] = static_cast<int32_t>(i);
+                readers[handle].clear();
+            }
+            else {
+                if (transition) {
+                    lastWriters[handle] = static_cast<int32_t>(i);
+                    readers[handle].clear();
+                }
+                readers[handle].push_back(i);
+            }
+            addUnique(users[handle], i);
+
+            if (transition) {
+                layouts[handle] = access.m_layout;
+            }
+            if (access.m_finalLayout != VK_IMAGE_LAYOUT_UNDEFINED) {
+                layouts[handle] = access.m_finalLayout;
+            }
+        }
+    }
+}
+
+void RenderGraph::placeAsyncPasses(bool available) {
+    // The passes are added in an order their dependencies follow, a single sweep from the last one finds the
+    // passes a graphics pass depends on through any chain of passes. Buffers are not imported with a handle to
+    // release, the passes using them stay on the graphics queue.
+    std::vector<bool> required(m_passes.size());
+    for (size_t i = m_passes.size(); i-- > 0;) {
+        const Pass& pass = m_passes[i];
+        CompiledPass& compiled = m_compiled[i];
+        bool images = std::all_of(pass.m_accesses.begin(), pass.m_accesses.end(), [this](const Access& access) {
+            return m_resources[access.m_resource].m_image != VK_NULL_HANDLE;
+        });
+
+        compiled.m_async = available && pass.m_queue == Queue::AsyncCompute && pass.m_record && images && !required[i];
+        if (compiled.m_async) {
+            ++m_statistics.m_asyncPasses;
+            continue;
+        }
+        for (uint32_t dependency : compiled.m_dependencies) {
+            required[dependency] = true;
+        }
+    }
+}
+
+void RenderGraph::acquire(VkCommandBuffer commandBuffer, Resource handle, Queue queue, const Access& access, CompiledPass& compiled) {
+    ResourceState& resource = m_resources[handle];
+
+    // The graphics work waits at the stages of the passes first using what the compute queue touched, the
+    // compute work waits at the stages of all its passes
+    if (queue == Queue::Graphics) {
+        m_graphicsHandoff.m_waitStages |= access.m_stages;
+    }
+
+    // Without a release, as once the contents are no longer needed, the queue takes the image over and its
+    // contents are lost
+    if (resource.m_released) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = access.m_access;
+        barrier.oldLayout = resource.m_layout;
+        barrier.newLayout = resource.m_layout;
+        barrier.srcQueueFamilyIndex = getFamily(resource.m_queue);
+        barrier.dstQueueFamilyIndex = getFamily(queue);
+        barrier.image = resource.m_image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        // Its source stages are those the semaphore wait blocks
+        vkCmdPipelineBarrier(commandBuffer, access.m_stages, access.m_stages, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        compiled.m_acquires.push_back(handle);
+    }
+    else {
+        resource.m_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+
+    // Like a transition, the acquire is a write of its own the later barriers wait on
+    resource.m_writeStages = access.m_stages;
+    resource.m_writeAccess = 0;
+    resource.m_readStages = 0;
+    resource.m_visibleStages = resource.m_released ? access.m_stages : 0;
+    resource.m_visibleAccess = resource.m_released ? access.m_access : 0;
+    resource.m_queue = queue;
+    resource.m_released = false;
+}
+
+void RenderGraph::release(VkCommandBuffer commandBuffer, Queue queue) {
+    std::vector<Resource> releases;
+    std::vector<Resource> acquires;
+
+    if (queue == Queue::Graphics) {
+        // The images the async passes use, unless their contents are undefined. Those the compute queue released
+        // before and no graphics pass acquired since only go through the graphics queue: acquired and released
+        // at once, at a stage no graphics work waits on.
+        for (size_t i = 0; i < m_passes.size(); ++i) {
+            if (!m_compiled[i].m_async) {
+                continue;
+            }
+            for (const Access& access : m_passes[i].m_accesses) {
+                const ResourceState& resource = m_resources[access.m_resource];
+                if (resource.m_released && resource.m_queue == Queue::AsyncCompute) {
+                    addUnique(acquires, access.m_resource);
+                    addUnique(releases, access.m_resource);
+                }
+                else if (!resource.m_released && resource.m_queue == Queue::Graphics && resource.m_layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+                    addUnique(releases, access.m_resource);
+                }
+            }
+        }
+    }
+    else {
+        // Everything the compute queue owns, the graphics passes of the next frames using an image acquire it.
+        // The next frame writes the transient images before reading them, the graphics queue takes them over.
+        for (size_t i = 0; i < m_resources.size(); ++i) {
+            const ResourceState& resource = m_resources[i];
+            if (resource.m_queue == Queue::AsyncCompute && !resource.m_released && !resource.m_transient && resource.m_image != VK_NULL_HANDLE &&
+                resource.m_layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+                releases.push_back(static_cast<Resource>(i));
+            }
+        }
+    }
+
+    auto getBarrier = [this](const ResourceState& resource, Queue srcQueue, Queue dstQueue) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = resource.m_layout;
+        barrier.newLayout = resource.m_layout;
+        barrier.srcQueueFamilyIndex = getFamily(srcQueue);
+        barrier.dstQueueFamilyIndex = getFamily(dstQueue);
+        barrier.image = resource.m_image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        return barrier;
+    };
+
+    if (!acquires.empty()) {
+        std::vector<VkImageMemoryBarrier> barriers;
+        for (Resource handle : acquires) {
+            ResourceState& resource = m_resources[handle];
+            barriers.push_back(getBarrier(resource, Queue::AsyncCompute, Queue::Graphics));
+            resource.m_queue = Queue::Graphics;
+            resource.m_released = false;
+            resource.m_writeStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+            resource.m_writeAccess = 0;
+            resource.m_readStages = 0;
+        }
+        m_graphicsHandoff.m_waitStages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr,
+            static_cast<uint32_t>(barriers.size()), barriers.data());
+    }
+
+    if (releases.empty()) {
+        return;
+    }
+
+    // The acquire of the other queue makes the writes visible to its passes, the release only waits for them
+    VkPipelineStageFlags srcStages = 0;
+    std::vector<VkImageMemoryBarrier> barriers;
+    for (Resource handle : releases) {
+        ResourceState& resource = m_resources[handle];
+        VkImageMemoryBarrier barrier = getBarrier(resource, queue, queue == Queue::Graphics ? Queue::AsyncCompute : Queue::Graphics);
+        barrier.srcAccessMask = resource.m_writeAccess;
+        barrier.dstAccessMask = 0;
+        barriers.push_back(barrier);
+        srcStages |= resource.m_writeStages | resource.m_readStages;
+        resource.m_released = true;
+    }
+
+    if (srcStages == 0) {
+        srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    }
+    vkCmdPipelineBarrier(commandBuffer, srcStages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr,
+        static_cast<uint32_t>(barriers.size()), barriers.data());
+    m_statistics.m_queueTransfers += static_cast<uint32_t>(releases.size());
+    (queue == Queue::Graphics ? m_graphicsHandoff : m_computeHandoff).m_releases = std::move(releases);
+}
+
+void RenderGraph::prepareSubmit(Queue queue, std::vector<VkSemaphore>& waitSemaphores, std::vector<VkPipelineStageFlags>& waitStages, std::vector<uint64_t>& waitValues,
+    std::vector<VkSemaphore>& signalSemaphores, std::vector<uint64_t>& signalValues) const {
+    // Ignored for the binary semaphores
+    waitValues.resize(waitSemaphores.size(), 0);
+    signalValues.resize(signalSemaphores.size(), 0);
+
+    const QueueHandoff& handoff = queue == Queue::Graphics ? m_graphicsHandoff : m_computeHandoff;
+    if (handoff.m_waitStages != 0) {
+        waitSemaphores.push_back(queue == Queue::Graphics ? m_computeTimeline : m_graphicsTimeline);
+        waitStages.push_back(handoff.m_waitStages);
+        waitValues.push_back(handoff.m_waitValue);
+    }
+
+    if (hasAsyncPasses()) {
+        signalSemaphores.push_back(queue == Queue::Graphics ? m_graphicsTimeline : m_computeTimeline);
+        signalValues.push_back(m_timelineValue);
+    }
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, uint32_t passIndex, Queue queue) {
+    const Pass& pass = m_passes[passIndex];
+    CompiledPass& compiled = m_compiled[passIndex];
+
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    bool memoryDependency = false;
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+
+    for (const Access& access : pass.m_accesses) {
+        ResourceState& resource = m_resources[access.m_resource];
+        if (queue == Queue::AsyncCompute) {
+            m_computeHandoff.m_waitStages |= access.m_stages;
+        }
+        if (resource.m_queue != queue) {
+            acquire(commandBuffer, access.m_resource, queue, access, compiled);
+        }
+
+        // The first use of an image sharing its memory discards its contents, once the other images of its slot
+        // are done with the memory: those used earlier in the frame or during the previous one
+        if (isAliased(resource) && static_cast<int32_t>(passIndex) == resource.m_firstPass && resource.m_lastWriter < 0 && resource.m_readers.empty()) {
+            for (Resource other : m_aliasSlots[resource.m_aliasSlot].m_resources) {
+                const ResourceState& alias = m_resources[other];
+                if (other == access.m_resource) {
+                    continue;
+                }
+                // The semaphore wait covers the accesses of the other queue, the barrier starts from its stages
+                if (alias.m_queue != queue) {
+                    if (queue == Queue::Graphics) {
+                        m_graphicsHandoff.m_waitStages |= access.m_stages;
+                    }
+                    resource.m_writeStages |= access.m_stages;
+                    continue;
+                }
+                resource.m_writeStages |= alias.m_writeStages;
+                resource.m_writeAccess |= alias.m_writeAccess;
+                resource.m_readStages |= alias.m_readStages;
+            }
+            resource.m_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            resource.m_visibleStages = 0;
+            resource.m_visibleAccess = 0;
+        }
+
+        bool write = (access.m_access & g_writeAccess) != 0;
+        bool transition = resource.m_image != VK_NULL_HANDLE && access.m_layout != VK_IMAGE_LAYOUT_UNDEFINED && access.m_layout != resource.m_layout;
+
+        VkPipelineStageFlags waitStages = 0;
+        VkAccessFlags waitAccess = 0;
+        if (write || transition) {
+            // Writes and layout transitions wait for the reads since the last write, and for that write
+            waitStages = resource.m_readStages | resource.m_writeStages;
+            waitAccess = resource.m_writeAccess;
+        }
+        else if (resource.m_writeStages != 0 &&
+            ((access.m_stages & ~resource.m_visibleStages) != 0 || (access.m_access & ~resource.m_visibleAccess) != 0)) {
+            // Reads wait for the last write, unless a barrier before already made it visible to them
+            waitStages = resource.m_writeStages;
+            waitAccess = resource.m_writeAccess;
+        }
+
+        if (transition) {
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = waitAccess;
+            barrier.dstAccessMask = access.m_access;
+            barrier.oldLayout = resource.m_layout;
+            barrier.newLayout = access.m_layout;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = resource.m_image;
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            barrier.subresourceRange.baseMipLevel = 0;
+            barrier.subresourceRange.levelCount = 1;
+            barrier.subresourceRange.baseArrayLayer = 0;
+            barrier.subresourceRange.layerCount = 1;
+            imageBarriers.push_back(barrier);
+
+            if (waitStages == 0) {
+                waitStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+            }
+        }
+        else if (waitStages != 0) {
+            memoryBarrier.srcAccessMask |= waitAccess;
+            memoryBarrier.dstAccessMask |= access.m_access;
+            memoryDependency = true;
+        }
+
+        if (waitStages != 0) {
+            srcStages |= waitStages;
+            dstStages |= access.m_stages;
+            compiled.m_barriers.push_back({ access.m_resource, waitStages, access.m_stages,
+                transition ? resource.m_layout : VK_IMAGE_LAYOUT_UNDEFINED, transition ? access.m_layout : VK_IMAGE_LAYOUT_UNDEFINED });
+        }
+
+        if (write) {
+            resource.m_writeStages = access.m_stages;
+            resource.m_writeAccess = access.m_access & g_writeAccess;
+            resource.m_readStages = 0;
+            resource.m_visibleStages = 0;
+            resource.m_visibleAccess = 0;
+            resource.m_lastWriter = static_cast<int32_t>(passIndex);
+            resource.m_readers.clear();
+        }
+        else {
+            if (transition) {
+                // The transition is a write of its own, already visible to the pass
+                resource.m_writeStages = access.m_stages;
+                resource.m_writeAccess = 0;
+                resource.m_readStages = 0;
+                resource.m_visibleStages = 0;
+                resource.m_visibleAccess = 0;
+            }
+            if (waitStages != 0) {
+                resource.m_visibleStages |= access.m_stages;
+                resource.m_visibleAccess |= access.m_access;
+            }
+            resource.m_readStages |= access.m_stages;
+            resource.m_readers.push_back(passIndex);
+        }
+
+        if (transition) {
+            resource.m_layout = access.m_layout;
+        }
+        if (access.m_finalLayout != VK_IMAGE_LAYOUT_UNDEFINED) {
+            resource.m_layout = access.m_finalLayout;
+        }
+    }
+
+    if (srcStages == 0) {
+        return;
+    }
+
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        srcStages, dstStages,
+        0,
+        memoryDependency ? 1 : 0, &memoryBarrier,
+        0, nullptr,
+        static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data()
+    );
+    m_statistics.m_memoryBarriers += memoryDependency ? 1 : 0;
+    m_statistics.m_imageBarriers += static_cast<uint32_t>(imageBarriers.size());
+}
+
+void RenderGraph::computeTransientMemory() {
+    std::vector<VkDeviceSize> liveMemory(m_passes.size());
+    for (const ResourceState& resource : m_resources) {
+        if (!resource.m_transient || resource.m_image == VK_NULL_HANDLE) {
+            continue;
+        }
+        m_statistics.m_transientMemory += resource.m_memory.size;
+        if (resource.m_aliasSlot < 0) {
+            m_statistics.m_aliasedMemory += resource.m_memory.size;
+        }
+        for (int32_t i = resource.m_firstPass; i >= 0 && i <= resource.m_lastPass; ++i) {
+            liveMemory[i] += resource.m_memory.size;
+        }
+    }
+
+    for (const AliasSlot& slot : m_aliasSlots) {
+        m_statistics.m_aliasedMemory += slot.m_size;
+    }
+    for (VkDeviceSize memory : liveMemory) {
+        m_statistics.m_peakTransientMemory = std::max(m_statistics.m_peakTransientMemory, memory);
+    }
+}
+
+std::string RenderGraph::dump() const {
+    char line[256];
+    std::string result;
+
+    std::snprintf(line, sizeof(line), "%u passes, %u memory barriers, %u image barriers\n",
+        m_statistics.m_passes, m_statistics.m_memoryBarriers, m_statistics.m_imageBarriers);
+    result += line;
+
+    for (size_t i = 0; i < m_passes.size() && i < m_compiled.size(); ++i) {
+        const Pass& pass = m_passes[i];
+        const char* placement = !pass.m_record ? " (outside the command buffer)" : m_compiled[i].m_async ? " (async compute)" :
+            pass.m_queue == Queue::AsyncCompute ? " (async compute asked, on graphics)" : "";
+        std::snprintf(line, sizeof(line), "%2zu %s%s\n", i, pass.m_name.c_str(), placement);
+        result += line;
+
+        for (Resource handle : m_compiled[i].m_acquires) {
+            std::snprintf(line, sizeof(line), "     %s: acquired from the %s queue\n", m_resources[handle].m_name.c_str(),
+                getQueueName(m_compiled[i].m_async ? Queue::Graphics : Queue::AsyncCompute));
+            result += line;
+        }
+
+        for (const Dependency& barrier : m_compiled[i].m_barriers) {
+            std::snprintf(line, sizeof(line), "     %s: %s -> %s", m_resources[barrier.m_resource].m_name.c_str(),
+                getStageNames(barrier.m_srcStages).c_str(), getStageNames(barrier.m_dstStages).c_str());
+            result += line;
+            if (barrier.m_newLayout != VK_IMAGE_LAYOUT_UNDEFINED) {
+                std::snprintf(line, sizeof(line), ", %s -> %s layout", getLayoutName(barrier.m_oldLayout), getLayoutName(barrier.m_newLayout));
+                result += line;
+            }
+            result += "\n";
+        }
+    }
+
+    if (m_statistics.m_transientMemory > 0) {
+        result += m_aliasingEnabled ? "Transient images:\n" : "Transient images (not aliased):\n";
+        for (size_t i = 0; i < m_aliasSlots.size(); ++i) {
+            for (Resource handle : m_aliasSlots[i].m_resources) {
+                const ResourceState& resource = m_resources[handle];
+                if (resource.m_firstPass < 0) {
+                    std::snprintf(line, sizeof(line), "   %s: unused, slot %zu, %.1f MB\n", resource.m_name.c_str(), i, toMegabytes(resource.m_memory.size));
+                }
+                else {
+                    std::snprintf(line, sizeof(line), "   %s: passes %d to %d, slot %zu, %.1f MB\n", resource.m_name.c_str(),
+                        resource.m_firstPass, resource.m_lastPass, i, toMegabytes(resource.m_memory.size));
+                }
+                result += line;
+            }
+        }
+        std::snprintf(line, sizeof(line), "   %.1f MB unaliased, %.1f MB aliased, %.1f MB used at once at most\n",
+            toMegabytes(m_statistics.m_transientMemory), toMegabytes(m_statistics.m_aliasedMemory), toMegabytes(m_statistics.m_peakTransientMemory));
+        result += line;
+    }
+
+    // The edges between the queues: the semaphore waits and the images each command buffer releases at its end
+    if (m_graphicsHandoff.m_waitStages != 0 || hasAsyncPasses()) {
+        std::snprintf(line, sizeof(line), "Queues (%u async compute passes, timeline value %llu):\n", m_statistics.m_asyncPasses,
+            static_cast<unsigned long long>(m_timelineValue));
+        result += line;
+
+        auto addQueue = [&](Queue queue, const QueueHandoff& handoff) {
+            if (handoff.m_waitStages != 0) {
+                std::snprintf(line, sizeof(line), "   %s waits for the %s queue to reach %llu at %s\n", getQueueName(queue),
+                    getQueueName(queue == Queue::Graphics ? Queue::AsyncCompute : Queue::Graphics), static_cast<unsigned long long>(handoff.m_waitValue),
+                    getStageNames(handoff.m_waitStages).c_str());
+                result += line;
+            }
+            if (!handoff.m_releases.empty()) {
+                result += std::string("   ") + getQueueName(queue) + " releases ";
+                for (size_t i = 0; i < handoff.m_releases.size(); ++i) {
+                    result += (i > 0 ? ", " : "") + m_resources[handoff.m_releases[i]].m_name;
+                }
+                result += "\n";
+            }
+            if (hasAsyncPasses()) {
+                std::snprintf(line, sizeof(line), "   %s signals %llu\n", getQueueName(queue), static_cast<unsigned long long>(m_timelineValue));
+                result += line;
+            }
+        };
+        addQueue(Queue::Graphics, m_graphicsHandoff);
+        if (hasAsyncPasses()) {
+            addQueue(Queue::AsyncCompute, m_computeHandoff);
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,215 @@
+#ifndef RENDERGRAPH_H
+#define RENDERGRAPH_H
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Records the passes of a frame with the barriers between them, derived from the resources each pass declares
+// to read and write. The passes are added again every frame, in the order they run, while the resources are
+// imported once and keep their state from one frame to the next, so the first passes of a frame wait on the
+// accesses of the last ones of the frame before.
+//
+// An image gets a barrier of its own when it changes layout, every other dependency of a pass is merged into a
+// single global memory barrier recorded before it. Buffers are tracked as a whole, the buffers always written
+// and read together can be a single resource.
+//
+// The transient images, only used within a frame, can share memory when no frame uses them at the same time:
+// the graph follows their lifetimes over the frames and groups them into alias slots, each bound to a single
+// allocation by the caller. The first pass of a frame using an aliased image discards its contents.
+//
+// A pass can ask for the async compute queue. When the device has a compute family of its own, the passes asking
+// for it that no graphics pass of the frame depends on, directly or through other passes, are recorded to a
+// second command buffer submitted to that queue after the graphics one. The images they use change queue family
+// with a release at the end of one command buffer and an acquire before the first pass using them in the other,
+// and each queue signals a timeline semaphore the other waits on, one value per frame using the compute queue:
+// the compute command buffer waits for the graphics work of its frame, the graphics work of the next frames
+// waits for it at the stages first using the images it touched.
+class RenderGraph {
+public:
+	using Resource = uint32_t;
+
+	enum class Queue { Graphics, AsyncCompute };
+
+	struct Access {
+		Resource m_resource = 0;
+		VkPipelineStageFlags m_stages = 0;
+		// A write bit makes the pass a writer of the resource
+		VkAccessFlags m_access = 0;
+		// Layout the image must be in, it is transitioned before the pass. Undefined for the buffers and for the
+		// attachments transitioned by the render pass of the pass.
+		VkImageLayout m_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		// Layout the render pass of the pass leaves the image in, undefined when it does not change it
+		VkImageLayout m_finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	};
+
+	struct Pass {
+		std::string m_name;
+		Queue m_queue = Queue::Graphics;
+		std::vector<Access> m_accesses;
+		// Recorded after the barriers the pass needs. Without one, the accesses happen once the command buffer
+		// is done, as for the UI command buffer submitted after it or the host reading a buffer back: only the
+		// barriers are recorded, such passes are added last.
+		std::function<void(VkCommandBuffer)> m_record;
+	};
+
+	struct Statistics {
+		uint32_t m_passes = 0;
+		uint32_t m_memoryBarriers = 0;
+		uint32_t m_imageBarriers = 0;
+		// Passes recorded to the compute command buffer, and the images released to the other queue family
+		uint32_t m_asyncPasses = 0;
+		uint32_t m_queueTransfers = 0;
+		// Memory of the transient images each in memory of its own, as bound to their alias slots, and the most
+		// the frame used at once, which no aliasing of its schedule can go below
+		VkDeviceSize m_transientMemory = 0;
+		VkDeviceSize m_aliasedMemory = 0;
+		VkDeviceSize m_peakTransientMemory = 0;
+	};
+
+	// Transient images sharing memory, bound at its start
+	struct AliasSlot {
+		VkDeviceSize m_size = 0;
+		VkDeviceSize m_alignment = 1;
+		uint32_t m_memoryTypeBits = ~0u;
+		std::vector<Resource> m_resources;
+	};
+
+	// Resources are matched by name, importing one again returns the same handle. An image imported with
+	// another handle than before, e.g. once recreated, forgets its accesses and starts in the given layout.
+	// Transient images are written by the first pass of a frame using them before any read.
+	Resource importImage(const std::string& name, VkImage image, VkImageLayout layout, const VkMemoryRequirements& memory = {}, bool transient = false);
+	Resource importBuffer(const std::string& name);
+	// Forgets the accesses of every resource, once the device is idle. The queue family owning each image is
+	// kept, as are the releases not acquired yet.
+	void reset();
+
+	// Queue families of the two command buffers and the timeline semaphore each queue signals, created by the
+	// caller with an initial value of zero. Without it, or when the families are the same, every pass is
+	// recorded to the graphics command buffer.
+	void setAsyncCompute(uint32_t graphicsFamily, uint32_t computeFamily, VkSemaphore graphicsTimeline, VkSemaphore computeTimeline);
+
+	// Groups the transient images no frame executed so far used at the same time into slots, largest first. The
+	// images no frame used yet get a slot of their own, as do all of them when not enabled. The caller binds the
+	// images of each slot to the same memory, of the size, alignment and type of the slot.
+	const std::vector<AliasSlot>& aliasTransientImages(bool enabled);
+	inline bool isAliasingEnabled() const { return m_aliasingEnabled; }
+
+	void beginFrame();
+	void addPass(Pass pass);
+	// Follows the lifetimes of the transient images in the passes added since beginFrame. True when they must
+	// be created and aliased again before the frame is executed: images of a slot are used at the same time,
+	// or images used for the first time let the slots take less memory.
+	bool checkAliasing();
+	// Records the passes added since beginFrame, each after its barriers, the async compute ones to the compute
+	// command buffer when given one. Both command buffers are begun and ended by the caller, the compute one is
+	// only submitted when hasAsyncPasses.
+	void execute(VkCommandBuffer commandBuffer, VkCommandBuffer computeCommandBuffer = VK_NULL_HANDLE);
+	inline bool hasAsyncPasses() const { return m_statistics.m_asyncPasses > 0; }
+	// Adds the timeline semaphore waits and signals of the frame executed last to the submit of the command
+	// buffer of the queue, after the binary semaphores already in the vectors, whose values are padded
+	void prepareSubmit(Queue queue, std::vector<VkSemaphore>& waitSemaphores, std::vector<VkPipelineStageFlags>& waitStages, std::vector<uint64_t>& waitValues,
+		std::vector<VkSemaphore>& signalSemaphores, std::vector<uint64_t>& signalValues) const;
+	// Value the compute queue signals once done with the frame executed last, the compute command buffer of a
+	// frame in flight can be recorded again once it is reached
+	inline uint64_t getTimelineValue() const { return m_timelineValue; }
+
+	inline const Statistics& getStatistics() const { return m_statistics; }
+	// Passes of the last frame executed with their barriers, the lifetimes and slots of the transient images and
+	// the work handed over between the queues, one line each
+	std::string dump() const;
+
+private:
+	struct ResourceState {
+		std::string m_name;
+		VkImage m_image = VK_NULL_HANDLE;
+		VkMemoryRequirements m_memory{};
+		bool m_transient = false;
+		VkImageLayout m_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		// Queue that used the image last, and whether the end of its command buffer released the image to the
+		// other queue family, which acquires it before using it
+		Queue m_queue = Queue::Graphics;
+		bool m_released = false;
+		// Index in m_aliasSlots, -1 before aliasTransientImages
+		int32_t m_aliasSlot = -1;
+		// Whether a frame used the transient image, and the others it used at the same time, kept when the
+		// image is created again
+		bool m_used = false;
+		std::vector<Resource> m_interferences;
+
+		// Last write and the reads since, with the stages and the accesses it was made visible to
+		VkPipelineStageFlags m_writeStages = 0;
+		VkAccessFlags m_writeAccess = 0;
+		VkPipelineStageFlags m_readStages = 0;
+		VkPipelineStageFlags m_visibleStages = 0;
+		VkAccessFlags m_visibleAccess = 0;
+
+		// Passes of the frame being executed, -1 for none
+		int32_t m_lastWriter = -1;
+		std::vector<uint32_t> m_readers;
+		int32_t m_firstPass = -1;
+		int32_t m_lastPass = -1;
+	};
+
+	// A wait of a pass on the previous accesses of a resource, or a change of queue family, for the dump
+	struct Dependency {
+		Resource m_resource;
+		VkPipelineStageFlags m_srcStages;
+		VkPipelineStageFlags m_dstStages;
+		VkImageLayout m_oldLayout;
+		VkImageLayout m_newLayout;
+	};
+
+	struct CompiledPass {
+		std::vector<Dependency> m_barriers;
+		// Images acquired from the other queue family before the pass
+		std::vector<Resource> m_acquires;
+		// Earlier passes of the frame it depends on
+		std::vector<uint32_t> m_dependencies;
+		bool m_async = false;
+	};
+
+	// Semaphore waits and releases of the command buffer of a queue, for the submits and the dump
+	struct QueueHandoff {
+		VkPipelineStageFlags m_waitStages = 0;
+		uint64_t m_waitValue = 0;
+		std::vector<Resource> m_releases;
+	};
+
+	std::vector<ResourceState> m_resources;
+	std::vector<Pass> m_passes;
+	std::vector<CompiledPass> m_compiled;
+	std::vector<AliasSlot> m_aliasSlots;
+	Statistics m_statistics;
+	bool m_aliasingEnabled = false;
+
+	uint32_t m_graphicsFamily = VK_QUEUE_FAMILY_IGNORED;
+	uint32_t m_computeFamily = VK_QUEUE_FAMILY_IGNORED;
+	VkSemaphore m_graphicsTimeline = VK_NULL_HANDLE;
+	VkSemaphore m_computeTimeline = VK_NULL_HANDLE;
+	// Value of the last frame using the compute queue, signaled by both queues once done with it
+	uint64_t m_timelineValue = 0;
+	QueueHandoff m_graphicsHandoff;
+	QueueHandoff m_computeHandoff;
+
+	Resource findResource(const std::string& name);
+	bool isAliased(const ResourceState& resource) const;
+	std::vector<AliasSlot> planAliasSlots(bool enabled) const;
+	// First and last pass of the frame using each resource
+	void computeLifetimes();
+	void computeDependencies();
+	void placeAsyncPasses(bool available);
+	void recordBarriers(VkCommandBuffer commandBuffer, uint32_t passIndex, Queue queue);
+	// Moves the image to the queue about to use it, with an acquire when the other queue released it
+	void acquire(VkCommandBuffer commandBuffer, Resource handle, Queue queue, const Access& access, CompiledPass& compiled);
+	// Releases to the other queue family the images the queue used last, or those the async passes use
+	void release(VkCommandBuffer commandBuffer, Queue queue);
+	uint32_t getFamily(Queue queue) const;
+	void computeTransientMemory();
+};
+
+#endif
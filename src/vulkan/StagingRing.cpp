@@ -0,0 +1,233 @@
+#include "StagingRing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+void StagingRing::init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, VkQueue queue, VkDeviceSize blockSize, uint32_t blockCount) {
+    m_device = device;
+    m_queue = queue;
+    m_blockSize = blockSize;
+    m_blocks.resize(std::max(blockCount, 1u));
+    m_currentBlock = 0;
+    m_used = 0;
+    m_statistics = Statistics{};
+    m_completedSubmissions = 0;
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = m_blockSize * m_blocks.size();
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &m_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create staging buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(m_device, m_buffer, &memRequirements);
+
+    // Only written sequentially by the CPU, write combined memory without caching is the fastest for that
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    const VkMemoryPropertyFlags coherent = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    int memoryType = -1;
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
+        VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[i].propertyFlags;
+        if ((memRequirements.memoryTypeBits & (1u << i)) == 0 || (flags & coherent) != coherent) {
+            continue;
+        }
+        if (memoryType < 0 || !(flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT)) {
+            memoryType = static_cast<int>(i);
+            if (!(flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT)) {
+                break;
+            }
+        }
+    }
+    if (memoryType < 0) {
+        throw std::runtime_error("No host visible memory for the staging buffer!");
+    }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = static_cast<uint32_t>(memoryType);
+
+    if (vkAllocateMemory(m_device, &allocInfo, nullptr, &m_memory) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate staging buffer memory!");
+    }
+
+    vkBindBufferMemory(m_device, m_buffer, m_memory, 0);
+    // Mapped for the lifetime of the ring
+    void* mapped = nullptr;
+    vkMapMemory(m_device, m_memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+    m_mapped = static_cast<uint8_t*>(mapped);
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = queueFamilyIndex;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create staging command pool!");
+    }
+
+    std::vector<VkCommandBuffer> commandBuffers(m_blocks.size());
+    VkCommandBufferAllocateInfo commandBufferInfo{};
+    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferInfo.commandPool = m_commandPool;
+    commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+
+    if (vkAllocateCommandBuffers(m_device, &commandBufferInfo, commandBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate staging command buffers!");
+    }
+
+    VkSemaphoreTypeCreateInfo semaphoreTypeInfo{};
+    semaphoreTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    semaphoreTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    semaphoreTypeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &semaphoreTypeInfo;
+
+    if (vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_semaphore) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create staging semaphore!");
+    }
+
+    for (size_t i = 0; i < m_blocks.size(); ++i) {
+        m_blocks[i] = Block{};
+        m_blocks[i].m_commandBuffer = commandBuffers[i];
+    }
+}
+
+void StagingRing::cleanup() {
+    if (m_device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    for (const Block& block : m_blocks) {
+        waitForBlock(block);
+    }
+    m_blocks.clear();
+    vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+    vkDestroySemaphore(m_device, m_semaphore, nullptr);
+
+    vkUnmapMemory(m_device, m_memory);
+    vkDestroyBuffer(m_device, m_buffer, nullptr);
+    vkFreeMemory(m_device, m_memory, nullptr);
+
+    m_commandPool = VK_NULL_HANDLE;
+    m_semaphore = VK_NULL_HANDLE;
+    m_buffer = VK_NULL_HANDLE;
+    m_memory = VK_NULL_HANDLE;
+    m_mapped = nullptr;
+    m_device = VK_NULL_HANDLE;
+}
+
+StagingRing::Allocation StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment) {
+    if (size > m_blockSize) {
+        throw std::runtime_error("Staging allocation larger than a block!");
+    }
+
+    VkDeviceSize offset = (m_used + alignment - 1) / alignment * alignment;
+    if (offset + size > m_blockSize) {
+        flush();
+        offset = 0;
+    }
+
+    Allocation allocation;
+    allocation.m_commandBuffer = getCommandBuffer();
+    allocation.m_buffer = m_buffer;
+    allocation.m_offset = m_currentBlock * m_blockSize + offset;
+    allocation.m_data = m_mapped + allocation.m_offset;
+
+    m_used = offset + size;
+    m_statistics.m_bytes += size;
+    return allocation;
+}
+
+VkCommandBuffer StagingRing::getCommandBuffer() {
+    Block& block = m_blocks[m_currentBlock];
+    if (!block.m_recording) {
+        // The previous round of this block may still be copying out of its part of the buffer
+        waitForBlock(block);
+        vkResetCommandBuffer(block.m_commandBuffer, 0);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(block.m_commandBuffer, &beginInfo);
+
+        block.m_recording = true;
+        m_used = 0;
+    }
+    return block.m_commandBuffer;
+}
+
+void StagingRing::flush() {
+    Block& block = m_blocks[m_currentBlock];
+    if (!block.m_recording) {
+        return;
+    }
+
+    vkEndCommandBuffer(block.m_commandBuffer);
+
+    uint64_t submission = m_statistics.m_submissions + 1;
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &submission;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &block.m_commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &m_semaphore;
+
+    if (vkQueueSubmit(m_queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit staging copies!");
+    }
+
+    block.m_recording = false;
+    block.m_submission = submission;
+    m_statistics.m_submissions = submission;
+
+    m_currentBlock = (m_currentBlock + 1) % static_cast<uint32_t>(m_blocks.size());
+    m_used = 0;
+}
+
+void StagingRing::finish() {
+    flush();
+    for (const Block& block : m_blocks) {
+        waitForBlock(block);
+    }
+}
+
+uint64_t StagingRing::pollCompletedSubmissions() {
+    if (m_completedSubmissions < m_statistics.m_submissions) {
+        vkGetSemaphoreCounterValue(m_device, m_semaphore, &m_completedSubmissions);
+    }
+    return m_completedSubmissions;
+}
+
+void StagingRing::waitForBlock(const Block& block) {
+    if (block.m_submission <= pollCompletedSubmissions()) {
+        return;
+    }
+
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &m_semaphore;
+    waitInfo.pValues = &block.m_submission;
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    vkWaitSemaphores(m_device, &waitInfo, UINT64_MAX);
+    m_statistics.m_waitTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+    m_completedSubmissions = std::max(m_completedSubmissions, block.m_submission);
+}
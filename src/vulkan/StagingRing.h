@@ -0,0 +1,86 @@
+#ifndef STAGINGRING_H
+#define STAGINGRING_H
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <vector>
+
+// Persistently mapped upload buffer split into blocks, each with its own command buffer. Copies are recorded
+// into the current block until it is full, it is then submitted and the next block is filled while the
+// previous ones are in flight. A block is only waited on when the ring wraps around to it, so the CPU writing
+// the data and the GPU copying it overlap.
+//
+// Every submission signals a timeline semaphore with its number, counted from 1, so other queues can wait on
+// the copies of a given submission and the CPU can poll them without a fence per block. Every block is
+// submitted to the same queue in order, so a barrier recorded in one block applies to the copies recorded in
+// the others.
+class StagingRing {
+public:
+	struct Allocation {
+		void* m_data = nullptr;
+		VkBuffer m_buffer = VK_NULL_HANDLE;
+		VkDeviceSize m_offset = 0;
+		// Command buffer of the block holding the allocation, the copy out of it is recorded there
+		VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
+	};
+
+	struct Statistics {
+		uint64_t m_bytes = 0;
+		uint64_t m_submissions = 0;
+		// Time spent waiting for a block to be free again, in milliseconds
+		double m_waitTime = 0.0;
+	};
+
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, VkQueue queue, VkDeviceSize blockSize, uint32_t blockCount);
+	void cleanup();
+
+	// size bytes of the current block at the given alignment. Submits the block and moves to the next one when
+	// they do not fit, throws when size exceeds the block size.
+	Allocation allocate(VkDeviceSize size, VkDeviceSize alignment);
+	// Command buffer of the current block, for the barriers recorded around the copies
+	VkCommandBuffer getCommandBuffer();
+	// Submits the current block if anything was recorded in it
+	void flush();
+	// Flushes and waits for every block in flight
+	void finish();
+	// Number of submissions whose copies are done, never blocks. Submissions complete in order, the first ones
+	// are those of m_statistics.m_submissions.
+	uint64_t pollCompletedSubmissions();
+	// Signaled with the number of each submission once its copies are done
+	inline VkSemaphore getSemaphore() const { return m_semaphore; }
+
+	inline VkDeviceSize getBlockSize() const { return m_blockSize; }
+	inline const Statistics& getStatistics() const { return m_statistics; }
+	inline bool isInitialized() const { return m_device != VK_NULL_HANDLE; }
+
+private:
+	struct Block {
+		VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
+		bool m_recording = false;
+		// Number of the last submission of the block, 0 before the first
+		uint64_t m_submission = 0;
+	};
+
+	VkDevice m_device = VK_NULL_HANDLE;
+	VkQueue m_queue = VK_NULL_HANDLE;
+	VkCommandPool m_commandPool = VK_NULL_HANDLE;
+	VkSemaphore m_semaphore = VK_NULL_HANDLE;
+	VkBuffer m_buffer = VK_NULL_HANDLE;
+	VkDeviceMemory m_memory = VK_NULL_HANDLE;
+	uint8_t* m_mapped = nullptr;
+
+	VkDeviceSize m_blockSize = 0;
+	std::vector<Block> m_blocks;
+	uint32_t m_currentBlock = 0;
+	// Bytes allocated in the current block
+	VkDeviceSize m_used = 0;
+	Statistics m_statistics;
+	// Last value of the semaphore read, it only grows
+	uint64_t m_completedSubmissions = 0;
+
+	void waitForBlock(const Block& block);
+};
+
+#endif
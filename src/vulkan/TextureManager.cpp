@@ -0,0 +1,706 @@
+#include "TextureManager.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <imgui.h>
+
+namespace {
+
+    VkFormat getStreamedFormat(const TextureCache::Entry& entry) {
+        bool srgb = entry.m_encoding == Texture::Encoding::Srgb;
+        switch (entry.m_format) {
+        case BlockCompression::Format::Bc1: return srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+        case BlockCompression::Format::Bc5: return VK_FORMAT_BC5_UNORM_BLOCK;
+        case BlockCompression::Format::Bc7: return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+        }
+        return VK_FORMAT_UNDEFINED;
+    }
+
+    const char* getFormatName(BlockCompression::Format format) {
+        switch (format) {
+        case BlockCompression::Format::Bc1: return "BC1";
+        case BlockCompression::Format::Bc5: return "BC5";
+        case BlockCompression::Format::Bc7: return "BC7";
+        }
+        return "?";
+    }
+
+    double toMegabytes(uint64_t bytes) {
+        return static_cast<double>(bytes) / (1024.0 * 1024.0);
+    }
+
+}
+
+uint32_t TextureManager::getMaxTextures(VkPhysicalDevice physicalDevice) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    const VkPhysicalDeviceLimits& limits = properties.limits;
+    return std::min({ m_MAX_TEXTURES, limits.maxPerStageDescriptorSampledImages, limits.maxPerStageDescriptorSamplers,
+                      limits.maxDescriptorSetSampledImages, limits.maxDescriptorSetSamplers });
+}
+
+void TextureManager::init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, VkQueue queue, bool anisotropy) {
+    m_device = device;
+    m_physicalDevice = physicalDevice;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+
+    // Shared by every texture, the mip level is chosen by the trace shader from its ray cones
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.anisotropyEnable = anisotropy ? VK_TRUE : VK_FALSE;
+    samplerInfo.maxAnisotropy = anisotropy ? std::min(properties.limits.maxSamplerAnisotropy, 8.0f) : 1.0f;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+
+    if (vkCreateSampler(m_device, &samplerInfo, nullptr, &m_sampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture sampler!");
+    }
+
+    m_staging.init(m_device, m_physicalDevice, queueFamilyIndex, queue, m_STAGING_BLOCK_SIZE, m_STAGING_BLOCK_COUNT);
+}
+
+void TextureManager::cleanup() {
+    if (m_device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    m_loader.reset();
+    m_decoded.clear();
+    m_uploadTextures.clear();
+    m_staging.cleanup();
+    destroyImages();
+    m_cache.close();
+    vkDestroySampler(m_device, m_sampler, nullptr);
+    m_sampler = VK_NULL_HANDLE;
+    m_device = VK_NULL_HANDLE;
+}
+
+void TextureManager::upload(const std::vector<Texture>& textures, unsigned int workerCount) {
+    retireImages();
+
+    uint32_t maxTextures = getMaxTextures(m_physicalDevice);
+    if (textures.size() > maxTextures) {
+        throw std::runtime_error("The scene has " + std::to_string(textures.size()) + " textures, the device samples at most " + std::to_string(maxTextures));
+    }
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    StagingRing::Statistics stagingBefore = m_staging.getStatistics();
+
+    m_images.resize(textures.size());
+    try {
+        TextureLoader loader(textures, workerCount);
+        TextureLoader::DecodedTexture texture;
+        while (loader.next(texture)) {
+            Image& image = m_images[texture.m_index];
+            VkFormat format = texture.m_encoding == Texture::Encoding::Srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+            createImage(format, texture.m_levels[0].m_width, texture.m_levels[0].m_height, static_cast<uint32_t>(texture.m_levels.size()), image);
+            recordUpload(texture, image, m_staging);
+        }
+        m_statistics.m_decodeTime = loader.getDecodeTime();
+        m_staging.finish();
+    }
+    catch (...) {
+        // The blocks in flight may still copy into the images, releaseImages waits for them
+        retireImages();
+        throw;
+    }
+
+    m_statistics.m_uploadTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+    m_statistics.m_uploadedBytes = m_staging.getStatistics().m_bytes - stagingBefore.m_bytes;
+    m_statistics.m_stagingSubmissions = m_staging.getStatistics().m_submissions - stagingBefore.m_submissions;
+}
+
+void TextureManager::stream(const std::vector<Texture>& textures, const std::vector<BlockCompression::Format>& formats, const std::string& cachePath, unsigned int workerCount) {
+    retireImages();
+
+    uint32_t maxTextures = getMaxTextures(m_physicalDevice);
+    if (textures.size() > maxTextures) {
+        throw std::runtime_error("The scene has " + std::to_string(textures.size()) + " textures, the device samples at most " + std::to_string(maxTextures));
+    }
+
+    m_cache.open(cachePath, textures, formats, workerCount);
+    m_streaming = true;
+    m_frame = 0;
+    m_images.resize(textures.size());
+    m_residency.resize(textures.size());
+
+    VkDeviceSize fullMemory = 0;
+    try {
+        for (size_t i = 0; i < textures.size(); ++i) {
+            const std::vector<TextureCache::Level>& levels = m_cache.getEntry(i).m_levels;
+            uint32_t tail = 0;
+            while (tail + 1 < levels.size() && (levels[tail].m_width > m_TAIL_SIZE || levels[tail].m_height > m_TAIL_SIZE)) {
+                ++tail;
+            }
+
+            Residency& residency = m_residency[i];
+            residency.m_tailLevel = tail;
+            residency.m_requestedLevel = tail;
+            setResidentLevel(i, tail);
+            fullMemory += getLevelsSize(i, 0);
+        }
+        m_staging.finish();
+    }
+    catch (...) {
+        retireImages();
+        throw;
+    }
+
+    // The tails are not counted as streamed
+    m_streamingStatistics = StreamingStatistics{};
+    m_streamingStatistics.m_cacheBuildTime = m_cache.wasRebuilt() ? m_cache.getBuildTime() : 0.0;
+    m_streamingStatistics.m_cacheSize = m_cache.getFileSize();
+    m_streamingStatistics.m_fullMemory = fullMemory;
+}
+
+void TextureManager::beginUpload(std::vector<Texture> textures, unsigned int workerCount) {
+    retireImages();
+
+    uint32_t maxTextures = getMaxTextures(m_physicalDevice);
+    if (textures.size() > maxTextures) {
+        throw std::runtime_error("The scene has " + std::to_string(textures.size()) + " textures, the device samples at most " + std::to_string(maxTextures));
+    }
+
+    // Counted from the start, the descriptors of the textures not created yet are left unwritten
+    m_images.resize(textures.size());
+    m_statistics = Statistics{};
+    m_uploadStart = std::chrono::high_resolution_clock::now();
+    if (!textures.empty()) {
+        m_uploadTextures = std::move(textures);
+        m_loader = std::make_unique<TextureLoader>(m_uploadTextures, workerCount);
+    }
+}
+
+std::vector<TextureManager::UploadedImage> TextureManager::uploadNext(StagingRing& staging, uint32_t stagingFamily, uint32_t graphicsFamily) {
+    std::vector<UploadedImage> uploaded;
+    if (!m_loader) {
+        return uploaded;
+    }
+
+    try {
+        VkDeviceSize bytes = 0;
+        while (m_uploadedCount < m_images.size()) {
+            auto decoded = m_decoded.find(m_uploadedCount);
+            if (decoded == m_decoded.end()) {
+                TextureLoader::DecodedTexture texture;
+                if (!m_loader->poll(texture)) {
+                    break;
+                }
+                uint32_t index = texture.m_index;
+                m_decoded.emplace(index, std::move(texture));
+                continue;
+            }
+
+            const TextureLoader::DecodedTexture& texture = decoded->second;
+            VkDeviceSize size = 0;
+            for (const TextureLoader::Level& level : texture.m_levels) {
+                size += level.m_pixels.size();
+            }
+            if (bytes > 0 && bytes + size > m_uploadBudget) {
+                break;
+            }
+
+            Image& image = m_images[m_uploadedCount];
+            uint32_t mipLevels = static_cast<uint32_t>(texture.m_levels.size());
+            VkFormat format = texture.m_encoding == Texture::Encoding::Srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+            createImage(format, texture.m_levels[0].m_width, texture.m_levels[0].m_height, mipLevels, image);
+            recordUpload(texture, image, staging, stagingFamily, graphicsFamily);
+            uploaded.push_back({ image.m_image, mipLevels });
+
+            bytes += size;
+            m_statistics.m_uploadedBytes += size;
+            m_decoded.erase(decoded);
+            ++m_uploadedCount;
+            ++m_generation;
+        }
+    }
+    catch (...) {
+        // The images created so far stay, the descriptors of the others are never written
+        m_loader.reset();
+        m_decoded.clear();
+        m_uploadTextures.clear();
+        throw;
+    }
+
+    if (m_uploadedCount == m_images.size()) {
+        m_statistics.m_decodeTime = m_loader->getDecodeTime();
+        m_statistics.m_uploadTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_uploadStart).count();
+        m_loader.reset();
+        m_uploadTextures.clear();
+    }
+    return uploaded;
+}
+
+void TextureManager::update(const uint32_t* feedback) {
+    if (!m_streaming) {
+        return;
+    }
+    ++m_frame;
+
+    for (size_t i = 0; i < m_residency.size(); ++i) {
+        if (feedback[i] == 0) {
+            continue;
+        }
+
+        // Level of the full chain the footprint covers one texel of, the finer one when it falls between two
+        const TextureCache::Level& base = m_cache.getEntry(i).m_levels[0];
+        float footprint = -static_cast<float>(feedback[i] - 1) / m_FEEDBACK_LOD_SCALE;
+        float level = std::floor(footprint + 0.5f * std::log2(static_cast<float>(base.m_width) * static_cast<float>(base.m_height)));
+
+        Residency& residency = m_residency[i];
+        residency.m_requestedLevel = static_cast<uint32_t>(std::clamp(level, 0.0f, static_cast<float>(residency.m_tailLevel)));
+        residency.m_lastUsed = m_frame;
+    }
+
+    // The textures sampled the most recently first, then the ones missing the most levels
+    std::vector<size_t> requests;
+    for (size_t i = 0; i < m_residency.size(); ++i) {
+        if (m_residency[i].m_requestedLevel < m_residency[i].m_residentLevel) {
+            requests.push_back(i);
+        }
+    }
+    std::sort(requests.begin(), requests.end(), [this](size_t a, size_t b) {
+        const Residency& first = m_residency[a];
+        const Residency& second = m_residency[b];
+        if (first.m_lastUsed != second.m_lastUsed) {
+            return first.m_lastUsed > second.m_lastUsed;
+        }
+        return first.m_residentLevel - first.m_requestedLevel > second.m_residentLevel - second.m_requestedLevel;
+    });
+
+    uint64_t stagedBefore = m_staging.getStatistics().m_bytes;
+    m_streamingStatistics.m_starved = 0;
+    VkDeviceSize uploaded = 0;
+    for (size_t texture : requests) {
+        const Residency& residency = m_residency[texture];
+
+        // Settles for coarser levels when the budget cannot fit the requested ones
+        uint32_t level = residency.m_requestedLevel;
+        while (level < residency.m_residentLevel) {
+            VkDeviceSize growth = getLevelsSize(texture, level) - getLevelsSize(texture, residency.m_residentLevel);
+            if (m_memory + growth <= m_budget || makeRoom(growth, texture)) {
+                break;
+            }
+            ++level;
+        }
+        if (level != residency.m_requestedLevel) {
+            ++m_streamingStatistics.m_starved;
+        }
+        if (level >= residency.m_residentLevel) {
+            continue;
+        }
+
+        // The rest waits for the next frames, a camera cut does not stall a single one
+        VkDeviceSize size = getLevelsSize(texture, level);
+        if (uploaded > 0 && uploaded + size > m_uploadBudget) {
+            break;
+        }
+        setResidentLevel(texture, level);
+        ++m_streamingStatistics.m_loads;
+        uploaded += size;
+    }
+    m_staging.flush();
+
+    m_streamingStatistics.m_lastUploadedBytes = m_staging.getStatistics().m_bytes - stagedBefore;
+    m_streamingStatistics.m_uploadedBytes += m_streamingStatistics.m_lastUploadedBytes;
+}
+
+void TextureManager::releaseImages(uint64_t generation) {
+    bool waited = false;
+    auto released = std::remove_if(m_releasedImages.begin(), m_releasedImages.end(), [&](ReleasedImage& image) {
+        if (image.m_generation > generation) {
+            return false;
+        }
+        // The copies into the image may have been submitted after the last frames that sampled it
+        if (!waited) {
+            m_staging.finish();
+            waited = true;
+        }
+        m_releasedMemory -= image.m_image.m_size;
+        destroyImage(image.m_image);
+        return true;
+    });
+    m_releasedImages.erase(released, m_releasedImages.end());
+}
+
+VkDeviceSize TextureManager::getLevelsSize(size_t texture, uint32_t level) const {
+    const std::vector<TextureCache::Level>& levels = m_cache.getEntry(texture).m_levels;
+    VkDeviceSize size = 0;
+    for (size_t i = level; i < levels.size(); ++i) {
+        size += levels[i].m_size;
+    }
+    return size;
+}
+
+void TextureManager::setResidentLevel(size_t texture, uint32_t level) {
+    const TextureCache::Entry& entry = m_cache.getEntry(texture);
+    uint32_t mipLevels = static_cast<uint32_t>(entry.m_levels.size()) - level;
+    size_t blockSize = BlockCompression::getBlockSize(entry.m_format);
+
+    Image image;
+    createImage(getStreamedFormat(entry), entry.m_levels[level].m_width, entry.m_levels[level].m_height, mipLevels, image);
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image.m_image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = mipLevels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(m_staging.getCommandBuffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    // Straight out of the mapped cache, in bands of block rows
+    for (uint32_t i = 0; i < mipLevels; ++i) {
+        const TextureCache::Level& mip = entry.m_levels[level + i];
+        const uint8_t* blocks = m_cache.getLevelData(texture, level + i);
+        uint32_t blockRows = (mip.m_height + 3) / 4;
+        VkDeviceSize rowSize = static_cast<VkDeviceSize>((mip.m_width + 3) / 4) * blockSize;
+        uint32_t maxRows = static_cast<uint32_t>(std::max<VkDeviceSize>(m_staging.getBlockSize() / rowSize, 1));
+
+        for (uint32_t row = 0; row < blockRows; row += maxRows) {
+            uint32_t rows = std::min(maxRows, blockRows - row);
+            VkDeviceSize size = rowSize * rows;
+            StagingRing::Allocation allocation = m_staging.allocate(size, 16);
+            std::memcpy(allocation.m_data, blocks + row * rowSize, static_cast<size_t>(size));
+
+            // The extent of the last band stops at the edge of the level, not of its blocks
+            VkBufferImageCopy region{};
+            region.bufferOffset = allocation.m_offset;
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = i;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = { 0, static_cast<int32_t>(row * 4), 0 };
+            region.imageExtent = { mip.m_width, std::min(rows * 4, mip.m_height - row * 4), 1 };
+            vkCmdCopyBufferToImage(allocation.m_commandBuffer, allocation.m_buffer, image.m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        }
+    }
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(m_staging.getCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    // The descriptor sets still point at the previous image until they are rewritten
+    Image& previous = m_images[texture];
+    if (previous.m_image != VK_NULL_HANDLE) {
+        ++m_generation;
+        m_memory -= previous.m_size;
+        m_releasedMemory += previous.m_size;
+        m_releasedImages.push_back({ previous, m_generation });
+    }
+    previous = image;
+    m_residency[texture].m_residentLevel = level;
+}
+
+bool TextureManager::makeRoom(VkDeviceSize size, size_t loadingTexture) {
+    auto fits = [this, size] { return m_memory + size <= m_budget; };
+
+    std::vector<size_t> unused;
+    for (size_t i = 0; i < m_residency.size(); ++i) {
+        const Residency& residency = m_residency[i];
+        if (i != loadingTexture && residency.m_lastUsed < m_frame && residency.m_residentLevel < residency.m_tailLevel) {
+            unused.push_back(i);
+        }
+    }
+    std::sort(unused.begin(), unused.end(), [this](size_t a, size_t b) { return m_residency[a].m_lastUsed < m_residency[b].m_lastUsed; });
+
+    for (size_t texture : unused) {
+        if (fits()) {
+            return true;
+        }
+        setResidentLevel(texture, m_residency[texture].m_tailLevel);
+        ++m_streamingStatistics.m_evictions;
+    }
+
+    for (size_t i = 0; i < m_residency.size() && !fits(); ++i) {
+        const Residency& residency = m_residency[i];
+        if (i != loadingTexture && residency.m_residentLevel < residency.m_requestedLevel) {
+            setResidentLevel(i, residency.m_requestedLevel);
+            ++m_streamingStatistics.m_evictions;
+        }
+    }
+    return fits();
+}
+
+void TextureManager::drawUI() {
+    if (!m_streaming || !ImGui::CollapsingHeader("Texture streaming")) {
+        return;
+    }
+
+    int budget = static_cast<int>(m_budget / (1024 * 1024));
+    if (ImGui::SliderInt("Budget (MB)", &budget, 1, 4096, "%d", ImGuiSliderFlags_Logarithmic)) {
+        m_budget = static_cast<VkDeviceSize>(budget) * 1024 * 1024;
+    }
+    int uploadBudget = static_cast<int>(m_uploadBudget / (1024 * 1024));
+    if (ImGui::SliderInt("Uploads per frame (MB)", &uploadBudget, 1, 256, "%d", ImGuiSliderFlags_Logarithmic)) {
+        m_uploadBudget = static_cast<VkDeviceSize>(uploadBudget) * 1024 * 1024;
+    }
+
+    const StreamingStatistics& statistics = m_streamingStatistics;
+    char overlay[64];
+    std::snprintf(overlay, sizeof(overlay), "%.1f / %.1f MB", toMegabytes(m_memory), toMegabytes(m_budget));
+    ImGui::ProgressBar(m_budget > 0 ? static_cast<float>(static_cast<double>(m_memory) / m_budget) : 0.0f, ImVec2(-1.0f, 0.0f), overlay);
+    ImGui::Text("Full resolution: %.1f MB, waiting for release: %.1f MB", toMegabytes(statistics.m_fullMemory), toMegabytes(m_releasedMemory));
+    ImGui::Text("Loads: %llu, evictions: %llu", static_cast<unsigned long long>(statistics.m_loads), static_cast<unsigned long long>(statistics.m_evictions));
+    ImGui::Text("Uploaded: %.1f MB (%.2f MB last frame)", toMegabytes(statistics.m_uploadedBytes), toMegabytes(statistics.m_lastUploadedBytes));
+    if (statistics.m_starved > 0) {
+        ImGui::TextColored(ImVec4(1.0f, 0.6f, 0.2f, 1.0f), "%u textures held back by the budget", statistics.m_starved);
+    }
+    ImGui::Text("Cache: %.1f MB%s", toMegabytes(statistics.m_cacheSize), statistics.m_cacheBuildTime > 0.0 ? "" : " (up to date)");
+    if (statistics.m_cacheBuildTime > 0.0) {
+        ImGui::SameLine();
+        ImGui::Text("built in %.0f ms", statistics.m_cacheBuildTime);
+    }
+
+    if (ImGui::BeginTable("textures", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY, ImVec2(0.0f, 200.0f))) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("#");
+        ImGui::TableSetupColumn("Format");
+        ImGui::TableSetupColumn("Resident");
+        ImGui::TableSetupColumn("Requested");
+        ImGui::TableSetupColumn("MB");
+        ImGui::TableSetupColumn("Last sampled");
+        ImGui::TableHeadersRow();
+
+        for (size_t i = 0; i < m_residency.size(); ++i) {
+            const Residency& residency = m_residency[i];
+            const TextureCache::Entry& entry = m_cache.getEntry(i);
+            const TextureCache::Level& resident = entry.m_levels[residency.m_residentLevel];
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%zu", i);
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(getFormatName(entry.m_format));
+            ImGui::TableNextColumn();
+            ImGui::Text("%ux%u (%u/%zu)", resident.m_width, resident.m_height, residency.m_residentLevel, entry.m_levels.size());
+            ImGui::TableNextColumn();
+            ImGui::Text("%u", residency.m_requestedLevel);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", toMegabytes(m_images[i].m_size));
+            ImGui::TableNextColumn();
+            if (residency.m_lastUsed == 0) {
+                ImGui::TextDisabled("never");
+            }
+            else {
+                ImGui::Text("%llu frames ago", static_cast<unsigned long long>(m_frame - residency.m_lastUsed));
+            }
+        }
+        ImGui::EndTable();
+    }
+}
+
+std::vector<VkDescriptorImageInfo> TextureManager::getDescriptorInfos() const {
+    size_t count = 0;
+    while (count < m_images.size() && m_images[count].m_view != VK_NULL_HANDLE) {
+        ++count;
+    }
+
+    std::vector<VkDescriptorImageInfo> infos(count);
+    for (size_t i = 0; i < count; ++i) {
+        infos[i].sampler = m_sampler;
+        infos[i].imageView = m_images[i].m_view;
+        infos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+    return infos;
+}
+
+void TextureManager::createImage(VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, Image& image) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = width;
+    imageInfo.extent.height = height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateImage(m_device, &imageInfo, nullptr, &image.m_image) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture image!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(m_device, image.m_image, &memRequirements);
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &memoryProperties);
+
+    int memoryType = -1;
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
+        if ((memRequirements.memoryTypeBits & (1u << i)) && (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+            memoryType = static_cast<int>(i);
+            break;
+        }
+    }
+    if (memoryType < 0) {
+        throw std::runtime_error("No device local memory for the textures!");
+    }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = static_cast<uint32_t>(memoryType);
+
+    if (vkAllocateMemory(m_device, &allocInfo, nullptr, &image.m_memory) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate texture memory!");
+    }
+    vkBindImageMemory(m_device, image.m_image, image.m_memory, 0);
+    image.m_size = memRequirements.size;
+    m_memory += image.m_size;
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image.m_image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = mipLevels;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(m_device, &viewInfo, nullptr, &image.m_view) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture image view!");
+    }
+}
+
+void TextureManager::recordUpload(const TextureLoader::DecodedTexture& texture, const Image& image, StagingRing& staging, uint32_t stagingFamily, uint32_t graphicsFamily) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image.m_image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = static_cast<uint32_t>(texture.m_levels.size());
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(staging.getCommandBuffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    // Each level goes in bands of rows fitting the free space of a block, the large ones span several blocks
+    for (uint32_t level = 0; level < texture.m_levels.size(); ++level) {
+        const TextureLoader::Level& mip = texture.m_levels[level];
+        VkDeviceSize rowSize = static_cast<VkDeviceSize>(mip.m_width) * 4;
+        uint32_t maxRows = static_cast<uint32_t>(std::max<VkDeviceSize>(staging.getBlockSize() / rowSize, 1));
+
+        for (uint32_t y = 0; y < mip.m_height; y += maxRows) {
+            uint32_t rows = std::min(maxRows, mip.m_height - y);
+            VkDeviceSize size = rowSize * rows;
+            StagingRing::Allocation allocation = staging.allocate(size, 16);
+            std::memcpy(allocation.m_data, mip.m_pixels.data() + y * rowSize, static_cast<size_t>(size));
+
+            VkBufferImageCopy region{};
+            region.bufferOffset = allocation.m_offset;
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = level;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = { 0, static_cast<int32_t>(y), 0 };
+            region.imageExtent = { mip.m_width, rows, 1 };
+            vkCmdCopyBufferToImage(allocation.m_commandBuffer, allocation.m_buffer, image.m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        }
+    }
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    if (stagingFamily == graphicsFamily) {
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(staging.getCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        return;
+    }
+
+    // Release half of the ownership transfer, the graphics queue acquires the image with the same layouts
+    barrier.srcQueueFamilyIndex = stagingFamily;
+    barrier.dstQueueFamilyIndex = graphicsFamily;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(staging.getCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void TextureManager::destroyImage(Image& image) {
+    if (image.m_view != VK_NULL_HANDLE) {
+        vkDestroyImageView(m_device, image.m_view, nullptr);
+    }
+    if (image.m_image != VK_NULL_HANDLE) {
+        vkDestroyImage(m_device, image.m_image, nullptr);
+    }
+    if (image.m_memory != VK_NULL_HANDLE) {
+        vkFreeMemory(m_device, image.m_memory, nullptr);
+    }
+    image = Image{};
+}
+
+void TextureManager::destroyImages() {
+    for (Image& image : m_images) {
+        destroyImage(image);
+    }
+    for (ReleasedImage& released : m_releasedImages) {
+        destroyImage(released.m_image);
+    }
+    m_images.clear();
+    m_releasedImages.clear();
+    m_residency.clear();
+    m_memory = 0;
+    m_releasedMemory = 0;
+    m_streaming = false;
+}
+
+void TextureManager::retireImages() {
+    m_loader.reset();
+    m_decoded.clear();
+    m_uploadTextures.clear();
+    m_uploadedCount = 0;
+
+    ++m_generation;
+    for (Image& image : m_images) {
+        if (image.m_image != VK_NULL_HANDLE) {
+            m_memory -= image.m_size;
+            m_releasedMemory += image.m_size;
+            m_releasedImages.push_back({ image, m_generation });
+        }
+    }
+    m_images.clear();
+    m_residency.clear();
+    m_streaming = false;
+}
@@ -0,0 +1,199 @@
+#ifndef TEXTUREMANAGER_H
+#define TEXTUREMANAGER_H
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "io/BlockCompression.h"
+#include "io/TextureCache.h"
+#include "io/TextureLoader.h"
+#include "scene/Texture.h"
+#include "vulkan/StagingRing.h"
+
+// Images of the scene textures, sampled by the trace pass through a single array of combined image samplers
+// indexed by the materials. The textures are either all uploaded with their whole mip chain, or streamed:
+//  - upload decodes them on a TextureLoader and copies them as they come through a StagingRing, as RGBA8.
+//    beginUpload does the same over the next frames, through the staging ring of the caller: uploadNext
+//    copies the decoded textures in the order of the scene, so the ones uploaded are always the first ones.
+//  - stream maps a block compressed TextureCache and only keeps the levels the trace pass asked for in its
+//    feedback buffer, within a memory budget. The levels small enough to fit a tail are always resident.
+//    When a texture needs finer levels, its image is replaced by one holding them, and the least recently
+//    used textures drop back to their tail to make room.
+// Either way the images stay in the shader read only layout, and their first level is the finest resident
+// one, so the level the shader picks from textureSize is correct whatever is resident.
+class TextureManager {
+public:
+	// Length of the descriptor array of the trace pass, bounded by the limits of the device
+	static uint32_t getMaxTextures(VkPhysicalDevice physicalDevice);
+
+	// Scale of the level of detail written to the feedback buffer by the trace pass, see update
+	static constexpr float m_FEEDBACK_LOD_SCALE = 256.0f;
+
+	// Anisotropic filtering needs the samplerAnisotropy feature enabled on the device
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, VkQueue queue, bool anisotropy);
+	void cleanup();
+
+	// Replaces the textures, the previous images are released like the replaced images of the streaming. Returns
+	// once the copies are done, throws std::runtime_error when a texture cannot be decoded or when there are
+	// more than getMaxTextures.
+	void upload(const std::vector<Texture>& textures, unsigned int workerCount);
+	// Replaces the textures by streamed ones in the given formats, which needs the textureCompressionBC feature.
+	// The cache is built first when it is missing or stale. Only the tails are resident when this returns.
+	void stream(const std::vector<Texture>& textures, const std::vector<BlockCompression::Format>& formats, const std::string& cachePath, unsigned int workerCount);
+	// Replaces the textures like upload, but only starts decoding the new ones and returns, uploadNext copies
+	// them. Throws std::runtime_error when there are more than getMaxTextures.
+	void beginUpload(std::vector<Texture> textures, unsigned int workerCount);
+
+	// Image whose copies uploadNext recorded, released to the queue family given to it when it is not the one
+	// of the staging ring. The caller acquires it with the same barrier.
+	struct UploadedImage {
+		VkImage m_image = VK_NULL_HANDLE;
+		uint32_t m_mipLevels = 0;
+	};
+	// Records into staging the copies of the textures decoded since the last call, in the order of the scene:
+	// a texture waits for the ones before it. At most getUploadBudget bytes, or a single texture larger than
+	// that, the caller submits them. Never waits for the decoding, rethrows its errors and stops uploading.
+	std::vector<UploadedImage> uploadNext(StagingRing& staging, uint32_t stagingFamily, uint32_t graphicsFamily);
+	inline bool isUploading() const { return m_loader != nullptr; }
+	// Textures whose copies were recorded, the first ones of the scene
+	inline uint32_t getUploadedCount() const { return m_uploadedCount; }
+
+	// Reads the feedback of a finished frame, one value per texture: 0 when the texture was not sampled,
+	// otherwise 1 + m_FEEDBACK_LOD_SCALE times the negated log2 of the finest footprint it was sampled with,
+	// in texture coordinates. Records the copies of the levels to load and submits them without waiting,
+	// at most getUploadBudget bytes per call. Does nothing when the textures are not streamed.
+	void update(const uint32_t* feedback);
+	// Incremented whenever the image of a texture is replaced or created, the descriptors written before are stale
+	inline uint64_t getGeneration() const { return m_generation; }
+	// Destroys the replaced images once every descriptor set was rewritten at generation or later
+	void releaseImages(uint64_t generation);
+
+	// One per texture up to the first one not created yet by uploadNext, in the order of the scene
+	std::vector<VkDescriptorImageInfo> getDescriptorInfos() const;
+	inline uint32_t getTextureCount() const { return static_cast<uint32_t>(m_images.size()); }
+	// Device memory held by the images, the replaced ones waiting to be released included
+	inline VkDeviceSize getMemory() const { return m_memory + m_releasedMemory; }
+	inline bool isInitialized() const { return m_device != VK_NULL_HANDLE; }
+	inline bool isStreaming() const { return m_streaming; }
+
+	// Device memory the resident levels are kept under, the tails are resident whatever the budget
+	inline void setBudget(VkDeviceSize budget) { m_budget = budget; }
+	inline VkDeviceSize getBudget() const { return m_budget; }
+	inline void setUploadBudget(VkDeviceSize budget) { m_uploadBudget = budget; }
+	inline VkDeviceSize getUploadBudget() const { return m_uploadBudget; }
+
+	// Of the last upload, in milliseconds. The submissions are those of the staging ring of upload only.
+	struct Statistics {
+		// Summed over the decoding workers
+		double m_decodeTime = 0.0;
+		// Wall clock time of the whole upload, decoding included
+		double m_uploadTime = 0.0;
+		uint64_t m_uploadedBytes = 0;
+		uint64_t m_stagingSubmissions = 0;
+	};
+	inline const Statistics& getStatistics() const { return m_statistics; }
+
+	// Since the textures were streamed, the cache build excepted
+	struct StreamingStatistics {
+		// Zero when the cache was up to date
+		double m_cacheBuildTime = 0.0;
+		uint64_t m_cacheSize = 0;
+		// Every level of every texture, as if nothing was streamed
+		VkDeviceSize m_fullMemory = 0;
+		uint64_t m_uploadedBytes = 0;
+		uint64_t m_lastUploadedBytes = 0;
+		uint64_t m_loads = 0;
+		uint64_t m_evictions = 0;
+		// Textures that asked for levels the budget could not fit in the last update
+		uint32_t m_starved = 0;
+	};
+	inline const StreamingStatistics& getStreamingStatistics() const { return m_streamingStatistics; }
+
+	// Residency of every streamed texture, with the budget and the memory in a table
+	void drawUI();
+
+private:
+	// Upper bound of the descriptor array, whatever the device allows
+	static constexpr uint32_t m_MAX_TEXTURES = 4096;
+	// Blocks of the staging ring, the levels larger than a block are copied in bands of rows
+	static constexpr VkDeviceSize m_STAGING_BLOCK_SIZE = 8 * 1024 * 1024;
+	static constexpr uint32_t m_STAGING_BLOCK_COUNT = 4;
+	// Streamed levels at most this size on both sides are always resident
+	static constexpr uint32_t m_TAIL_SIZE = 64;
+
+	struct Image {
+		VkImage m_image = VK_NULL_HANDLE;
+		VkImageView m_view = VK_NULL_HANDLE;
+		VkDeviceMemory m_memory = VK_NULL_HANDLE;
+		VkDeviceSize m_size = 0;
+	};
+
+	struct Residency {
+		// First level of the chain held by the image, and the first one of the tail
+		uint32_t m_residentLevel = 0;
+		uint32_t m_tailLevel = 0;
+		// Finest level asked for by the feedback, kept while the texture is not sampled
+		uint32_t m_requestedLevel = 0;
+		// Value of m_frame when the texture was last sampled, 0 if never
+		uint64_t m_lastUsed = 0;
+	};
+
+	struct ReleasedImage {
+		Image m_image;
+		uint64_t m_generation = 0;
+	};
+
+	VkDevice m_device = VK_NULL_HANDLE;
+	VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+	VkSampler m_sampler = VK_NULL_HANDLE;
+	StagingRing m_staging;
+
+	std::vector<Image> m_images;
+	VkDeviceSize m_memory = 0;
+	Statistics m_statistics;
+
+	// Of beginUpload, the loader reads the textures it keeps. The textures decoded before the ones preceding
+	// them wait in m_decoded.
+	std::vector<Texture> m_uploadTextures;
+	std::unique_ptr<TextureLoader> m_loader;
+	std::map<uint32_t, TextureLoader::DecodedTexture> m_decoded;
+	uint32_t m_uploadedCount = 0;
+	std::chrono::high_resolution_clock::time_point m_uploadStart;
+
+	bool m_streaming = false;
+	TextureCache m_cache;
+	std::vector<Residency> m_residency;
+	std::vector<ReleasedImage> m_releasedImages;
+	VkDeviceSize m_releasedMemory = 0;
+	VkDeviceSize m_budget = 256 * 1024 * 1024;
+	VkDeviceSize m_uploadBudget = 32 * 1024 * 1024;
+	uint64_t m_generation = 0;
+	uint64_t m_frame = 0;
+	StreamingStatistics m_streamingStatistics;
+
+	void createImage(VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, Image& image);
+	// Ends in the shader read only layout, released from stagingFamily to graphicsFamily when they differ
+	void recordUpload(const TextureLoader::DecodedTexture& texture, const Image& image, StagingRing& staging,
+		uint32_t stagingFamily = VK_QUEUE_FAMILY_IGNORED, uint32_t graphicsFamily = VK_QUEUE_FAMILY_IGNORED);
+	void destroyImage(Image& image);
+	void destroyImages();
+	// Moves the images to the released ones at a new generation, for the frames still sampling them
+	void retireImages();
+
+	// Size of the levels of a streamed texture from level on, as compressed in the cache
+	VkDeviceSize getLevelsSize(size_t texture, uint32_t level) const;
+	// Replaces the image of a streamed texture by one holding the levels from level on
+	void setResidentLevel(size_t texture, uint32_t level);
+	// Drops least recently used textures to their tail, then textures holding finer levels than they asked
+	// for, until size more bytes fit the budget. The texture about to load is left alone.
+	bool makeRoom(VkDeviceSize size, size_t loadingTexture);
+};
+
+#endif
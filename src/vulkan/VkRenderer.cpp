@@ -1,98 +1,531 @@
 #include "VkRenderer.h"
 
+#include <cstdio>
+#include <filesystem>
+#include <thread>
+
 VkRenderer::VkRenderer() : m_camera
 (
     glm::vec3(0.0f, 4.0f, 1.0f), 
     glm::vec3(0.0f, 0.0f, 1.0f), 
     glm::vec3(0.0f, 0.0f, -1.0f), 
     45.0f, 
-    static_cast<float>(Config::INIT_WINDOW_WIDTH)/static_cast<float>(Config::INIT_WINDOW_HEIGHT), 
+    // Replaced by the aspect ratio of the swapchain every frame
+    1.0f, 
     0.1f, 
     100.0f
 ) {}
 
 
-void VkRenderer::initVulkan(GLFWwindow* window) {
+void VkRenderer::initVulkan(GLFWwindow* window, const Scene& scene) {
+    m_window = window;
     createInstance();
     setupDebugMessenger();
     createSurface(window);
     m_physicalDevice = pickPhysicalDevice();
     createLogicalDevice();
-    createSwapchain();
+    createSwapchain(VK_NULL_HANDLE);
     createImageViews();
     createRenderPass();
+    createTraceRenderPass();
     createDescriptorSetLayout();
+    createDenoiseDescriptorSetLayouts();
     createGraphicsPipeline();
+    createPresentPipeline();
+    createDenoisePipelines();
+    createAccumulatePipeline();
+    createTonemapPipeline();
     createCommandPool();
     createFramebuffers();
-    createData();
+    createRenderTargets();
+    createPresentSampler();
+    m_uploadRing.init(m_device, m_physicalDevice, m_queueIndices.m_transferFamily, m_transferQueue, m_UPLOAD_BLOCK_SIZE, m_UPLOAD_BLOCKS);
+    createData(scene);
     createVertexBuffer(m_vertices);
     createIndexBuffer(m_indices);
+    // One wait for every upload of the initialization, the first frame acquires them all
+    m_uploadRing.finish();
     createUniformBuffers();
     createDescriptorPool();
     createDescriptorSets();
+    createDenoiseDescriptorSets();
+#ifdef RAYTRACER_RAY_STATS
+    createRayStatsResources();
+#endif
+    createProfiler();
     createCommandBuffers();
     createSyncObjects();
+    createCaptureResources();
 
     createImguiContext(window);
 }
 
+void VkRenderer::initHeadless(uint32_t width, uint32_t height, const Scene& scene) {
+    m_headless = true;
+    m_swapchainExtent = { width, height };
+    m_renderExtent = m_swapchainExtent;
+    m_previousRenderExtent = m_swapchainExtent;
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    createInstance();
+    setupDebugMessenger();
+    m_physicalDevice = pickPhysicalDevice();
+    createLogicalDevice();
+
+    auto deviceTime = std::chrono::high_resolution_clock::now();
+
+    // No present pass, the present descriptor sets are still allocated so the denoiser sets stay shared
+    createTraceRenderPass();
+    createDescriptorSetLayout();
+    createDenoiseDescriptorSetLayouts();
+    createGraphicsPipeline();
+    createDenoisePipelines();
+    createAccumulatePipeline();
+
+    auto pipelineTime = std::chrono::high_resolution_clock::now();
+
+    createCommandPool();
+    m_uploadRing.init(m_device, m_physicalDevice, m_queueIndices.m_transferFamily, m_transferQueue, m_UPLOAD_BLOCK_SIZE, m_UPLOAD_BLOCKS);
+    createData(scene);
+    // One wait for every upload of the initialization, the first frame acquires them all
+    m_uploadRing.finish();
+
+    auto sceneTime = std::chrono::high_resolution_clock::now();
+
+    createRenderTargets();
+    createPresentSampler();
+    createUniformBuffers();
+    createDescriptorPool();
+    createDescriptorSets();
+    createDenoiseDescriptorSets();
+#ifdef RAYTRACER_RAY_STATS
+    createRayStatsResources();
+#endif
+    createProfiler();
+    createCommandBuffers();
+    createSyncObjects();
+    createCaptureResources();
+
+    m_initTimings.m_deviceTime = std::chrono::duration<float, std::milli>(deviceTime - startTime).count();
+    m_initTimings.m_pipelineTime = std::chrono::duration<float, std::milli>(pipelineTime - deviceTime).count();
+    m_initTimings.m_sceneUploadTime = std::chrono::duration<float, std::milli>(sceneTime - pipelineTime).count();
+}
+
+float VkRenderer::renderHeadlessFrame() {
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    vkWaitForFences(m_device, 1, &m_inFlightFences[m_currentFrame], VK_TRUE, UINT64_MAX);
+    releaseRetiredScenes(false);
+
+    updateSceneLoading();
+    updateRenderScale();
+    updateUniformBuffer(m_currentFrame, m_deltaTime);
+    updateTextureDescriptors(m_currentFrame);
+    prepareTiledFrame();
+
+    vkResetCommandBuffer(m_commandBuffers[m_currentFrame], 0);
+    recordCommandBuffer(m_commandBuffers[m_currentFrame], 0);
+
+    m_resetHistory = !m_denoiseSettings.m_enabled || m_tiledSettings.m_enabled || !m_dirtyTriangles.empty();
+    m_previousRenderExtent = m_renderExtent;
+    ++m_frameIndex;
+
+    std::vector<VkSemaphore> waitSemaphores;
+    std::vector<VkPipelineStageFlags> waitStages;
+    std::vector<VkSemaphore> signalSemaphores;
+    prepareCaptureSubmit(waitSemaphores, waitStages, signalSemaphores);
+    std::vector<uint64_t> waitValues;
+    prepareUploadSubmit(waitSemaphores, waitStages, waitValues);
+    std::vector<uint64_t> signalValues;
+    m_renderGraph.prepareSubmit(RenderGraph::Queue::Graphics, waitSemaphores, waitStages, waitValues, signalSemaphores, signalValues);
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+    timelineInfo.pWaitSemaphoreValues = waitValues.data();
+    timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+    timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &m_commandBuffers[m_currentFrame];
+    submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+    submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+    vkResetFences(m_device, 1, &m_inFlightFences[m_currentFrame]);
+
+    if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_inFlightFences[m_currentFrame]) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit headless command buffer!");
+    }
+    submitAsyncCompute();
+    submitCapture();
+
+    // Each frame is waited on, so the benchmark times frames one at a time. The capture copy is not, it
+    // overlaps with the next frame.
+    vkWaitForFences(m_device, 1, &m_inFlightFences[m_currentFrame], VK_TRUE, UINT64_MAX);
+    m_readback.poll();
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    float frameTime = std::chrono::duration<float, std::milli>(endTime - startTime).count();
+    m_deltaTime = frameTime / 1000.0f;
+    m_totalTime += m_deltaTime;
+    recordFrameTime(frameTime);
+
+    // Reads the results of this frame right away, the next wait on this fence returns immediately
+    readTimestamps();
+#ifdef RAYTRACER_RAY_STATS
+    readRayStatistics();
+#endif
+    updateTextureStreaming();
+
+    m_currentFrame = (m_currentFrame + 1) % m_MAX_FRAMES_IN_FLIGHT;
+
+    return frameTime;
+}
+
+void VkRenderer::setTextureStreaming(bool enabled, VkDeviceSize budget, const std::string& cachePath) {
+    m_textureStreamingSettings.m_enabled = enabled;
+    m_textureStreamingSettings.m_budget = budget;
+    m_textureStreamingSettings.m_cachePath = cachePath;
+}
+
+void VkRenderer::setTraceSettings(int samples, int bounces) {
+    m_traceSettings.m_samples = std::clamp(samples, 1, m_MAX_TRACE_SAMPLES);
+    m_traceSettings.m_bounces = std::clamp(bounces, 1, m_MAX_TRACE_BOUNCES);
+    m_resetHistory = true;
+    m_tiledState.m_reset = true;
+}
+
+void VkRenderer::setProfiling(bool gpuTimestamps, const std::string& csvPath) {
+    m_gpuTimestamps = gpuTimestamps;
+    m_profileCsvPath = csvPath;
+}
+
+void VkRenderer::setTiledRendering(bool enabled, int targetSamples) {
+    m_tiledSettings.m_enabled = enabled;
+    m_tiledSettings.m_targetSamples = targetSamples;
+    m_tiledState.m_reset = true;
+}
+
+void VkRenderer::setTiledSelection(int tileSize, const std::vector<uint32_t>& tiles) {
+    m_tiledSettings.m_tileSize = tileSize;
+    m_tiledSettings.m_selectedTiles = tiles;
+    m_tiledState.m_reset = true;
+}
+
+bool VkRenderer::isTiledRenderComplete() const {
+    const TiledRenderState& state = m_tiledState;
+    if (!m_tiledSettings.m_enabled || state.m_reset || state.m_tilePasses.empty()) {
+        return false;
+    }
+
+    uint32_t requiredPasses = requiredTilePasses();
+    for (uint32_t tile = 0; tile < state.m_tilePasses.size(); ++tile) {
+        if (state.m_tileSelected[tile] && state.m_tilePasses[tile] < requiredPasses) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const VkRenderer::ImageResource& VkRenderer::getOutputImage() const {
+    if (m_tiledSettings.m_enabled) {
+        return m_accumulation;
+    }
+    return m_denoiseSettings.m_enabled ? m_denoiseOutput : m_traceColor;
+}
+
+// Same choice as recordPresentCommands
+const VkRenderer::ImageResource& VkRenderer::getPresentedImage() const {
+#ifdef RAYTRACER_RAY_STATS
+    if (m_rayStatsSettings.m_heatmap >= 0) {
+        return m_rayStatsHeatmap;
+    }
+#endif
+    return m_tonemapOutput;
+}
+
+void VkRenderer::createCaptureResources() {
+    // Without a dedicated transfer queue, the copies go to the graphics queue after the frame
+    m_readback.init(m_device, m_physicalDevice, m_queueIndices.m_transferFamily, m_transferQueue, m_CAPTURE_SLOTS,
+        [this](uint32_t slot, const void* data) {
+            CaptureSlot& capture = m_captureSlots[slot];
+
+            if (capture.m_consumer) {
+                CaptureConsumer consumer = std::move(capture.m_consumer);
+                capture.m_consumer = nullptr;
+                consumer(static_cast<const float*>(data), capture.m_area.extent.width, capture.m_area.extent.height);
+                m_readback.release(slot);
+                return;
+            }
+
+            FrameEncoder::Frame frame;
+            frame.m_path = capture.m_path;
+            frame.m_format = capture.m_format;
+            frame.m_width = capture.m_area.extent.width;
+            frame.m_height = capture.m_area.extent.height;
+            frame.m_pixels = static_cast<const float*>(data);
+            // As presented when the copy completes, for the 8 bit formats
+            frame.m_toneMapping = m_toneMapping;
+            frame.m_release = [this, slot] { m_readback.release(slot); };
+            // The queue holds as many frames as there are slots, so this never blocks
+            m_captureEncoder->submit(std::move(frame));
+        });
+
+    // The render loop and the driver keep the other cores busy
+    unsigned int workerCount = m_captureWorkerCount > 0 ? m_captureWorkerCount : std::max(getWorkerCount() / 2, 1u);
+    m_captureEncoder = std::make_unique<FrameEncoder>(workerCount, m_CAPTURE_SLOTS);
+}
+
+void VkRenderer::cleanupCaptureResources() {
+    if (m_pendingCapture >= 0) {
+        m_readback.cancel(static_cast<uint32_t>(m_pendingCapture));
+        m_pendingCapture = -1;
+    }
+
+    // The device is idle, every copy is done. Destroying the encoder lets the workers write the queued
+    // captures before joining them, their data is unmapped right after.
+    m_readback.waitForCopies();
+    m_captureEncoder.reset();
+    m_readback.cleanup();
+}
+
+bool VkRenderer::requestCapture(const std::string& path, ImageWriter::Format format, bool wait) {
+    int slot = acquireCaptureSlot(wait);
+    if (slot < 0) {
+        return false;
+    }
+
+    CaptureSlot& capture = m_captureSlots[slot];
+    capture.m_path = path;
+    capture.m_format = format;
+    capture.m_area = VkRect2D{};
+    capture.m_consumer = nullptr;
+    return true;
+}
+
+bool VkRenderer::requestCapture(const VkRect2D& area, CaptureConsumer consumer, bool wait) {
+    int slot = acquireCaptureSlot(wait);
+    if (slot < 0) {
+        return false;
+    }
+
+    CaptureSlot& capture = m_captureSlots[slot];
+    capture.m_path.clear();
+    capture.m_area = area;
+    capture.m_consumer = std::move(consumer);
+    return true;
+}
+
+int VkRenderer::acquireCaptureSlot(bool wait) {
+    ++m_captureStatistics.m_requested;
+    if (m_pendingCapture >= 0) {
+        ++m_captureStatistics.m_dropped;
+        return -1;
+    }
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    int slot = m_readback.acquire(wait);
+    m_captureStatistics.m_slotWaitTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+    if (slot < 0) {
+        ++m_captureStatistics.m_dropped;
+        return -1;
+    }
+
+    m_pendingCapture = slot;
+    return slot;
+}
+
+void VkRenderer::finishCaptures() {
+    m_readback.waitForCopies();
+    m_captureEncoder->finish();
+}
+
+VkRenderer::CaptureStatistics VkRenderer::getCaptureStatistics() const {
+    CaptureStatistics statistics = m_captureStatistics;
+    if (m_captureEncoder) {
+        statistics.m_encoder = m_captureEncoder->getStatistics();
+    }
+    return statistics;
+}
+
+std::string VkRenderer::nextCapturePath() {
+    std::filesystem::create_directories(m_captureSettings.m_directory);
+
+    char fileName[64];
+    std::snprintf(fileName, sizeof(fileName), "capture_%05u.%s", m_captureIndex++, ImageWriter::extension(m_captureSettings.m_format));
+    return (std::filesystem::path(m_captureSettings.m_directory) / fileName).string();
+}
+
+void VkRenderer::prepareCaptureSubmit(std::vector<VkSemaphore>& waitSemaphores, std::vector<VkPipelineStageFlags>& waitStages, std::vector<VkSemaphore>& signalSemaphores) {
+    // The copy of the previous capture may still read the output images this frame writes
+    if (m_captureWaitSemaphore != VK_NULL_HANDLE) {
+        waitSemaphores.push_back(m_captureWaitSemaphore);
+        waitStages.push_back(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        m_captureWaitSemaphore = VK_NULL_HANDLE;
+    }
+
+    if (m_pendingCapture >= 0) {
+        signalSemaphores.push_back(m_readback.getRenderSemaphore(static_cast<uint32_t>(m_pendingCapture)));
+    }
+}
+
+void VkRenderer::submitCapture() {
+    m_frameCaptured = m_pendingCapture >= 0;
+    if (!m_frameCaptured) {
+        return;
+    }
+
+    uint32_t slot = static_cast<uint32_t>(m_pendingCapture);
+    m_pendingCapture = -1;
+
+    CaptureSlot& capture = m_captureSlots[slot];
+    if (capture.m_area.extent.width == 0 || capture.m_area.extent.height == 0) {
+        capture.m_area = { { 0, 0 }, m_renderExtent };
+    }
+
+    // Every output image is RGBA32F
+    m_readback.submit(slot, getOutputImage().m_image, capture.m_area, 4 * sizeof(float));
+    m_captureWaitSemaphore = m_readback.getCopySemaphore(slot);
+}
+
+void VkRenderer::recordFrameTime(double frameTime) {
+    (m_frameCaptured ? m_captureStatistics.m_captureFrames : m_captureStatistics.m_otherFrames).add(frameTime);
+    m_frameCaptured = false;
+
+    // Only the frames since the last scene loaded
+    if (m_frameStreamed) {
+        m_sceneLoadStatistics.m_streamingFrames.add(frameTime);
+    }
+    else if (m_sceneLoadStatistics.m_uploadTime > 0.0) {
+        m_sceneLoadStatistics.m_residentFrames.add(frameTime);
+    }
+    m_frameStreamed = false;
+}
+
+std::string VkRenderer::getDeviceName() const {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+    return properties.deviceName;
+}
+
 void VkRenderer::cleanupVulkan() {
     VkResult err = vkDeviceWaitIdle(m_device);
     check_vk_result(err);
 
+    cleanupCaptureResources();
+
     //TODO delete m_io ?
 
-    //cleaning imgui context
-    ImGui_ImplVulkan_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
-    //cleaning vulkan context
-    ImGui_ImplVulkanH_DestroyWindow(m_instance, m_device, &m_mainWindowData, m_allocator);
+    // The headless renderer never created the UI, the swapchain and the present pass
+    if (!m_headless) {
+        //cleaning imgui context
+        ImGui_ImplVulkan_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+        //cleaning vulkan context
+        ImGui_ImplVulkanH_DestroyWindow(m_instance, m_device, &m_mainWindowData, m_allocator);
+
+        vkFreeCommandBuffers(m_device, m_uiCommandPool, static_cast<uint32_t>(m_uiCommandBuffers.size()), m_uiCommandBuffers.data());
+        vkDestroyCommandPool(m_device, m_uiCommandPool, m_allocator);
+
+        vkDestroyPipeline(m_device, m_tonemapPipeline, m_allocator);
+        vkDestroyPipelineLayout(m_device, m_tonemapPipelineLayout, m_allocator);
+        vkDestroyPipeline(m_device, m_presentPipeline, m_allocator);
+        vkDestroyPipelineLayout(m_device, m_presentPipelineLayout, m_allocator);
+        vkDestroyRenderPass(m_device, m_renderPass, m_allocator);
+        vkDestroyRenderPass(m_device, m_uiRenderPass, m_allocator);
+
+        vkDestroyDescriptorPool(m_device, m_uiDescriptorPool, m_allocator);
+
+        for (auto& swapchainFramebuffer : m_swapchainFramebuffers) {
+            vkDestroyFramebuffer(m_device, swapchainFramebuffer, m_allocator);
+        }
+
+        for (auto& uiFramebuffer : m_uiFramebuffers) {
+            vkDestroyFramebuffer(m_device, uiFramebuffer, m_allocator);
+        }
+
+        for (auto& swapchainImageView : m_swapchainImageViews) {
+            vkDestroyImageView(m_device, swapchainImageView, m_allocator);
+        }
+        releaseRetiredSwapchains(true);
+        vkDestroySwapchainKHR(m_device, m_swapchain, m_allocator);
+        vkDestroySurfaceKHR(m_instance, m_surface, m_allocator);
+    }
 
     vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_commandBuffers.size()), m_commandBuffers.data());
-    vkFreeCommandBuffers(m_device, m_uiCommandPool, static_cast<uint32_t>(m_uiCommandBuffers.size()), m_uiCommandBuffers.data());
 
     //TODO free descriptor sets only if the flag VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT is enabled
 
     vkDestroyCommandPool(m_device, m_commandPool, m_allocator);
-    vkDestroyCommandPool(m_device, m_uiCommandPool, m_allocator);
+    if (m_computeCommandPool != VK_NULL_HANDLE) {
+        vkFreeCommandBuffers(m_device, m_computeCommandPool, static_cast<uint32_t>(m_computeCommandBuffers.size()), m_computeCommandBuffers.data());
+        vkDestroyCommandPool(m_device, m_computeCommandPool, m_allocator);
+    }
 
     vkDestroyPipeline(m_device, m_graphicsPipeline, m_allocator);
     vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_allocator);
-    vkDestroyRenderPass(m_device, m_renderPass, m_allocator);
-    vkDestroyRenderPass(m_device, m_uiRenderPass, m_allocator);
+    vkDestroyPipeline(m_device, m_denoiseTemporalPipeline, m_allocator);
+    vkDestroyPipeline(m_device, m_denoiseAtrousPipeline, m_allocator);
+    vkDestroyPipelineLayout(m_device, m_denoisePipelineLayout, m_allocator);
+    vkDestroyPipeline(m_device, m_accumulatePipeline, m_allocator);
+    vkDestroyPipelineLayout(m_device, m_accumulatePipelineLayout, m_allocator);
+    vkDestroyRenderPass(m_device, m_traceRenderPass, m_allocator);
+
+    cleanupRenderTargets();
+    vkDestroySampler(m_device, m_presentSampler, m_allocator);
+
+    m_profiler.cleanup();
+#ifdef RAYTRACER_RAY_STATS
+    cleanupRayStatsResources();
+#endif
 
     vkDestroyDescriptorPool(m_device, m_descriptorPool, m_allocator);
-    vkDestroyDescriptorPool(m_device, m_uiDescriptorPool, m_allocator);
+    vkDestroyDescriptorPool(m_device, m_denoiseDescriptorPool, m_allocator);
+    releaseRetiredScenes(true);
 
-    vkDestroyBuffer(m_device, m_vertexBuffer, m_allocator);
-    vkFreeMemory(m_device, m_vertexBufferMemory, m_allocator);
+    destroyBuffer(m_vertexBuffer, m_vertexBufferMemory);
 
-    vkDestroyBuffer(m_device, m_indexBuffer, m_allocator);
-    vkFreeMemory(m_device, m_indexBufferMemory, m_allocator);
+    destroyBuffer(m_indexBuffer, m_indexBufferMemory);
 
-    vkDestroyBuffer(m_device, m_triangleBuffer, m_allocator);
-    vkFreeMemory(m_device, m_triangleBufferMemory, m_allocator);
+    destroySceneBuffers();
+    m_uploadRing.cleanup();
 
-    vkDestroyBuffer(m_device, m_sphereBuffer, m_allocator);
-    vkFreeMemory(m_device, m_sphereBufferMemory, m_allocator);
+    if (m_sceneUpdateBuffer != VK_NULL_HANDLE) {
+        vkUnmapMemory(m_device, m_sceneUpdateBufferMemory);
+        destroyBuffer(m_sceneUpdateBuffer, m_sceneUpdateBufferMemory);
+    }
 
-    vkDestroyBuffer(m_device, m_lightBuffer, m_allocator);
-    vkFreeMemory(m_device, m_lightBufferMemory, m_allocator);
+    trackDeviceMemory(0, m_textureManager.getMemory());
+    m_textureManager.cleanup();
 
-    for (size_t i = 0; i < m_uniformBuffers.size(); i++) {
-        vkDestroyBuffer(m_device, m_uniformBuffers[i], m_allocator);
-        vkFreeMemory(m_device, m_uniformBuffersMemory[i], m_allocator);
-    }
+    vkUnmapMemory(m_device, m_textureFeedbackBufferMemory);
+    destroyBuffer(m_textureFeedbackBuffer, m_textureFeedbackBufferMemory);
+
+    vkUnmapMemory(m_device, m_frameUniformBufferMemory);
+    destroyBuffer(m_frameUniformBuffer, m_frameUniformBufferMemory);
 
     vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, m_allocator);
+    vkDestroyDescriptorSetLayout(m_device, m_textureDescriptorSetLayout, m_allocator);
+    vkDestroyDescriptorSetLayout(m_device, m_denoiseDescriptorSetLayout, m_allocator);
+    vkDestroyDescriptorSetLayout(m_device, m_tonemapDescriptorSetLayout, m_allocator);
+    vkDestroyDescriptorSetLayout(m_device, m_presentDescriptorSetLayout, m_allocator);
 
     for (size_t i = 0; i < m_MAX_FRAMES_IN_FLIGHT; i++) {
         vkDestroySemaphore(m_device, m_renderFinishedSemaphores[i], m_allocator);
         vkDestroySemaphore(m_device, m_imageAvailableSemaphores[i], m_allocator);
         vkDestroyFence(m_device, m_inFlightFences[i], m_allocator);
     }
+    vkDestroySemaphore(m_device, m_graphicsTimeline, m_allocator);
+    vkDestroySemaphore(m_device, m_computeTimeline, m_allocator);
 
     //if using the debug report callback
     auto f_vkDestroyDebugReportCallbackEXT = (PFN_vkDestroyDebugReportCallbackEXT)vkGetInstanceProcAddr(m_instance, "vkDestroyDebugReportCallbackEXT");
@@ -104,19 +537,6 @@ void VkRenderer::cleanupVulkan() {
         DestroyDebugUtilsMessengerEXT(m_instance, m_debugMessenger, m_allocator);
     }
 
-    for (auto& swapchainFramebuffer : m_swapchainFramebuffers) {
-        vkDestroyFramebuffer(m_device, swapchainFramebuffer, m_allocator);
-    }
-
-    for (auto& uiFramebuffer : m_uiFramebuffers) {
-        vkDestroyFramebuffer(m_device, uiFramebuffer, m_allocator);
-    }
-
-    for (auto& swapchainImageView : m_swapchainImageViews) {
-        vkDestroyImageView(m_device, swapchainImageView, m_allocator);
-    }
-    vkDestroySwapchainKHR(m_device, m_swapchain, m_allocator);
-    vkDestroySurfaceKHR(m_instance, m_surface, m_allocator);
     vkDestroyDevice(m_device, m_allocator);
     vkDestroyInstance(m_instance, m_allocator);
 }
@@ -161,176 +581,836 @@ bool VkRenderer::checkValidationLayerSupport() {
     return true;
 }
 
-void VkRenderer::createData() {
-    //cornell box
-    Material whiteMat({1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}, 0.0f, 0.0f, 0.0f);
-    Material leftWall({1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, 0.0f, 0.0f, 0.0f);
-    Material rightWall({0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, 0.0f, 0.0f, 0.0f);
-    Material emissive({1.0f, 1.0f, 1.0f}, {1.0f, 1.0f, 1.0f}, 0.5f, 0.0f, 0.0f);
-
-    m_triangles = {
-        //ground
-        Triangle(Vertex3D({-2.0f, 2.0f, 0.0f}, {0.0f, 0.0f, 1.0f}),
-                 Vertex3D({2.0f, 2.0f, 0.0f}, {0.0f, 0.0f, 1.0f}),
-                 Vertex3D({-2.0f, -2.0f, 0.0f}, {0.0f, 0.0f, 1.0f}),
-                 whiteMat
-        ),
-        Triangle(Vertex3D({-2.0f, -2.0f, 0.0f}, {0.0f, 0.0f, 1.0f}),
-                 Vertex3D({2.0f, 2.0f, 0.0f}, {0.0f, 0.0f, 1.0f}),
-                 Vertex3D({2.0f, -2.0f, 0.0f}, {0.0f, 0.0f, 1.0f}),
-                 whiteMat
-        ),
-        //back wall
-        Triangle(Vertex3D({2.0f, -2.0f, 0.0f}, {0.0f, 1.0f, 0.0f}),
-                 Vertex3D({2.0f, -2.0f, 2.0f}, {0.0f, 1.0f, 0.0f}),
-                 Vertex3D({-2.0f, -2.0f, 0.0f}, {0.0f, 1.0f, 0.0f}),
-                 whiteMat
-        ),
-        Triangle(Vertex3D({-2.0f, -2.0f, 0.0f}, {0.0f, 1.0f, 0.0f}),
-                 Vertex3D({2.0f, -2.0f, 2.0f}, {0.0f, 1.0f, 0.0f}),
-                 Vertex3D({-2.0f, -2.0f, 2.0f}, {0.0f, 1.0f, 0.0f}),
-                 whiteMat
-        ),
-        //left wall
-        Triangle(Vertex3D({-2.0f, 2.0f, 0.0f}, {1.0f, 0.0f, 0.0f}),
-                 Vertex3D({-2.0f, -2.0f, 0.0f}, {1.0f, 0.0f, 0.0f}),
-                 Vertex3D({-2.0f, -2.0f, 2.0f}, {1.0f, 0.0f, 0.0f}),
-                 leftWall
-        ),
-        Triangle(Vertex3D({-2.0f, 2.0f, 0.0f}, {1.0f, 0.0f, 0.0f}),
-                 Vertex3D({-2.0f, -2.0f, 2.0f}, {1.0f, 0.0f, 0.0f}),
-                 Vertex3D({-2.0f, 2.0f, 2.0f}, {1.0f, 0.0f, 0.0f}),
-                 leftWall
-        ),
-        //right wall
-        Triangle(Vertex3D({2.0f, -2.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}),
-                 Vertex3D({2.0f, 2.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}),
-                 Vertex3D({2.0f, -2.0f, 2.0f}, {-1.0f, 0.0f, 0.0f}),
-                 rightWall
-        ),
-        Triangle(Vertex3D({2.0f, -2.0f, 2.0f}, {-1.0f, 0.0f, 0.0f}),
-                 Vertex3D({2.0f, 2.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}),
-                 Vertex3D({2.0f, 2.0f, 2.0f}, {-1.0f, 0.0f, 0.0f}),
-                 rightWall
-        ),
-        //ceiling
-        Triangle(Vertex3D({-2.0f, 2.0f, 2.0f}, {0.0f, 0.0f, -1.0f}),
-                 Vertex3D({-2.0f, -2.0f, 2.0f}, {0.0f, 0.0f, -1.0f}),
-                 Vertex3D({2.0f, 2.0f, 2.0f}, {0.0f, 0.0f, -1.0f}),
-                 whiteMat
-        ),
-        Triangle(Vertex3D({-2.0f, -2.0f, 2.0f}, {0.0f, 0.0f, -1.0f}),
-                 Vertex3D({2.0f, 2.0f, 2.0f}, {0.0f, 0.0f, -1.0f}),
-                 Vertex3D({2.0f, -2.0f, 2.0f}, {0.0f, 0.0f, -1.0f}),
-                 whiteMat
-        ),
-        //light
-        Triangle(Vertex3D({-1.0f, 1.0f, 1.99f}, {0.0f, 0.0f, -1.0f}),
-                 Vertex3D({-1.0f, -1.0f, 1.99f}, {0.0f, 0.0f, -1.0f}),
-                 Vertex3D({1.0f, 1.0f, 1.99f}, {0.0f, 0.0f, -1.0f}),
-                 emissive
-        ),
-        Triangle(Vertex3D({-1.0f, -1.0f, 1.99f}, {0.0f, 0.0f, -1.0f}),
-                 Vertex3D({1.0f, 1.0f, 1.99f}, {0.0f, 0.0f, -1.0f}),
-                 Vertex3D({1.0f, -1.0f, 1.99f}, {0.0f, 0.0f, -1.0f}),
-                 emissive
-        )
+void VkRenderer::createData(const Scene& scene) {
+    m_triangles = scene.m_triangles;
+    m_spheres = scene.m_spheres;
+    m_lights = scene.m_lights;
+
+    for (const Triangle& triangle : m_triangles) {
+        checkMaterialTextures(triangle.m_material, scene.m_textures.size());
+    }
+    for (const Sphere& sphere : m_spheres) {
+        checkMaterialTextures(sphere.m_material, scene.m_textures.size());
+    }
+
+    createMeshes();
+    m_bvh.build(m_triangles, m_spheres, getWorkerCount());
+    createSceneBuffers(true);
+    m_residentTriangles = static_cast<uint32_t>(m_triangles.size());
+    m_sceneResident = true;
+
+    createTextures(scene);
+    createTextureFeedbackBuffer();
+    m_residentTextures = m_textureManager.getTextureCount();
+}
+
+void VkRenderer::createMeshes() {
+    m_meshes.clear();
+    for (uint32_t i = 0; i < m_triangles.size(); ++i) {
+        if (m_meshes.empty() || !(m_triangles[i].m_material == m_triangles[i - 1].m_material)) {
+            m_meshes.push_back({ i, i });
+        }
+        m_meshes.back().m_end = i + 1;
+    }
+}
+
+void VkRenderer::createSceneBuffers(bool upload) {
+    m_sphereCapacity = m_spheres.size() + m_SPHERE_RESERVE;
+    m_lightCapacity = m_lights.size() + m_LIGHT_RESERVE;
+    size_t primitiveCapacity = m_triangles.size() + m_sphereCapacity;
+
+    // Without upload the buffers are left for streamScene to fill
+    auto create = [&](const void* data, VkDeviceSize dataSize, VkDeviceSize size, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+        if (upload) {
+            createStorageBuffer(data, dataSize, size, buffer, bufferMemory);
+        }
+        else {
+            createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, bufferMemory);
+        }
     };
 
-    Material gold({1.0f, 0.9f, 0.0f}, {0.0f, 0.0f, 0.0f}, 0.0f, 0.1f, 1.0f);
-    Sphere sphere({-1.0, 0.0, 0.2}, 0.2, gold);
-    Material silver({0.7, 0.7, 0.7}, {0.0f, 0.0f, 0.0f}, 0.0f, 0.1f, 1.0f);
-    Sphere sphere2({0.0, 0.0, 0.2}, 0.2, silver);
-    Material flatBlue({0.0, 0.0, 1.0}, {0.0f, 0.0f, 0.0f}, 0.0f, 1.0f, 0.0f);
-    Sphere sphere3({1.0, 0.0, 0.2}, 0.2, flatBlue);
-    /*std::vector<Triangle> sphereGeom = sphere.sphereGeometry(5, 5);
-    m_triangles.insert(std::end(m_triangles), std::begin(sphereGeom), std::end(sphereGeom));*/
-    m_spheres = {
-        sphere, sphere2, sphere3
+    // An empty array keeps one zeroed element, a buffer cannot be empty
+    create(m_triangles.data(), sizeof(Triangle) * m_triangles.size(), sizeof(Triangle) * std::max<size_t>(m_triangles.size(), 1), m_triangleBuffer, m_triangleBufferMemory);
+    create(m_spheres.data(), sizeof(Sphere) * m_spheres.size(), sizeof(Sphere) * m_sphereCapacity, m_sphereBuffer, m_sphereBufferMemory);
+    create(m_lights.data(), sizeof(Light) * m_lights.size(), sizeof(Light) * m_lightCapacity, m_lightBuffer, m_lightBufferMemory);
+    create(m_bvh.getNodes().data(), sizeof(Bvh::Node) * m_bvh.getNodes().size(), sizeof(Bvh::Node) * Bvh::getMaxNodeCount(primitiveCapacity), m_bvhNodeBuffer, m_bvhNodeBufferMemory);
+    create(m_bvh.getPrimitives().data(), sizeof(uint32_t) * m_bvh.getPrimitives().size(), sizeof(uint32_t) * primitiveCapacity, m_bvhPrimitiveBuffer, m_bvhPrimitiveBufferMemory);
+    m_bvh.clearDirtyNodes();
+
+    // Room for every sphere and light, for a rebuilt BVH and for the triangles a frame copies at most, so the
+    // edits of the UI never grow it
+    createSceneUpdateBuffer(sizeof(Sphere) * m_sphereCapacity + sizeof(Light) * m_lightCapacity +
+        sizeof(Bvh::Node) * Bvh::getMaxNodeCount(primitiveCapacity) + sizeof(uint32_t) * primitiveCapacity +
+        sizeof(Triangle) * std::min<size_t>(m_triangles.size(), m_TRIANGLE_UPDATE_RESERVE));
+}
+
+void VkRenderer::destroySceneBuffers() {
+    destroyBuffer(m_triangleBuffer, m_triangleBufferMemory);
+    destroyBuffer(m_sphereBuffer, m_sphereBufferMemory);
+    destroyBuffer(m_lightBuffer, m_lightBufferMemory);
+    destroyBuffer(m_bvhNodeBuffer, m_bvhNodeBufferMemory);
+    destroyBuffer(m_bvhPrimitiveBuffer, m_bvhPrimitiveBufferMemory);
+}
+
+void VkRenderer::loadScene(std::function<Scene()> source) {
+    if (isSceneLoading()) {
+        throw std::runtime_error("A scene is already loading");
+    }
+    m_sceneLoadError.clear();
+    m_sceneLoader.start(std::move(source), getWorkerCount());
+}
+
+void VkRenderer::updateSceneLoading() {
+    SceneLoader::Stage stage = m_sceneLoader.getStage();
+    if (stage == SceneLoader::Stage::Ready || stage == SceneLoader::Stage::Failed) {
+        try {
+            replaceScene(m_sceneLoader.take());
+        }
+        catch (const std::exception& e) {
+            m_sceneLoadError = e.what();
+            std::cerr << "Failed to load the scene: " << e.what() << std::endl;
+        }
+    }
+    streamScene();
+    streamTextures();
+}
+
+void VkRenderer::replaceScene(SceneLoader::Result result) {
+    // Refused before anything of the current scene is released
+    const Scene& scene = result.m_scene;
+    for (const Triangle& triangle : scene.m_triangles) {
+        checkMaterialTextures(triangle.m_material, scene.m_textures.size());
+    }
+    for (const Sphere& sphere : scene.m_spheres) {
+        checkMaterialTextures(sphere.m_material, scene.m_textures.size());
+    }
+    if (scene.m_textures.size() > m_maxTextures) {
+        throw std::runtime_error("The scene has " + std::to_string(scene.m_textures.size()) + " textures, the device samples at most " + std::to_string(m_maxTextures));
+    }
+
+    // The frames in flight still read the buffers and the descriptor sets being replaced, and the staging
+    // slices of the updates and the feedback of the textures
+    RetiredScene retired;
+    retired.m_buffers = {
+        { m_triangleBuffer, m_triangleBufferMemory },
+        { m_sphereBuffer, m_sphereBufferMemory },
+        { m_lightBuffer, m_lightBufferMemory },
+        { m_bvhNodeBuffer, m_bvhNodeBufferMemory },
+        { m_bvhPrimitiveBuffer, m_bvhPrimitiveBufferMemory },
+        { m_sceneUpdateBuffer, m_sceneUpdateBufferMemory },
+        { m_textureFeedbackBuffer, m_textureFeedbackBufferMemory }
+    };
+    retired.m_descriptorPool = m_descriptorPool;
+    retired.m_frameIndex = m_frameIndex;
+
+    // The copies of a scene still streaming may still write them, they are finished and never acquired
+    auto replaced = [&retired](const PendingAcquire& upload) {
+        return upload.m_image != VK_NULL_HANDLE || std::any_of(retired.m_buffers.begin(), retired.m_buffers.end(),
+            [&upload](const std::pair<VkBuffer, VkDeviceMemory>& buffer) { return buffer.first == upload.m_buffer; });
+    };
+    if (std::any_of(m_pendingAcquires.begin(), m_pendingAcquires.end(), replaced)) {
+        m_uploadRing.finish();
+        std::erase_if(m_pendingAcquires, replaced);
+    }
+
+    vkUnmapMemory(m_device, m_sceneUpdateBufferMemory);
+    vkUnmapMemory(m_device, m_textureFeedbackBufferMemory);
+    m_sceneUpdateBuffer = VK_NULL_HANDLE;
+    m_sceneUpdateBufferMemory = VK_NULL_HANDLE;
+    m_textureFeedbackBuffer = VK_NULL_HANDLE;
+    m_textureFeedbackBufferMemory = VK_NULL_HANDLE;
+    m_retiredScenes.push_back(std::move(retired));
+
+    m_triangles = std::move(result.m_scene.m_triangles);
+    m_spheres = std::move(result.m_scene.m_spheres);
+    m_lights = std::move(result.m_scene.m_lights);
+    m_bvh = std::move(result.m_bvh);
+    m_bvhOutdated = false;
+    m_dirtyTriangles.clear();
+    m_dirtySpheres.clear();
+    m_dirtyLights.clear();
+    m_movedTriangles.clear();
+    m_movedSpheres.clear();
+    m_sceneEditor = SceneEditorState{};
+    createMeshes();
+    createSceneBuffers(false);
+
+    // The previous images are released by the texture manager once every descriptor set moved past them. Only
+    // the tails of streamed textures are uploaded before the next frame, the cache is opened or built first.
+    m_textureSubmissions.clear();
+    if (m_textureStreamingSettings.m_enabled && m_textureCompressionBC) {
+        createTextures(scene);
+        m_residentTextures = m_textureManager.getTextureCount();
+    }
+    else {
+        m_textureManager.beginUpload(std::move(result.m_scene.m_textures), getWorkerCount());
+        m_residentTextures = 0;
+    }
+    createTextureFeedbackBuffer();
+
+    // Sized for the new textures, the sets are written as the textures are created. Starting them from
+    // generation 0 keeps the previous images until each set was rewritten by a frame whose fence was waited on.
+    createDescriptorPool();
+    createDescriptorSets();
+    m_textureDescriptorGenerations.assign(m_textureDescriptorGenerations.size(), 0);
+
+    SceneStreamState& stream = m_sceneStream;
+    stream = SceneStreamState{};
+    stream.m_active = true;
+    stream.m_sizes = {
+        sizeof(Light) * m_lights.size(),
+        sizeof(Sphere) * m_spheres.size(),
+        sizeof(Bvh::Node) * m_bvh.getNodes().size(),
+        sizeof(uint32_t) * m_bvh.getPrimitives().size(),
+        sizeof(Triangle) * m_triangles.size()
+    };
+    for (size_t i = 0; i < stream.m_sizes.size(); ++i) {
+        stream.m_totalBytes += stream.m_sizes[i];
+    }
+    stream.m_sceneBytes = stream.m_totalBytes - stream.m_sizes.back();
+    stream.m_stagingStart = m_uploadRing.getStatistics();
+    stream.m_startTime = std::chrono::steady_clock::now();
+    m_residentTriangles = 0;
+    m_sceneResident = false;
+
+    m_sceneLoadStatistics = SceneLoadStatistics{};
+    m_sceneLoadStatistics.m_readTime = result.m_readTime;
+    m_sceneLoadStatistics.m_buildTime = result.m_buildTime;
+    m_resetHistory = true;
+    m_tiledState.m_reset = true;
+}
+
+void VkRenderer::streamScene() {
+    SceneStreamState& stream = m_sceneStream;
+    if (!stream.m_active) {
+        return;
+    }
+
+    // Read from the members on each call, the edits made meanwhile may move their arrays
+    const std::array<std::pair<VkBuffer, const void*>, 5> copies = { {
+        { m_lightBuffer, m_lights.data() },
+        { m_sphereBuffer, m_spheres.data() },
+        { m_bvhNodeBuffer, m_bvh.getNodes().data() },
+        { m_bvhPrimitiveBuffer, m_bvh.getPrimitives().data() },
+        { m_triangleBuffer, m_triangles.data() }
+    } };
+
+    VkDeviceSize budget = m_SCENE_STREAM_BUDGET;
+    VkDeviceSize stagedBefore = stream.m_stagedBytes;
+    while (budget > 0 && stream.m_copy < copies.size()) {
+        const auto& [buffer, data] = copies[stream.m_copy];
+        VkDeviceSize size = std::min(stream.m_sizes[stream.m_copy] - stream.m_copyOffset, budget);
+        uploadBuffer(buffer, stream.m_copyOffset, static_cast<const char*>(data) + stream.m_copyOffset, size);
+
+        stream.m_copyOffset += size;
+        stream.m_stagedBytes += size;
+        budget -= size;
+        if (stream.m_copyOffset == stream.m_sizes[stream.m_copy]) {
+            ++stream.m_copy;
+            stream.m_copyOffset = 0;
+        }
+    }
+    if (stream.m_stagedBytes > stagedBefore) {
+        m_uploadRing.flush();
+        stream.m_submissions.push_back({ m_uploadRing.getStatistics().m_submissions, stream.m_stagedBytes });
+    }
+    m_frameStreamed = true;
+
+    // Acquired by the frame recorded next, which polls after this
+    uint64_t completed = m_uploadRing.pollCompletedSubmissions();
+    while (!stream.m_submissions.empty() && stream.m_submissions.front().first <= completed) {
+        stream.m_residentBytes = stream.m_submissions.front().second;
+        stream.m_submissions.pop_front();
+    }
+
+    // A triangle is only traced once all of its bytes are resident
+    bool sceneResident = stream.m_residentBytes >= stream.m_sceneBytes;
+    uint32_t residentTriangles = sceneResident ? static_cast<uint32_t>((stream.m_residentBytes - stream.m_sceneBytes) / sizeof(Triangle)) : 0;
+    if (stream.m_copy == copies.size() && stream.m_residentBytes == stream.m_totalBytes) {
+        residentTriangles = static_cast<uint32_t>(m_triangles.size());
+    }
+    if (sceneResident != m_sceneResident || residentTriangles != m_residentTriangles) {
+        if (sceneResident && !m_sceneResident) {
+            m_sceneLoadStatistics.m_firstFrameTime = m_sceneLoader.getElapsedTime();
+        }
+        m_sceneResident = sceneResident;
+        m_residentTriangles = residentTriangles;
+        m_resetHistory = true;
+        m_tiledState.m_reset = true;
+    }
+
+    if (stream.m_copy == copies.size() && stream.m_residentBytes == stream.m_totalBytes) {
+        SceneLoadStatistics& statistics = m_sceneLoadStatistics;
+        statistics.m_residentTime = m_sceneLoader.getElapsedTime();
+        statistics.m_uploadTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stream.m_startTime).count();
+        statistics.m_uploadedBytes = m_uploadRing.getStatistics().m_bytes - stream.m_stagingStart.m_bytes;
+        statistics.m_stagingSubmissions = m_uploadRing.getStatistics().m_submissions - stream.m_stagingStart.m_submissions;
+        stream.m_active = false;
+    }
+}
+
+void VkRenderer::streamTextures() {
+    if (!m_textureManager.isUploading() && m_textureSubmissions.empty()) {
+        return;
+    }
+
+    // Released to the graphics family like the buffers, the frames acquire them with the same barriers
+    VkDeviceSize memoryBefore = m_textureManager.getMemory();
+    try {
+        std::vector<TextureManager::UploadedImage> images = m_textureManager.uploadNext(m_uploadRing, m_queueIndices.m_transferFamily, m_queueIndices.m_graphicsFamily);
+        if (!images.empty()) {
+            m_uploadRing.flush();
+            uint64_t submission = m_uploadRing.getStatistics().m_submissions;
+            for (const TextureManager::UploadedImage& image : images) {
+                m_pendingAcquires.push_back({ submission, VK_NULL_HANDLE, 0, 0, image.m_image, image.m_mipLevels });
+            }
+            m_textureSubmissions.push_back({ submission, m_textureManager.getUploadedCount() });
+        }
+    }
+    catch (const std::exception& e) {
+        // The textures uploaded so far stay resident, the others are never sampled
+        m_sceneLoadError = e.what();
+        std::cerr << "Failed to load the textures: " << e.what() << std::endl;
+    }
+    trackDeviceMemory(m_textureManager.getMemory() - memoryBefore, 0);
+    m_frameStreamed = true;
+
+    uint64_t completed = m_uploadRing.pollCompletedSubmissions();
+    uint32_t residentTextures = m_residentTextures;
+    while (!m_textureSubmissions.empty() && m_textureSubmissions.front().first <= completed) {
+        residentTextures = m_textureSubmissions.front().second;
+        m_textureSubmissions.pop_front();
+    }
+    if (residentTextures != m_residentTextures) {
+        m_residentTextures = residentTextures;
+        m_resetHistory = true;
+        m_tiledState.m_reset = true;
+    }
+}
+
+void VkRenderer::releaseRetiredScenes(bool all) {
+    auto released = std::remove_if(m_retiredScenes.begin(), m_retiredScenes.end(), [&](const RetiredScene& retired) {
+        // Same as the retired swapchains, the frames in flight when it was retired were waited on since
+        if (!all && m_frameIndex - retired.m_frameIndex < static_cast<uint32_t>(m_MAX_FRAMES_IN_FLIGHT)) {
+            return false;
+        }
+        for (const auto& [buffer, bufferMemory] : retired.m_buffers) {
+            destroyBuffer(buffer, bufferMemory);
+        }
+        vkDestroyDescriptorPool(m_device, retired.m_descriptorPool, m_allocator);
+        return true;
+    });
+    m_retiredScenes.erase(released, m_retiredScenes.end());
+}
+
+void VkRenderer::checkMaterialTextures(const Material& material, size_t textureCount) {
+    // The descriptors past the textures of the scene are left unwritten, the shader must never index them
+    for (int32_t texture : { material.m_albedoTexture, material.m_roughnessMetallicTexture, material.m_normalTexture }) {
+        if (texture >= static_cast<int32_t>(textureCount)) {
+            throw std::runtime_error("A material uses texture " + std::to_string(texture) + " of " + std::to_string(textureCount));
+        }
+    }
+}
+
+void VkRenderer::createStorageBuffer(const void* data, VkDeviceSize dataSize, VkDeviceSize size, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+    size = std::max<VkDeviceSize>(size, 1);
+    createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, bufferMemory);
+
+    // Whatever is past the data is zeroed
+    uploadBuffer(buffer, 0, data, dataSize);
+    uploadBuffer(buffer, dataSize, nullptr, size - dataSize);
+}
+
+void VkRenderer::updateTriangle(uint32_t index, const Triangle& triangle) {
+    if (index >= m_triangles.size()) {
+        throw std::runtime_error("Cannot update triangle " + std::to_string(index) + " of " + std::to_string(m_triangles.size()));
+    }
+    checkMaterialTextures(triangle.m_material, m_textureManager.getTextureCount());
+
+    // A new material leaves the BVH alone
+    const Triangle& previous = m_triangles[index];
+    if (triangle.m_v0.m_position != previous.m_v0.m_position || triangle.m_v1.m_position != previous.m_v1.m_position || triangle.m_v2.m_position != previous.m_v2.m_position) {
+        m_movedTriangles.push_back(index);
+    }
+    m_triangles[index] = triangle;
+    m_dirtyTriangles.add(index);
+    m_tiledState.m_reset = true;
+}
+
+void VkRenderer::updateSphere(uint32_t index, const Sphere& sphere) {
+    if (index >= m_spheres.size()) {
+        throw std::runtime_error("Cannot update sphere " + std::to_string(index) + " of " + std::to_string(m_spheres.size()));
+    }
+    checkMaterialTextures(sphere.m_material, m_textureManager.getTextureCount());
+
+    const Sphere& previous = m_spheres[index];
+    if (sphere.m_center != previous.m_center || sphere.m_radius != previous.m_radius) {
+        m_movedSpheres.push_back(index);
+    }
+    m_spheres[index] = sphere;
+    m_dirtySpheres.add(index);
+    m_tiledState.m_reset = true;
+}
+
+uint32_t VkRenderer::addSphere(const Sphere& sphere) {
+    if (m_spheres.size() >= m_sphereCapacity) {
+        throw std::runtime_error("Cannot add a sphere, the " + std::to_string(m_sphereCapacity) + " reserved are used");
+    }
+    checkMaterialTextures(sphere.m_material, m_textureManager.getTextureCount());
+
+    m_spheres.push_back(sphere);
+    uint32_t index = static_cast<uint32_t>(m_spheres.size() - 1);
+    m_dirtySpheres.add(index);
+    m_bvhOutdated = true;
+    m_tiledState.m_reset = true;
+    return index;
+}
+
+uint32_t VkRenderer::addLight(const Light& light) {
+    if (m_lights.size() >= m_lightCapacity) {
+        throw std::runtime_error("Cannot add a light, the " + std::to_string(m_lightCapacity) + " reserved are used");
+    }
+
+    m_lights.push_back(light);
+    uint32_t index = static_cast<uint32_t>(m_lights.size() - 1);
+    m_dirtyLights.add(index);
+    m_tiledState.m_reset = true;
+    return index;
+}
+
+void VkRenderer::updateLight(uint32_t index, const Light& light) {
+    if (index >= m_lights.size()) {
+        throw std::runtime_error("Cannot update light " + std::to_string(index) + " of " + std::to_string(m_lights.size()));
+    }
+    m_lights[index] = light;
+    m_dirtyLights.add(index);
+    m_tiledState.m_reset = true;
+}
+
+bool VkRenderer::hasSceneUpdates() const {
+    if (m_sceneStream.m_active) {
+        return false;
+    }
+    return !m_movedTriangles.empty() || !m_movedSpheres.empty() || m_bvhOutdated ||
+        !m_dirtyTriangles.empty() || !m_dirtySpheres.empty() || !m_dirtyLights.empty();
+}
+
+void VkRenderer::recordSceneUpdates(VkCommandBuffer commandBuffer) {
+    bool moved = !m_movedTriangles.empty() || !m_movedSpheres.empty();
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    SceneUpdateStatistics& statistics = m_sceneUpdateStatistics;
+
+    if (m_bvhOutdated) {
+        m_bvh.build(m_triangles, m_spheres, getWorkerCount());
+        ++statistics.m_rebuilds;
+        statistics.m_costRatio = 1.0f;
+        m_bvhOutdated = false;
+        m_movedTriangles.clear();
+        m_movedSpheres.clear();
+    }
+    else if (moved) {
+        unsigned int workerCount = getWorkerCount();
+        statistics.m_refittedNodes += m_bvh.refit(m_triangles, m_spheres, m_movedTriangles, m_movedSpheres, workerCount);
+        if (m_bvh.getCost() > m_bvh.getBuildCost() * m_BVH_REBUILD_THRESHOLD) {
+            m_bvh.build(m_triangles, m_spheres, workerCount);
+            ++statistics.m_rebuilds;
+        }
+        statistics.m_costRatio = m_bvh.getCost() / std::max(m_bvh.getBuildCost(), 1e-6f);
+        m_movedTriangles.clear();
+        m_movedSpheres.clear();
+    }
+
+    struct Upload {
+        VkBuffer m_buffer;
+        const void* m_data;
+        VkDeviceSize m_elementSize;
+        std::vector<DirtyRanges::Range> m_ranges;
     };
+    std::vector<DirtyRanges::Range> primitiveRanges;
+    if (m_bvh.arePrimitivesDirty()) {
+        primitiveRanges.push_back({ 0, static_cast<uint32_t>(m_bvh.getPrimitives().size()) });
+    }
+    std::array<Upload, 5> uploads = { {
+        { m_sphereBuffer, m_spheres.data(), sizeof(Sphere), m_dirtySpheres.getRanges(m_UPDATE_RANGE_GAP) },
+        { m_lightBuffer, m_lights.data(), sizeof(Light), m_dirtyLights.getRanges(m_UPDATE_RANGE_GAP) },
+        { m_bvhNodeBuffer, m_bvh.getNodes().data(), sizeof(Bvh::Node), m_bvh.getDirtyNodes().getRanges(m_UPDATE_RANGE_GAP) },
+        { m_bvhPrimitiveBuffer, m_bvh.getPrimitives().data(), sizeof(uint32_t), primitiveRanges },
+        { m_triangleBuffer, m_triangles.data(), sizeof(Triangle), {} }
+    } };
+
+    // The other arrays always fit in the slice reserved by createSceneBuffers, the triangles take what is left
+    // and the rest of them stays dirty for the next frames
+    VkDeviceSize uploadSize = 0;
+    for (const Upload& upload : uploads) {
+        for (const DirtyRanges::Range& range : upload.m_ranges) {
+            uploadSize += (range.m_end - range.m_begin) * upload.m_elementSize;
+        }
+    }
+    uint32_t triangleBudget = static_cast<uint32_t>((m_sceneUpdateStride - uploadSize) / sizeof(Triangle));
+    std::vector<DirtyRanges::Range> triangleRanges = m_dirtyTriangles.getRanges(m_UPDATE_RANGE_GAP);
+    m_dirtyTriangles.clear();
+    for (const DirtyRanges::Range& range : triangleRanges) {
+        uint32_t count = std::min(range.m_end - range.m_begin, triangleBudget);
+        if (count > 0) {
+            uploads.back().m_ranges.push_back({ range.m_begin, range.m_begin + count });
+            uploadSize += count * sizeof(Triangle);
+            triangleBudget -= count;
+        }
+        m_dirtyTriangles.add(range.m_begin + count, range.m_end);
+    }
+    if (!m_dirtyTriangles.empty()) {
+        ++statistics.m_splitUpdates;
+        // The frames in between may trace a mesh partly edited, none of them is accumulated
+        m_tiledState.m_reset = true;
+    }
 
-    m_lights = {
-        /*Light({-10.0, 10.0, 2.0}, {1.0, 1.0, 1.0}, 1.0),
-        Light({10.0, 10.0, 2.0}, {1.0, 1.0, 1.0}, 1.0),
-        Light({10.0, -10.0, 2.0}, {1.0, 1.0, 1.0}, 1.0),
-        Light({-10.0, -10.0, 2.0}, {1.0, 1.0, 1.0}, 1.0)*/
-        //Light({0.0, 0.0, 1.99}, {1.0, 1.0, 1.0}, 5.0)
+    VkDeviceSize sliceOffset = m_currentFrame * m_sceneUpdateStride;
+    char* slice = static_cast<char*>(m_sceneUpdateBufferMapped) + sliceOffset;
+    VkDeviceSize offset = 0;
+    std::vector<VkBufferCopy> regions;
+    for (const Upload& upload : uploads) {
+        regions.clear();
+        for (const DirtyRanges::Range& range : upload.m_ranges) {
+            VkBufferCopy region{};
+            region.srcOffset = sliceOffset + offset;
+            region.dstOffset = range.m_begin * upload.m_elementSize;
+            region.size = (range.m_end - range.m_begin) * upload.m_elementSize;
+            std::memcpy(slice + offset, static_cast<const char*>(upload.m_data) + region.dstOffset, static_cast<size_t>(region.size));
+            regions.push_back(region);
+            offset += region.size;
+        }
+        if (!regions.empty()) {
+            vkCmdCopyBuffer(commandBuffer, m_sceneUpdateBuffer, upload.m_buffer, static_cast<uint32_t>(regions.size()), regions.data());
+        }
+    }
+
+    m_dirtySpheres.clear();
+    m_dirtyLights.clear();
+    m_bvh.clearDirtyNodes();
+
+    double updateTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+    ++statistics.m_updates;
+    statistics.m_lastTime = updateTime;
+    statistics.m_totalTime += updateTime;
+    statistics.m_lastUploadedBytes = uploadSize;
+    statistics.m_uploadedBytes += uploadSize;
+}
+
+void VkRenderer::createSceneUpdateBuffer(VkDeviceSize stride) {
+    // One slice per frame in flight, the slice of a frame was last read by the frame its fence waited for. The
+    // buffer being replaced may still be read by the other frames in flight.
+    if (m_sceneUpdateBuffer != VK_NULL_HANDLE) {
+        if (!m_inFlightFences.empty()) {
+            vkWaitForFences(m_device, static_cast<uint32_t>(m_inFlightFences.size()), m_inFlightFences.data(), VK_TRUE, UINT64_MAX);
+        }
+        vkUnmapMemory(m_device, m_sceneUpdateBufferMemory);
+        destroyBuffer(m_sceneUpdateBuffer, m_sceneUpdateBufferMemory);
+    }
+
+    m_sceneUpdateStride = std::max<VkDeviceSize>(stride, 1);
+    createBuffer(
+        m_sceneUpdateStride * m_MAX_FRAMES_IN_FLIGHT,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        m_sceneUpdateBuffer, m_sceneUpdateBufferMemory
+    );
+    vkMapMemory(m_device, m_sceneUpdateBufferMemory, 0, VK_WHOLE_SIZE, 0, &m_sceneUpdateBufferMapped);
+}
+
+bool VkRenderer::drawMaterialUI(Material& material, uint32_t textureCount) {
+    bool changed = false;
+    changed |= ImGui::ColorEdit3("Albedo", &material.m_albedo.x);
+    changed |= ImGui::SliderFloat("Roughness", &material.m_roughness, 0.0f, 1.0f);
+    changed |= ImGui::SliderFloat("Metallic", &material.m_metallic, 0.0f, 1.0f);
+    changed |= ImGui::ColorEdit3("Emission", &material.m_emission.x);
+    changed |= ImGui::DragFloat("Emission strength", &material.m_emissionStrength, 0.1f, 0.0f, 1000.0f);
+    changed |= ImGui::SliderFloat("Transparency", &material.m_transparency, 0.0f, 1.0f);
+    if (material.m_transparency > 0.0f) {
+        changed |= ImGui::SliderFloat("IOR", &material.m_ior, 1.0f, 3.0f);
+        changed |= ImGui::ColorEdit3("Transparency color", &material.m_transparencyColor.x);
+    }
+
+    // -1 for none, the others must be textures of the scene
+    const std::pair<const char*, int32_t*> maps[] = {
+        { "Albedo texture", &material.m_albedoTexture },
+        { "Roughness/metallic texture", &material.m_roughnessMetallicTexture },
+        { "Normal texture", &material.m_normalTexture }
     };
+    for (const auto& [label, texture] : maps) {
+        if (textureCount > 0 && ImGui::SliderInt(label, texture, -1, static_cast<int>(textureCount) - 1)) {
+            *texture = std::clamp(*texture, -1, static_cast<int>(textureCount) - 1);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void VkRenderer::drawSceneUI() {
+    ImGui::Begin("Scene");
+    bool edited = false;
+
+    drawSceneLoadUI();
+    ImGui::BeginDisabled(isSceneLoading());
+
+    if (ImGui::CollapsingHeader("Spheres", ImGuiTreeNodeFlags_DefaultOpen)) {
+        ImGui::Text("%zu of %zu reserved", m_spheres.size(), m_sphereCapacity);
+        if (!m_spheres.empty()) {
+            m_sceneEditor.m_sphere = std::clamp(m_sceneEditor.m_sphere, 0, static_cast<int>(m_spheres.size()) - 1);
+            ImGui::SliderInt("Sphere", &m_sceneEditor.m_sphere, 0, static_cast<int>(m_spheres.size()) - 1);
+
+            ImGui::PushID("sphere");
+            Sphere sphere = m_spheres[m_sceneEditor.m_sphere];
+            bool changed = false;
+            changed |= ImGui::DragFloat3("Center", &sphere.m_center.x, 0.01f);
+            changed |= ImGui::DragFloat("Radius", &sphere.m_radius, 0.005f, 0.001f, 100.0f);
+            changed |= drawMaterialUI(sphere.m_material, m_textureManager.getTextureCount());
+            if (changed) {
+                sphere.m_radius = std::max(sphere.m_radius, 0.001f);
+                updateSphere(static_cast<uint32_t>(m_sceneEditor.m_sphere), sphere);
+                edited = true;
+            }
+            ImGui::PopID();
+        }
+
+        ImGui::BeginDisabled(m_spheres.size() >= m_sphereCapacity);
+        if (ImGui::Button("Add sphere")) {
+            // A copy of the selected sphere next to it, or a white one in front of the camera
+            Sphere sphere = m_spheres.empty() ? Sphere(m_camera.m_cameraUBO.m_position + m_camera.m_cameraUBO.m_front * 2.0f, 0.25f, Material{ glm::vec3(0.8f), glm::vec3(0.0f), 0.0f, 0.5f, 0.0f }) : m_spheres[m_sceneEditor.m_sphere];
+            if (!m_spheres.empty()) {
+                sphere.m_center.x += 2.5f * sphere.m_radius;
+            }
+            m_sceneEditor.m_sphere = static_cast<int>(addSphere(sphere));
+            edited = true;
+        }
+        ImGui::EndDisabled();
+    }
+
+    if (ImGui::CollapsingHeader("Lights", ImGuiTreeNodeFlags_DefaultOpen)) {
+        ImGui::Text("%zu of %zu reserved", m_lights.size(), m_lightCapacity);
+        if (!m_lights.empty()) {
+            m_sceneEditor.m_light = std::clamp(m_sceneEditor.m_light, 0, static_cast<int>(m_lights.size()) - 1);
+            ImGui::SliderInt("Light", &m_sceneEditor.m_light, 0, static_cast<int>(m_lights.size()) - 1);
+
+            ImGui::PushID("light");
+            Light light = m_lights[m_sceneEditor.m_light];
+            bool changed = false;
+            changed |= ImGui::DragFloat3("Position", &light.m_position.x, 0.01f);
+            changed |= ImGui::ColorEdit3("Color", &light.m_color.x);
+            changed |= ImGui::DragFloat("Intensity", &light.m_intensity, 0.05f, 0.0f, 1000.0f);
+            if (changed) {
+                light.m_intensity = std::max(light.m_intensity, 0.0f);
+                updateLight(static_cast<uint32_t>(m_sceneEditor.m_light), light);
+                edited = true;
+            }
+            ImGui::PopID();
+        }
+
+        ImGui::BeginDisabled(m_lights.size() >= m_lightCapacity);
+        if (ImGui::Button("Add light")) {
+            Light light = m_lights.empty() ? Light{ m_camera.m_cameraUBO.m_position, glm::vec3(1.0f), 1.0f } : m_lights[m_sceneEditor.m_light];
+            m_sceneEditor.m_light = static_cast<int>(addLight(light));
+            edited = true;
+        }
+        ImGui::EndDisabled();
+    }
+
+    if (!m_meshes.empty() && ImGui::CollapsingHeader("Meshes")) {
+        m_sceneEditor.m_mesh = std::clamp(m_sceneEditor.m_mesh, 0, static_cast<int>(m_meshes.size()) - 1);
+        ImGui::SliderInt("Mesh", &m_sceneEditor.m_mesh, 0, static_cast<int>(m_meshes.size()) - 1);
+        const DirtyRanges::Range& mesh = m_meshes[m_sceneEditor.m_mesh];
+        ImGui::Text("Triangles %u to %u", mesh.m_begin, mesh.m_end - 1);
+
+        // Every triangle of the run takes the new material, a single copy range
+        ImGui::PushID("mesh");
+        Material material = m_triangles[mesh.m_begin].m_material;
+        if (drawMaterialUI(material, m_textureManager.getTextureCount())) {
+            for (uint32_t i = mesh.m_begin; i < mesh.m_end; ++i) {
+                Triangle triangle = m_triangles[i];
+                triangle.m_material = material;
+                updateTriangle(i, triangle);
+            }
+            edited = true;
+        }
+        ImGui::PopID();
+    }
+
+    ImGui::EndDisabled();
+
+    // Without motion vectors for the objects, the denoiser history would smear the edit
+    if (edited) {
+        m_resetHistory = true;
+    }
+
+    ImGui::End();
+}
 
-    VkDeviceSize triangleBufferSize;
+void VkRenderer::drawSceneLoadUI() {
+    const SceneStreamState& stream = m_sceneStream;
+    SceneLoader::Stage stage = m_sceneLoader.getStage();
+    if (stage == SceneLoader::Stage::Reading || stage == SceneLoader::Stage::Building) {
+        ImGui::Text("Loading: %s (%.1f s)", SceneLoader::getStageName(stage), m_sceneLoader.getElapsedTime() / 1000.0);
+    }
+    else if (stream.m_active) {
+        float progress = stream.m_totalBytes > 0 ? static_cast<float>(stream.m_residentBytes) / static_cast<float>(stream.m_totalBytes) : 1.0f;
+        char overlay[64];
+        std::snprintf(overlay, sizeof(overlay), "%.1f of %.1f MB", stream.m_residentBytes / (1024.0 * 1024.0), stream.m_totalBytes / (1024.0 * 1024.0));
+        if (m_sceneResident) {
+            ImGui::Text("Streaming the triangles: %u of %zu resident", m_residentTriangles, m_triangles.size());
+        }
+        else {
+            ImGui::Text("Streaming the lights, the spheres and the BVH");
+        }
+        ImGui::ProgressBar(progress, ImVec2(-1.0f, 0.0f), overlay);
+    }
+    else if (m_textureManager.isUploading() || !m_textureSubmissions.empty()) {
+        ImGui::Text("Streaming the textures: %u of %u resident", m_residentTextures, m_textureManager.getTextureCount());
+    }
+    else if (!m_sceneLoadError.empty()) {
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Loading failed: %s", m_sceneLoadError.c_str());
+    }
 
-    if (m_triangles.empty()) {
-        triangleBufferSize = sizeof(Triangle);
-        createBuffer(triangleBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_triangleBuffer, m_triangleBufferMemory);
+    const SceneLoadStatistics& statistics = m_sceneLoadStatistics;
+    if (statistics.m_firstFrameTime > 0.0 && ImGui::CollapsingHeader("Scene loading")) {
+        ImGui::Text("Read: %.1f ms, BVH build: %.1f ms", statistics.m_readTime, statistics.m_buildTime);
+        ImGui::Text("First frame: %.1f ms", statistics.m_firstFrameTime);
+        if (!stream.m_active) {
+            ImGui::Text("Resident: %.1f ms, upload %.1f MB in %.1f ms (%.2f GB/s, %llu submissions)", statistics.m_residentTime,
+                statistics.m_uploadedBytes / (1024.0 * 1024.0), statistics.m_uploadTime,
+                statistics.m_uploadTime > 0.0 ? statistics.m_uploadedBytes / (statistics.m_uploadTime * 1e6) : 0.0,
+                static_cast<unsigned long long>(statistics.m_stagingSubmissions));
+        }
 
-        void* data;
-        vkMapMemory(m_device, m_triangleBufferMemory, 0, triangleBufferSize, 0, &data);
-        memset(data, 0, static_cast<size_t>(triangleBufferSize));
-        vkUnmapMemory(m_device, m_triangleBufferMemory);
+        // CPU time of the frames, the streaming should not make them longer than the frames after
+        const FrameTimeStatistics& streaming = statistics.m_streamingFrames;
+        const FrameTimeStatistics& resident = statistics.m_residentFrames;
+        if (streaming.m_frames > 0) {
+            ImGui::Text("Frames streaming: %.3f ms avg, %.3f ms max", streaming.m_totalTime / streaming.m_frames, streaming.m_maxTime);
+        }
+        if (resident.m_frames > 0) {
+            ImGui::Text("Frames after:     %.3f ms avg, %.3f ms max", resident.m_totalTime / resident.m_frames, resident.m_maxTime);
+        }
     }
-    else {
-        triangleBufferSize = sizeof(Triangle) * m_triangles.size();
 
-        createBuffer(triangleBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            m_triangleBuffer, m_triangleBufferMemory);
+    if (ImGui::CollapsingHeader("Uploads")) {
+        const StagingRing::Statistics& uploads = m_uploadRing.getStatistics();
+        ImGui::Text("Queue family: %s", m_queueIndices.m_transferFamily != m_queueIndices.m_graphicsFamily ? "dedicated transfer" : "graphics");
+        ImGui::Text("%.1f MB in %llu submissions, %.2f ms waiting for staging blocks", uploads.m_bytes / (1024.0 * 1024.0),
+            static_cast<unsigned long long>(uploads.m_submissions), uploads.m_waitTime);
+        ImGui::Text("Acquisitions pending: %zu", m_pendingAcquires.size());
+    }
+}
 
-        void* data;
-        vkMapMemory(m_device, m_triangleBufferMemory, 0, triangleBufferSize, 0, &data);
-        memcpy(data, m_triangles.data(), static_cast<size_t>(triangleBufferSize));
-        vkUnmapMemory(m_device, m_triangleBufferMemory);
+void VkRenderer::drawSceneUpdateUI() {
+    if (!ImGui::CollapsingHeader("Scene updates")) {
+        return;
     }
 
-    VkDeviceSize sphereBufferSize;
+    const SceneUpdateStatistics& statistics = m_sceneUpdateStatistics;
+    ImGui::Text("BVH: %zu nodes over %zu primitives", m_bvh.getNodes().size(), m_bvh.getPrimitives().size());
+    ImGui::Text("SAH cost: %.2f (%.2fx the build, rebuilt past %.2fx)", m_bvh.getCost(), statistics.m_costRatio, m_BVH_REBUILD_THRESHOLD);
+    ImGui::Text("Updates: %llu, rebuilds: %llu, carried over: %llu", static_cast<unsigned long long>(statistics.m_updates),
+        static_cast<unsigned long long>(statistics.m_rebuilds), static_cast<unsigned long long>(statistics.m_splitUpdates));
+    if (statistics.m_updates > 0) {
+        ImGui::Text("Last update: %.3f ms, %.1f KB", statistics.m_lastTime, statistics.m_lastUploadedBytes / 1024.0);
+        ImGui::Text("Average: %.3f ms, %.1f KB, %.0f nodes refitted", statistics.m_totalTime / statistics.m_updates,
+            statistics.m_uploadedBytes / 1024.0 / statistics.m_updates, static_cast<double>(statistics.m_refittedNodes) / statistics.m_updates);
+    }
+}
 
-    if (m_spheres.empty()) {
-        sphereBufferSize = sizeof(Sphere);
-        createBuffer(sphereBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_sphereBuffer, m_sphereBufferMemory);
+void VkRenderer::createTextures(const Scene& scene) {
+    // Decoded on all the cores, nothing else runs while the scene is uploaded
+    unsigned int workerCount = getWorkerCount();
+    if (!m_textureManager.isInitialized()) {
+        m_textureManager.init(m_device, m_physicalDevice, m_queueIndices.m_graphicsFamily, m_graphicsQueue, m_samplerAnisotropy);
+    }
+    // The previous images are kept until the descriptor sets move past them, they are counted until released
+    VkDeviceSize memoryBefore = m_textureManager.getMemory();
 
-        void* data;
-        vkMapMemory(m_device, m_sphereBufferMemory, 0, sphereBufferSize, 0, &data);
-        memset(data, 0, static_cast<size_t>(sphereBufferSize));
-        vkUnmapMemory(m_device, m_sphereBufferMemory);
+    const TextureStreamingSettings& settings = m_textureStreamingSettings;
+    if (settings.m_enabled && !m_textureCompressionBC) {
+        std::cerr << "The device cannot sample block compressed textures, they are uploaded whole" << std::endl;
+    }
+    if (settings.m_enabled && m_textureCompressionBC) {
+        std::string cachePath = settings.m_cachePath;
+        if (cachePath.empty()) {
+            std::string name = scene.m_name.empty() ? "scene" : scene.m_name;
+            cachePath = (std::filesystem::temp_directory_path() / ("raytracer_" + name + ".texcache")).string();
+        }
+        m_textureManager.setBudget(settings.m_budget);
+        m_textureManager.stream(scene.m_textures, TextureCache::pickFormats(scene), cachePath, workerCount);
     }
     else {
-        sphereBufferSize = sizeof(Sphere) * m_spheres.size();
+        m_textureManager.upload(scene.m_textures, workerCount);
+    }
+    trackDeviceMemory(m_textureManager.getMemory() - memoryBefore, 0);
+}
 
-        createBuffer(sphereBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_sphereBuffer, m_sphereBufferMemory);
+void VkRenderer::createTextureFeedbackBuffer() {
+    // One slice of counters per frame in flight, selected with a dynamic offset. Written even when the
+    // textures are uploaded whole, the binding has to be valid.
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+    VkDeviceSize alignment = std::max<VkDeviceSize>(properties.limits.minStorageBufferOffsetAlignment, 1);
+    VkDeviceSize feedbackSize = std::max(m_textureManager.getTextureCount(), 1u) * sizeof(uint32_t);
+    m_textureFeedbackStride = (feedbackSize + alignment - 1) / alignment * alignment;
+
+    createBuffer(
+        m_textureFeedbackStride * m_MAX_FRAMES_IN_FLIGHT,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        m_textureFeedbackBuffer, m_textureFeedbackBufferMemory
+    );
+    vkMapMemory(m_device, m_textureFeedbackBufferMemory, 0, VK_WHOLE_SIZE, 0, &m_textureFeedbackBufferMapped);
+    std::memset(m_textureFeedbackBufferMapped, 0, static_cast<size_t>(m_textureFeedbackStride * m_MAX_FRAMES_IN_FLIGHT));
+}
 
-        void* data;
-        vkMapMemory(m_device, m_sphereBufferMemory, 0, sphereBufferSize, 0, &data);
-        memcpy(data, m_spheres.data(), static_cast<size_t>(sphereBufferSize));
-        vkUnmapMemory(m_device, m_sphereBufferMemory);
+void VkRenderer::updateTextureStreaming() {
+    if (!m_textureManager.isStreaming()) {
+        return;
     }
 
-    VkDeviceSize lightBufferSize;
+    // The frame that wrote this slice is done, it is cleared for the next one using it
+    uint32_t* feedback = reinterpret_cast<uint32_t*>(static_cast<char*>(m_textureFeedbackBufferMapped) + m_currentFrame * m_textureFeedbackStride);
+    VkDeviceSize memoryBefore = m_textureManager.getMemory();
+    m_textureManager.update(feedback);
+    std::memset(feedback, 0, m_textureManager.getTextureCount() * sizeof(uint32_t));
 
-    if (m_lights.empty()) {
-        lightBufferSize = sizeof(Light);
-        createBuffer(lightBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_lightBuffer, m_lightBufferMemory);
+    VkDeviceSize memoryAfter = m_textureManager.getMemory();
+    trackDeviceMemory(memoryAfter > memoryBefore ? memoryAfter - memoryBefore : 0, memoryBefore > memoryAfter ? memoryBefore - memoryAfter : 0);
+}
 
-        void* data;
-        vkMapMemory(m_device, m_lightBufferMemory, 0, lightBufferSize, 0, &data);
-        memset(data, 0, static_cast<size_t>(lightBufferSize));
-        vkUnmapMemory(m_device, m_lightBufferMemory);
+void VkRenderer::updateTextureDescriptors(uint32_t setIndex) {
+    // Only called once the frames using the set are done, its descriptors can be rewritten. The textures not
+    // created yet by a streaming scene are left unwritten, the set is partially bound.
+    uint64_t generation = m_textureManager.getGeneration();
+    std::vector<VkDescriptorImageInfo> textureInfos;
+    if (m_textureDescriptorGenerations[setIndex] != generation) {
+        textureInfos = m_textureManager.getDescriptorInfos();
     }
-    else {
-        lightBufferSize = sizeof(Light) * m_lights.size();
-
-        createBuffer(lightBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_lightBuffer, m_lightBufferMemory);
-
-        void* data;
-        vkMapMemory(m_device, m_lightBufferMemory, 0, lightBufferSize, 0, &data);
-        memcpy(data, m_lights.data(), static_cast<size_t>(lightBufferSize));
-        vkUnmapMemory(m_device, m_lightBufferMemory);
+    if (!textureInfos.empty()) {
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = m_textureDescriptorSets[setIndex];
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrite.descriptorCount = static_cast<uint32_t>(textureInfos.size());
+        descriptorWrite.pImageInfo = textureInfos.data();
+        vkUpdateDescriptorSets(m_device, 1, &descriptorWrite, 0, nullptr);
     }
+    m_textureDescriptorGenerations[setIndex] = generation;
+
+    VkDeviceSize memoryBefore = m_textureManager.getMemory();
+    m_textureManager.releaseImages(*std::min_element(m_textureDescriptorGenerations.begin(), m_textureDescriptorGenerations.end()));
+    trackDeviceMemory(0, memoryBefore - m_textureManager.getMemory());
 }
 
 void VkRenderer::createDescriptorSetLayout() {
-    //camera
+    //cameras and settings of the frame, one slice of the uniform ring per frame in flight
     VkDescriptorSetLayoutBinding uboLayoutBinding{};
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uboLayoutBinding.descriptorCount = 1;
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
     uboLayoutBinding.pImmutableSamplers = nullptr;
@@ -359,118 +1439,269 @@ void VkRenderer::createDescriptorSetLayout() {
     lightBufferLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
     lightBufferLayoutBinding.pImmutableSamplers = nullptr;
 
-    std::array<VkDescriptorSetLayoutBinding, 4> bindings = {uboLayoutBinding, triangleBufferLayoutBinding, sphereBufferLayoutBinding, lightBufferLayoutBinding };
+    //levels of detail the textures are sampled with, one slice per frame in flight
+    VkDescriptorSetLayoutBinding textureFeedbackLayoutBinding{};
+    textureFeedbackLayoutBinding.binding = 4;
+    textureFeedbackLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    textureFeedbackLayoutBinding.descriptorCount = 1;
+    textureFeedbackLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    textureFeedbackLayoutBinding.pImmutableSamplers = nullptr;
+
+    //BVH nodes
+    VkDescriptorSetLayoutBinding bvhNodeLayoutBinding{};
+    bvhNodeLayoutBinding.binding = 5;
+    bvhNodeLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bvhNodeLayoutBinding.descriptorCount = 1;
+    bvhNodeLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    bvhNodeLayoutBinding.pImmutableSamplers = nullptr;
+
+    //primitives referenced by the BVH leaves
+    VkDescriptorSetLayoutBinding bvhPrimitiveLayoutBinding{};
+    bvhPrimitiveLayoutBinding.binding = 6;
+    bvhPrimitiveLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bvhPrimitiveLayoutBinding.descriptorCount = 1;
+    bvhPrimitiveLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    bvhPrimitiveLayoutBinding.pImmutableSamplers = nullptr;
+
+    std::array<VkDescriptorSetLayoutBinding, 7> bindings = {uboLayoutBinding, triangleBufferLayoutBinding, sphereBufferLayoutBinding, lightBufferLayoutBinding, textureFeedbackLayoutBinding, bvhNodeLayoutBinding, bvhPrimitiveLayoutBinding };
 
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
     layoutInfo.pBindings = bindings.data();
 
     if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_descriptorSetLayout) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create descriptor set layout!");
     }
+
+    //textures of the materials, the sets are allocated with one descriptor per texture of the scene
+    m_maxTextures = TextureManager::getMaxTextures(m_physicalDevice);
+    VkDescriptorSetLayoutBinding textureLayoutBinding{};
+    textureLayoutBinding.binding = 0;
+    textureLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    textureLayoutBinding.descriptorCount = m_maxTextures;
+    textureLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    textureLayoutBinding.pImmutableSamplers = nullptr;
+
+    // A variable count is only allowed on the last binding
+    VkDescriptorBindingFlags textureBindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount = 1;
+    bindingFlagsInfo.pBindingFlags = &textureBindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo textureLayoutInfo{};
+    textureLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    textureLayoutInfo.pNext = &bindingFlagsInfo;
+    textureLayoutInfo.bindingCount = 1;
+    textureLayoutInfo.pBindings = &textureLayoutBinding;
+
+    if (vkCreateDescriptorSetLayout(m_device, &textureLayoutInfo, nullptr, &m_textureDescriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture descriptor set layout!");
+    }
+
+#ifdef RAYTRACER_RAY_STATS
+    // Set 2 of the instrumented trace pass and set 0 of the heat map pass:
+    // 0 totals of the frame in flight, 1 per pixel counters, 2 heat map, 3 per pixel BVH node visits
+    std::array<VkDescriptorSetLayoutBinding, 4> rayStatsBindings{};
+    rayStatsBindings[0].binding = 0;
+    rayStatsBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    rayStatsBindings[0].descriptorCount = 1;
+    rayStatsBindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    rayStatsBindings[1].binding = 1;
+    rayStatsBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    rayStatsBindings[1].descriptorCount = 1;
+    rayStatsBindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    rayStatsBindings[2].binding = 2;
+    rayStatsBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    rayStatsBindings[2].descriptorCount = 1;
+    rayStatsBindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    rayStatsBindings[3].binding = 3;
+    rayStatsBindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    rayStatsBindings[3].descriptorCount = 1;
+    rayStatsBindings[3].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo rayStatsLayoutInfo{};
+    rayStatsLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    rayStatsLayoutInfo.bindingCount = static_cast<uint32_t>(rayStatsBindings.size());
+    rayStatsLayoutInfo.pBindings = rayStatsBindings.data();
+
+    if (vkCreateDescriptorSetLayout(m_device, &rayStatsLayoutInfo, nullptr, &m_rayStatsDescriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create ray statistics descriptor set layout!");
+    }
+#endif
 }
 
 void VkRenderer::createDescriptorSets() {
-    m_descriptorSets.resize(m_swapchainImages.size());
-
-    // Create a vector of descriptor layouts, one for each swapchain image
-    std::vector<VkDescriptorSetLayout> layouts(m_swapchainImages.size(), m_descriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = m_descriptorPool; 
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(m_swapchainImages.size()); 
-    allocInfo.pSetLayouts = layouts.data();  
+    allocInfo.descriptorPool = m_descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &m_descriptorSetLayout;
 
-    // Allocation des Descriptor Sets
-    if (vkAllocateDescriptorSets(m_device, &allocInfo, m_descriptorSets.data()) != VK_SUCCESS) {
+    if (vkAllocateDescriptorSets(m_device, &allocInfo, &m_descriptorSet) != VK_SUCCESS) {
         throw std::runtime_error("Failed to allocate of descriptor sets !");
     }
 
-    // For each Descriptor Set, link the corresponding uniform buffer
-    for (size_t i = 0; i < m_swapchainImages.size(); i++) {
-        std::array<VkWriteDescriptorSet, 4> descriptorWrites{};
-
-        VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = m_uniformBuffers[i]; 
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(Camera::UniformBufferObject);
-
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = m_descriptorSets[i];  
-        descriptorWrites[0].dstBinding = 0;  
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;  
-        descriptorWrites[0].descriptorCount = 1;
-        descriptorWrites[0].pBufferInfo = &bufferInfo;  
-
-        VkDescriptorBufferInfo triangleBufferInfo{};
-        triangleBufferInfo.buffer = m_triangleBuffer;
-        triangleBufferInfo.offset = 0;
-        triangleBufferInfo.range = m_triangles.empty() ? sizeof(Triangle) : sizeof(Triangle) * m_triangles.size();
-
-        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[1].dstSet = m_descriptorSets[i];
-        descriptorWrites[1].dstBinding = 1;
-        descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pBufferInfo = &triangleBufferInfo;
-
-        VkDescriptorBufferInfo sphereBufferInfo{};
-        sphereBufferInfo.buffer = m_sphereBuffer;
-        sphereBufferInfo.offset = 0;
-        sphereBufferInfo.range = m_spheres.empty() ? sizeof(Sphere) : sizeof(Sphere) * m_spheres.size();
-
-        descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[2].dstSet = m_descriptorSets[i];
-        descriptorWrites[2].dstBinding = 2;
-        descriptorWrites[2].dstArrayElement = 0;
-        descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descriptorWrites[2].descriptorCount = 1;
-        descriptorWrites[2].pBufferInfo = &sphereBufferInfo;
-
-        VkDescriptorBufferInfo lightBufferInfo{};
-        lightBufferInfo.buffer = m_lightBuffer;
-        lightBufferInfo.offset = 0;
-        lightBufferInfo.range = m_lights.empty() ? sizeof(Light) : sizeof(Light) * m_lights.size();
-
-        descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[3].dstSet = m_descriptorSets[i];
-        descriptorWrites[3].dstBinding = 3;
-        descriptorWrites[3].dstArrayElement = 0;
-        descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descriptorWrites[3].descriptorCount = 1;
-        descriptorWrites[3].pBufferInfo = &lightBufferInfo;
+    std::array<VkWriteDescriptorSet, 7> descriptorWrites{};
+
+    // Bound at the slice of the frame in flight by the dynamic offset
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = m_frameUniformBuffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = sizeof(FrameUniforms);
+
+    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[0].dstSet = m_descriptorSet;
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].dstArrayElement = 0;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptorWrites[0].descriptorCount = 1;
+    descriptorWrites[0].pBufferInfo = &bufferInfo;
+
+    VkDescriptorBufferInfo triangleBufferInfo{};
+    triangleBufferInfo.buffer = m_triangleBuffer;
+    triangleBufferInfo.offset = 0;
+    triangleBufferInfo.range = m_triangles.empty() ? sizeof(Triangle) : sizeof(Triangle) * m_triangles.size();
+
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = m_descriptorSet;
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].dstArrayElement = 0;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pBufferInfo = &triangleBufferInfo;
+
+    VkDescriptorBufferInfo sphereBufferInfo{};
+    sphereBufferInfo.buffer = m_sphereBuffer;
+    sphereBufferInfo.offset = 0;
+    sphereBufferInfo.range = sizeof(Sphere) * m_sphereCapacity;
+
+    descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[2].dstSet = m_descriptorSet;
+    descriptorWrites[2].dstBinding = 2;
+    descriptorWrites[2].dstArrayElement = 0;
+    descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[2].descriptorCount = 1;
+    descriptorWrites[2].pBufferInfo = &sphereBufferInfo;
+
+    VkDescriptorBufferInfo lightBufferInfo{};
+    lightBufferInfo.buffer = m_lightBuffer;
+    lightBufferInfo.offset = 0;
+    lightBufferInfo.range = sizeof(Light) * m_lightCapacity;
+
+    descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[3].dstSet = m_descriptorSet;
+    descriptorWrites[3].dstBinding = 3;
+    descriptorWrites[3].dstArrayElement = 0;
+    descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[3].descriptorCount = 1;
+    descriptorWrites[3].pBufferInfo = &lightBufferInfo;
+
+    VkDescriptorBufferInfo textureFeedbackBufferInfo{};
+    textureFeedbackBufferInfo.buffer = m_textureFeedbackBuffer;
+    textureFeedbackBufferInfo.offset = 0;
+    textureFeedbackBufferInfo.range = m_textureFeedbackStride;
+
+    descriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[4].dstSet = m_descriptorSet;
+    descriptorWrites[4].dstBinding = 4;
+    descriptorWrites[4].dstArrayElement = 0;
+    descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    descriptorWrites[4].descriptorCount = 1;
+    descriptorWrites[4].pBufferInfo = &textureFeedbackBufferInfo;
+
+    VkDescriptorBufferInfo bvhNodeBufferInfo{};
+    bvhNodeBufferInfo.buffer = m_bvhNodeBuffer;
+    bvhNodeBufferInfo.offset = 0;
+    bvhNodeBufferInfo.range = VK_WHOLE_SIZE;
+
+    descriptorWrites[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[5].dstSet = m_descriptorSet;
+    descriptorWrites[5].dstBinding = 5;
+    descriptorWrites[5].dstArrayElement = 0;
+    descriptorWrites[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[5].descriptorCount = 1;
+    descriptorWrites[5].pBufferInfo = &bvhNodeBufferInfo;
+
+    VkDescriptorBufferInfo bvhPrimitiveBufferInfo{};
+    bvhPrimitiveBufferInfo.buffer = m_bvhPrimitiveBuffer;
+    bvhPrimitiveBufferInfo.offset = 0;
+    bvhPrimitiveBufferInfo.range = VK_WHOLE_SIZE;
+
+    descriptorWrites[6].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[6].dstSet = m_descriptorSet;
+    descriptorWrites[6].dstBinding = 6;
+    descriptorWrites[6].dstArrayElement = 0;
+    descriptorWrites[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[6].descriptorCount = 1;
+    descriptorWrites[6].pBufferInfo = &bvhPrimitiveBufferInfo;
+
+    vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+    // One texture set per frame in flight
+    m_textureDescriptorSets.resize(getFrameResourceCount());
+    std::vector<VkDescriptorSetLayout> layouts(getFrameResourceCount(), m_textureDescriptorSetLayout);
+    VkDescriptorSetAllocateInfo textureAllocInfo{};
+    textureAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    textureAllocInfo.descriptorPool = m_descriptorPool;
+    textureAllocInfo.descriptorSetCount = getFrameResourceCount();
+    textureAllocInfo.pSetLayouts = layouts.data();
+
+    // At least one descriptor, a set without textures keeps the array of the layout valid
+    std::vector<uint32_t> textureCounts(getFrameResourceCount(), std::max(m_textureManager.getTextureCount(), 1u));
+    VkDescriptorSetVariableDescriptorCountAllocateInfo variableCountInfo{};
+    variableCountInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+    variableCountInfo.descriptorSetCount = static_cast<uint32_t>(textureCounts.size());
+    variableCountInfo.pDescriptorCounts = textureCounts.data();
+    textureAllocInfo.pNext = &variableCountInfo;
+
+    if (vkAllocateDescriptorSets(m_device, &textureAllocInfo, m_textureDescriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate texture descriptor sets!");
+    }
 
-        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    std::vector<VkDescriptorImageInfo> textureInfos = m_textureManager.getDescriptorInfos();
+    m_textureDescriptorGenerations.assign(m_textureDescriptorSets.size(), m_textureManager.getGeneration());
+
+    // Partially bound, left unwritten when the scene has no textures
+    for (size_t i = 0; i < m_textureDescriptorSets.size() && !textureInfos.empty(); i++) {
+        VkWriteDescriptorSet textureWrite{};
+        textureWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        textureWrite.dstSet = m_textureDescriptorSets[i];
+        textureWrite.dstBinding = 0;
+        textureWrite.dstArrayElement = 0;
+        textureWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        textureWrite.descriptorCount = static_cast<uint32_t>(textureInfos.size());
+        textureWrite.pImageInfo = textureInfos.data();
+        vkUpdateDescriptorSets(m_device, 1, &textureWrite, 0, nullptr);
     }
 }
 
 void VkRenderer::createDescriptorPool() {
     std::array<VkDescriptorPoolSize, 4> poolSizes{};
 
-    //for camera
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(m_swapchainImages.size());
+    //for the frame uniforms
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[0].descriptorCount = 1;
 
-    //for triangles
+    //for the triangles, spheres, lights, BVH nodes and BVH primitives
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(m_swapchainImages.size());
+    poolSizes[1].descriptorCount = 5;
 
-    //for spheres
-    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    poolSizes[2].descriptorCount = static_cast<uint32_t>(m_swapchainImages.size());
+    //for the texture feedback
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    poolSizes[2].descriptorCount = 1;
 
-    //for lights
-    poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    poolSizes[3].descriptorCount = static_cast<uint32_t>(m_swapchainImages.size());
+    //for textures, as many as the variable count the sets are allocated with
+    poolSizes[3].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[3].descriptorCount = std::max(m_textureManager.getTextureCount(), 1u) * getFrameResourceCount();
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(m_swapchainImages.size());
+    poolInfo.maxSets = 1 + getFrameResourceCount();
     //poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
 
     if (vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptorPool) != VK_SUCCESS) {
@@ -478,6 +1709,270 @@ void VkRenderer::createDescriptorPool() {
     }
 }
 
+void VkRenderer::createDenoiseDescriptorSetLayouts() {
+    // The denoise and accumulation shaders share one layout, each of them only declares the bindings it uses:
+    // 0 color, 1 albedo, 2 normal/depth, 3 previous normal/depth, 4 history color, 5 history moments, 6 input, 7 output,
+    // 8 motion, 9 integrated moments, 10 tiled accumulation
+    std::array<VkDescriptorSetLayoutBinding, 11> bindings{};
+    for (size_t i = 0; i < bindings.size(); ++i) {
+        bindings[i].binding = static_cast<uint32_t>(i);
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_denoiseDescriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create denoise descriptor set layout!");
+    }
+
+    // 0 linear radiance, 1 tone mapped output
+    std::array<VkDescriptorSetLayoutBinding, 2> tonemapBindings{};
+    for (size_t i = 0; i < tonemapBindings.size(); ++i) {
+        tonemapBindings[i].binding = static_cast<uint32_t>(i);
+        tonemapBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        tonemapBindings[i].descriptorCount = 1;
+        tonemapBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        tonemapBindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo tonemapLayoutInfo{};
+    tonemapLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    tonemapLayoutInfo.bindingCount = static_cast<uint32_t>(tonemapBindings.size());
+    tonemapLayoutInfo.pBindings = tonemapBindings.data();
+
+    if (vkCreateDescriptorSetLayout(m_device, &tonemapLayoutInfo, nullptr, &m_tonemapDescriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create tonemap descriptor set layout!");
+    }
+
+    VkDescriptorSetLayoutBinding displayBinding{};
+    displayBinding.binding = 0;
+    displayBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    displayBinding.descriptorCount = 1;
+    displayBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    displayBinding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutCreateInfo presentLayoutInfo{};
+    presentLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    presentLayoutInfo.bindingCount = 1;
+    presentLayoutInfo.pBindings = &displayBinding;
+
+    if (vkCreateDescriptorSetLayout(m_device, &presentLayoutInfo, nullptr, &m_presentDescriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create present descriptor set layout!");
+    }
+}
+
+void VkRenderer::createDenoiseDescriptorSets() {
+    // This pool is not tied to the swapchain, resizing only rewrites the sets with the new image views
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[0].descriptorCount = static_cast<uint32_t>(m_denoiseDescriptorSets.size() * 11 + m_tonemapDescriptorSets.size() * 2);
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = static_cast<uint32_t>(m_presentDescriptorSets.size());
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = static_cast<uint32_t>(m_denoiseDescriptorSets.size() + m_tonemapDescriptorSets.size() + m_presentDescriptorSets.size());
+
+    if (vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_denoiseDescriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create denoise descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> denoiseLayouts(m_denoiseDescriptorSets.size(), m_denoiseDescriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = m_denoiseDescriptorPool;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(denoiseLayouts.size());
+    allocInfo.pSetLayouts = denoiseLayouts.data();
+
+    if (vkAllocateDescriptorSets(m_device, &allocInfo, m_denoiseDescriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate denoise descriptor sets!");
+    }
+
+    std::vector<VkDescriptorSetLayout> tonemapLayouts(m_tonemapDescriptorSets.size(), m_tonemapDescriptorSetLayout);
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(tonemapLayouts.size());
+    allocInfo.pSetLayouts = tonemapLayouts.data();
+
+    if (vkAllocateDescriptorSets(m_device, &allocInfo, m_tonemapDescriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate tonemap descriptor sets!");
+    }
+
+    std::vector<VkDescriptorSetLayout> presentLayouts(m_presentDescriptorSets.size(), m_presentDescriptorSetLayout);
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(presentLayouts.size());
+    allocInfo.pSetLayouts = presentLayouts.data();
+
+    if (vkAllocateDescriptorSets(m_device, &allocInfo, m_presentDescriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate present descriptor sets!");
+    }
+
+    updateDenoiseDescriptorSets();
+}
+
+void VkRenderer::updateDenoiseDescriptorSets() {
+    // Input and output of each a-trous iteration, see m_denoiseDescriptorSets
+    std::array<std::pair<ImageResource*, ImageResource*>, 4> pingPongs = { {
+        { &m_denoisePingPong[0], &m_denoisePingPong[1] },
+        { &m_denoisePingPong[1], &m_denoisePingPong[0] },
+        { &m_denoisePingPong[0], &m_denoiseOutput },
+        { &m_denoisePingPong[1], &m_denoiseOutput }
+    } };
+
+    for (size_t i = 0; i < m_denoiseDescriptorSets.size(); ++i) {
+        std::array<VkImageView, 11> views = {
+            m_traceColor.m_view, m_traceAlbedo.m_view, m_traceNormalDepth.m_view, m_prevNormalDepth.m_view,
+            m_historyColor.m_view, m_historyMoments.m_view, pingPongs[i].first->m_view, pingPongs[i].second->m_view,
+            m_traceMotion.m_view, m_denoiseMoments.m_view, m_accumulation.m_view
+        };
+
+        std::array<VkDescriptorImageInfo, 11> imageInfos{};
+        std::array<VkWriteDescriptorSet, 11> descriptorWrites{};
+        for (size_t binding = 0; binding < views.size(); ++binding) {
+            imageInfos[binding].sampler = VK_NULL_HANDLE;
+            imageInfos[binding].imageView = views[binding];
+            imageInfos[binding].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[binding].dstSet = m_denoiseDescriptorSets[i];
+            descriptorWrites[binding].dstBinding = static_cast<uint32_t>(binding);
+            descriptorWrites[binding].dstArrayElement = 0;
+            descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            descriptorWrites[binding].descriptorCount = 1;
+            descriptorWrites[binding].pImageInfo = &imageInfos[binding];
+        }
+
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+
+    // Headless renderers present nothing, they have no tone mapped target
+    if (m_headless) {
+        return;
+    }
+
+    // Same order as getOutputImage
+    std::array<VkImageView, 3> radianceViews = { m_traceColor.m_view, m_denoiseOutput.m_view, m_accumulation.m_view };
+    for (size_t i = 0; i < m_tonemapDescriptorSets.size(); ++i) {
+        std::array<VkImageView, 2> views = { radianceViews[i], m_tonemapOutput.m_view };
+
+        std::array<VkDescriptorImageInfo, 2> imageInfos{};
+        std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+        for (size_t binding = 0; binding < views.size(); ++binding) {
+            imageInfos[binding].sampler = VK_NULL_HANDLE;
+            imageInfos[binding].imageView = views[binding];
+            imageInfos[binding].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[binding].dstSet = m_tonemapDescriptorSets[i];
+            descriptorWrites[binding].dstBinding = static_cast<uint32_t>(binding);
+            descriptorWrites[binding].dstArrayElement = 0;
+            descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            descriptorWrites[binding].descriptorCount = 1;
+            descriptorWrites[binding].pImageInfo = &imageInfos[binding];
+        }
+
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+
+    std::vector<VkImageView> presentViews = { m_tonemapOutput.m_view };
+#ifdef RAYTRACER_RAY_STATS
+    presentViews.push_back(m_rayStatsHeatmap.m_view);
+#endif
+    for (size_t i = 0; i < m_presentDescriptorSets.size(); ++i) {
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.sampler = m_presentSampler;
+        imageInfo.imageView = presentViews[i];
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = m_presentDescriptorSets[i];
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = &imageInfo;
+
+        vkUpdateDescriptorSets(m_device, 1, &descriptorWrite, 0, nullptr);
+    }
+}
+
+void VkRenderer::createProfiler() {
+    m_traceScope = m_profiler.addScope("Trace");
+    m_denoiseScope = m_profiler.addScope("Denoise");
+    m_tonemapScope = m_profiler.addScope("Tonemap");
+    m_presentScope = m_profiler.addScope("Present");
+    m_uiScope = m_profiler.addScope("UI");
+
+    VkPhysicalDeviceFeatures features;
+    vkGetPhysicalDeviceFeatures(m_physicalDevice, &features);
+
+    m_profiler.init(m_device, m_physicalDevice, m_queueIndices.m_graphicsFamily, m_MAX_FRAMES_IN_FLIGHT, m_gpuTimestamps, features.pipelineStatisticsQuery == VK_TRUE);
+    if (!m_profileCsvPath.empty() && !m_profiler.startCsvExport(m_profileCsvPath)) {
+        throw std::runtime_error("Failed to open the profiling output " + m_profileCsvPath);
+    }
+}
+
+// Must be called once the fence of the current frame has been waited on, so the results are available
+void VkRenderer::readTimestamps() {
+    if (m_profiler.collect(m_currentFrame, m_deltaTime * 1000.0f)) {
+        m_traceGpuTime = m_profiler.getTime(m_traceScope);
+        m_denoiseGpuTime = m_profiler.getTime(m_denoiseScope);
+        m_newTimestamps = true;
+
+        uint32_t tiles = m_tiledState.m_tilesInFlight[m_currentFrame];
+        if (tiles > 0) {
+            float gpuTimePerTile = m_traceGpuTime / static_cast<float>(tiles);
+            m_tiledState.m_gpuTimePerTile = m_tiledState.m_gpuTimePerTile > 0.0f ? glm::mix(m_tiledState.m_gpuTimePerTile, gpuTimePerTile, 0.2f) : gpuTimePerTile;
+        }
+    }
+}
+
+void VkRenderer::updateRenderScale() {
+    RenderScaleSettings& settings = m_renderScaleSettings;
+    float gpuTime = m_traceGpuTime + (m_denoiseSettings.m_enabled ? m_denoiseGpuTime : 0.0f);
+
+    // The tiled mode measures tiles rather than frames, and would restart at every change of scale
+    if (settings.m_dynamic && m_profiler.isAvailable() && !m_tiledSettings.m_enabled) {
+        settings.m_maxScale = std::clamp(settings.m_maxScale, 0.1f, 1.0f);
+        settings.m_minScale = std::clamp(settings.m_minScale, 0.1f, settings.m_maxScale);
+
+        if (m_newTimestamps && gpuTime > 0.0f) {
+            // The cost of both passes grows with the pixel count, so with the square of the scale
+            float idealScale = settings.m_scale * std::sqrt(settings.m_targetFrameTime / gpuTime);
+            // The measurement is a few frames old, only move part of the way to avoid oscillating
+            settings.m_scale = glm::mix(settings.m_scale, idealScale, 0.1f);
+        }
+        settings.m_scale = std::clamp(settings.m_scale, settings.m_minScale, settings.m_maxScale);
+    }
+    else {
+        settings.m_scale = std::clamp(settings.m_scale, 0.1f, 1.0f);
+    }
+
+    m_renderExtent.width = std::clamp(static_cast<uint32_t>(std::lround(m_swapchainExtent.width * settings.m_scale)), 1u, m_swapchainExtent.width);
+    m_renderExtent.height = std::clamp(static_cast<uint32_t>(std::lround(m_swapchainExtent.height * settings.m_scale)), 1u, m_swapchainExtent.height);
+
+    if (!m_newTimestamps) {
+        return;
+    }
+    m_newTimestamps = false;
+
+    m_renderScaleHistory[m_renderScaleHistoryOffset] = settings.m_scale;
+    m_frameTimeHistory[m_renderScaleHistoryOffset] = gpuTime;
+    m_renderScaleHistoryOffset = (m_renderScaleHistoryOffset + 1) % m_RENDER_SCALE_HISTORY_SIZE;
+
+    if (settings.m_log && m_totalTime - m_lastRenderScaleLogTime >= 1.0f) {
+        m_lastRenderScaleLogTime = m_totalTime;
+        std::cout << "Render scale " << settings.m_scale << " (" << m_renderExtent.width << "x" << m_renderExtent.height << "), "
+                  << "trace + denoise " << gpuTime << " ms, target " << settings.m_targetFrameTime << " ms" << std::endl;
+    }
+}
+
 void VkRenderer::createCommandPool() {
     VkCommandPoolCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -487,6 +1982,13 @@ void VkRenderer::createCommandPool() {
     if (vkCreateCommandPool(m_device, &createInfo, nullptr, &m_commandPool) != VK_SUCCESS) {
         throw std::runtime_error("Unable to create command pool!");
     }
+
+    if (m_queueIndices.m_computeFamily != m_queueIndices.m_graphicsFamily) {
+        createInfo.queueFamilyIndex = m_queueIndices.m_computeFamily;
+        if (vkCreateCommandPool(m_device, &createInfo, nullptr, &m_computeCommandPool) != VK_SUCCESS) {
+            throw std::runtime_error("Unable to create compute command pool!");
+        }
+    }
 }
 
 void VkRenderer::createUICommandPool() {
@@ -522,9 +2024,276 @@ void VkRenderer::createFramebuffers() {
 }
 
 void VkRenderer::createGraphicsPipeline() {
+    // The time, the frame index and the viewport size are in the frame uniforms, there are no push constants
+#ifdef RAYTRACER_RAY_STATS
+    std::array<VkDescriptorSetLayout, 3> setLayouts = { m_descriptorSetLayout, m_textureDescriptorSetLayout, m_rayStatsDescriptorSetLayout };
+#else
+    std::array<VkDescriptorSetLayout, 2> setLayouts = { m_descriptorSetLayout, m_textureDescriptorSetLayout };
+#endif
+
+    // Named after the build options by shaders/CMakeLists.txt
+#if defined(RAYTRACER_SPECTRAL) && defined(RAYTRACER_RAY_STATS)
+    const char* traceShader = "frag_spectral_raystats.spv";
+#elif defined(RAYTRACER_SPECTRAL)
+    const char* traceShader = "frag_spectral.spv";
+#elif defined(RAYTRACER_RAY_STATS)
+    const char* traceShader = "frag_raystats.spv";
+#else
+    const char* traceShader = "frag.spv";
+#endif
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+
+    if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    // The tracer writes the radiance, albedo, normal/depth and motion targets
+    m_graphicsPipeline = createFullscreenPipeline(traceShader, m_pipelineLayout, m_traceRenderPass, 4);
+}
+
+uint32_t VkRenderer::requiredTilePasses() const {
+    int samples = m_traceSettings.m_samples;
+    return static_cast<uint32_t>((std::max(m_tiledSettings.m_targetSamples, 1) + samples - 1) / samples);
+}
+
+void VkRenderer::prepareTiledFrame() {
+    TiledRenderState& state = m_tiledState;
+    state.m_frameTiles.clear();
+
+    if (!m_tiledSettings.m_enabled) {
+        state.m_tilesInFlight[m_currentFrame] = 0;
+        return;
+    }
+
+    m_tiledSettings.m_tileSize = std::clamp(m_tiledSettings.m_tileSize, 16, 1024);
+
+    if (state.m_reset || state.m_tileSize != m_tiledSettings.m_tileSize ||
+        state.m_extent.width != m_renderExtent.width || state.m_extent.height != m_renderExtent.height) {
+        state.m_reset = false;
+        state.m_extent = m_renderExtent;
+        state.m_tileSize = m_tiledSettings.m_tileSize;
+        state.m_tilesX = (m_renderExtent.width + state.m_tileSize - 1) / state.m_tileSize;
+        state.m_tilesY = (m_renderExtent.height + state.m_tileSize - 1) / state.m_tileSize;
+        state.m_tilePasses.assign(state.m_tilesX * state.m_tilesY, 0);
+        state.m_tileSelected.assign(state.m_tilePasses.size(), m_tiledSettings.m_selectedTiles.empty());
+        for (uint32_t tile : m_tiledSettings.m_selectedTiles) {
+            if (tile < state.m_tileSelected.size()) {
+                state.m_tileSelected[tile] = true;
+            }
+        }
+        state.m_nextTile = 0;
+        state.m_tilesPerSecond = 0.0f;
+        state.m_startTime = m_totalTime;
+        state.m_elapsedTime = 0.0f;
+    }
+
+    // Until a tile has been measured only one of them is submitted per frame
+    uint32_t tileCount = static_cast<uint32_t>(state.m_tilePasses.size());
+    uint32_t budget = 1;
+    if (state.m_gpuTimePerTile > 0.0f) {
+        budget = static_cast<uint32_t>(std::clamp(m_tiledSettings.m_submissionBudget / state.m_gpuTimePerTile, 1.0f, static_cast<float>(tileCount)));
+    }
+
+    // Tiles are visited in order so every pass refines the whole image before the next one starts. When fewer
+    // tiles are left than the budget allows, as with the few tiles selected by a distributed worker, the same
+    // tile gets several passes in one submission.
+    uint32_t requiredPasses = requiredTilePasses();
+    std::vector<uint32_t> plannedPasses = state.m_tilePasses;
+    uint64_t remainingPasses = 0;
+    for (uint32_t tile = 0; tile < tileCount; ++tile) {
+        if (state.m_tileSelected[tile]) {
+            remainingPasses += requiredPasses - std::min(plannedPasses[tile], requiredPasses);
+        }
+    }
+    while (remainingPasses > 0 && state.m_frameTiles.size() < budget) {
+        uint32_t tile = state.m_nextTile;
+        state.m_nextTile = (state.m_nextTile + 1) % tileCount;
+        if (state.m_tileSelected[tile] && plannedPasses[tile] < requiredPasses) {
+            state.m_frameTiles.push_back(tile);
+            ++plannedPasses[tile];
+            --remainingPasses;
+        }
+    }
+
+    state.m_tilesInFlight[m_currentFrame] = static_cast<uint32_t>(state.m_frameTiles.size());
+
+    if (!state.m_frameTiles.empty()) {
+        state.m_elapsedTime = m_totalTime - state.m_startTime;
+        if (m_deltaTime > 0.0f) {
+            float tilesPerSecond = static_cast<float>(state.m_frameTiles.size()) / m_deltaTime;
+            state.m_tilesPerSecond = state.m_tilesPerSecond > 0.0f ? glm::mix(state.m_tilesPerSecond, tilesPerSecond, 0.05f) : tilesPerSecond;
+        }
+    }
+}
+
+void VkRenderer::drawTiledProgress() {
+    TiledRenderState& state = m_tiledState;
+    if (state.m_tilePasses.empty()) {
+        return;
+    }
+
+    uint32_t requiredPasses = requiredTilePasses();
+    uint64_t donePasses = 0;
+    for (uint32_t passes : state.m_tilePasses) {
+        donePasses += std::min(passes, requiredPasses);
+    }
+    uint64_t totalPasses = static_cast<uint64_t>(requiredPasses) * state.m_tilePasses.size();
+    float progress = totalPasses > 0 ? static_cast<float>(donePasses) / static_cast<float>(totalPasses) : 1.0f;
+
+    ImGui::ProgressBar(progress);
+    ImGui::Text("Tile passes: %llu / %llu (%d spp each)", static_cast<unsigned long long>(donePasses), static_cast<unsigned long long>(totalPasses), m_traceSettings.m_samples);
+    ImGui::Text("Tiles per submission: %zu", state.m_frameTiles.size());
+    if (state.m_gpuTimePerTile > 0.0f) {
+        ImGui::Text("GPU time per tile: %.3f ms", state.m_gpuTimePerTile);
+    }
+
+    if (donePasses == totalPasses) {
+        ImGui::Text("Done in %.1f s", state.m_elapsedTime);
+    }
+    else if (state.m_tilesPerSecond > 0.0f) {
+        float eta = static_cast<float>(totalPasses - donePasses) / state.m_tilesPerSecond;
+        ImGui::Text("Elapsed: %.1f s, ETA: %.1f s", state.m_elapsedTime, eta);
+    }
+
+    // One cell per tile, filled with its progress, the tiles of the current submission are outlined
+    const float gridWidth = std::max(ImGui::GetContentRegionAvail().x, 64.0f);
+    const float cellSize = gridWidth / static_cast<float>(state.m_tilesX);
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+
+    for (uint32_t tile = 0; tile < state.m_tilePasses.size(); ++tile) {
+        ImVec2 min(origin.x + (tile % state.m_tilesX) * cellSize, origin.y + (tile / state.m_tilesX) * cellSize);
+        ImVec2 max(min.x + cellSize - 1.0f, min.y + cellSize - 1.0f);
+        float tileProgress = static_cast<float>(std::min(state.m_tilePasses[tile], requiredPasses)) / static_cast<float>(requiredPasses);
+
+        drawList->AddRectFilled(min, max, IM_COL32(60, 60, 60, 255));
+        drawList->AddRectFilled(ImVec2(min.x, max.y - (max.y - min.y) * tileProgress), max, IM_COL32(70, 170, 90, 255));
+    }
+    for (uint32_t tile : state.m_frameTiles) {
+        ImVec2 min(origin.x + (tile % state.m_tilesX) * cellSize, origin.y + (tile / state.m_tilesX) * cellSize);
+        drawList->AddRect(min, ImVec2(min.x + cellSize - 1.0f, min.y + cellSize - 1.0f), IM_COL32(240, 200, 60, 255));
+    }
+
+    ImGui::Dummy(ImVec2(gridWidth, cellSize * state.m_tilesY));
+}
+
+void VkRenderer::createPresentPipeline() {
+    //create push constants for the region of the radiance image to upscale
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PresentPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_presentDescriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_presentPipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create present pipeline layout!");
+    }
+
+    m_presentPipeline = createFullscreenPipeline("present_frag.spv", m_presentPipelineLayout, m_renderPass, 1);
+}
+
+void VkRenderer::createDenoisePipelines() {
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DenoisePushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_denoiseDescriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_denoisePipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create denoise pipeline layout!");
+    }
+
+    m_denoiseTemporalPipeline = createComputePipeline("denoise_temporal_comp.spv", m_denoisePipelineLayout);
+    m_denoiseAtrousPipeline = createComputePipeline("denoise_atrous_comp.spv", m_denoisePipelineLayout);
+}
+
+void VkRenderer::createAccumulatePipeline() {
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(AccumulatePushConstants);
+
+    // Reads the trace color and writes the accumulation through the storage images of the denoiser
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_denoiseDescriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_accumulatePipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create accumulate pipeline layout!");
+    }
+
+    m_accumulatePipeline = createComputePipeline("accumulate_comp.spv", m_accumulatePipelineLayout);
+}
+
+void VkRenderer::createTonemapPipeline() {
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(TonemapPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_tonemapDescriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_tonemapPipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create tonemap pipeline layout!");
+    }
+
+    m_tonemapPipeline = createComputePipeline("tonemap_comp.spv", m_tonemapPipelineLayout);
+}
+
+VkPipeline VkRenderer::createComputePipeline(const std::string& shaderFile, VkPipelineLayout pipelineLayout) {
+    auto shaderCode = Config::readFile(std::string(SHADER_DIR) + "/build/" + shaderFile);
+    VkShaderModule shaderModule = createShaderModule(shaderCode);
+
+    VkPipelineShaderStageCreateInfo stageInfo{};
+    stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    stageInfo.module = shaderModule;
+    stageInfo.pName = "main";
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = stageInfo;
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+    VkPipeline pipeline;
+    if (vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline " + shaderFile + "!");
+    }
+
+    vkDestroyShaderModule(m_device, shaderModule, m_allocator);
+
+    return pipeline;
+}
+
+VkPipeline VkRenderer::createFullscreenPipeline(const std::string& fragShaderFile, VkPipelineLayout pipelineLayout, VkRenderPass renderPass, uint32_t colorAttachmentCount) {
     // Load our shader modules in from disk
     auto vertShaderCode = Config::readFile(std::string(SHADER_DIR) + "/build/vert.spv");
-    auto fragShaderCode = Config::readFile(std::string(SHADER_DIR) + "/build/frag.spv");
+    auto fragShaderCode = Config::readFile(std::string(SHADER_DIR) + "/build/" + fragShaderFile);
 
     VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
     VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
@@ -591,42 +2360,28 @@ void VkRenderer::createGraphicsPipeline() {
     colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
     colorBlendAttachment.blendEnable = VK_FALSE;
 
+    // Every color attachment of the render pass needs its own blend state
+    std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments(colorAttachmentCount, colorBlendAttachment);
+
     VkPipelineColorBlendStateCreateInfo colorBlending{};
     colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
     colorBlending.logicOpEnable = VK_FALSE;
     colorBlending.logicOp = VK_LOGIC_OP_COPY;
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachment;
+    colorBlending.attachmentCount = colorAttachmentCount;
+    colorBlending.pAttachments = colorBlendAttachments.data();
     colorBlending.blendConstants[0] = 0.0f;
     colorBlending.blendConstants[1] = 0.0f;
     colorBlending.blendConstants[2] = 0.0f;
     colorBlending.blendConstants[3] = 0.0f;
 
-    std::vector<VkDynamicState> dynamicStates = {
-        VK_DYNAMIC_STATE_VIEWPORT,
-        VK_DYNAMIC_STATE_SCISSOR
-    };
-    VkPipelineDynamicStateCreateInfo dynamicState{};
-    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-    dynamicState.pDynamicStates = dynamicStates.data();
-
-    //create push constants for uTime
-    VkPushConstantRange pushConstantRange = {};
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-    pushConstantRange.offset = 0;
-    pushConstantRange.size = sizeof(float);
-
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-
-    if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create pipeline layout!");
-    }
+    std::vector<VkDynamicState> dynamicStates = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
 
     VkGraphicsPipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -640,17 +2395,20 @@ void VkRenderer::createGraphicsPipeline() {
     pipelineInfo.pDepthStencilState = &depthStencil;
     pipelineInfo.pColorBlendState = &colorBlending;
     pipelineInfo.pDynamicState = &dynamicState;
-    pipelineInfo.layout = m_pipelineLayout;
-    pipelineInfo.renderPass = m_renderPass;
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.renderPass = renderPass;
     pipelineInfo.subpass = 0;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_graphicsPipeline) != VK_SUCCESS) {
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline!");
     }
 
     vkDestroyShaderModule(m_device, fragShaderModule, m_allocator);
     vkDestroyShaderModule(m_device, vertShaderModule, m_allocator);
+
+    return pipeline;
 }
 
 void VkRenderer::createImageViews() {
@@ -721,43 +2479,10 @@ void VkRenderer::createInstance() {
 }
 
 void VkRenderer::createLogicalDevice() {
-    uint32_t queueFamilyCount = 0;
-    vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, nullptr);
-    if (queueFamilyCount == 0) {
-        throw std::runtime_error("Failed to retrieve queue families.");
-    }
-
-    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-    vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, queueFamilies.data());
-
-    int graphicsFamilyIndex = -1;
-    int presentFamilyIndex = -1;
+    getDeviceQueueIndices();
 
-    for (uint32_t i = 0; i < queueFamilyCount; i++) {
-        // V�rifier le support des op�rations graphiques
-        if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-            graphicsFamilyIndex = i;
-        }
-
-        VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(m_physicalDevice, i, m_surface, &presentSupport);
-        if (presentSupport) {
-            presentFamilyIndex = i;
-        }
-
-        if (graphicsFamilyIndex != -1 && presentFamilyIndex != -1) {
-            break;
-        }
-    }
-
-    if (graphicsFamilyIndex == -1 || presentFamilyIndex == -1) {
-        throw std::runtime_error("Unable to find the required queue families !");
-    }
-
-    m_queueIndices.m_graphicsFamily = graphicsFamilyIndex;
-    m_queueIndices.m_presentFamily = presentFamilyIndex;
-
-    std::set<uint32_t> uniqueQueueIndices = { m_queueIndices.m_graphicsFamily, m_queueIndices.m_presentFamily };
+    std::set<uint32_t> uniqueQueueIndices = { m_queueIndices.m_graphicsFamily, m_queueIndices.m_presentFamily, m_queueIndices.m_computeFamily,
+        m_queueIndices.m_transferFamily };
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     const float priority = 1.0f;
     for (uint32_t queueIndex : uniqueQueueIndices) {
@@ -773,13 +2498,57 @@ void VkRenderer::createLogicalDevice() {
     deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     deviceInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     deviceInfo.pQueueCreateInfos = queueCreateInfos.data();
-    deviceInfo.enabledExtensionCount = static_cast<uint32_t>(m_deviceExtensions.size());
-    deviceInfo.ppEnabledExtensionNames = m_deviceExtensions.data();
+    // The swapchain extension is the only one required, headless rendering does without it
+    deviceInfo.enabledExtensionCount = m_headless ? 0 : static_cast<uint32_t>(m_deviceExtensions.size());
+    deviceInfo.ppEnabledExtensionNames = m_headless ? nullptr : m_deviceExtensions.data();
+
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(m_physicalDevice, &supportedFeatures);
 
     VkPhysicalDeviceFeatures physicalDeviceFeatures = {};
     physicalDeviceFeatures.fragmentStoresAndAtomics = VK_TRUE;
+    // Optional, only used by the profiler
+    physicalDeviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+    // Optional, only used by the texture sampler
+    physicalDeviceFeatures.samplerAnisotropy = supportedFeatures.samplerAnisotropy;
+    m_samplerAnisotropy = supportedFeatures.samplerAnisotropy == VK_TRUE;
+    // Optional, only used by the texture streaming
+    physicalDeviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+    m_textureCompressionBC = supportedFeatures.textureCompressionBC == VK_TRUE;
     deviceInfo.pEnabledFeatures = &physicalDeviceFeatures;
 
+    // The textures are sampled through one array indexed by the materials, descriptor indexing is core in Vulkan 1.2
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+    if (deviceProperties.apiVersion < VK_API_VERSION_1_2) {
+        throw std::runtime_error("The device does not support Vulkan 1.2!");
+    }
+
+    VkPhysicalDeviceVulkan12Features supportedVulkan12Features{};
+    supportedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 supportedFeatures2{};
+    supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedFeatures2.pNext = &supportedVulkan12Features;
+    vkGetPhysicalDeviceFeatures2(m_physicalDevice, &supportedFeatures2);
+
+    if (!supportedVulkan12Features.runtimeDescriptorArray || !supportedVulkan12Features.shaderSampledImageArrayNonUniformIndexing ||
+        !supportedVulkan12Features.descriptorBindingPartiallyBound || !supportedVulkan12Features.descriptorBindingVariableDescriptorCount) {
+        throw std::runtime_error("The device does not support descriptor indexing of sampled images!");
+    }
+    // The uploads of the transfer queue and the async compute passes are waited on by their submission number
+    if (!supportedVulkan12Features.timelineSemaphore) {
+        throw std::runtime_error("The device does not support timeline semaphores!");
+    }
+
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+    vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+    vulkan12Features.descriptorBindingVariableDescriptorCount = VK_TRUE;
+    vulkan12Features.timelineSemaphore = VK_TRUE;
+    deviceInfo.pNext = &vulkan12Features;
+
     if (m_enableValidationLayers) {
         deviceInfo.enabledLayerCount = static_cast<uint32_t>(m_validationLayers.size());
         deviceInfo.ppEnabledLayerNames = m_validationLayers.data();
@@ -794,6 +2563,8 @@ void VkRenderer::createLogicalDevice() {
 
     vkGetDeviceQueue(m_device, m_queueIndices.m_graphicsFamily, 0, &m_graphicsQueue);
     vkGetDeviceQueue(m_device, m_queueIndices.m_presentFamily, 0, &m_presentQueue);
+    vkGetDeviceQueue(m_device, m_queueIndices.m_computeFamily, 0, &m_computeQueue);
+    vkGetDeviceQueue(m_device, m_queueIndices.m_transferFamily, 0, &m_transferQueue);
 }
 
 void VkRenderer::createRenderPass() {
@@ -838,6 +2609,62 @@ void VkRenderer::createRenderPass() {
     }
 }
 
+void VkRenderer::createTraceRenderPass() {
+    // Radiance, albedo, normal/depth and motion, in the order of the fragment shader outputs
+    std::array<VkFormat, 4> formats = { VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+
+    std::array<VkAttachmentDescription, 4> attachments{};
+    std::array<VkAttachmentReference, 4> attachmentRefs{};
+    for (size_t i = 0; i < attachments.size(); ++i) {
+        attachments[i].format = formats[i];
+        attachments[i].samples = VK_SAMPLE_COUNT_1_BIT;
+        attachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE; // Every pixel is traced again
+        attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        attachments[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachments[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachments[i].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        attachments[i].finalLayout = VK_IMAGE_LAYOUT_GENERAL; // Read as storage images by the denoiser
+
+        attachmentRefs[i].attachment = static_cast<uint32_t>(i);
+        attachmentRefs[i].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    }
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = static_cast<uint32_t>(attachmentRefs.size());
+    subpass.pColorAttachments = attachmentRefs.data();
+
+    // The targets of the previous frame must have been consumed before they are overwritten,
+    // and the denoiser or the present pass can only read them once the trace is done
+    std::array<VkSubpassDependency, 2> dependencies{};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[0].srcAccessMask = 0;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderPassInfo.pAttachments = attachments.data();
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
+
+    if (vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &m_traceRenderPass) != VK_SUCCESS) {
+        throw std::runtime_error("Could not create trace render pass!");
+    }
+}
+
 VkShaderModule VkRenderer::createShaderModule(const std::vector<char>& shaderCode) {
     VkShaderModuleCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -852,74 +2679,69 @@ VkShaderModule VkRenderer::createShaderModule(const std::vector<char>& shaderCod
     return shaderModule;
 }
 
-void VkRenderer::updateUniformBuffer(uint32_t currentImage, float deltaTime) {
-    Camera::UniformBufferObject ubo;
+void VkRenderer::updateUniformBuffer(uint32_t frame, float deltaTime) {
+    FrameUniforms uniforms{};
     //ubo.m_model = glm::rotate(glm::mat4(1.0f), deltaTime * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
     m_camera.m_cameraUBO.m_aspectRatio = static_cast<float>(m_swapchainExtent.width)/static_cast<float>(m_swapchainExtent.height);
-    m_camera.updateCameraUBO(ubo, deltaTime);
+    m_camera.updateCameraUBO(uniforms.m_camera, deltaTime);
+    const Camera::UniformBufferObject& ubo = uniforms.m_camera;
 
-    memcpy(m_uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
-}
+    // The trace pass reprojects its primary hits with the camera of the previous frame
+    if (m_frameIndex == 0) {
+        m_previousCameraUBO = ubo;
+    }
 
-void VkRenderer::createUniformBuffers() {
-    VkDeviceSize bufferSize = sizeof(Camera::UniformBufferObject);
+    // The tiled accumulation has no reprojection, it restarts whenever the camera moves
+    if (ubo.m_position != m_previousCameraUBO.m_position || ubo.m_front != m_previousCameraUBO.m_front ||
+        ubo.m_fov != m_previousCameraUBO.m_fov || ubo.m_aspectRatio != m_previousCameraUBO.m_aspectRatio) {
+        m_tiledState.m_reset = true;
+    }
 
-    size_t imageCount = m_swapchainImages.size();
+    uniforms.m_previousCamera = m_previousCameraUBO;
+    uniforms.m_time = m_deltaTime;
+    uniforms.m_frameIndex = m_frameIndex;
+    uniforms.m_viewportSize = glm::vec2(static_cast<float>(m_renderExtent.width), static_cast<float>(m_renderExtent.height));
+    uniforms.m_lightCount = m_sceneResident ? static_cast<uint32_t>(m_lights.size()) : 0;
+    uniforms.m_samples = static_cast<uint32_t>(m_traceSettings.m_samples);
+    uniforms.m_bounces = static_cast<uint32_t>(m_traceSettings.m_bounces);
+    uniforms.m_residentTriangles = m_residentTriangles;
+    uniforms.m_sceneResident = m_sceneResident ? 1 : 0;
+    uniforms.m_residentTextures = m_residentTextures;
+
+    // The fence of this frame in flight was waited on, nothing reads its slice anymore. The memory is host
+    // coherent, the write needs no flush.
+    memcpy(static_cast<char*>(m_frameUniformBufferMapped) + frame * m_frameUniformStride, &uniforms, sizeof(uniforms));
+
+    m_previousCameraUBO = ubo;
+}
 
-    m_uniformBuffers.resize(imageCount);
-    m_uniformBuffersMemory.resize(imageCount);
-    m_uniformBuffersMapped.resize(imageCount);
+void VkRenderer::createUniformBuffers() {
+    // The slices are bound through a dynamic offset, which has to respect the device alignment
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+    VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+    m_frameUniformStride = (sizeof(FrameUniforms) + alignment - 1) & ~(alignment - 1);
 
-    for (size_t i = 0; i < imageCount; i++) {
-        createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_uniformBuffers[i], m_uniformBuffersMemory[i]);
+    VkDeviceSize bufferSize = m_frameUniformStride * getFrameResourceCount();
+    createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_frameUniformBuffer, m_frameUniformBufferMemory);
 
-        vkMapMemory(m_device, m_uniformBuffersMemory[i], 0, bufferSize, 0, &m_uniformBuffersMapped[i]);
-    }
+    // Mapped for the lifetime of the renderer
+    vkMapMemory(m_device, m_frameUniformBufferMemory, 0, bufferSize, 0, &m_frameUniformBufferMapped);
 }
 
 void VkRenderer::createVertexBuffer(const std::vector<Vertex2D>& vertices) {
     VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
 
-    // Create a temporary memory buffer accessible by the CPU
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-    // Copy vertex data to the temporary buffer
-    void* data;
-    vkMapMemory(m_device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, vertices.data(), (size_t)bufferSize);
-    vkUnmapMemory(m_device, stagingBufferMemory);
-
-    // Create vertex buffer in GPU memory
+    // Create vertex buffer in GPU memory, filled by the transfer queue
     createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_vertexBuffer, m_vertexBufferMemory);
-
-    // Copy data from the temporary buffer to the vertex buffer on the GPU
-    copyBuffer(stagingBuffer, m_vertexBuffer, bufferSize);
-
-    // Clean temporary buffer
-    vkDestroyBuffer(m_device, stagingBuffer, nullptr);
-    vkFreeMemory(m_device, stagingBufferMemory, nullptr);
+    uploadBuffer(m_vertexBuffer, 0, vertices.data(), bufferSize);
 }
 
 void VkRenderer::createIndexBuffer(const std::vector<uint32_t>& indices) {
     VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-    void* data;
-    vkMapMemory(m_device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, indices.data(), (size_t)bufferSize);
-    vkUnmapMemory(m_device, stagingBufferMemory);
-
     createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_indexBuffer, m_indexBufferMemory);
-
-    copyBuffer(stagingBuffer, m_indexBuffer, bufferSize);
-
-    vkDestroyBuffer(m_device, stagingBuffer, nullptr);
-    vkFreeMemory(m_device, stagingBufferMemory, nullptr);
+    uploadBuffer(m_indexBuffer, 0, indices.data(), bufferSize);
 }
 
 void VkRenderer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
@@ -946,16 +2768,509 @@ void VkRenderer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMem
     }
 
     vkBindBufferMemory(m_device, buffer, bufferMemory, 0);
+
+    trackDeviceMemory(memRequirements.size, 0);
+}
+
+void VkRenderer::destroyBuffer(VkBuffer buffer, VkDeviceMemory bufferMemory) {
+    // Destroyed before its uploads were acquired, the transfer queue may still be writing it
+    auto pending = [buffer](const PendingAcquire& upload) { return upload.m_buffer == buffer; };
+    if (std::any_of(m_pendingAcquires.begin(), m_pendingAcquires.end(), pending)) {
+        m_uploadRing.finish();
+        std::erase_if(m_pendingAcquires, pending);
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(m_device, buffer, &memRequirements);
+    trackDeviceMemory(0, memRequirements.size);
+
+    vkDestroyBuffer(m_device, buffer, m_allocator);
+    vkFreeMemory(m_device, bufferMemory, m_allocator);
+}
+
+void VkRenderer::trackDeviceMemory(VkDeviceSize allocated, VkDeviceSize freed) {
+    m_deviceMemoryInUse += allocated;
+    m_deviceMemoryInUse -= std::min(freed, m_deviceMemoryInUse);
+    m_peakDeviceMemory = std::max(m_peakDeviceMemory, m_deviceMemoryInUse);
+}
+
+void VkRenderer::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, ImageResource& image, bool captureSource) {
+    createImageHandle(width, height, format, usage, image, captureSource);
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(m_device, image.m_image, &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+
+    if (vkAllocateMemory(m_device, &allocInfo, nullptr, &image.m_memory) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate image memory!");
+    }
+
+    vkBindImageMemory(m_device, image.m_image, image.m_memory, 0);
+    image.m_size = memRequirements.size;
+    trackDeviceMemory(image.m_size, 0);
+
+    createImageView(image);
+}
+
+void VkRenderer::createImageHandle(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, ImageResource& image, bool captureSource) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = width;
+    imageInfo.extent.height = height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = usage;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    // Concurrent sharing spares the ownership transfers of every captured frame
+    std::array<uint32_t, 2> queueFamilies = { m_queueIndices.m_graphicsFamily, m_queueIndices.m_transferFamily };
+    if (captureSource && queueFamilies[0] != queueFamilies[1]) {
+        imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+        imageInfo.pQueueFamilyIndices = queueFamilies.data();
+    }
+
+    if (vkCreateImage(m_device, &imageInfo, nullptr, &image.m_image) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create image!");
+    }
+
+    image.m_format = format;
+}
+
+void VkRenderer::createImageView(ImageResource& image) {
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image.m_image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = image.m_format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(m_device, &viewInfo, nullptr, &image.m_view) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create image view!");
+    }
 }
 
-void VkRenderer::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+void VkRenderer::destroyImage(ImageResource& image) {
+    vkDestroyImageView(m_device, image.m_view, m_allocator);
+    vkDestroyImage(m_device, image.m_image, m_allocator);
+    vkFreeMemory(m_device, image.m_memory, m_allocator);
+    trackDeviceMemory(0, image.m_size);
+    image = ImageResource{};
+}
+
+void VkRenderer::createRenderTargets() {
+    uint32_t width = m_swapchainExtent.width;
+    uint32_t height = m_swapchainExtent.height;
+
+    VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    VkImageUsageFlags storageUsage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+    createImage(width, height, VK_FORMAT_R32G32B32A32_SFLOAT, attachmentUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_traceColor, true);
+
+    createImage(width, height, VK_FORMAT_R32G32B32A32_SFLOAT, storageUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_prevNormalDepth);
+    createImage(width, height, VK_FORMAT_R32G32B32A32_SFLOAT, storageUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_historyColor);
+    createImage(width, height, VK_FORMAT_R32G32B32A32_SFLOAT, storageUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_historyMoments);
+    createImage(width, height, VK_FORMAT_R32G32B32A32_SFLOAT, storageUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_denoiseOutput, true);
+    createImage(width, height, VK_FORMAT_R32G32B32A32_SFLOAT, storageUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_accumulation, true);
+#ifdef RAYTRACER_RAY_STATS
+    createImage(width, height, VK_FORMAT_R32G32B32A32_UINT, storageUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_rayCounts);
+    createImage(width, height, VK_FORMAT_R32_UINT, storageUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_rayNodeVisits);
+    createImage(width, height, VK_FORMAT_R32G32B32A32_SFLOAT, storageUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_rayStatsHeatmap);
+#endif
+
+    createTransientTargets();
+
+    // Every other target lives in the general layout so the passes never have to transition them, the storage
+    // images are cleared so the first frames do not blend uninitialized history
+    std::vector<ImageResource*> images = {
+        &m_traceColor, &m_prevNormalDepth, &m_historyColor, &m_historyMoments, &m_denoiseOutput, &m_accumulation
+    };
+#ifdef RAYTRACER_RAY_STATS
+    images.push_back(&m_rayCounts);
+    images.push_back(&m_rayNodeVisits);
+    images.push_back(&m_rayStatsHeatmap);
+#endif
+
+    std::vector<VkImageMemoryBarrier> barriers;
+    for (ImageResource* image : images) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image->m_image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers.push_back(barrier);
+    }
+
     VkCommandBuffer commandBuffer = beginSingleTimeCommands(m_commandPool);
 
-    VkBufferCopy copyRegion{};
-    copyRegion.size = size;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        static_cast<uint32_t>(barriers.size()), barriers.data()
+    );
+
+    VkClearColorValue clearValue = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+    VkImageSubresourceRange range{};
+    range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    range.baseMipLevel = 0;
+    range.levelCount = 1;
+    range.baseArrayLayer = 0;
+    range.layerCount = 1;
+    for (size_t i = 1; i < images.size(); ++i) {
+        vkCmdClearColorImage(commandBuffer, images[i]->m_image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &range);
+    }
 
     endSingleTimeCommands(commandBuffer, m_commandPool);
+
+    m_sceneResource = m_renderGraph.importBuffer("scene buffers");
+    m_swapchainResource = m_renderGraph.importImage("swapchain", VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED);
+#ifdef RAYTRACER_RAY_STATS
+    m_rayStatsResource = m_renderGraph.importBuffer("ray stats");
+#endif
+
+    m_resetHistory = true;
+    m_tiledState.m_reset = true;
+}
+
+void VkRenderer::createTransientTargets() {
+    uint32_t width = m_swapchainExtent.width;
+    uint32_t height = m_swapchainExtent.height;
+
+    VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    VkImageUsageFlags storageUsage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+    createImageHandle(width, height, VK_FORMAT_R16G16B16A16_SFLOAT, attachmentUsage, m_traceAlbedo);
+    createImageHandle(width, height, VK_FORMAT_R32G32B32A32_SFLOAT, attachmentUsage, m_traceNormalDepth);
+    createImageHandle(width, height, VK_FORMAT_R32G32B32A32_SFLOAT, attachmentUsage, m_traceMotion);
+    createImageHandle(width, height, VK_FORMAT_R32G32B32A32_SFLOAT, storageUsage, m_denoiseMoments);
+    for (ImageResource& pingPong : m_denoisePingPong) {
+        createImageHandle(width, height, VK_FORMAT_R32G32B32A32_SFLOAT, storageUsage, pingPong);
+    }
+    std::vector<ImageResource*> transients = {
+        &m_traceAlbedo, &m_traceNormalDepth, &m_traceMotion, &m_denoiseMoments, &m_denoisePingPong[0], &m_denoisePingPong[1]
+    };
+    // Holds values in [0, 1] once tone mapped, half floats keep more precision than the swapchain at half the
+    // memory and bandwidth of the radiance targets
+    if (!m_headless) {
+        createImageHandle(width, height, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, m_tonemapOutput);
+        transients.push_back(&m_tonemapOutput);
+    }
+
+    // The graph groups the transient targets by the lifetimes of the frames recorded so far
+    importRenderGraphResources();
+
+    for (const RenderGraph::AliasSlot& slot : m_renderGraph.aliasTransientImages(m_aliasTransientTargets)) {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = slot.m_size;
+        allocInfo.memoryTypeIndex = findMemoryType(slot.m_memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        VkDeviceMemory memory;
+        if (vkAllocateMemory(m_device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate transient target memory!");
+        }
+        m_transientMemory.push_back(memory);
+        m_transientMemorySize += slot.m_size;
+        trackDeviceMemory(slot.m_size, 0);
+
+        for (ImageResource* image : transients) {
+            if (std::find(slot.m_resources.begin(), slot.m_resources.end(), image->m_graphResource) != slot.m_resources.end()) {
+                vkBindImageMemory(m_device, image->m_image, memory, 0);
+                createImageView(*image);
+            }
+        }
+    }
+
+    std::array<VkImageView, 4> attachments = { m_traceColor.m_view, m_traceAlbedo.m_view, m_traceNormalDepth.m_view, m_traceMotion.m_view };
+
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = m_traceRenderPass;
+    framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    framebufferInfo.pAttachments = attachments.data();
+    framebufferInfo.width = width;
+    framebufferInfo.height = height;
+    framebufferInfo.layers = 1;
+
+    if (vkCreateFramebuffer(m_device, &framebufferInfo, nullptr, &m_traceFramebuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create trace framebuffer!");
+    }
+}
+
+void VkRenderer::cleanupTransientTargets() {
+    vkDestroyFramebuffer(m_device, m_traceFramebuffer, m_allocator);
+
+    destroyImage(m_traceAlbedo);
+    destroyImage(m_traceNormalDepth);
+    destroyImage(m_traceMotion);
+    destroyImage(m_denoiseMoments);
+    for (ImageResource& pingPong : m_denoisePingPong) {
+        destroyImage(pingPong);
+    }
+    destroyImage(m_tonemapOutput);
+
+    for (VkDeviceMemory memory : m_transientMemory) {
+        vkFreeMemory(m_device, memory, m_allocator);
+    }
+    m_transientMemory.clear();
+    trackDeviceMemory(0, m_transientMemorySize);
+    m_transientMemorySize = 0;
+}
+
+void VkRenderer::realiasTransientTargets() {
+    // The frames in flight may still use the targets, the one being recorded has not been submitted yet
+    vkWaitForFences(m_device, static_cast<uint32_t>(m_inFlightFences.size()), m_inFlightFences.data(), VK_TRUE, UINT64_MAX);
+    waitAsyncCompute(m_renderGraph.getTimelineValue());
+
+    cleanupTransientTargets();
+    createTransientTargets();
+    updateDenoiseDescriptorSets();
+}
+
+void VkRenderer::importRenderGraphResources() {
+    // Only the targets written and read within a frame are transient, the others are read by the next frame,
+    // the tone mapping and present passes or the captures. The ray counts of the tiles not traced by a frame are
+    // kept for the heat map.
+    struct Target {
+        const char* m_name;
+        ImageResource* m_image;
+        bool m_transient;
+    };
+    std::vector<Target> targets = {
+        { "trace color", &m_traceColor, false },
+        { "trace albedo", &m_traceAlbedo, true },
+        { "trace normal depth", &m_traceNormalDepth, true },
+        { "trace motion", &m_traceMotion, true },
+        { "previous normal depth", &m_prevNormalDepth, false },
+        { "history color", &m_historyColor, false },
+        { "history moments", &m_historyMoments, false },
+        { "denoise moments", &m_denoiseMoments, true },
+        { "denoise ping", &m_denoisePingPong[0], true },
+        { "denoise pong", &m_denoisePingPong[1], true },
+        { "denoise output", &m_denoiseOutput, false },
+        { "accumulation", &m_accumulation, false }
+    };
+    if (!m_headless) {
+        targets.push_back({ "tone mapped", &m_tonemapOutput, true });
+    }
+#ifdef RAYTRACER_RAY_STATS
+    targets.push_back({ "ray counts", &m_rayCounts, false });
+    targets.push_back({ "ray node visits", &m_rayNodeVisits, false });
+    targets.push_back({ "ray stats heat map", &m_rayStatsHeatmap, false });
+#endif
+
+    // The other targets are transitioned and cleared before the first frame, the transient ones are transitioned
+    // by the first pass using them
+    for (const Target& target : targets) {
+        VkMemoryRequirements memory;
+        vkGetImageMemoryRequirements(m_device, target.m_image->m_image, &memory);
+        target.m_image->m_graphResource = m_renderGraph.importImage(target.m_name, target.m_image->m_image,
+            target.m_transient ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_GENERAL, memory, target.m_transient);
+    }
+}
+
+void VkRenderer::drawRenderGraphUI() {
+    if (!ImGui::CollapsingHeader("Render graph")) {
+        return;
+    }
+
+    // Of the last frame recorded
+    const RenderGraph::Statistics& statistics = m_renderGraph.getStatistics();
+    ImGui::Text("Passes: %u", statistics.m_passes);
+    ImGui::Text("Barriers: %u memory, %u image", statistics.m_memoryBarriers, statistics.m_imageBarriers);
+    // Applied to the next frame, which creates the transient targets again
+    ImGui::Checkbox("Alias transient targets", &m_aliasTransientTargets);
+    ImGui::Text("Transient targets: %.1f MB, %.1f MB unaliased, %.1f MB used at once", statistics.m_aliasedMemory / (1024.0 * 1024.0),
+        statistics.m_transientMemory / (1024.0 * 1024.0), statistics.m_peakTransientMemory / (1024.0 * 1024.0));
+    if (m_computeCommandPool != VK_NULL_HANDLE) {
+        ImGui::Text("Async compute passes: %u, %u images released to the other queue", statistics.m_asyncPasses, statistics.m_queueTransfers);
+    }
+    else {
+        ImGui::TextUnformatted("Async compute passes: none, no compute queue of its own");
+    }
+    if (ImGui::Button("Print schedule")) {
+        std::cout << m_renderGraph.dump() << std::flush;
+    }
+    if (ImGui::TreeNode("Schedule")) {
+        ImGui::TextUnformatted(m_renderGraph.dump().c_str());
+        ImGui::TreePop();
+    }
+}
+
+void VkRenderer::cleanupRenderTargets() {
+    cleanupTransientTargets();
+    // The frames in flight are done, the buffers kept have no access left to wait on
+    m_renderGraph.reset();
+
+    destroyImage(m_traceColor);
+    destroyImage(m_prevNormalDepth);
+    destroyImage(m_historyColor);
+    destroyImage(m_historyMoments);
+    destroyImage(m_denoiseOutput);
+    destroyImage(m_accumulation);
+#ifdef RAYTRACER_RAY_STATS
+    destroyImage(m_rayCounts);
+    destroyImage(m_rayNodeVisits);
+    destroyImage(m_rayStatsHeatmap);
+#endif
+}
+
+void VkRenderer::createPresentSampler() {
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    // Bilinear, the present pass upscales the radiance when the render scale is below one
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.anisotropyEnable = VK_FALSE;
+    samplerInfo.maxAnisotropy = 1.0f;
+    samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+    samplerInfo.unnormalizedCoordinates = VK_FALSE;
+    samplerInfo.compareEnable = VK_FALSE;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = 0.0f;
+
+    if (vkCreateSampler(m_device, &samplerInfo, nullptr, &m_presentSampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create present sampler!");
+    }
+}
+
+void VkRenderer::uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size) {
+    // Owned by the graphics family once acquired, the copies made by another family must be released to it
+    bool release = m_queueIndices.m_transferFamily != m_queueIndices.m_graphicsFamily;
+
+    VkDeviceSize uploaded = 0;
+    while (uploaded < size) {
+        VkDeviceSize chunkSize = size - uploaded;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        if (data != nullptr) {
+            chunkSize = std::min(chunkSize, m_uploadRing.getBlockSize());
+            StagingRing::Allocation allocation = m_uploadRing.allocate(chunkSize, 16);
+            std::memcpy(allocation.m_data, static_cast<const char*>(data) + uploaded, static_cast<size_t>(chunkSize));
+
+            VkBufferCopy region{};
+            region.srcOffset = allocation.m_offset;
+            region.dstOffset = offset + uploaded;
+            region.size = chunkSize;
+            commandBuffer = allocation.m_commandBuffer;
+            vkCmdCopyBuffer(commandBuffer, allocation.m_buffer, buffer, 1, &region);
+        }
+        else {
+            // Zeroes without staging, the offset and the size are multiples of 4 for every element type
+            commandBuffer = m_uploadRing.getCommandBuffer();
+            vkCmdFillBuffer(commandBuffer, buffer, offset + uploaded, chunkSize, 0);
+        }
+
+        if (release) {
+            VkBufferMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+            barrier.srcQueueFamilyIndex = m_queueIndices.m_transferFamily;
+            barrier.dstQueueFamilyIndex = m_queueIndices.m_graphicsFamily;
+            barrier.buffer = buffer;
+            barrier.offset = offset + uploaded;
+            barrier.size = chunkSize;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+        }
+
+        // Recorded into the current block, submitted next
+        m_pendingAcquires.push_back({ m_uploadRing.getStatistics().m_submissions + 1, buffer, offset + uploaded, chunkSize });
+        uploaded += chunkSize;
+    }
+}
+
+void VkRenderer::acquireUploads(VkCommandBuffer commandBuffer) {
+    bool acquire = m_queueIndices.m_transferFamily != m_queueIndices.m_graphicsFamily;
+    uint64_t completed = m_uploadRing.pollCompletedSubmissions();
+
+    std::vector<VkBufferMemoryBarrier> barriers;
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    while (!m_pendingAcquires.empty() && m_pendingAcquires.front().m_submission <= completed) {
+        const PendingAcquire& upload = m_pendingAcquires.front();
+        if (acquire && upload.m_image != VK_NULL_HANDLE) {
+            // Same layouts as the release recorded by the texture manager
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.srcQueueFamilyIndex = m_queueIndices.m_transferFamily;
+            barrier.dstQueueFamilyIndex = m_queueIndices.m_graphicsFamily;
+            barrier.image = upload.m_image;
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            barrier.subresourceRange.baseMipLevel = 0;
+            barrier.subresourceRange.levelCount = upload.m_mipLevels;
+            barrier.subresourceRange.baseArrayLayer = 0;
+            barrier.subresourceRange.layerCount = 1;
+            imageBarriers.push_back(barrier);
+        }
+        else if (acquire) {
+            VkBufferMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.srcQueueFamilyIndex = m_queueIndices.m_transferFamily;
+            barrier.dstQueueFamilyIndex = m_queueIndices.m_graphicsFamily;
+            barrier.buffer = upload.m_buffer;
+            barrier.offset = upload.m_offset;
+            barrier.size = upload.m_size;
+            barriers.push_back(barrier);
+        }
+        m_uploadWaitValue = std::max(m_uploadWaitValue, upload.m_submission);
+        m_pendingAcquires.pop_front();
+    }
+
+    // The semaphore wait of the submit orders the copies before the frame, on the same family it is enough
+    if (!barriers.empty() || !imageBarriers.empty()) {
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(),
+            static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+    }
+}
+
+void VkRenderer::prepareUploadSubmit(std::vector<VkSemaphore>& waitSemaphores, std::vector<VkPipelineStageFlags>& waitStages, std::vector<uint64_t>& waitValues) {
+    // Ignored for the binary semaphores
+    waitValues.resize(waitSemaphores.size(), 0);
+
+    // Already signaled, the frame only acquires the submissions seen complete
+    if (m_uploadWaitValue > 0) {
+        waitSemaphores.push_back(m_uploadRing.getSemaphore());
+        waitStages.push_back(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT);
+        waitValues.push_back(m_uploadWaitValue);
+        m_uploadWaitValue = 0;
+    }
 }
 
 uint32_t VkRenderer::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
@@ -978,7 +3293,7 @@ void VkRenderer::createSurface(GLFWwindow* window) {
     }
 }
 
-void VkRenderer::createSwapchain() {
+void VkRenderer::createSwapchain(VkSwapchainKHR oldSwapchain) {
     SwapChainSupportDetails configuration = querySwapchainSupport(m_physicalDevice);
 
     VkSurfaceFormatKHR surfaceFormat = pickSwapchainSurfaceFormat(configuration.m_formats);
@@ -1017,7 +3332,7 @@ void VkRenderer::createSwapchain() {
     swapchainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     swapchainCreateInfo.presentMode = presentMode;
     swapchainCreateInfo.clipped = VK_TRUE;
-    swapchainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+    swapchainCreateInfo.oldSwapchain = oldSwapchain;
 
     if (vkCreateSwapchainKHR(m_device, &swapchainCreateInfo, nullptr, &m_swapchain) != VK_SUCCESS) {
         throw std::runtime_error("Unable to create swap chain!");
@@ -1039,42 +3354,251 @@ void VkRenderer::createSyncObjects() {
     m_renderFinishedSemaphores.resize(m_MAX_FRAMES_IN_FLIGHT);
     m_inFlightFences.resize(m_MAX_FRAMES_IN_FLIGHT);
     m_imagesInFlight.resize(m_swapchainImages.size(), VK_NULL_HANDLE);
+    m_tiledState.m_tilesInFlight.assign(m_MAX_FRAMES_IN_FLIGHT, 0);
 
     // Create semaphores for the number of frames that can be submitted to the GPU at a time
     VkSemaphoreCreateInfo semaphoreCreateInfo = {};
     semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VkFenceCreateInfo fenceCreateInfo = {};
-    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT; // Set this flag to be initialized to be on
-    for (size_t i = 0; i < m_MAX_FRAMES_IN_FLIGHT; ++i) {
-        if (vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_imageAvailableSemaphores[i]) != VK_SUCCESS) {
-            throw std::runtime_error("Unable to create semaphore!");
-        }
+    VkFenceCreateInfo fenceCreateInfo = {};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT; // Set this flag to be initialized to be on
+    for (size_t i = 0; i < m_MAX_FRAMES_IN_FLIGHT; ++i) {
+        if (vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_imageAvailableSemaphores[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Unable to create semaphore!");
+        }
+
+        if (vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_renderFinishedSemaphores[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Unable to create semaphore!");
+        }
+
+        if (vkCreateFence(m_device, &fenceCreateInfo, nullptr, &m_inFlightFences[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Unable to create fence!");
+        }
+    }
+
+    // The render graph hands the images over between the queues with a value of these per frame using the
+    // compute queue
+    if (m_computeCommandPool != VK_NULL_HANDLE) {
+        VkSemaphoreTypeCreateInfo timelineCreateInfo{};
+        timelineCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        timelineCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        timelineCreateInfo.initialValue = 0;
+        semaphoreCreateInfo.pNext = &timelineCreateInfo;
+
+        if (vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_graphicsTimeline) != VK_SUCCESS ||
+            vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_computeTimeline) != VK_SUCCESS) {
+            throw std::runtime_error("Unable to create timeline semaphore!");
+        }
+        m_computeTimelineValues.assign(m_MAX_FRAMES_IN_FLIGHT, 0);
+        m_renderGraph.setAsyncCompute(m_queueIndices.m_graphicsFamily, m_queueIndices.m_computeFamily, m_graphicsTimeline, m_computeTimeline);
+    }
+}
+
+void VkRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording command buffer!");
+    }
+
+    // Resets the queries of this frame in flight, the UI command buffer writes its scope in the same slice
+    m_profiler.beginFrame(commandBuffer, m_currentFrame);
+
+    // Before the passes, which may copy into the buffers acquired
+    acquireUploads(commandBuffer);
+
+    // Every pass declares what it reads and writes, the graph records the barriers between them. The first
+    // passes wait on the accesses of the previous frame, e.g. the scene updates on its trace pass.
+    m_renderGraph.beginFrame();
+
+    if (hasSceneUpdates()) {
+        m_renderGraph.addPass({ "scene updates", RenderGraph::Queue::Graphics,
+            { { m_sceneResource, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT } },
+            [this](VkCommandBuffer commandBuffer) { recordSceneUpdates(commandBuffer); } });
+    }
+
+#ifdef RAYTRACER_RAY_STATS
+    // The trace pass adds to the totals of this frame in flight, they start from zero
+    m_renderGraph.addPass({ "ray stats clear", RenderGraph::Queue::Graphics,
+        { { m_rayStatsResource, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT } },
+        [this](VkCommandBuffer commandBuffer) {
+            vkCmdFillBuffer(commandBuffer, m_rayStatsBuffer, m_currentFrame * m_rayStatsStride, m_rayStatsStride, 0);
+        } });
+    m_rayStatsRecorded[m_currentFrame] = true;
+#endif
+
+    addTracePasses();
+
+    // The tiled mode presents its converged accumulation as is
+    if (m_denoiseSettings.m_enabled && !m_tiledSettings.m_enabled) {
+        addDenoisePasses();
+    }
+
+#ifdef RAYTRACER_RAY_STATS
+    if (m_rayStatsSettings.m_heatmap >= 0) {
+        m_renderGraph.addPass({ "ray stats heat map", RenderGraph::Queue::AsyncCompute,
+            {
+                { m_rayCounts.m_graphResource, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL },
+                { m_rayNodeVisits.m_graphResource, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL },
+                { m_rayStatsHeatmap.m_graphResource, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL }
+            },
+            [this](VkCommandBuffer commandBuffer) { recordRayStatsHeatmap(commandBuffer); } });
+    }
+#endif
+
+    // Headless frames stop at the radiance targets
+    if (!m_headless) {
+#ifdef RAYTRACER_RAY_STATS
+        bool tonemapped = m_rayStatsSettings.m_heatmap < 0;
+#else
+        bool tonemapped = true;
+#endif
+        if (tonemapped) {
+            m_renderGraph.addPass({ "tonemap", RenderGraph::Queue::Graphics,
+                {
+                    { getOutputImage().m_graphResource, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL },
+                    { m_tonemapOutput.m_graphResource, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL }
+                },
+                [this](VkCommandBuffer commandBuffer) { recordTonemapCommands(commandBuffer); } });
+        }
+
+        // The present render pass discards the previous contents of the swapchain image
+        m_renderGraph.importImage("swapchain", m_swapchainImages[imageIndex], VK_IMAGE_LAYOUT_UNDEFINED);
+        m_renderGraph.addPass({ "present", RenderGraph::Queue::Graphics,
+            {
+                { getPresentedImage().m_graphResource, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL },
+                { m_swapchainResource, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL }
+            },
+            [this, imageIndex](VkCommandBuffer commandBuffer) { recordPresentCommands(commandBuffer, imageIndex); } });
+
+        // Recorded in the UI command buffer submitted after this one, whose render pass hands the image over to
+        // the presentation
+        m_renderGraph.addPass({ "ui", RenderGraph::Queue::Graphics,
+            { { m_swapchainResource, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR } },
+            nullptr });
+    }
+
+#ifdef RAYTRACER_RAY_STATS
+    // The totals are read on the host once the fence of this frame is signaled
+    m_renderGraph.addPass({ "ray stats readback", RenderGraph::Queue::Graphics,
+        { { m_rayStatsResource, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT } },
+        nullptr });
+#endif
+
+    // A change of settings may use the transient targets in a way their aliasing does not allow, or let them
+    // share more memory, as do the first frames using them. They are then created again before the passes are
+    // recorded, which only read the targets once recorded.
+    if (m_renderGraph.checkAliasing() || m_renderGraph.isAliasingEnabled() != m_aliasTransientTargets) {
+        realiasTransientTargets();
+    }
+
+    // The async compute passes no graphics pass depends on go to the compute command buffer of this frame in
+    // flight, once the compute queue is done with its previous submit
+    VkCommandBuffer computeCommandBuffer = VK_NULL_HANDLE;
+    if (!m_computeCommandBuffers.empty()) {
+        computeCommandBuffer = m_computeCommandBuffers[m_currentFrame];
+        waitAsyncCompute(m_computeTimelineValues[m_currentFrame]);
+        vkResetCommandBuffer(computeCommandBuffer, 0);
+
+        VkCommandBufferBeginInfo computeBeginInfo{};
+        computeBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        computeBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(computeCommandBuffer, &computeBeginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to begin recording compute command buffer!");
+        }
+    }
+
+    m_renderGraph.execute(commandBuffer, computeCommandBuffer);
+
+    // End command buffer recording
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record command buffer!");
+    }
+    if (computeCommandBuffer != VK_NULL_HANDLE && vkEndCommandBuffer(computeCommandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record compute command buffer!");
+    }
+}
+
+void VkRenderer::submitAsyncCompute() {
+    if (!m_renderGraph.hasAsyncPasses()) {
+        return;
+    }
+
+    std::vector<VkSemaphore> waitSemaphores;
+    std::vector<VkPipelineStageFlags> waitStages;
+    std::vector<uint64_t> waitValues;
+    std::vector<VkSemaphore> signalSemaphores;
+    std::vector<uint64_t> signalValues;
+    m_renderGraph.prepareSubmit(RenderGraph::Queue::AsyncCompute, waitSemaphores, waitStages, waitValues, signalSemaphores, signalValues);
 
-        if (vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_renderFinishedSemaphores[i]) != VK_SUCCESS) {
-            throw std::runtime_error("Unable to create semaphore!");
-        }
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+    timelineInfo.pWaitSemaphoreValues = waitValues.data();
+    timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+    timelineInfo.pSignalSemaphoreValues = signalValues.data();
 
-        if (vkCreateFence(m_device, &fenceCreateInfo, nullptr, &m_inFlightFences[i]) != VK_SUCCESS) {
-            throw std::runtime_error("Unable to create fence!");
-        }
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &m_computeCommandBuffers[m_currentFrame];
+    submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+    submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+    if (vkQueueSubmit(m_computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit compute command buffer!");
     }
+    m_computeTimelineValues[m_currentFrame] = m_renderGraph.getTimelineValue();
 }
 
-void VkRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+void VkRenderer::waitAsyncCompute(uint64_t value) {
+    if (m_computeTimeline == VK_NULL_HANDLE || value == 0) {
+        return;
+    }
 
-    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to begin recording command buffer!");
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &m_computeTimeline;
+    waitInfo.pValues = &value;
+    vkWaitSemaphores(m_device, &waitInfo, UINT64_MAX);
+}
+
+void VkRenderer::recordTonemapCommands(VkCommandBuffer commandBuffer) {
+    m_profiler.beginScope(commandBuffer, m_tonemapScope);
+
+    glm::mat3 colorTransform = m_toneMapping.colorTransform();
+
+    TonemapPushConstants pushConstants{};
+    for (int column = 0; column < 3; ++column) {
+        pushConstants.m_colorTransform[column] = glm::vec4(colorTransform[column], 0.0f);
     }
+    pushConstants.m_renderSize = glm::ivec2(m_renderExtent.width, m_renderExtent.height);
+    pushConstants.m_operator = static_cast<int32_t>(m_toneMapping.m_operator);
+
+    // Same choice as getOutputImage, only the rendered region is tone mapped
+    size_t setIndex = m_tiledSettings.m_enabled ? 2 : (m_denoiseSettings.m_enabled ? 1 : 0);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_tonemapPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_tonemapPipelineLayout, 0, 1, &m_tonemapDescriptorSets[setIndex], 0, nullptr);
+    vkCmdPushConstants(commandBuffer, m_tonemapPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TonemapPushConstants), &pushConstants);
+    vkCmdDispatch(commandBuffer, (m_renderExtent.width + 7) / 8, (m_renderExtent.height + 7) / 8, 1);
+
+    m_profiler.endScope(commandBuffer, m_tonemapScope);
+}
 
-    float uTime = m_deltaTime;
-    vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(float), &uTime);
+void VkRenderer::recordPresentCommands(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    m_profiler.beginScope(commandBuffer, m_presentScope);
 
-    // Begin render pass
+    // Present the tone mapped image on the swapchain image
     VkRenderPassBeginInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     renderPassInfo.renderPass = m_renderPass;
@@ -1088,10 +3612,9 @@ void VkRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t ima
 
     vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-    // Bind the graphics pipeline
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_presentPipeline);
 
-    // Set the dynamic viewport
+    // The present pass covers the whole swapchain image
     VkViewport viewport{};
     viewport.x = 0.0f;
     viewport.y = 0.0f;
@@ -1101,60 +3624,536 @@ void VkRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t ima
     viewport.maxDepth = 1.0f;
     vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-    // Set the dynamic scissor
     VkRect2D scissor{};
     scissor.offset = { 0, 0 };
     scissor.extent = m_swapchainExtent;
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
+    glm::vec2 targetSize(static_cast<float>(m_swapchainExtent.width), static_cast<float>(m_swapchainExtent.height));
+    glm::vec2 renderSize(static_cast<float>(m_renderExtent.width), static_cast<float>(m_renderExtent.height));
+
+    PresentPushConstants presentPushConstants{};
+    presentPushConstants.m_uvScale = renderSize / targetSize;
+    presentPushConstants.m_uvMax = (renderSize - 0.5f) / targetSize;
+    // The UNORM fallback of pickSwapchainSurfaceFormat stores the values as they are written
+    presentPushConstants.m_encodeSrgb = m_swapchainImageFormat == VK_FORMAT_B8G8R8A8_SRGB || m_swapchainImageFormat == VK_FORMAT_R8G8B8A8_SRGB ? 0 : 1;
+    vkCmdPushConstants(commandBuffer, m_presentPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PresentPushConstants), &presentPushConstants);
+
+    VkBuffer vertexBuffers[] = { m_vertexBuffer };
+    VkDeviceSize offsets[] = { 0 };
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+    // Same choice as getPresentedImage
+    size_t presentSetIndex = 0;
+#ifdef RAYTRACER_RAY_STATS
+    if (m_rayStatsSettings.m_heatmap >= 0) {
+        presentSetIndex = 1;
+    }
+#endif
+    VkDescriptorSet presentDescriptorSet = m_presentDescriptorSets[presentSetIndex];
+    vkCmdBindDescriptorSets(
+        commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_presentPipelineLayout,
+        0, 1, &presentDescriptorSet, 0, nullptr
+    );
+
+    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(m_indices.size()), 1, 0, 0, 0);
+
+    vkCmdEndRenderPass(commandBuffer);
+    m_profiler.endScope(commandBuffer, m_presentScope);
+}
+
+void VkRenderer::recordTraceCommands(VkCommandBuffer commandBuffer, const VkRect2D& area) {
+    // Trace the scene into the offscreen radiance and feature targets
+    VkRenderPassBeginInfo traceRenderPassInfo{};
+    traceRenderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    traceRenderPassInfo.renderPass = m_traceRenderPass;
+    traceRenderPassInfo.framebuffer = m_traceFramebuffer;
+    traceRenderPassInfo.renderArea = area;
+    traceRenderPassInfo.clearValueCount = 0;
+    traceRenderPassInfo.pClearValues = nullptr;
+
+    vkCmdBeginRenderPass(commandBuffer, &traceRenderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    // Bind the graphics pipeline
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+
+    // Set the dynamic viewport, the scene is only traced in the scaled corner of the targets
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(m_renderExtent.width);
+    viewport.height = static_cast<float>(m_renderExtent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    // Set the dynamic scissor, a tile only keeps its own part of the viewport
+    VkRect2D scissor = area;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
     // Bind vertex and index buffers
     VkBuffer vertexBuffers[] = { m_vertexBuffer };
     VkDeviceSize offsets[] = { 0 };
     vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
     vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 
-    // Bind descriptor sets (if any)
+    // Bind descriptor sets (if any), at the uniform and texture feedback slices of the frame in flight, in
+    // the order of their bindings
+    std::array<uint32_t, 2> dynamicOffsets = {
+        static_cast<uint32_t>(m_currentFrame * m_frameUniformStride),
+        static_cast<uint32_t>(m_currentFrame * m_textureFeedbackStride)
+    };
+    std::array<VkDescriptorSet, 2> descriptorSets = { m_descriptorSet, m_textureDescriptorSets[m_currentFrame] };
+    vkCmdBindDescriptorSets(
+        commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout,
+        0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data()
+    );
+
+#ifdef RAYTRACER_RAY_STATS
+    uint32_t rayStatsOffset = static_cast<uint32_t>(m_currentFrame * m_rayStatsStride);
     vkCmdBindDescriptorSets(
         commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout,
-        0, 1, &m_descriptorSets[imageIndex], 0, nullptr
+        2, 1, &m_rayStatsDescriptorSet, 1, &rayStatsOffset
     );
+#endif
 
     // Issue draw command
     vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(m_indices.size()), 1, 0, 0, 0);
 
     // End the render pass
     vkCmdEndRenderPass(commandBuffer);
+}
 
-    // Transition the swapchain image layout to PRESENT_SRC_KHR
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = m_swapchainImages[imageIndex];
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-
-    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    barrier.dstAccessMask = 0;
+std::vector<RenderGraph::Access> VkRenderer::getTraceAccesses() const {
+    // The render pass leaves its attachments in the general layout, their previous contents are discarded
+    std::vector<RenderGraph::Access> accesses;
+    for (const ImageResource* attachment : { &m_traceColor, &m_traceAlbedo, &m_traceNormalDepth, &m_traceMotion }) {
+        accesses.push_back({ attachment->m_graphResource, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL });
+    }
+    accesses.push_back({ m_sceneResource, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT });
+#ifdef RAYTRACER_RAY_STATS
+    accesses.push_back({ m_rayStatsResource, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT });
+    accesses.push_back({ m_rayCounts.m_graphResource, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL });
+    accesses.push_back({ m_rayNodeVisits.m_graphResource, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL });
+#endif
+    return accesses;
+}
 
-    vkCmdPipelineBarrier(
-        commandBuffer,
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-        0,
-        0, nullptr,
-        0, nullptr,
-        1, &barrier
+void VkRenderer::addTracePasses() {
+    if (!m_tiledSettings.m_enabled) {
+        m_renderGraph.addPass({ "trace", RenderGraph::Queue::Graphics, getTraceAccesses(), [this](VkCommandBuffer commandBuffer) {
+            VkRect2D renderArea{};
+            renderArea.offset = { 0, 0 };
+            renderArea.extent = m_renderExtent;
+
+            m_profiler.beginScope(commandBuffer, m_traceScope);
+            recordTraceCommands(commandBuffer, renderArea);
+            m_profiler.endScope(commandBuffer, m_traceScope);
+        } });
+        return;
+    }
+
+    TiledRenderState& state = m_tiledState;
+    uint32_t tileSize = static_cast<uint32_t>(state.m_tileSize);
+    std::vector<RenderGraph::Access> traceAccesses = getTraceAccesses();
+    std::vector<RenderGraph::Access> accumulateAccesses = {
+        { m_traceColor.m_graphResource, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL },
+        { m_accumulation.m_graphResource, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL }
+    };
+
+    // The trace scope spans the tiles of the frame
+    for (size_t i = 0; i < state.m_frameTiles.size(); ++i) {
+        uint32_t tile = state.m_frameTiles[i];
+        bool firstTile = i == 0;
+        bool lastTile = i + 1 == state.m_frameTiles.size();
+
+        VkRect2D area{};
+        area.offset.x = static_cast<int32_t>((tile % state.m_tilesX) * tileSize);
+        area.offset.y = static_cast<int32_t>((tile / state.m_tilesX) * tileSize);
+        area.extent.width = std::min(tileSize, state.m_extent.width - static_cast<uint32_t>(area.offset.x));
+        area.extent.height = std::min(tileSize, state.m_extent.height - static_cast<uint32_t>(area.offset.y));
+
+        // Each tile is a render pass of its own so a single draw never covers more than one tile
+        m_renderGraph.addPass({ "trace tile " + std::to_string(tile), RenderGraph::Queue::Graphics, traceAccesses,
+            [this, area, firstTile](VkCommandBuffer commandBuffer) {
+                if (firstTile) {
+                    m_profiler.beginScope(commandBuffer, m_traceScope);
+                }
+                recordTraceCommands(commandBuffer, area);
+            } });
+
+        AccumulatePushConstants pushConstants{};
+        pushConstants.m_tileOffset = glm::ivec2(area.offset.x, area.offset.y);
+        pushConstants.m_tileSize = glm::ivec2(area.extent.width, area.extent.height);
+        pushConstants.m_passIndex = static_cast<int32_t>(state.m_tilePasses[tile]);
+
+        // The accumulation is read back by the next pass over this tile and by the present pass
+        m_renderGraph.addPass({ "accumulate tile " + std::to_string(tile), RenderGraph::Queue::Graphics, accumulateAccesses,
+            [this, area, pushConstants, lastTile](VkCommandBuffer commandBuffer) {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_accumulatePipeline);
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_accumulatePipelineLayout, 0, 1, &m_denoiseDescriptorSets[0], 0, nullptr);
+                vkCmdPushConstants(commandBuffer, m_accumulatePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(AccumulatePushConstants), &pushConstants);
+                vkCmdDispatch(commandBuffer, (area.extent.width + 7) / 8, (area.extent.height + 7) / 8, 1);
+                if (lastTile) {
+                    m_profiler.endScope(commandBuffer, m_traceScope);
+                }
+            } });
+
+        ++state.m_tilePasses[tile];
+    }
+}
+
+#ifdef RAYTRACER_RAY_STATS
+void VkRenderer::createRayStatsResources() {
+    // One slice of totals per frame in flight, selected with a dynamic offset
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+    VkDeviceSize alignment = std::max<VkDeviceSize>(properties.limits.minStorageBufferOffsetAlignment, 1);
+    m_rayStatsStride = (m_RAY_STATS_COUNTERS * 2 * sizeof(uint32_t) + alignment - 1) / alignment * alignment;
+
+    createBuffer(
+        m_rayStatsStride * m_MAX_FRAMES_IN_FLIGHT,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        m_rayStatsBuffer, m_rayStatsBufferMemory
     );
+    vkMapMemory(m_device, m_rayStatsBufferMemory, 0, VK_WHOLE_SIZE, 0, &m_rayStatsBufferMapped);
 
-    // End command buffer recording
-    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to record command buffer!");
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    poolSizes[0].descriptorCount = 1;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[1].descriptorCount = 3;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 1;
+
+    if (vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_rayStatsDescriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create ray statistics descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = m_rayStatsDescriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &m_rayStatsDescriptorSetLayout;
+
+    if (vkAllocateDescriptorSets(m_device, &allocInfo, &m_rayStatsDescriptorSet) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate ray statistics descriptor set!");
+    }
+
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(RayStatsHeatmapPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_rayStatsDescriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_rayStatsHeatmapPipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create ray statistics pipeline layout!");
+    }
+
+    m_rayStatsHeatmapPipeline = createComputePipeline("raystats_heatmap_comp.spv", m_rayStatsHeatmapPipelineLayout);
+
+    m_rayStatsRecorded.assign(m_MAX_FRAMES_IN_FLIGHT, false);
+
+    updateRayStatsDescriptorSet();
+}
+
+void VkRenderer::updateRayStatsDescriptorSet() {
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = m_rayStatsBuffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = m_RAY_STATS_COUNTERS * 2 * sizeof(uint32_t);
+
+    std::array<VkDescriptorImageInfo, 3> imageInfos{};
+    imageInfos[0].imageView = m_rayCounts.m_view;
+    imageInfos[0].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    imageInfos[1].imageView = m_rayStatsHeatmap.m_view;
+    imageInfos[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    imageInfos[2].imageView = m_rayNodeVisits.m_view;
+    imageInfos[2].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    std::array<VkWriteDescriptorSet, 4> descriptorWrites{};
+    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[0].dstSet = m_rayStatsDescriptorSet;
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].dstArrayElement = 0;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    descriptorWrites[0].descriptorCount = 1;
+    descriptorWrites[0].pBufferInfo = &bufferInfo;
+
+    for (size_t i = 0; i < imageInfos.size(); ++i) {
+        descriptorWrites[i + 1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[i + 1].dstSet = m_rayStatsDescriptorSet;
+        descriptorWrites[i + 1].dstBinding = static_cast<uint32_t>(i + 1);
+        descriptorWrites[i + 1].dstArrayElement = 0;
+        descriptorWrites[i + 1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[i + 1].descriptorCount = 1;
+        descriptorWrites[i + 1].pImageInfo = &imageInfos[i];
+    }
+
+    vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void VkRenderer::cleanupRayStatsResources() {
+    vkUnmapMemory(m_device, m_rayStatsBufferMemory);
+    destroyBuffer(m_rayStatsBuffer, m_rayStatsBufferMemory);
+
+    vkDestroyPipeline(m_device, m_rayStatsHeatmapPipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_rayStatsHeatmapPipelineLayout, nullptr);
+    vkDestroyDescriptorPool(m_device, m_rayStatsDescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_rayStatsDescriptorSetLayout, nullptr);
+}
+
+// Must be called once the fence of the current frame has been waited on, like readTimestamps
+void VkRenderer::readRayStatistics() {
+    if (!m_rayStatsRecorded[m_currentFrame]) {
+        return;
     }
+    m_rayStatsRecorded[m_currentFrame] = false;
+
+    const uint32_t* counters = reinterpret_cast<const uint32_t*>(static_cast<const char*>(m_rayStatsBufferMapped) + m_currentFrame * m_rayStatsStride);
+    auto counter = [counters](int index) {
+        return static_cast<uint64_t>(counters[2 * index]) | (static_cast<uint64_t>(counters[2 * index + 1]) << 32);
+    };
+
+    m_rayStats.m_primaryRays = counter(0);
+    m_rayStats.m_bounceRays = counter(1);
+    m_rayStats.m_shadowRays = counter(2);
+    m_rayStats.m_triangleTests = counter(3);
+    m_rayStats.m_sphereTests = counter(4);
+    m_rayStats.m_nodeVisits = counter(5);
+    m_rayStatsPixels = m_renderExtent.width * m_renderExtent.height;
+}
+
+void VkRenderer::recordRayStatsHeatmap(VkCommandBuffer commandBuffer) {
+    float maxValue = m_rayStatsSettings.m_maxValue;
+    if (m_rayStatsSettings.m_autoScale && m_rayStatsPixels > 0) {
+        // Per pixel average of the channel over the last frame read back, the log scale keeps some headroom above it
+        std::array<uint64_t, 7> totals = {
+            m_rayStats.m_primaryRays + m_rayStats.m_bounceRays, m_rayStats.m_shadowRays,
+            m_rayStats.m_triangleTests, m_rayStats.m_sphereTests,
+            m_rayStats.m_primaryRays + m_rayStats.m_bounceRays + m_rayStats.m_shadowRays,
+            m_rayStats.m_triangleTests + m_rayStats.m_sphereTests,
+            m_rayStats.m_nodeVisits
+        };
+        size_t channel = static_cast<size_t>(std::clamp(m_rayStatsSettings.m_heatmap, 0, 6));
+        maxValue = 4.0f * static_cast<float>(totals[channel]) / static_cast<float>(m_rayStatsPixels);
+    }
+
+    RayStatsHeatmapPushConstants pushConstants{};
+    pushConstants.m_channel = m_rayStatsSettings.m_heatmap;
+    pushConstants.m_maxValue = std::max(maxValue, 1.0f);
+    pushConstants.m_renderSize = glm::ivec2(m_renderExtent.width, m_renderExtent.height);
+
+    uint32_t dynamicOffset = static_cast<uint32_t>(m_currentFrame * m_rayStatsStride);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_rayStatsHeatmapPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_rayStatsHeatmapPipelineLayout, 0, 1, &m_rayStatsDescriptorSet, 1, &dynamicOffset);
+    vkCmdPushConstants(commandBuffer, m_rayStatsHeatmapPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RayStatsHeatmapPushConstants), &pushConstants);
+    vkCmdDispatch(commandBuffer, (m_renderExtent.width + 7) / 8, (m_renderExtent.height + 7) / 8, 1);
+}
+
+void VkRenderer::drawRayStatsUI() {
+    if (!ImGui::CollapsingHeader("Ray statistics")) {
+        return;
+    }
+
+    uint64_t rays = m_rayStats.m_primaryRays + m_rayStats.m_bounceRays + m_rayStats.m_shadowRays;
+    double pixels = std::max(static_cast<double>(m_rayStatsPixels), 1.0);
+
+    ImGui::Text("Primary rays: %llu (%.2f / pixel)", static_cast<unsigned long long>(m_rayStats.m_primaryRays), m_rayStats.m_primaryRays / pixels);
+    ImGui::Text("Bounce rays: %llu (%.2f / pixel)", static_cast<unsigned long long>(m_rayStats.m_bounceRays), m_rayStats.m_bounceRays / pixels);
+    ImGui::Text("Shadow rays: %llu (%.2f / pixel)", static_cast<unsigned long long>(m_rayStats.m_shadowRays), m_rayStats.m_shadowRays / pixels);
+    ImGui::Text("Triangle tests: %llu (%.1f / pixel)", static_cast<unsigned long long>(m_rayStats.m_triangleTests), m_rayStats.m_triangleTests / pixels);
+    ImGui::Text("Sphere tests: %llu (%.1f / pixel)", static_cast<unsigned long long>(m_rayStats.m_sphereTests), m_rayStats.m_sphereTests / pixels);
+    ImGui::Text("BVH node visits: %llu (%.1f / pixel)", static_cast<unsigned long long>(m_rayStats.m_nodeVisits), m_rayStats.m_nodeVisits / pixels);
+    if (m_profiler.isAvailable() && m_traceGpuTime > 0.0f) {
+        ImGui::Text("Throughput: %.1f Mrays/s", static_cast<double>(rays) / (m_traceGpuTime * 1000.0));
+    }
+
+    // Index 0 presents the image, the others are the channels of raystats_heatmap_comp.glsl
+    const char* heatmaps[] = { "Image", "Rays", "Shadow rays", "Triangle tests", "Sphere tests", "All rays", "All tests", "Node visits" };
+    int heatmap = m_rayStatsSettings.m_heatmap + 1;
+    if (ImGui::Combo("Heat map", &heatmap, heatmaps, IM_ARRAYSIZE(heatmaps))) {
+        m_rayStatsSettings.m_heatmap = heatmap - 1;
+    }
+    ImGui::Checkbox("Auto scale", &m_rayStatsSettings.m_autoScale);
+    if (!m_rayStatsSettings.m_autoScale) {
+        ImGui::SliderFloat("Max count", &m_rayStatsSettings.m_maxValue, 1.0f, 100000.0f, "%.0f", ImGuiSliderFlags_Logarithmic);
+    }
+}
+#endif
+
+void VkRenderer::drawToneMappingUI() {
+    if (!ImGui::CollapsingHeader("Tone mapping", ImGuiTreeNodeFlags_DefaultOpen)) {
+        return;
+    }
+
+    // Same order as ToneMapping::Operator
+    const char* operators[] = { "ACES", "AgX", "Filmic", "Clamp" };
+    int op = static_cast<int>(m_toneMapping.m_operator);
+    if (ImGui::Combo("Operator", &op, operators, IM_ARRAYSIZE(operators))) {
+        m_toneMapping.m_operator = static_cast<ToneMapping::Operator>(op);
+    }
+    ImGui::SliderFloat("Exposure (stops)", &m_toneMapping.m_exposure, -10.0f, 10.0f, "%.2f");
+    ImGui::SliderFloat("Temperature (K)", &m_toneMapping.m_temperature, 2000.0f, 12000.0f, "%.0f");
+    ImGui::SliderFloat("Tint", &m_toneMapping.m_tint, -1.0f, 1.0f);
+    if (ImGui::Button("Reset##tonemapping")) {
+        m_toneMapping = ToneMapping{};
+    }
+}
+
+void VkRenderer::drawCaptureUI() {
+    if (!ImGui::CollapsingHeader("Capture")) {
+        return;
+    }
+
+    const char* formats[] = { "PNG", "PFM", "EXR" };
+    int format = static_cast<int>(m_captureSettings.m_format);
+    if (ImGui::Combo("Format", &format, formats, IM_ARRAYSIZE(formats))) {
+        m_captureSettings.m_format = static_cast<ImageWriter::Format>(format);
+    }
+    if (ImGui::Button("Screenshot")) {
+        requestCapture(nextCapturePath(), m_captureSettings.m_format, false);
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("Capture every frame", &m_captureSettings.m_everyFrame);
+    ImGui::TextDisabled("Written to %s", m_captureSettings.m_directory.c_str());
+
+    CaptureStatistics statistics = getCaptureStatistics();
+    ImGui::Text("Captures: %llu requested, %llu written, %llu dropped", static_cast<unsigned long long>(statistics.m_requested),
+        static_cast<unsigned long long>(statistics.m_encoder.m_frames), static_cast<unsigned long long>(statistics.m_dropped));
+    if (statistics.m_encoder.m_frames > 0) {
+        ImGui::Text("Encode: %.2f ms avg, %.2f ms max", statistics.m_encoder.m_encodeTime / statistics.m_encoder.m_frames, statistics.m_encoder.m_maxEncodeTime);
+    }
+
+    // CPU time of drawFrame, a capture costs the render loop no more than its submission
+    const FrameTimeStatistics& captured = statistics.m_captureFrames;
+    const FrameTimeStatistics& other = statistics.m_otherFrames;
+    if (captured.m_frames > 0) {
+        ImGui::Text("Frames with capture: %.3f ms avg, %.3f ms max", captured.m_totalTime / captured.m_frames, captured.m_maxTime);
+    }
+    if (other.m_frames > 0) {
+        ImGui::Text("Frames without:      %.3f ms avg, %.3f ms max", other.m_totalTime / other.m_frames, other.m_maxTime);
+    }
+    if (ImGui::Button("Reset frame times")) {
+        m_captureStatistics.m_captureFrames = FrameTimeStatistics{};
+        m_captureStatistics.m_otherFrames = FrameTimeStatistics{};
+    }
+}
+
+void VkRenderer::addDenoisePasses() {
+    DenoisePushConstants pushConstants{};
+    pushConstants.m_stepSize = 1;
+    pushConstants.m_finalPass = 0;
+    pushConstants.m_temporalEnabled = m_denoiseSettings.m_temporal ? 1 : 0;
+    pushConstants.m_resetHistory = m_resetHistory ? 1 : 0;
+    pushConstants.m_clampHistory = m_denoiseSettings.m_clampHistory ? 1 : 0;
+    pushConstants.m_sigmaLuminance = m_denoiseSettings.m_sigmaLuminance;
+    pushConstants.m_sigmaNormal = m_denoiseSettings.m_sigmaNormal;
+    pushConstants.m_sigmaDepth = m_denoiseSettings.m_sigmaDepth;
+    pushConstants.m_temporalAlpha = m_denoiseSettings.m_temporalAlpha;
+    pushConstants.m_momentsAlpha = m_denoiseSettings.m_momentsAlpha;
+    pushConstants.m_renderSize = glm::ivec2(m_renderExtent.width, m_renderExtent.height);
+    pushConstants.m_previousRenderSize = glm::ivec2(m_previousRenderExtent.width, m_previousRenderExtent.height);
+
+    auto read = [](const ImageResource& image) {
+        return RenderGraph::Access{ image.m_graphResource, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL };
+    };
+    auto write = [](const ImageResource& image) {
+        return RenderGraph::Access{ image.m_graphResource, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+    };
+
+    // Copies of the images the next frame reads as its history. No pass of this frame reads them, they go to the
+    // async compute queue unless the memory of a transient image they read is used again by a later graphics
+    // pass. The images are only read once recorded, the transient ones may be created again before.
+    using Copies = std::vector<std::pair<const ImageResource*, const ImageResource*>>;
+    auto addCopyPass = [this](const std::string& name, const Copies& copies) {
+        RenderGraph::Pass pass{ name, RenderGraph::Queue::AsyncCompute, {}, nullptr };
+        for (const auto& [source, destination] : copies) {
+            pass.m_accesses.push_back({ source->m_graphResource, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL });
+            pass.m_accesses.push_back({ destination->m_graphResource, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL });
+        }
+
+        VkImageCopy fullCopy{};
+        fullCopy.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        fullCopy.srcSubresource.mipLevel = 0;
+        fullCopy.srcSubresource.baseArrayLayer = 0;
+        fullCopy.srcSubresource.layerCount = 1;
+        fullCopy.dstSubresource = fullCopy.srcSubresource;
+        fullCopy.extent = { m_renderExtent.width, m_renderExtent.height, 1 };
+
+        pass.m_record = [copies, fullCopy](VkCommandBuffer commandBuffer) {
+            for (const auto& [source, destination] : copies) {
+                vkCmdCopyImage(commandBuffer, source->m_image, VK_IMAGE_LAYOUT_GENERAL, destination->m_image, VK_IMAGE_LAYOUT_GENERAL, 1, &fullCopy);
+            }
+        };
+        m_renderGraph.addPass(std::move(pass));
+    };
+
+    // Temporal accumulation and variance estimation, written to ping 0 (set 1 outputs to ping 0). The filter
+    // passes stay on the graphics queue, they hold the denoise scope whose statistics queries need graphics.
+    m_renderGraph.addPass({ "denoise temporal", RenderGraph::Queue::Graphics,
+        {
+            read(m_traceColor), read(m_traceAlbedo), read(m_traceNormalDepth), read(m_traceMotion), read(m_prevNormalDepth),
+            read(m_historyColor), read(m_historyMoments), write(m_denoisePingPong[0]), write(m_denoiseMoments)
+        },
+        [this, pushConstants](VkCommandBuffer commandBuffer) {
+            m_profiler.beginScope(commandBuffer, m_denoiseScope);
+            recordDenoiseDispatch(commandBuffer, m_denoiseTemporalPipeline, 1, pushConstants);
+        } });
+
+    int iterations = std::max(m_denoiseSettings.m_iterations, 1);
+
+    // With a single iteration there is no filtered image to feed back, keep the integrated one
+    if (iterations == 1) {
+        addCopyPass("denoise color history", { { &m_denoisePingPong[0], &m_historyColor } });
+    }
+
+    // A-trous iterations with a step size doubling every time, the last one writes the output
+    for (int i = 0; i < iterations; ++i) {
+        bool finalPass = i == iterations - 1;
+        size_t setIndex = (i % 2 == 0 ? 0 : 1) + (finalPass ? 2 : 0);
+        const ImageResource& input = m_denoisePingPong[i % 2];
+        const ImageResource& output = finalPass ? m_denoiseOutput : m_denoisePingPong[(i + 1) % 2];
+
+        pushConstants.m_stepSize = 1 << i;
+        pushConstants.m_finalPass = finalPass ? 1 : 0;
+
+        m_renderGraph.addPass({ "denoise a-trous " + std::to_string(i), RenderGraph::Queue::Graphics,
+            { read(m_traceAlbedo), read(m_traceNormalDepth), read(input), write(output) },
+            [this, setIndex, pushConstants, finalPass](VkCommandBuffer commandBuffer) {
+                recordDenoiseDispatch(commandBuffer, m_denoiseAtrousPipeline, setIndex, pushConstants);
+                if (finalPass) {
+                    m_profiler.endScope(commandBuffer, m_denoiseScope);
+                }
+            } });
+
+        // As in SVGF, the output of the first iteration becomes the history of the next frame
+        if (i == 0 && !finalPass) {
+            addCopyPass("denoise color history", { { &m_denoisePingPong[1], &m_historyColor } });
+        }
+    }
+
+    addCopyPass("denoise history", { { &m_traceNormalDepth, &m_prevNormalDepth }, { &m_denoiseMoments, &m_historyMoments } });
+}
+
+void VkRenderer::recordDenoiseDispatch(VkCommandBuffer commandBuffer, VkPipeline pipeline, size_t setIndex, const DenoisePushConstants& pushConstants) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_denoisePipelineLayout, 0, 1, &m_denoiseDescriptorSets[setIndex], 0, nullptr);
+    vkCmdPushConstants(commandBuffer, m_denoisePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DenoisePushConstants), &pushConstants);
+    vkCmdDispatch(commandBuffer, (m_renderExtent.width + 7) / 8, (m_renderExtent.height + 7) / 8, 1);
 }
 
 void VkRenderer::createUIDescriptorPool() {
@@ -1257,7 +4256,7 @@ void VkRenderer::recordUICommands(uint32_t imageIndex) {
     cmdBufferBegin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     cmdBufferBegin.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-    if (vkBeginCommandBuffer(m_uiCommandBuffers[imageIndex], &cmdBufferBegin) != VK_SUCCESS) {
+    if (vkBeginCommandBuffer(m_uiCommandBuffers[m_currentFrame], &cmdBufferBegin) != VK_SUCCESS) {
         throw std::runtime_error("Unable to start recording UI command buffer!");
     }
 
@@ -1271,20 +4270,24 @@ void VkRenderer::recordUICommands(uint32_t imageIndex) {
     renderPassBeginInfo.clearValueCount = 1;
     renderPassBeginInfo.pClearValues = &clearColor;
 
-    vkCmdBeginRenderPass(m_uiCommandBuffers[imageIndex], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    m_profiler.beginScope(m_uiCommandBuffers[m_currentFrame], m_uiScope);
+    vkCmdBeginRenderPass(m_uiCommandBuffers[m_currentFrame], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
     // Grab and record the draw data for Dear Imgui
-    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), m_uiCommandBuffers[imageIndex]);
+    ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), m_uiCommandBuffers[m_currentFrame]);
 
     // End and submit render pass
-    vkCmdEndRenderPass(m_uiCommandBuffers[imageIndex]);
+    vkCmdEndRenderPass(m_uiCommandBuffers[m_currentFrame]);
+    m_profiler.endScope(m_uiCommandBuffers[m_currentFrame], m_uiScope);
 
-    if (vkEndCommandBuffer(m_uiCommandBuffers[imageIndex]) != VK_SUCCESS) {
+    if (vkEndCommandBuffer(m_uiCommandBuffers[m_currentFrame]) != VK_SUCCESS) {
         throw std::runtime_error("Failed to record command buffers!");
     }
 }
 
 void VkRenderer::drawFrame(GLFWwindow* window) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+
     // Calculate deltaTime
     float currentFrameTime = static_cast<float>(glfwGetTime());
     m_deltaTime = currentFrameTime - m_lastFrameTime;
@@ -1293,6 +4296,22 @@ void VkRenderer::drawFrame(GLFWwindow* window) {
 
     // Sync for next frame. Fences also need to be manually reset unlike semaphores, which is done here
     vkWaitForFences(m_device, 1, &m_inFlightFences[m_currentFrame], VK_TRUE, UINT64_MAX);
+    releaseRetiredSwapchains(false);
+    releaseRetiredScenes(false);
+
+    readTimestamps();
+#ifdef RAYTRACER_RAY_STATS
+    readRayStatistics();
+#endif
+    m_readback.poll();
+    updateTextureStreaming();
+    updateSceneLoading();
+    updateRenderScale();
+
+    // Dropped rather than waited for when the copies or the encoders fall behind
+    if (m_captureSettings.m_everyFrame && m_pendingCapture < 0) {
+        requestCapture(nextCapturePath(), m_captureSettings.m_format, false);
+    }
 
     uint32_t imageIndex;
     VkResult result = vkAcquireNextImageKHR(m_device, m_swapchain, UINT64_MAX, m_imageAvailableSemaphores[m_currentFrame], VK_NULL_HANDLE, &imageIndex);
@@ -1307,7 +4326,8 @@ void VkRenderer::drawFrame(GLFWwindow* window) {
         throw std::runtime_error("Unable to acquire swap chain!");
     }
 
-    updateUniformBuffer(imageIndex, m_deltaTime);
+    // The command buffer, the uniform buffer and the descriptor set of this frame in flight are free again
+    updateUniformBuffer(m_currentFrame, m_deltaTime);
 
     // Check if a previous frame is using this image (i.e. there is its fence to wait on)
     if (m_imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
@@ -1316,10 +4336,19 @@ void VkRenderer::drawFrame(GLFWwindow* window) {
 
     // Mark the image as now being in use by this frame
     m_imagesInFlight[imageIndex] = m_inFlightFences[m_currentFrame];
+    updateTextureDescriptors(m_currentFrame);
+
+    prepareTiledFrame();
 
     // Ensure the primary command buffer is recorded for the current image
-    vkResetCommandBuffer(m_commandBuffers[imageIndex], 0);
-    recordCommandBuffer(m_commandBuffers[imageIndex], imageIndex);
+    vkResetCommandBuffer(m_commandBuffers[m_currentFrame], 0);
+    recordCommandBuffer(m_commandBuffers[m_currentFrame], imageIndex);
+
+    // The history has been consumed by this frame, it only stays invalid while the denoiser is off or while the
+    // edit of a large mesh is still being copied
+    m_resetHistory = !m_denoiseSettings.m_enabled || m_tiledSettings.m_enabled || !m_dirtyTriangles.empty();
+    m_previousRenderExtent = m_renderExtent;
+    ++m_frameIndex;
 
     // Record UI command buffer if necessary
     recordUICommands(imageIndex);
@@ -1328,18 +4357,31 @@ void VkRenderer::drawFrame(GLFWwindow* window) {
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    VkSemaphore waitSemaphores[] = { m_imageAvailableSemaphores[m_currentFrame] };
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    std::array<VkCommandBuffer, 2> cmdBuffers = { m_commandBuffers[imageIndex], m_uiCommandBuffers[imageIndex] };
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
+    std::vector<VkSemaphore> waitSemaphores = { m_imageAvailableSemaphores[m_currentFrame] };
+    std::vector<VkPipelineStageFlags> waitStages = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+    std::vector<VkSemaphore> signalSemaphores = { m_renderFinishedSemaphores[m_currentFrame] };
+    prepareCaptureSubmit(waitSemaphores, waitStages, signalSemaphores);
+    std::vector<uint64_t> waitValues;
+    prepareUploadSubmit(waitSemaphores, waitStages, waitValues);
+    std::vector<uint64_t> signalValues;
+    m_renderGraph.prepareSubmit(RenderGraph::Queue::Graphics, waitSemaphores, waitStages, waitValues, signalSemaphores, signalValues);
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+    timelineInfo.pWaitSemaphoreValues = waitValues.data();
+    timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+    timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+    std::array<VkCommandBuffer, 2> cmdBuffers = { m_commandBuffers[m_currentFrame], m_uiCommandBuffers[m_currentFrame] };
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
     submitInfo.commandBufferCount = static_cast<uint32_t>(cmdBuffers.size());
     submitInfo.pCommandBuffers = cmdBuffers.data();
-
-    VkSemaphore signalSemaphores[] = { m_renderFinishedSemaphores[m_currentFrame] };
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
+    submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+    submitInfo.pSignalSemaphores = signalSemaphores.data();
 
     // Reset the in-flight fences so we do not get blocked waiting on in-flight images
     vkResetFences(m_device, 1, &m_inFlightFences[m_currentFrame]);
@@ -1347,11 +4389,13 @@ void VkRenderer::drawFrame(GLFWwindow* window) {
     if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_inFlightFences[m_currentFrame]) != VK_SUCCESS) {
         throw std::runtime_error("Failed to submit draw command buffer!");
     }
+    submitAsyncCompute();
+    submitCapture();
 
     VkPresentInfoKHR presentInfo = {};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
+    presentInfo.pWaitSemaphores = &m_renderFinishedSemaphores[m_currentFrame];
 
     VkSwapchainKHR swapchains[] = { m_swapchain };
     presentInfo.swapchainCount = 1;
@@ -1371,6 +4415,8 @@ void VkRenderer::drawFrame(GLFWwindow* window) {
 
     // Advance the current frame to get the semaphore data for the next frame
     m_currentFrame = (m_currentFrame + 1) % m_MAX_FRAMES_IN_FLIGHT;
+
+    recordFrameTime(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count());
 }
 
 void VkRenderer::drawUI() {
@@ -1379,43 +4425,101 @@ void VkRenderer::drawUI() {
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
 
-    // 1. Show the big demo window (Most of the sample code is in ImGui::ShowDemoWindow()! You can browse its code to learn more about Dear ImGui!).
-    if (m_show_demo_window)
-        ImGui::ShowDemoWindow(&m_show_demo_window);
+    drawSceneUI();
+
+    ImGui::Begin("Renderer");
+    ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / m_io->Framerate, m_io->Framerate);
+
+    if (ImGui::CollapsingHeader("Resolution", ImGuiTreeNodeFlags_DefaultOpen)) {
+        RenderScaleSettings& settings = m_renderScaleSettings;
 
-    // 2. Show a simple window that we create ourselves. We use a Begin/End pair to create a named window.
-    {
-        static float f = 0.0f;
-        static int counter = 0;
+        if (m_profiler.isAvailable()) {
+            ImGui::Checkbox("Dynamic scale", &settings.m_dynamic);
+        }
+        else {
+            ImGui::TextDisabled("Dynamic scale needs GPU timestamps");
+        }
 
-        ImGui::Begin("Hello, world!");                          // Create a window called "Hello, world!" and append into it.
+        if (settings.m_dynamic) {
+            ImGui::SliderFloat("Target GPU time (ms)", &settings.m_targetFrameTime, 1.0f, 100.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+            ImGui::DragFloatRange2("Scale range", &settings.m_minScale, &settings.m_maxScale, 0.01f, 0.1f, 1.0f, "Min %.2f", "Max %.2f");
+            ImGui::Checkbox("Log scale and GPU time", &settings.m_log);
+        }
+        else {
+            ImGui::SliderFloat("Render scale", &settings.m_scale, 0.1f, 1.0f);
+        }
 
-        ImGui::Text("This is some useful text.");               // Display some text (you can use a format strings too)
-        ImGui::Checkbox("Demo Window", &m_show_demo_window);      // Edit bools storing our window open/close state
-        ImGui::Checkbox("Another Window", &m_show_another_window);
+        ImGui::Text("Render resolution: %u x %u (%.2f)", m_renderExtent.width, m_renderExtent.height, settings.m_scale);
+        ImGui::Text("Swapchain recreations: %llu (last %.2f ms, max %.2f ms)", static_cast<unsigned long long>(m_swapchainStatistics.m_recreations),
+            m_swapchainStatistics.m_lastTime, m_swapchainStatistics.m_maxTime);
+        if (m_profiler.isAvailable()) {
+            ImGui::Text("Trace GPU time: %.3f ms", m_traceGpuTime);
+            ImGui::PlotLines("Scale", m_renderScaleHistory.data(), static_cast<int>(m_RENDER_SCALE_HISTORY_SIZE), static_cast<int>(m_renderScaleHistoryOffset), nullptr, 0.0f, 1.0f, ImVec2(0.0f, 40.0f));
+            ImGui::PlotLines("GPU time (ms)", m_frameTimeHistory.data(), static_cast<int>(m_RENDER_SCALE_HISTORY_SIZE), static_cast<int>(m_renderScaleHistoryOffset), nullptr, 0.0f, 2.0f * settings.m_targetFrameTime, ImVec2(0.0f, 40.0f));
+        }
+    }
 
-        ImGui::SliderFloat("float", &f, 0.0f, 1.0f);            // Edit 1 float using a slider from 0.0f to 1.0f
-        ImGui::ColorEdit3("clear color", (float*)&m_clear_color); // Edit 3 floats representing a color
+    if (ImGui::CollapsingHeader("Path tracing", ImGuiTreeNodeFlags_DefaultOpen)) {
+        TraceSettings settings = m_traceSettings;
+        bool changed = false;
+        changed |= ImGui::SliderInt("Samples per frame", &settings.m_samples, 1, m_MAX_TRACE_SAMPLES);
+        changed |= ImGui::SliderInt("Bounces", &settings.m_bounces, 1, m_MAX_TRACE_BOUNCES);
+        if (changed) {
+            setTraceSettings(settings.m_samples, settings.m_bounces);
+        }
+    }
 
-        if (ImGui::Button("Button"))                            // Buttons return true when clicked (most widgets return true when edited/activated)
-            counter++;
-        ImGui::SameLine();
-        ImGui::Text("counter = %d", counter);
+    if (ImGui::CollapsingHeader("Tiled rendering")) {
+        bool changed = false;
+        changed |= ImGui::Checkbox("Enabled##tiled", &m_tiledSettings.m_enabled);
+        changed |= ImGui::SliderInt("Tile size", &m_tiledSettings.m_tileSize, 16, 1024);
+        changed |= ImGui::InputInt("Target spp", &m_tiledSettings.m_targetSamples, m_traceSettings.m_samples, 1024);
+        ImGui::SliderFloat("GPU budget per submission (ms)", &m_tiledSettings.m_submissionBudget, 1.0f, 100.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+        changed |= ImGui::Button("Restart");
+        if (changed) {
+            m_tiledSettings.m_targetSamples = std::max(m_tiledSettings.m_targetSamples, 1);
+            m_tiledState.m_reset = true;
+        }
 
-        ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / m_io->Framerate, m_io->Framerate);
-        ImGui::End();
+        if (m_tiledSettings.m_enabled) {
+            drawTiledProgress();
+        }
     }
 
-    // 3. Show another simple window.
-    if (m_show_another_window)
-    {
-        ImGui::Begin("Another Window", &m_show_another_window);   // Pass a pointer to our bool variable (the window will have a closing button that will clear the bool when clicked)
-        ImGui::Text("Hello from another window!");
-        if (ImGui::Button("Close Me"))
-            m_show_another_window = false;
-        ImGui::End();
+    if (ImGui::CollapsingHeader("Denoiser", ImGuiTreeNodeFlags_DefaultOpen)) {
+        bool changed = false;
+        changed |= ImGui::Checkbox("Enabled", &m_denoiseSettings.m_enabled);
+        changed |= ImGui::Checkbox("Temporal accumulation", &m_denoiseSettings.m_temporal);
+        ImGui::Checkbox("Clamp history", &m_denoiseSettings.m_clampHistory);
+        ImGui::SliderInt("A-trous iterations", &m_denoiseSettings.m_iterations, 1, 8);
+        ImGui::SliderFloat("Luminance sigma", &m_denoiseSettings.m_sigmaLuminance, 0.1f, 16.0f);
+        ImGui::SliderFloat("Normal sigma", &m_denoiseSettings.m_sigmaNormal, 1.0f, 256.0f);
+        ImGui::SliderFloat("Depth sigma", &m_denoiseSettings.m_sigmaDepth, 0.001f, 1.0f, "%.3f", ImGuiSliderFlags_Logarithmic);
+        ImGui::SliderFloat("Temporal alpha", &m_denoiseSettings.m_temporalAlpha, 0.01f, 1.0f);
+        ImGui::SliderFloat("Moments alpha", &m_denoiseSettings.m_momentsAlpha, 0.01f, 1.0f);
+        if (changed) {
+            m_resetHistory = true;
+        }
+
+        if (m_profiler.isAvailable()) {
+            ImGui::Text("Denoise GPU time: %.3f ms", m_denoiseSettings.m_enabled ? m_denoiseGpuTime : 0.0f);
+        }
     }
 
+    drawToneMappingUI();
+    drawCaptureUI();
+
+#ifdef RAYTRACER_RAY_STATS
+    drawRayStatsUI();
+#endif
+
+    drawSceneUpdateUI();
+    drawRenderGraphUI();
+    m_textureManager.drawUI();
+    m_profiler.drawUI();
+
+    ImGui::End();
+
     ImGui::Render();
 }
 
@@ -1448,8 +4552,17 @@ void VkRenderer::endSingleTimeCommands(VkCommandBuffer commandBuffer, VkCommandP
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffer;
 
-    vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(m_graphicsQueue);
+    // Waits for these commands only, not for the frames in flight on the same queue
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkFence fence;
+    if (vkCreateFence(m_device, &fenceInfo, m_allocator, &fence) != VK_SUCCESS) {
+        throw std::runtime_error("Could not create one-time fence!");
+    }
+
+    vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, fence);
+    vkWaitForFences(m_device, 1, &fence, VK_TRUE, UINT64_MAX);
+    vkDestroyFence(m_device, fence, m_allocator);
 
     vkFreeCommandBuffers(m_device, cmdPool, 1, &commandBuffer);
 }
@@ -1457,30 +4570,59 @@ void VkRenderer::endSingleTimeCommands(VkCommandBuffer commandBuffer, VkCommandP
 void VkRenderer::getDeviceQueueIndices() {
     uint32_t queueFamilyCount = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, nullptr);
+    if (queueFamilyCount == 0) {
+        throw std::runtime_error("Failed to retrieve queue families.");
+    }
 
     std::vector<VkQueueFamilyProperties> queueProperties(queueFamilyCount);
     vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, queueProperties.data());
-    for (size_t i = 0; i < queueProperties.size(); ++i) {
-        if (queueProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-            m_queueIndices.m_graphicsFamily = i;
+
+    int graphicsFamily = -1;
+    int presentFamily = -1;
+    int computeFamily = -1;
+    int transferFamily = -1;
+    for (uint32_t i = 0; i < queueFamilyCount; ++i) {
+        VkQueueFlags flags = queueProperties[i].queueFlags;
+        if (graphicsFamily < 0 && (flags & VK_QUEUE_GRAPHICS_BIT)) {
+            graphicsFamily = static_cast<int>(i);
         }
 
         // Check if a queue supports presentation
         // If this returns false, make sure to enable DRI3 if using X11
-        VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(m_physicalDevice, i, m_surface, &presentSupport);
-        if (presentSupport) {
-            m_queueIndices.m_presentFamily = i;
+        if (!m_headless && presentFamily < 0) {
+            VkBool32 presentSupport = false;
+            vkGetPhysicalDeviceSurfaceSupportKHR(m_physicalDevice, i, m_surface, &presentSupport);
+            if (presentSupport) {
+                presentFamily = static_cast<int>(i);
+            }
         }
 
-        if (queueProperties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
-            m_queueIndices.m_computeFamily = i;
+        // A compute family without graphics runs next to the rendering
+        if (computeFamily < 0 && (flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+            computeFamily = static_cast<int>(i);
+        }
+        // A transfer only family is usually backed by the copy engines, its copies run next to the rendering
+        if (transferFamily < 0 && (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            transferFamily = static_cast<int>(i);
         }
     }
+    if (m_headless) {
+        presentFamily = graphicsFamily;
+    }
+
+    if (graphicsFamily < 0 || presentFamily < 0) {
+        throw std::runtime_error("Unable to find the required queue families !");
+    }
+
+    // The graphics family supports compute and transfer, it stands in for the dedicated ones
+    m_queueIndices.m_graphicsFamily = static_cast<uint32_t>(graphicsFamily);
+    m_queueIndices.m_presentFamily = static_cast<uint32_t>(presentFamily);
+    m_queueIndices.m_computeFamily = static_cast<uint32_t>(computeFamily >= 0 ? computeFamily : graphicsFamily);
+    m_queueIndices.m_transferFamily = static_cast<uint32_t>(transferFamily >= 0 ? transferFamily : graphicsFamily);
 }
 
 void VkRenderer::createCommandBuffers() {
-    m_commandBuffers.resize(m_swapchainImages.size());
+    m_commandBuffers.resize(getFrameResourceCount());
 
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1491,10 +4633,26 @@ void VkRenderer::createCommandBuffers() {
     if (vkAllocateCommandBuffers(m_device, &allocInfo, m_commandBuffers.data()) != VK_SUCCESS) {
         throw std::runtime_error("failed to allocate command buffers!");
     }
+
+    if (m_computeCommandPool != VK_NULL_HANDLE) {
+        m_computeCommandBuffers.resize(getFrameResourceCount());
+        allocInfo.commandPool = m_computeCommandPool;
+        if (vkAllocateCommandBuffers(m_device, &allocInfo, m_computeCommandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate compute command buffers!");
+        }
+    }
+}
+
+uint32_t VkRenderer::getFrameResourceCount() const {
+    return static_cast<uint32_t>(m_MAX_FRAMES_IN_FLIGHT);
+}
+
+unsigned int VkRenderer::getWorkerCount() const {
+    return m_workerCount > 0 ? m_workerCount : std::max(std::thread::hardware_concurrency(), 1u);
 }
 
 void VkRenderer::createUICommandBuffers() {
-    m_uiCommandBuffers.resize(m_swapchainImages.size());
+    m_uiCommandBuffers.resize(getFrameResourceCount());
 
     VkCommandBufferAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1508,11 +4666,16 @@ void VkRenderer::createUICommandBuffers() {
 }
 
 std::vector<const char*> VkRenderer::getRequiredExtensions() const {
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwRequiredExtensions;
-    glfwRequiredExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    std::vector<const char*> extensions;
+
+    // Headless rendering has no surface, hence no need for GLFW nor its surface extensions
+    if (!m_headless) {
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwRequiredExtensions;
+        glfwRequiredExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwRequiredExtensions, glfwRequiredExtensions + glfwExtensionCount);
+    }
 
-    std::vector<const char*> extensions(glfwRequiredExtensions, glfwRequiredExtensions + glfwExtensionCount);
     for (const char* extension : extensions) {
         std::cout << extension << std::endl;
     }
@@ -1561,6 +4724,11 @@ void VkRenderer::createImguiContext(GLFWwindow* window) {
 bool VkRenderer::isDeviceSuitable(VkPhysicalDevice device) {
     VkPhysicalDeviceProperties properties;
     vkGetPhysicalDeviceProperties(device, &properties);
+
+    if (m_headless) {
+        return properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
+    }
+
     bool extensionsSupported = checkDeviceExtensions(device);
 
     // Check if Swap Chain support is adequate
@@ -1613,7 +4781,10 @@ VkExtent2D VkRenderer::pickSwapchainExtent(const VkSurfaceCapabilitiesKHR& surfa
         return surfaceCapabilities.currentExtent;
     }
     else {
-        VkExtent2D actualExtent = { Config::INIT_WINDOW_WIDTH, Config::INIT_WINDOW_HEIGHT };
+        int width = 0;
+        int height = 0;
+        glfwGetFramebufferSize(m_window, &width, &height);
+        VkExtent2D actualExtent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
         actualExtent.width = std::max(surfaceCapabilities.minImageExtent.width,
             std::min(surfaceCapabilities.maxImageExtent.width, actualExtent.width));
         actualExtent.height = std::max(surfaceCapabilities.minImageExtent.height,
@@ -1668,35 +4839,36 @@ VkRenderer::SwapChainSupportDetails VkRenderer::querySwapchainSupport(const VkPh
     return config;
 }
 
-// Destroys all the resources associated with swapchain recreation
+// Destroys the resources created from the swapchain images, the swapchain itself is retired by the next one
 void VkRenderer::cleanupSwapchain() {
     for (auto& swapchainFramebuffer : m_swapchainFramebuffers) {
         vkDestroyFramebuffer(m_device, swapchainFramebuffer, m_allocator);
     }
 
-    vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_commandBuffers.size()), m_commandBuffers.data());
-
-    vkDestroyPipeline(m_device, m_graphicsPipeline, m_allocator);
-    vkDestroyPipelineLayout(m_device, m_pipelineLayout, m_allocator);
-    vkDestroyRenderPass(m_device, m_renderPass, m_allocator);
+    for (auto& uiFramebuffer : m_uiFramebuffers) {
+        vkDestroyFramebuffer(m_device, uiFramebuffer, m_allocator);
+    }
 
     for (auto& swapchainImageView : m_swapchainImageViews) {
         vkDestroyImageView(m_device, swapchainImageView, m_allocator);
     }
-
-    vkDestroySwapchainKHR(m_device, m_swapchain, m_allocator);
 }
 
-void VkRenderer::cleanupUIResources() {
-    for (auto framebuffer : m_uiFramebuffers) {
-        vkDestroyFramebuffer(m_device, framebuffer, m_allocator);
-    }
-
-    vkFreeCommandBuffers(m_device, m_uiCommandPool, static_cast<uint32_t>(m_uiCommandBuffers.size()), m_uiCommandBuffers.data());
+void VkRenderer::releaseRetiredSwapchains(bool all) {
+    auto released = std::remove_if(m_retiredSwapchains.begin(), m_retiredSwapchains.end(), [&](const RetiredSwapchain& retired) {
+        // The frames in flight when it was retired presented to it, their fences were waited on since
+        if (!all && m_frameIndex - retired.m_frameIndex < static_cast<uint32_t>(m_MAX_FRAMES_IN_FLIGHT)) {
+            return false;
+        }
+        vkDestroySwapchainKHR(m_device, retired.m_swapchain, m_allocator);
+        return true;
+    });
+    m_retiredSwapchains.erase(released, m_retiredSwapchains.end());
 }
 
-// In case the swapchain is invalidated, i.e. during window resizing,
-// we need to implement a mechanism to recreate it
+// In case the swapchain is invalidated, i.e. during window resizing, only what depends on its images and on
+// its size is recreated: the image views, the framebuffers and the render targets. The pipelines use a
+// dynamic viewport, and the command buffers and the scene descriptor sets belong to the frames in flight.
 void VkRenderer::recreateSwapchain(GLFWwindow* window) {
     int width = 0, height = 0;
     glfwGetFramebufferSize(window, &width, &height);
@@ -1706,32 +4878,54 @@ void VkRenderer::recreateSwapchain(GLFWwindow* window) {
         glfwWaitEvents();
     }
 
-    vkDeviceWaitIdle(m_device);
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    // The frames in flight read the render targets and the denoise descriptor sets about to be replaced.
+    // Their fences are enough, unlike vkDeviceWaitIdle the presentation and the captures keep going.
+    vkWaitForFences(m_device, static_cast<uint32_t>(m_inFlightFences.size()), m_inFlightFences.data(), VK_TRUE, UINT64_MAX);
+    waitAsyncCompute(m_renderGraph.getTimelineValue());
 
     cleanupSwapchain();
-    cleanupUIResources();
+    cleanupRenderTargets();
+
+    // The old swapchain hands its images over to the new one, and is destroyed once nothing presents to it
+    VkFormat previousFormat = m_swapchainImageFormat;
+    VkSwapchainKHR oldSwapchain = m_swapchain;
+    createSwapchain(oldSwapchain);
+    m_retiredSwapchains.push_back({ oldSwapchain, m_frameIndex });
+
+    // The present pass only depends on the surface format, which hardly ever changes
+    if (m_swapchainImageFormat != previousFormat) {
+        vkDestroyPipeline(m_device, m_presentPipeline, m_allocator);
+        vkDestroyPipelineLayout(m_device, m_presentPipelineLayout, m_allocator);
+        vkDestroyRenderPass(m_device, m_renderPass, m_allocator);
+        createRenderPass();
+        createPresentPipeline();
+    }
 
-    // Recreate main application Vulkan resources
-    createSwapchain();
     createImageViews();
-    createRenderPass();
-    createGraphicsPipeline();
     createFramebuffers();
-    createDescriptorPool();
-    createCommandBuffers();
+    createRenderTargets();
+    updateDenoiseDescriptorSets();
+#ifdef RAYTRACER_RAY_STATS
+    updateRayStatsDescriptorSet();
+#endif
+    m_imagesInFlight.assign(m_swapchainImages.size(), VK_NULL_HANDLE);
 
     // We also need to take care of the UI
     ImGui_ImplVulkan_SetMinImageCount(m_imageCount);
-    createUICommandBuffers();
     createUIFramebuffers();
+
+    double recreateTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+    ++m_swapchainStatistics.m_recreations;
+    m_swapchainStatistics.m_lastTime = recreateTime;
+    m_swapchainStatistics.m_totalTime += recreateTime;
+    m_swapchainStatistics.m_maxTime = std::max(m_swapchainStatistics.m_maxTime, recreateTime);
 }
 
 void VkRenderer::mainLoop(GLFWwindow* window) {
     drawUI();
     drawFrame(window);
-
-    // Wait for unfinished work on GPU before ending application
-    vkDeviceWaitIdle(m_device);
 }
 
 void VkRenderer::setupDebugMessenger() {
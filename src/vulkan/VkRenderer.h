@@ -11,9 +11,13 @@
 #include <algorithm>
 #include <optional>
 #include <iostream>
+#include <functional>
+#include <memory>
+#include <string>
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include <set>
+#include <deque>
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -21,15 +25,28 @@
 
 #include "globals/globals.h"
 #include "application/Camera.h"
+#include "vulkan/GpuProfiler.h"
+#include "vulkan/AsyncReadback.h"
+#include "vulkan/RenderGraph.h"
+#include "vulkan/StagingRing.h"
+#include "vulkan/TextureManager.h"
+#include "io/FrameEncoder.h"
+#include "io/ImageWriter.h"
 #include "math/Vertex.h"
 #include "math/Triangle.h"
 #include "math/Material.h"
 #include "math/Sphere.h"
 #include "math/Light.h"
+#include "math/ToneMapping.h"
+#include "scene/Bvh.h"
+#include "scene/DirtyRanges.h"
+#include "scene/Scene.h"
+#include "scene/SceneLoader.h"
 
 class VkRenderer {
 public:
-	void initVulkan(GLFWwindow* window);
+	void initVulkan(GLFWwindow* window, const Scene& scene);
+	// One frame, left in flight: only cleanupVulkan waits for the device to be idle
 	void mainLoop(GLFWwindow* window);
 	void cleanupVulkan();
 
@@ -39,6 +56,192 @@ public:
 
 	inline Camera& getRendererCamera() { return m_camera; }
 
+	// Offscreen rendering without window, swapchain nor UI, used by the benchmark
+	void initHeadless(uint32_t width, uint32_t height, const Scene& scene);
+	// Records and submits one frame, then waits for it. Returns the CPU time of the frame in milliseconds.
+	float renderHeadlessFrame();
+
+	// Wall clock time of the initialization steps, in milliseconds
+	struct InitTimings {
+		float m_deviceTime = 0.0f;
+		float m_pipelineTime = 0.0f;
+		float m_sceneUploadTime = 0.0f;
+	};
+	inline const InitTimings& getInitTimings() const { return m_initTimings; }
+	// Upper bounds of the trace settings, a single draw tracing more risks tripping the driver watchdog
+	static constexpr int m_MAX_TRACE_SAMPLES = 64;
+	static constexpr int m_MAX_TRACE_BOUNCES = 32;
+	// Samples per pixel of one draw of the trace pass and bounces of each path, clamped to the bounds above.
+	// Restarts the accumulation and the tiled mode.
+	void setTraceSettings(int samples, int bounces);
+	// Samples per pixel traced by one frame outside of the tiled mode
+	inline int getSamplesPerFrame() const { return m_traceSettings.m_samples; }
+	inline int getBounces() const { return m_traceSettings.m_bounces; }
+	// Threads of the BVH refits and the texture decoding, all the cores when 0
+	inline void setWorkerCount(unsigned int count) { m_workerCount = count; }
+	// Without GPU timestamps the profiler records no queries, the dynamic render scale is then unavailable. The
+	// timestamps of every frame are written to csvPath when not empty. Only read by the initialization.
+	void setProfiling(bool gpuTimestamps, const std::string& csvPath);
+	// Whether the trace shader samples hero wavelengths instead of RGB, see RAYTRACER_SPECTRAL
+	static constexpr bool isSpectral() {
+#ifdef RAYTRACER_SPECTRAL
+		return true;
+#else
+		return false;
+#endif
+	}
+	inline float getTraceGpuTime() const { return m_traceGpuTime; }
+	inline float getDenoiseGpuTime() const { return m_denoiseGpuTime; }
+	inline bool isProfilerAvailable() const { return m_profiler.isAvailable(); }
+	inline VkDeviceSize getPeakDeviceMemory() const { return m_peakDeviceMemory; }
+	// Decoding and upload of the scene textures, part of the scene upload time
+	inline const TextureManager::Statistics& getTextureStatistics() const { return m_textureManager.getStatistics(); }
+	inline uint32_t getTextureCount() const { return m_textureManager.getTextureCount(); }
+	inline VkDeviceSize getTextureMemory() const { return m_textureManager.getMemory(); }
+	// Streams the block compressed levels of the textures the frames sample from a cache file, within budget
+	// bytes of device memory, instead of uploading every level. The cache goes to the temporary directory when
+	// cachePath is empty. Only read by the initialization, devices without the textureCompressionBC feature
+	// fall back to the whole upload.
+	void setTextureStreaming(bool enabled, VkDeviceSize budget, const std::string& cachePath = "");
+	inline bool isTextureStreaming() const { return m_textureManager.isStreaming(); }
+	inline const TextureManager::StreamingStatistics& getTextureStreamingStatistics() const { return m_textureManager.getStreamingStatistics(); }
+	inline void setDenoiseEnabled(bool enabled) { m_denoiseSettings.m_enabled = enabled; }
+	std::string getDeviceName() const;
+
+	// Replace one primitive or light of the scene. The changes are gathered until the next frame records, which
+	// refits the BVH over the moved primitives and only copies the changed elements and nodes to the device.
+	void updateTriangle(uint32_t index, const Triangle& triangle);
+	void updateSphere(uint32_t index, const Sphere& sphere);
+	void updateLight(uint32_t index, const Light& light);
+	// Append within the capacity reserved by the initialization, getSphereCapacity and getLightCapacity, and return
+	// the index of the new element. Throws std::runtime_error when the capacity is reached.
+	uint32_t addSphere(const Sphere& sphere);
+	uint32_t addLight(const Light& light);
+	inline size_t getSphereCapacity() const { return m_sphereCapacity; }
+	inline size_t getLightCapacity() const { return m_lightCapacity; }
+	inline const std::vector<Triangle>& getTriangles() const { return m_triangles; }
+	inline const std::vector<Sphere>& getSpheres() const { return m_spheres; }
+	inline const std::vector<Light>& getLights() const { return m_lights; }
+
+	// Of the scene updates since the initialization, times in milliseconds
+	struct SceneUpdateStatistics {
+		uint64_t m_updates = 0;
+		// CPU time of the refits, the rebuilds and the staging copies
+		double m_totalTime = 0.0;
+		double m_lastTime = 0.0;
+		uint64_t m_uploadedBytes = 0;
+		uint64_t m_lastUploadedBytes = 0;
+		uint64_t m_refittedNodes = 0;
+		uint64_t m_rebuilds = 0;
+		// Updates that left triangles for the next one, the staging slice of a frame was too small for them
+		uint64_t m_splitUpdates = 0;
+		// SAH cost of the BVH relative to its cost when it was last built
+		float m_costRatio = 1.0f;
+	};
+	inline const SceneUpdateStatistics& getSceneUpdateStatistics() const { return m_sceneUpdateStatistics; }
+
+	// CPU time of the frames, in milliseconds
+	struct FrameTimeStatistics {
+		uint64_t m_frames = 0;
+		double m_totalTime = 0.0;
+		double m_maxTime = 0.0;
+
+		inline void add(double frameTime) {
+			++m_frames;
+			m_totalTime += frameTime;
+			m_maxTime = std::max(m_maxTime, frameTime);
+		}
+	};
+
+	// Calls source, usually reading a scene file, and builds the BVH of its scene on a background thread while
+	// the current scene keeps rendering. The new scene then replaces it and streams to the device through the
+	// transfer queue over the next frames: the lights, the spheres and the BVH first, then the triangles, which
+	// the trace pass skips until they are resident. Edits wait for the end of the streaming. Throws
+	// std::runtime_error when a scene is already loading, a failed load keeps the current scene.
+	void loadScene(std::function<Scene()> source);
+	// True from loadScene until the last triangle of the new scene is resident
+	inline bool isSceneLoading() const {
+		return m_sceneLoader.getStage() != SceneLoader::Stage::Idle || m_sceneStream.m_active || m_textureManager.isUploading() || !m_textureSubmissions.empty();
+	}
+	// Of the last scene loaded by loadScene, times in milliseconds since the call
+	struct SceneLoadStatistics {
+		double m_readTime = 0.0;
+		double m_buildTime = 0.0;
+		// Until the first frame tracing the new scene, whose triangles may not be resident yet
+		double m_firstFrameTime = 0.0;
+		// Until the last triangle is resident
+		double m_residentTime = 0.0;
+		uint64_t m_uploadedBytes = 0;
+		uint64_t m_stagingSubmissions = 0;
+		// From the replacement of the scene to the last triangle resident
+		double m_uploadTime = 0.0;
+		// Frames streaming the scene against the frames after, the difference is the hitch of the streaming
+		FrameTimeStatistics m_streamingFrames;
+		FrameTimeStatistics m_residentFrames;
+	};
+	inline const SceneLoadStatistics& getSceneLoadStatistics() const { return m_sceneLoadStatistics; }
+	// Of every buffer upload through the transfer queue since the initialization, the scene streaming included
+	inline const StagingRing::Statistics& getUploadStatistics() const { return m_uploadRing.getStatistics(); }
+
+	// CPU time of the swapchain recreations on resize, the hitch of the frame that resized, in milliseconds
+	struct SwapchainStatistics {
+		uint64_t m_recreations = 0;
+		double m_totalTime = 0.0;
+		double m_lastTime = 0.0;
+		double m_maxTime = 0.0;
+	};
+	inline const SwapchainStatistics& getSwapchainStatistics() const { return m_swapchainStatistics; }
+
+	// Progressive tiled rendering up to targetSamples per pixel, restarted whenever the camera moves
+	void setTiledRendering(bool enabled, int targetSamples);
+	// Restricts the tiled mode to some tiles of a grid of tileSize pixels, all of them when tiles is empty.
+	// Used by the distributed workers, which each render the tiles handed out by the coordinator.
+	void setTiledSelection(int tileSize, const std::vector<uint32_t>& tiles);
+	// True once every tile reached the target sample count of the current camera
+	bool isTiledRenderComplete() const;
+	inline VkExtent2D getRenderExtent() const { return m_renderExtent; }
+
+	// Captures the image the next frame presents (accumulation, denoised or raw radiance) over the render
+	// extent, copied on the transfer queue and written to path by the capture workers, so the render loop
+	// never waits for it. Returns false, dropping the capture, when every readback slot is busy and wait is
+	// false, or when the next frame already has a capture.
+	bool requestCapture(const std::string& path, ImageWriter::Format format, bool wait);
+	// Called on the render thread by a later frame, the RGBA32F pixels are only valid during the call
+	using CaptureConsumer = std::function<void(const float* pixels, uint32_t width, uint32_t height)>;
+	// Same for an area of the output image, handed to consumer instead of being written to disk
+	bool requestCapture(const VkRect2D& area, CaptureConsumer consumer, bool wait);
+	// Waits for the captures of the submitted frames to be written, rethrows the first write error
+	void finishCaptures();
+	// Encoding threads of the captures, half of the cores when 0. Only read by the initialization.
+	inline void setCaptureWorkerCount(unsigned int count) { m_captureWorkerCount = count; }
+	// Where the captures requested from the UI are written
+	inline void setCaptureDirectory(const std::string& directory) { m_captureSettings.m_directory = directory; }
+
+	struct CaptureStatistics {
+		uint64_t m_requested = 0;
+		uint64_t m_dropped = 0;
+		// Time requestCapture spent waiting for a free slot, in milliseconds
+		double m_slotWaitTime = 0.0;
+		// Frames submitting a capture against the others, the difference is the hitch of a capture
+		FrameTimeStatistics m_captureFrames;
+		FrameTimeStatistics m_otherFrames;
+		FrameEncoder::Statistics m_encoder;
+	};
+	CaptureStatistics getCaptureStatistics() const;
+
+#ifdef RAYTRACER_RAY_STATS
+	// Counted by the instrumented trace pass over one frame
+	struct RayStatistics {
+		uint64_t m_primaryRays = 0;
+		uint64_t m_bounceRays = 0;
+		uint64_t m_shadowRays = 0;
+		uint64_t m_triangleTests = 0;
+		uint64_t m_sphereTests = 0;
+		uint64_t m_nodeVisits = 0;
+	};
+	inline const RayStatistics& getRayStatistics() const { return m_rayStats; }
+#endif
+
 private:
 	VkInstance m_instance;
 	VkDevice m_device;
@@ -46,7 +249,15 @@ private:
 
 	VkQueue m_graphicsQueue;
 	VkQueue m_presentQueue;
+	// Dedicated transfer queue for the uploads and the captures when the device has one, the graphics queue
+	// otherwise
+	VkQueue m_transferQueue;
+	// Queue of the compute family without graphics, running the async compute passes of the render graph. The
+	// graphics queue when the device has no such family, the graph then records every pass to it.
+	VkQueue m_computeQueue;
 
+	// Window of the surface, its framebuffer size is the swapchain extent when the surface lets us choose
+	GLFWwindow* m_window = nullptr;
 	VkSurfaceKHR m_surface;
 
 	VkSwapchainKHR m_swapchain;
@@ -56,26 +267,53 @@ private:
 	VkFormat m_swapchainImageFormat;
 	std::vector<VkFramebuffer> m_swapchainFramebuffers;
 	std::vector<VkFramebuffer> m_uiFramebuffers;
+	// Replaced by a resize, destroyed once the frames in flight that presented to them are done
+	struct RetiredSwapchain {
+		VkSwapchainKHR m_swapchain = VK_NULL_HANDLE;
+		uint32_t m_frameIndex = 0;
+	};
+	std::vector<RetiredSwapchain> m_retiredSwapchains;
+	SwapchainStatistics m_swapchainStatistics;
 
 	VkRenderPass m_renderPass;
 	VkRenderPass m_uiRenderPass;
+	VkRenderPass m_traceRenderPass;
 
 	VkPipeline m_graphicsPipeline;
 	VkPipelineLayout m_pipelineLayout;
 
+	VkPipeline m_presentPipeline;
+	VkPipelineLayout m_presentPipelineLayout;
+
+	VkPipeline m_denoiseTemporalPipeline;
+	VkPipeline m_denoiseAtrousPipeline;
+	VkPipelineLayout m_denoisePipelineLayout;
+
+	VkPipeline m_accumulatePipeline;
+	VkPipelineLayout m_accumulatePipelineLayout;
+
+	VkPipeline m_tonemapPipeline;
+	VkPipelineLayout m_tonemapPipelineLayout;
+
 	VkCommandPool m_commandPool;
 	VkCommandPool m_uiCommandPool;
 	std::vector<VkCommandBuffer> m_commandBuffers;
 	std::vector<VkCommandBuffer> m_uiCommandBuffers;
+	// Only created with a compute family of its own, one per frame in flight
+	VkCommandPool m_computeCommandPool = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer> m_computeCommandBuffers;
 
 	VkBuffer m_vertexBuffer;
 	VkDeviceMemory m_vertexBufferMemory;
 	VkBuffer m_indexBuffer;
 	VkDeviceMemory m_indexBufferMemory;
 
-	std::vector<VkBuffer> m_uniformBuffers;
-	std::vector<VkDeviceMemory> m_uniformBuffersMemory;
-	std::vector<void*> m_uniformBuffersMapped;
+	// Ring of FrameUniforms, persistently mapped, one slice per frame in flight bound through the dynamic
+	// offset of binding 0
+	VkBuffer m_frameUniformBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory m_frameUniformBufferMemory = VK_NULL_HANDLE;
+	void* m_frameUniformBufferMapped = nullptr;
+	VkDeviceSize m_frameUniformStride = 0;
 
 	std::vector<Triangle> m_triangles;
 	VkBuffer m_triangleBuffer;
@@ -89,20 +327,396 @@ private:
 	VkBuffer m_lightBuffer;
 	VkDeviceMemory m_lightBufferMemory;
 
+	// Spheres and lights the buffers hold room for, the scene ones and as many added by addSphere and addLight.
+	// The trace pass reads the light count from its push constants.
+	static constexpr size_t m_SPHERE_RESERVE = 64;
+	static constexpr size_t m_LIGHT_RESERVE = 16;
+	size_t m_sphereCapacity = 0;
+	size_t m_lightCapacity = 0;
+
+	// Bindings 6 and 7 of the trace pass, sized for any hierarchy over the triangles and the sphere capacity so a
+	// rebuild is copied over the previous one
+	Bvh m_bvh;
+	// Set when spheres were added, the next frame builds the BVH again instead of refitting it
+	bool m_bvhOutdated = false;
+	VkBuffer m_bvhNodeBuffer;
+	VkDeviceMemory m_bvhNodeBufferMemory;
+	VkBuffer m_bvhPrimitiveBuffer;
+	VkDeviceMemory m_bvhPrimitiveBufferMemory;
+
+	// Elements changed since the last frame, copied at the start of the next one from the slice of the frame in
+	// flight of m_sceneUpdateBuffer. The moved primitives are also listed for the refit.
+	DirtyRanges m_dirtyTriangles;
+	DirtyRanges m_dirtySpheres;
+	DirtyRanges m_dirtyLights;
+	std::vector<uint32_t> m_movedTriangles;
+	std::vector<uint32_t> m_movedSpheres;
+	VkBuffer m_sceneUpdateBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory m_sceneUpdateBufferMemory = VK_NULL_HANDLE;
+	void* m_sceneUpdateBufferMapped = nullptr;
+	VkDeviceSize m_sceneUpdateStride = 0;
+	SceneUpdateStatistics m_sceneUpdateStatistics;
+	// The BVH is built again once a refit makes it this much more expensive than when it was built
+	static constexpr float m_BVH_REBUILD_THRESHOLD = 1.5f;
+	// Clean elements between two dirty ranges below which they are copied together
+	static constexpr uint32_t m_UPDATE_RANGE_GAP = 4;
+	// Triangles a frame copies at most, the staging slices have room for these on top of the other arrays. The
+	// edits of larger meshes take several frames instead of growing the buffer.
+	static constexpr uint32_t m_TRIANGLE_UPDATE_RESERVE = 16384;
+
+	// Scene loaded by loadScene, streamed to its buffers in the order of SceneStreamState::m_sizes through
+	// m_uploadRing, at most m_SCENE_STREAM_BUDGET bytes per frame. The copies are only trusted once their
+	// submission completed, the frames acquire them then.
+	struct SceneStreamState {
+		bool m_active = false;
+		// Bytes of the lights, the spheres, the BVH nodes, the BVH primitives and the triangles
+		std::array<VkDeviceSize, 5> m_sizes{};
+		// Next bytes to stage
+		size_t m_copy = 0;
+		VkDeviceSize m_copyOffset = 0;
+		VkDeviceSize m_stagedBytes = 0;
+		VkDeviceSize m_residentBytes = 0;
+		// Bytes before the triangles, the scene is traced once they are resident, and of the whole scene
+		VkDeviceSize m_sceneBytes = 0;
+		VkDeviceSize m_totalBytes = 0;
+		// Submission number of the upload ring and the bytes staged up to it, resident once it completes
+		std::deque<std::pair<uint64_t, VkDeviceSize>> m_submissions;
+		StagingRing::Statistics m_stagingStart;
+		std::chrono::steady_clock::time_point m_startTime;
+	};
+	static constexpr VkDeviceSize m_SCENE_STREAM_BUDGET = 16 * 1024 * 1024;
+	SceneLoader m_sceneLoader;
+	SceneStreamState m_sceneStream;
+	SceneLoadStatistics m_sceneLoadStatistics;
+	// Set by the frames that streamed, for recordFrameTime
+	bool m_frameStreamed = false;
+	std::string m_sceneLoadError;
+	// What the trace pass may read of the scene, all of it unless a scene is streaming
+	uint32_t m_residentTriangles = 0;
+	bool m_sceneResident = true;
+	// The textures of a loaded scene follow its geometry through m_uploadRing, see streamTextures. Submission
+	// number of the ring and the textures uploaded up to it, resident once it completes.
+	std::deque<std::pair<uint64_t, uint32_t>> m_textureSubmissions;
+	uint32_t m_residentTextures = 0;
+	// Replaced by a loaded scene, destroyed once the frames in flight that read them are done
+	struct RetiredScene {
+		std::vector<std::pair<VkBuffer, VkDeviceMemory>> m_buffers;
+		VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+		uint32_t m_frameIndex = 0;
+	};
+	std::vector<RetiredScene> m_retiredScenes;
+
+	// Every buffer upload goes through the transfer queue, the graphics queue never waits for it. Each copy is
+	// released to the graphics family when the families differ and acquired by the first frame recorded after
+	// its submission completed, that frame waits on the timeline semaphore of the ring for the submission,
+	// already signaled. Many small copies are batched into one submission per block.
+	struct PendingAcquire {
+		uint64_t m_submission;
+		VkBuffer m_buffer;
+		VkDeviceSize m_offset;
+		VkDeviceSize m_size;
+		// A texture image instead of a buffer, in the shader read only layout
+		VkImage m_image = VK_NULL_HANDLE;
+		uint32_t m_mipLevels = 0;
+	};
+	static constexpr VkDeviceSize m_UPLOAD_BLOCK_SIZE = 4 * 1024 * 1024;
+	static constexpr uint32_t m_UPLOAD_BLOCKS = 4;
+	StagingRing m_uploadRing;
+	std::deque<PendingAcquire> m_pendingAcquires;
+	// Submission of the upload ring the next frame waits on, 0 when it waits on none
+	uint64_t m_uploadWaitValue = 0;
+
+	// Bound to the array of set 1 of the trace pass, allocated with one descriptor per texture
+	TextureManager m_textureManager;
+	// Length of the array declared by the layout, see TextureManager::getMaxTextures
+	uint32_t m_maxTextures = 0;
+	// Optional device features, used by the texture sampler and the texture streaming when available
+	bool m_samplerAnisotropy = false;
+	bool m_textureCompressionBC = false;
+
+	struct TextureStreamingSettings {
+		bool m_enabled = false;
+		VkDeviceSize m_budget = 256 * 1024 * 1024;
+		std::string m_cachePath;
+	};
+	TextureStreamingSettings m_textureStreamingSettings;
+	// Level of detail each texture was sampled with, written by the trace pass through binding 4 into the
+	// slice of the frame in flight and handed to TextureManager::update once its fence is signaled
+	VkBuffer m_textureFeedbackBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory m_textureFeedbackBufferMemory = VK_NULL_HANDLE;
+	void* m_textureFeedbackBufferMapped = nullptr;
+	VkDeviceSize m_textureFeedbackStride = 0;
+	// Texture generation each texture descriptor set was last written at, the replaced images are released
+	// once every set moved past them
+	std::vector<uint64_t> m_textureDescriptorGenerations;
+
 	VkPushConstantRange m_pushConstantRange;
 
+	// Offscreen targets written by the trace pass and read by the denoiser
+	struct ImageResource {
+		VkImage m_image = VK_NULL_HANDLE;
+		// Null for the transient targets, bound to the memory of their alias slot
+		VkDeviceMemory m_memory = VK_NULL_HANDLE;
+		VkImageView m_view = VK_NULL_HANDLE;
+		VkFormat m_format = VK_FORMAT_UNDEFINED;
+		VkDeviceSize m_size = 0;
+		// Handle of the image in m_renderGraph, set by importRenderGraphResources
+		RenderGraph::Resource m_graphResource = 0;
+	};
+
+	ImageResource m_traceColor;
+	ImageResource m_traceAlbedo;
+	ImageResource m_traceNormalDepth;
+	ImageResource m_traceMotion;
+	ImageResource m_prevNormalDepth;
+	ImageResource m_historyColor;
+	ImageResource m_historyMoments;
+	ImageResource m_denoiseMoments;
+	std::array<ImageResource, 2> m_denoisePingPong;
+	ImageResource m_denoiseOutput;
+	ImageResource m_accumulation;
+	// Display linear, written by the tone mapping pass for the present pass. Transient, headless renderers
+	// have none.
+	ImageResource m_tonemapOutput;
+	VkFramebuffer m_traceFramebuffer;
+	// Memory of the alias slots of the transient targets, the images only the passes of a frame use
+	std::vector<VkDeviceMemory> m_transientMemory;
+	VkDeviceSize m_transientMemorySize = 0;
+	// Transient targets whose lifetimes never overlap share memory, applied by the next frame recorded
+	bool m_aliasTransientTargets = true;
+	VkSampler m_presentSampler;
+
+	// Orders the passes of every frame and records the barriers between them, see recordCommandBuffer
+	RenderGraph m_renderGraph;
+	// The scene buffers are written together by the scene updates and read together by the trace pass
+	RenderGraph::Resource m_sceneResource = 0;
+	// Imported again every frame with the swapchain image it presents to
+	RenderGraph::Resource m_swapchainResource = 0;
+
+	// Everything the trace pass reads once per frame, written to the slice of the frame in flight of the
+	// uniform ring. Must match the FrameUniforms block of frag.glsl, std140.
+	struct FrameUniforms {
+		Camera::UniformBufferObject m_camera;
+		// Camera of the previous frame, the primary hits are reprojected with it for the denoiser history
+		Camera::UniformBufferObject m_previousCamera;
+		float m_time;
+		uint32_t m_frameIndex;
+		glm::vec2 m_viewportSize;
+		// The light buffer has room for more lights than the scene holds
+		uint32_t m_lightCount;
+		uint32_t m_samples;
+		uint32_t m_bounces;
+		// Parts of a streamed scene the trace pass may read
+		uint32_t m_residentTriangles;
+		uint32_t m_sceneResident;
+		uint32_t m_residentTextures;
+	};
+
+	// Must match the push constant block of denoise_temporal_comp.glsl and denoise_atrous_comp.glsl
+	struct DenoisePushConstants {
+		int32_t m_stepSize;
+		int32_t m_finalPass;
+		int32_t m_temporalEnabled;
+		int32_t m_resetHistory;
+		int32_t m_clampHistory;
+		float m_sigmaLuminance;
+		float m_sigmaNormal;
+		float m_sigmaDepth;
+		float m_temporalAlpha;
+		float m_momentsAlpha;
+		glm::ivec2 m_renderSize;
+		glm::ivec2 m_previousRenderSize;
+	};
+
+	// Must match the push constant block of accumulate_comp.glsl
+	struct AccumulatePushConstants {
+		glm::ivec2 m_tileOffset;
+		glm::ivec2 m_tileSize;
+		int32_t m_passIndex;
+	};
+
+	// Must match the push constant block of tonemap_comp.glsl
+	struct TonemapPushConstants {
+		// Columns of ToneMapping::colorTransform
+		std::array<glm::vec4, 3> m_colorTransform;
+		glm::ivec2 m_renderSize;
+		int32_t m_operator;
+	};
+
+	// Must match the push constant block of present_frag.glsl
+	struct PresentPushConstants {
+		glm::vec2 m_uvScale;
+		glm::vec2 m_uvMax;
+		int32_t m_encodeSrgb;
+	};
+
+	// Applied to the presented image and to the 8 bit captures, the float captures stay linear
+	ToneMapping m_toneMapping;
+
+	struct DenoiseSettings {
+		bool m_enabled = true;
+		bool m_temporal = true;
+		bool m_clampHistory = true;
+		int m_iterations = 5;
+		float m_sigmaLuminance = 4.0f;
+		float m_sigmaNormal = 128.0f;
+		float m_sigmaDepth = 0.05f;
+		float m_temporalAlpha = 0.2f;
+		float m_momentsAlpha = 0.2f;
+	};
+	DenoiseSettings m_denoiseSettings;
+	bool m_resetHistory = true;
+	uint32_t m_frameIndex = 0;
+	Camera::UniformBufferObject m_previousCameraUBO{};
+
+	// The render targets keep the swapchain size, the trace and denoise passes only cover the
+	// m_renderExtent corner of them, which the present pass upscales
+	struct RenderScaleSettings {
+		bool m_dynamic = false;
+		float m_scale = 1.0f;
+		float m_targetFrameTime = 16.6f;
+		float m_minScale = 0.25f;
+		float m_maxScale = 1.0f;
+		bool m_log = false;
+	};
+	RenderScaleSettings m_renderScaleSettings;
+	VkExtent2D m_renderExtent{};
+	VkExtent2D m_previousRenderExtent{};
+	static constexpr size_t m_RENDER_SCALE_HISTORY_SIZE = 256;
+	std::array<float, m_RENDER_SCALE_HISTORY_SIZE> m_renderScaleHistory{};
+	std::array<float, m_RENDER_SCALE_HISTORY_SIZE> m_frameTimeHistory{};
+	size_t m_renderScaleHistoryOffset = 0;
+	float m_lastRenderScaleLogTime = 0.0f;
+
+	struct TraceSettings {
+		int m_samples = 10;
+		int m_bounces = 8;
+	};
+	TraceSettings m_traceSettings;
+	unsigned int m_workerCount = 0;
+
+	// Progressive mode splitting the image into tiles, so a high sample count render is spread over
+	// many small submissions instead of one that could trip the driver watchdog
+	struct TiledRenderSettings {
+		bool m_enabled = false;
+		int m_tileSize = 128;
+		int m_targetSamples = 4096;
+		// GPU time of the tiles recorded in one submission
+		float m_submissionBudget = 20.0f;
+		// Only these tiles are rendered when not empty
+		std::vector<uint32_t> m_selectedTiles;
+	};
+	TiledRenderSettings m_tiledSettings;
+
+	struct TiledRenderState {
+		bool m_reset = true;
+		VkExtent2D m_extent{};
+		int m_tileSize = 0;
+		uint32_t m_tilesX = 0;
+		uint32_t m_tilesY = 0;
+		// Passes accumulated in each tile, row by row
+		std::vector<uint32_t> m_tilePasses;
+		std::vector<bool> m_tileSelected;
+		uint32_t m_nextTile = 0;
+		// Tiles recorded in the current frame, highlighted in the UI
+		std::vector<uint32_t> m_frameTiles;
+		// Tiles recorded in each frame in flight, to turn its timestamps into a time per tile
+		std::vector<uint32_t> m_tilesInFlight;
+		float m_gpuTimePerTile = 0.0f;
+		float m_tilesPerSecond = 0.0f;
+		float m_startTime = 0.0f;
+		float m_elapsedTime = 0.0f;
+	};
+	TiledRenderState m_tiledState;
+
+	// One profiler scope per pass, the trace and denoise times also drive the render scale and the tiled mode
+	GpuProfiler m_profiler;
+	uint32_t m_traceScope = 0;
+	uint32_t m_denoiseScope = 0;
+	uint32_t m_tonemapScope = 0;
+	uint32_t m_presentScope = 0;
+	uint32_t m_uiScope = 0;
+	bool m_newTimestamps = false;
+	float m_traceGpuTime = 0.0f;
+	float m_denoiseGpuTime = 0.0f;
+	bool m_gpuTimestamps = true;
+	std::string m_profileCsvPath;
+
+#ifdef RAYTRACER_RAY_STATS
+	// The instrumented trace pass writes its counters per pixel in m_rayCounts and m_rayNodeVisits, and adds them
+	// to the totals in the slice of m_rayStatsBuffer of the frame in flight, read back once its fence is signaled
+	struct RayStatsSettings {
+		// -1 presents the image, otherwise the channel of raystats_heatmap_comp.glsl
+		int m_heatmap = -1;
+		bool m_autoScale = true;
+		float m_maxValue = 1000.0f;
+	};
+	// Counters of RayStatistics in frag.glsl, each a low and a high word
+	static constexpr uint32_t m_RAY_STATS_COUNTERS = 6;
+	RayStatsSettings m_rayStatsSettings;
+	RayStatistics m_rayStats;
+	std::vector<bool> m_rayStatsRecorded;
+	uint32_t m_rayStatsPixels = 0;
+
+	// Must match the push constant block of raystats_heatmap_comp.glsl
+	struct RayStatsHeatmapPushConstants {
+		int32_t m_channel;
+		float m_maxValue;
+		glm::ivec2 m_renderSize;
+	};
+
+	ImageResource m_rayCounts;
+	ImageResource m_rayNodeVisits;
+	ImageResource m_rayStatsHeatmap;
+	VkBuffer m_rayStatsBuffer;
+	RenderGraph::Resource m_rayStatsResource = 0;
+	VkDeviceMemory m_rayStatsBufferMemory;
+	void* m_rayStatsBufferMapped = nullptr;
+	VkDeviceSize m_rayStatsStride = 0;
+	VkDescriptorSetLayout m_rayStatsDescriptorSetLayout;
+	VkDescriptorPool m_rayStatsDescriptorPool;
+	VkDescriptorSet m_rayStatsDescriptorSet;
+	VkPipeline m_rayStatsHeatmapPipeline;
+	VkPipelineLayout m_rayStatsHeatmapPipelineLayout;
+#endif
+
 	VkDescriptorPool m_descriptorPool;
 	VkDescriptorPool m_uiDescriptorPool;
+	VkDescriptorPool m_denoiseDescriptorPool;
 
 	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkDescriptorSetLayout m_textureDescriptorSetLayout;
+	VkDescriptorSetLayout m_denoiseDescriptorSetLayout;
+	VkDescriptorSetLayout m_tonemapDescriptorSetLayout;
+	VkDescriptorSetLayout m_presentDescriptorSetLayout;
+	// [0] ping 0 -> ping 1, [1] ping 1 -> ping 0, [2] ping 0 -> output, [3] ping 1 -> output
+	std::array<VkDescriptorSet, 4> m_denoiseDescriptorSets;
+	// Input of the tone mapping pass: [0] raw trace color, [1] denoised output, [2] tiled accumulation
+	std::array<VkDescriptorSet, 3> m_tonemapDescriptorSets;
+#ifdef RAYTRACER_RAY_STATS
+	// [0] tone mapped image, [1] ray statistics heat map
+	std::array<VkDescriptorSet, 2> m_presentDescriptorSets;
+#else
+	// [0] tone mapped image
+	std::array<VkDescriptorSet, 1> m_presentDescriptorSets;
+#endif
 	//TODO add m_uiDescriptorSetLayout
-	std::vector<VkDescriptorSet> m_descriptorSets;
+	// Set 0 of the trace pass, shared by the frames in flight through its dynamic offsets
+	VkDescriptorSet m_descriptorSet;
+	// Set 1 of the trace pass, one per frame in flight so the texture streaming can rewrite a set while
+	// the other frame still samples the images it replaced
+	std::vector<VkDescriptorSet> m_textureDescriptorSets;
 	//TODO add m_uiDescriptorSets
 
 	std::vector<VkSemaphore> m_imageAvailableSemaphores;
 	std::vector<VkSemaphore> m_renderFinishedSemaphores;
 	std::vector<VkFence> m_inFlightFences;
 	std::vector<VkFence> m_imagesInFlight;
+	// Signaled by the graphics and compute queues with the values of the render graph, and the value the compute
+	// command buffer of each frame in flight signals, reached before it is recorded again
+	VkSemaphore m_graphicsTimeline = VK_NULL_HANDLE;
+	VkSemaphore m_computeTimeline = VK_NULL_HANDLE;
+	std::vector<uint64_t> m_computeTimelineValues;
 
 	std::vector<const char*> m_requiredExtensions;
 
@@ -115,12 +729,52 @@ private:
 	ImGuiIO* m_io;
 
 	uint32_t m_imageCount = 0;
+	bool m_headless = false;
+	InitTimings m_initTimings;
+
+	// A capture goes from requestCapture, which acquires a readback slot, to the submission of the next frame,
+	// which signals the render semaphore of the slot, to the copy on the transfer queue, to an encoder worker.
+	// The frame after it waits on the copy semaphore before writing the output images again.
+	struct CaptureSettings {
+		bool m_everyFrame = false;
+		ImageWriter::Format m_format = ImageWriter::Format::Png;
+		std::string m_directory = "captures";
+	};
+	struct CaptureSlot {
+		std::string m_path;
+		ImageWriter::Format m_format = ImageWriter::Format::Png;
+		// Empty for the whole render extent
+		VkRect2D m_area{};
+		// Takes the pixels instead of the encoder when set
+		CaptureConsumer m_consumer;
+	};
+	static constexpr uint32_t m_CAPTURE_SLOTS = 3;
+	CaptureSettings m_captureSettings;
+	AsyncReadback m_readback;
+	std::unique_ptr<FrameEncoder> m_captureEncoder;
+	std::array<CaptureSlot, AsyncReadback::m_MAX_SLOTS> m_captureSlots;
+	int m_pendingCapture = -1;
+	VkSemaphore m_captureWaitSemaphore = VK_NULL_HANDLE;
+	bool m_frameCaptured = false;
+	uint32_t m_captureIndex = 0;
+	unsigned int m_captureWorkerCount = 0;
+	CaptureStatistics m_captureStatistics;
+
+	// Device memory allocated through createBuffer and createImage
+	VkDeviceSize m_deviceMemoryInUse = 0;
+	VkDeviceSize m_peakDeviceMemory = 0;
 	const int m_MAX_FRAMES_IN_FLIGHT = 2;
 	uint32_t m_currentFrame = 0;
 
-	bool m_show_demo_window = true;
-	bool m_show_another_window = false;
-	ImVec4 m_clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
+	// Selection of the scene editor. The meshes are the runs of consecutive triangles sharing a material, edited
+	// as one.
+	struct SceneEditorState {
+		int m_sphere = 0;
+		int m_light = 0;
+		int m_mesh = 0;
+	};
+	SceneEditorState m_sceneEditor;
+	std::vector<DirtyRanges::Range> m_meshes;
 
 	Camera m_camera;
 
@@ -136,6 +790,7 @@ private:
 		uint32_t m_graphicsFamily;
 		uint32_t m_computeFamily;
 		uint32_t m_presentFamily;
+		uint32_t m_transferFamily;
 	};
 	QueueFamilyIndices m_queueIndices;
 
@@ -169,8 +824,59 @@ private:
 	void createRenderPass();
 	void createImageViews();
 	void createGraphicsPipeline();
-	void createSwapchain();
+	void createTraceRenderPass();
+	void createPresentPipeline();
+	void createPresentSampler();
+	void createDenoisePipelines();
+	void createAccumulatePipeline();
+	void createTonemapPipeline();
+	VkPipeline createFullscreenPipeline(const std::string& fragShaderFile, VkPipelineLayout pipelineLayout, VkRenderPass renderPass, uint32_t colorAttachmentCount);
+	VkPipeline createComputePipeline(const std::string& shaderFile, VkPipelineLayout pipelineLayout);
+	void createRenderTargets();
+	void cleanupRenderTargets();
+	// The transient targets bound to the alias slots of m_renderGraph, and the trace framebuffer having three of
+	// them as attachments
+	void createTransientTargets();
+	void cleanupTransientTargets();
+	// Creates the transient targets again with the aliasing of the lifetimes seen so far, once the frames in
+	// flight are done
+	void realiasTransientTargets();
+	// Images read by the capture copies are shared with the transfer queue
+	void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, ImageResource& image, bool captureSource = false);
+	// The image alone, to be bound to memory before createImageView
+	void createImageHandle(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, ImageResource& image, bool captureSource = false);
+	void createImageView(ImageResource& image);
+	void destroyImage(ImageResource& image);
+	void createDenoiseDescriptorSetLayouts();
+	void createDenoiseDescriptorSets();
+	void updateDenoiseDescriptorSets();
+	void createProfiler();
+	void readTimestamps();
+	void updateRenderScale();
+	uint32_t requiredTilePasses() const;
+	void prepareTiledFrame();
+	void drawTiledProgress();
+	// Imports the render targets into m_renderGraph, once they are created
+	void importRenderGraphResources();
+	void drawRenderGraphUI();
+	void recordTraceCommands(VkCommandBuffer commandBuffer, const VkRect2D& area);
+	std::vector<RenderGraph::Access> getTraceAccesses() const;
+	// The trace pass over the whole image, or the trace and accumulate passes of the tiles of this frame
+	void addTracePasses();
+	void addDenoisePasses();
+	void recordDenoiseDispatch(VkCommandBuffer commandBuffer, VkPipeline pipeline, size_t setIndex, const DenoisePushConstants& pushConstants);
+#ifdef RAYTRACER_RAY_STATS
+	void createRayStatsResources();
+	void updateRayStatsDescriptorSet();
+	void cleanupRayStatsResources();
+	void readRayStatistics();
+	void recordRayStatsHeatmap(VkCommandBuffer commandBuffer);
+	void drawRayStatsUI();
+#endif
+	void createSwapchain(VkSwapchainKHR oldSwapchain);
 	void recreateSwapchain(GLFWwindow* window);
+	// Destroys the retired swapchains the frames in flight are done presenting to, all of them when all is set
+	void releaseRetiredSwapchains(bool all);
 	void createFramebuffers();
 	void createDescriptorPool();
 	void createSurface(GLFWwindow* window);
@@ -179,7 +885,65 @@ private:
 	void createSyncObjects();
 	void createUICommandBuffers();
 	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
-	void createData();
+	void recordTonemapCommands(VkCommandBuffer commandBuffer);
+	void recordPresentCommands(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	const ImageResource& getOutputImage() const;
+	// The tone mapped output image, or the heat map when one is shown
+	const ImageResource& getPresentedImage() const;
+	int acquireCaptureSlot(bool wait);
+	void createCaptureResources();
+	void cleanupCaptureResources();
+	std::string nextCapturePath();
+	void prepareCaptureSubmit(std::vector<VkSemaphore>& waitSemaphores, std::vector<VkPipelineStageFlags>& waitStages, std::vector<VkSemaphore>& signalSemaphores);
+	void submitCapture();
+	// Submits the compute command buffer of the frame after its graphics one, when the graph recorded passes to it
+	void submitAsyncCompute();
+	// Waits for the compute queue to be done with the frames in flight, which the fences do not cover
+	void waitAsyncCompute(uint64_t value);
+	void recordFrameTime(double frameTime);
+	void drawCaptureUI();
+	void drawToneMappingUI();
+	void createData(const Scene& scene);
+	// Throws std::runtime_error when the material uses a texture past textureCount
+	static void checkMaterialTextures(const Material& material, size_t textureCount);
+	// Device local, filled through a staging buffer. size bytes are allocated, at least one, dataSize are copied.
+	void createStorageBuffer(const void* data, VkDeviceSize dataSize, VkDeviceSize size, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+	// Sets the capacities and creates the buffers of m_triangles, m_spheres, m_lights and m_bvh, filled when
+	// upload is set, and the staging buffer of the scene updates
+	void createSceneBuffers(bool upload);
+	void destroySceneBuffers();
+	// Runs of consecutive triangles sharing a material, see m_meshes
+	void createMeshes();
+	// Takes the scene of a finished load, replaces the current one and starts streaming it, then records the
+	// copies of the next part. Called once the fence of the frame in flight is signaled.
+	void updateSceneLoading();
+	// Retires the buffers, the textures and the descriptor sets of the current scene without waiting for the
+	// frames in flight, then creates the ones of the loaded scene, empty
+	void replaceScene(SceneLoader::Result result);
+	void streamScene();
+	// Records the copies of the textures decoded since the last frame, at most the upload budget of the
+	// texture manager, and makes the ones whose submission completed resident
+	void streamTextures();
+	// Destroys the retired scenes the frames in flight are done with, all of them when all is set
+	void releaseRetiredScenes(bool all);
+	void drawSceneLoadUI();
+	// Whether the BVH or the scene buffers changed since the last frame. The copies of a streaming scene would
+	// race with the updates on the transfer queue, they wait for its end.
+	bool hasSceneUpdates() const;
+	// Refits or rebuilds the BVH and records the copies of what changed since the last frame, before the trace pass
+	void recordSceneUpdates(VkCommandBuffer commandBuffer);
+	// Replaces the staging buffer of the scene updates by one of stride bytes per frame in flight
+	void createSceneUpdateBuffer(VkDeviceSize stride);
+	void drawSceneUpdateUI();
+	// Edits the spheres, the lights and the materials of the meshes through the update functions
+	void drawSceneUI();
+	// Returns true when the material changed
+	static bool drawMaterialUI(Material& material, uint32_t textureCount);
+	void createTextures(const Scene& scene);
+	// One slice of counters per texture and frame in flight, created again whenever the textures are replaced
+	void createTextureFeedbackBuffer();
+	void updateTextureStreaming();
+	void updateTextureDescriptors(uint32_t setIndex);
 	void createUICommandPool();
 	void createUIDescriptorPool();
 	void createUIFramebuffers();
@@ -189,13 +953,24 @@ private:
 	void drawUI();
 	void createDescriptorSetLayout();
 	void createDescriptorSets();
-	void updateUniformBuffer(uint32_t currentImage, float totalTime);
+	void updateUniformBuffer(uint32_t frame, float deltaTime);
 	void createUniformBuffers();
 	void createVertexBuffer(const std::vector<Vertex2D>& verticies);
 	void createIndexBuffer(const std::vector<uint32_t>& indices);
 	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+	void destroyBuffer(VkBuffer buffer, VkDeviceMemory bufferMemory);
+	void trackDeviceMemory(VkDeviceSize allocated, VkDeviceSize freed);
+	// Copies size bytes of data to buffer at offset through m_uploadRing, or zeroes them when data is null,
+	// without flushing it. The buffer needs VK_BUFFER_USAGE_TRANSFER_DST_BIT and must not be read before the
+	// copy is acquired by acquireUploads.
+	void uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+	// Records the acquisition of the uploads whose submission completed, for the frame recorded in commandBuffer
+	void acquireUploads(VkCommandBuffer commandBuffer);
+	// Adds the wait of the frame on the uploads it acquired, waitValues gets a value per wait semaphore
+	void prepareUploadSubmit(std::vector<VkSemaphore>& waitSemaphores, std::vector<VkPipelineStageFlags>& waitStages, std::vector<uint64_t>& waitValues);
 	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+	// Picks the graphics and present families, and compute and transfer families without graphics when the device
+	// has them, the graphics family otherwise
 	void getDeviceQueueIndices();
 	VkExtent2D pickSwapchainExtent(const VkSurfaceCapabilitiesKHR& surfaceCapabilities);
 	VkCommandBuffer beginSingleTimeCommands(VkCommandPool cmdPool);
@@ -203,8 +978,12 @@ private:
 	bool checkDeviceExtensions(VkPhysicalDevice device);
 	bool checkValidationLayerSupport();
 	void cleanupSwapchain();
-	void cleanupUIResources();
 	void createCommandBuffers();
+	// Number of command buffers, texture descriptor sets and uniform ring slices, one per frame in flight so
+	// they outlive the swapchain, whatever its image count
+	uint32_t getFrameResourceCount() const;
+	// Of the BVH refits and the texture decoding, see setWorkerCount
+	unsigned int getWorkerCount() const;
 	void createCommandPool();
 	std::vector<const char*> getRequiredExtensions() const;
 	VkPresentModeKHR pickSwapchainPresentMode(const std::vector<VkPresentModeKHR>& presentModes);